@@ -0,0 +1,21 @@
+/* $Id$ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <stdlib.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct epoll_event ev;
+	int fd;
+
+	(void)argc;
+	(void)argv;
+	ev.events = EPOLLIN | EPOLLET;
+	fd = eventfd(0, EFD_NONBLOCK);
+	(void)ev;
+	(void)fd;
+	exit(0);
+}
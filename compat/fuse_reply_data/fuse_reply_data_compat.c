@@ -0,0 +1,16 @@
+/* $Id$ */
+
+#include <stdlib.h>
+
+#include "fuse_lowlevel.h"
+
+int
+main(int argc, char *argv[])
+{
+	void *p;
+
+	(void)argc;
+	(void)argv;
+	p = fuse_reply_data;
+	exit(0);
+}
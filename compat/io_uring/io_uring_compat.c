@@ -0,0 +1,19 @@
+/* $Id$ */
+
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+#include <stdlib.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct io_uring_rsrc_update2 up;
+	int nr = __NR_io_uring_setup;
+
+	(void)argc;
+	(void)argv;
+	(void)up;
+	(void)nr;
+	exit(0);
+}
@@ -94,6 +94,7 @@ usocklnd_conn_allocate()
 	conn = psc_pool_get(usk_conn_pool);
         memset(conn, 0, sizeof(*conn));
 	INIT_PSC_LISTENTRY(&conn->uc_lentry);
+        CFS_INIT_LIST_HEAD(&conn->uc_ready_list);
         conn->uc_preq = pr;
 
         LIBCFS_ALLOC (conn->uc_rx_hello,
@@ -927,7 +928,6 @@ usocklnd_find_or_create_conn(usock_peer_t *peer, int type,
                         usocklnd_conn_decref(conn); /* should destroy conn */
                         goto find_or_create_conn_failed;
                 }
-                usocklnd_wakeup_pollthread(conn->uc_pt_idx);
         }
         
         pthread_mutex_lock(&conn->uc_lock);
@@ -50,7 +50,7 @@
 int
 usocklnd_notifier_handler(int fd)
 {
-	int notification;
+	__u64 notification;
 	return syscall(SYS_read, fd, &notification, sizeof(notification));
 }
 
@@ -47,6 +47,86 @@
 
 #include "pfl/pool.h"
 
+#ifdef HAVE_EPOLL
+static __u32
+usocklnd_poll2epoll(short events)
+{
+        __u32 ev = EPOLLET;
+
+        if (events & POLLIN)
+                ev |= EPOLLIN;
+        if (events & POLLOUT)
+                ev |= EPOLLOUT;
+        return ev;
+}
+
+static short
+usocklnd_epoll2poll(__u32 ev)
+{
+        short events = 0;
+
+        if (ev & EPOLLIN)
+                events |= POLLIN;
+        if (ev & EPOLLOUT)
+                events |= POLLOUT;
+        if (ev & EPOLLERR)
+                events |= POLLERR;
+        if (ev & EPOLLHUP)
+                events |= POLLHUP;
+        return events;
+}
+#else
+#define EPOLL_CTL_ADD   1
+#define EPOLL_CTL_DEL   2
+#define EPOLL_CTL_MOD   3
+#endif
+
+/* Mirror a change of conn's entry in upt_pollfd[] into the epoll set.
+ * This runs under upt_pollrequests_lock so a failure cannot kill the
+ * conn directly; instead POLLNVAL is posted and the conn is killed
+ * from usocklnd_execute_epoll_handlers(). */
+static void
+usocklnd_epoll_ctl(usock_pollthread_t *pt_data, int op,
+                   usock_conn_t *conn, short events)
+{
+#ifdef HAVE_EPOLL
+        struct epoll_event ev;
+
+        if (pt_data->upt_epfd == -1)
+                return;
+
+        if (op == EPOLL_CTL_DEL) {
+                list_del_init(&conn->uc_ready_list);
+                conn->uc_pt_revents = 0;
+        } else if (op == EPOLL_CTL_MOD) {
+                /* drop undrained events nobody is interested in now */
+                conn->uc_pt_revents &= events | POLLERR | POLLHUP;
+                if (conn->uc_pt_revents == 0)
+                        list_del_init(&conn->uc_ready_list);
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = usocklnd_poll2epoll(events);
+        ev.data.ptr = conn;
+        if (epoll_ctl(pt_data->upt_epfd, op, conn->uc_lx->lx_fd,
+                      &ev) == -1) {
+                CERROR("Cannot epoll_ctl(2) op=%d fd=%d: errno=%d\n",
+                       op, conn->uc_lx->lx_fd, errno);
+                if (op == EPOLL_CTL_DEL)
+                        return;
+                conn->uc_pt_revents |= POLLNVAL;
+                if (list_empty(&conn->uc_ready_list))
+                        list_add_tail(&conn->uc_ready_list,
+                                      &pt_data->upt_ready_list);
+        }
+#else
+        (void)pt_data;
+        (void)op;
+        (void)conn;
+        (void)events;
+#endif
+}
+
 void
 usocklnd_process_stale_list(usock_pollthread_t *pt_data)
 {
@@ -84,6 +164,8 @@ usocklnd_poll_thread(void *arg)
         pthread_sigmask (SIG_SETMASK, &sigs, 0);
         
         LASSERT(pt_data != NULL);
+
+        pt_data->upt_thread = pthread_self();
         
         planned_time = cfs_time_shift(usock_tuns.ut_poll_timeout);
         chunk = usocklnd_calculate_chunk_size(pt_data->upt_nfds);
@@ -115,17 +197,23 @@ usocklnd_poll_thread(void *arg)
                 usocklnd_process_stale_list(pt_data);
 
                 /* Actual polling for events */
-                rc = poll(pt_data->upt_pollfd,
-                          pt_data->upt_nfds,
-                          usock_tuns.ut_poll_timeout * 1000);
+                if (pt_data->upt_epfd != -1) {
+                        rc = usocklnd_epoll_wait(pt_data);
+                        if (rc < 0)
+                                break;
+                } else {
+                        rc = poll(pt_data->upt_pollfd,
+                                  pt_data->upt_nfds,
+                                  usock_tuns.ut_poll_timeout * 1000);
 
-                if (rc < 0 && errno != EINTR) {
-                        CERROR("Cannot poll(2): errno=%d\n", errno);
-                        break;
-                }
+                        if (rc < 0 && errno != EINTR) {
+                                CERROR("Cannot poll(2): errno=%d\n", errno);
+                                break;
+                        }
 
-                if (rc > 0)
-                        usocklnd_execute_handlers(pt_data);
+                        if (rc > 0)
+                                usocklnd_execute_handlers(pt_data);
+                }
 
                 current_time = cfs_time_current();
 
@@ -202,6 +290,8 @@ usocklnd_poll_thread(void *arg)
                 pthread_mutex_unlock(&pt_data->upt_pollrequests_lock);
 
                 usocklnd_process_stale_list(pt_data);
+
+                CFS_INIT_LIST_HEAD(&pt_data->upt_ready_list);
                 
                 for (idx = 1; idx < pt_data->upt_nfds; idx++) {
                         usock_conn_t *conn = pt_data->upt_idx2conn[idx];
@@ -231,6 +321,7 @@ usocklnd_add_pollrequest(usock_conn_t *conn, int type, short value)
         int                  pt_idx = conn->uc_pt_idx;
         usock_pollthread_t  *pt     = &usock_data.ud_pollthreads[pt_idx];
         usock_pollrequest_t *pr;
+        int                  wake;
 
 	pr = psc_pool_get(usk_pollreq_pool);
 	memset(pr, 0, sizeof(*pr));
@@ -252,8 +343,14 @@ usocklnd_add_pollrequest(usock_conn_t *conn, int type, short value)
                 return rc;
         }
         
+        /* only the first request needs to kick the poll thread */
+        wake = list_empty(&pt->upt_pollrequests) &&
+            !pthread_equal(pt->upt_thread, pthread_self());
         list_add_tail(&pr->upr_list, &pt->upt_pollrequests);
         pthread_mutex_unlock(&pt->upt_pollrequests_lock);
+
+        if (wake)
+                usocklnd_wakeup_pollthread(pt_idx);
         return 0;
 }
 
@@ -263,6 +360,7 @@ usocklnd_add_killrequest(usock_conn_t *conn)
         int                  pt_idx = conn->uc_pt_idx;
         usock_pollthread_t  *pt     = &usock_data.ud_pollthreads[pt_idx];
         usock_pollrequest_t *pr     = conn->uc_preq;
+        int                  wake;
         
         /* Use preallocated poll request because there is no good
          * workaround for ENOMEM error while killing connection */
@@ -281,10 +379,15 @@ usocklnd_add_killrequest(usock_conn_t *conn)
                         return; /* conn will be killed in poll thread anyway */
                 }
 
+                wake = list_empty(&pt->upt_pollrequests) &&
+                    !pthread_equal(pt->upt_thread, pthread_self());
                 list_add_tail(&pr->upr_list, &pt->upt_pollrequests);
                 pthread_mutex_unlock(&pt->upt_pollrequests_lock);
 
                 conn->uc_preq = NULL;
+
+                if (wake)
+                        usocklnd_wakeup_pollthread(pt_idx);
         }
 }
 
@@ -404,8 +507,10 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                 pollfd[idx].fd = conn->uc_lx->lx_fd;
                 pollfd[idx].events = value;
                 pollfd[idx].revents = 0;
+                usocklnd_epoll_ctl(pt_data, EPOLL_CTL_ADD, conn, value);
                 break;
         case POLL_DEL_REQUEST:
+                usocklnd_epoll_ctl(pt_data, EPOLL_CTL_DEL, conn, 0);
                 fd2idx[conn->uc_lx->lx_fd] = 0; /* invalidate this entry */
                 
                 --pt_data->upt_nfds;
@@ -427,12 +532,18 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                 break;
         case POLL_RX_SET_REQUEST:
 		pollfd[idx].events = (pollfd[idx].events & ~POLLIN) | value;
+                usocklnd_epoll_ctl(pt_data, EPOLL_CTL_MOD, conn,
+                                   pollfd[idx].events);
                 break;
         case POLL_TX_SET_REQUEST:
 		pollfd[idx].events = (pollfd[idx].events & ~POLLOUT) | value;
+                usocklnd_epoll_ctl(pt_data, EPOLL_CTL_MOD, conn,
+                                   pollfd[idx].events);
                 break;
         case POLL_SET_REQUEST:
                 pollfd[idx].events = value;
+                usocklnd_epoll_ctl(pt_data, EPOLL_CTL_MOD, conn,
+                                   pollfd[idx].events);
                 break;
         default:
                 LBUG(); /* unknown type */                
@@ -512,6 +623,106 @@ usocklnd_execute_handlers(usock_pollthread_t *pt_data)
         }
 }
 
+#ifdef HAVE_EPOLL
+/* Run handlers for conns on the ready list.  With edge-triggered
+ * notification an event is reported only once, so a conn stays on the
+ * list until its handler reports there is nothing more to do (<= 0);
+ * fair_limit bounds the passes made before checking for new events. */
+static void
+usocklnd_execute_epoll_handlers(usock_pollthread_t *pt_data)
+{
+        usock_conn_t *conn, *next;
+        short         events;
+        int           j;
+
+        for (j = 0; j < usock_tuns.ut_fair_limit &&
+             !list_empty(&pt_data->upt_ready_list); j++) {
+                list_for_each_entry_safe(conn, next,
+                                         &pt_data->upt_ready_list,
+                                         uc_ready_list) {
+                        events = pt_data->upt_pollfd[
+                            pt_data->upt_fd2idx[conn->uc_lx->lx_fd]].events;
+
+                        if (conn->uc_pt_revents & POLLNVAL) {
+                                conn->uc_pt_revents = 0;
+                                list_del_init(&conn->uc_ready_list);
+                                usocklnd_conn_kill(conn);
+                                continue;
+                        }
+
+                        /* kill connection if it's closed by peer and
+                         * there is no data pending for reading */
+                        if (conn->uc_pt_revents & (POLLERR | POLLHUP)) {
+                                if ((events & POLLIN) != 0 &&
+                                    (conn->uc_pt_revents & POLLIN) == 0)
+                                        usocklnd_conn_kill(conn);
+                                else
+                                        usocklnd_exception_handler(conn);
+                                conn->uc_pt_revents &=
+                                    ~(POLLERR | POLLHUP);
+                        }
+
+                        if ((conn->uc_pt_revents & POLLIN) != 0 &&
+                            usocklnd_read_handler(conn) <= 0)
+                                conn->uc_pt_revents &= ~POLLIN;
+
+                        if ((conn->uc_pt_revents & POLLOUT) != 0 &&
+                            usocklnd_write_handler(conn) <= 0)
+                                conn->uc_pt_revents &= ~POLLOUT;
+
+                        if (conn->uc_pt_revents == 0)
+                                list_del_init(&conn->uc_ready_list);
+                }
+        }
+}
+
+/* epoll(7) counterpart of poll(2) + usocklnd_execute_handlers(): cost
+ * is proportional to the number of ready conns rather than to the
+ * number of conns owned by this thread.
+ * Returns # of events reaped or <0 on error */
+int
+usocklnd_epoll_wait(usock_pollthread_t *pt_data)
+{
+        struct epoll_event *ev = pt_data->upt_events;
+        usock_conn_t       *conn;
+        int                 i, n;
+
+        /* don't sleep while some conns still have work pending */
+        n = epoll_wait(pt_data->upt_epfd, ev, UPT_NEVENTS,
+                       list_empty(&pt_data->upt_ready_list) ?
+                       usock_tuns.ut_poll_timeout * 1000 : 0);
+        if (n < 0) {
+                if (errno == EINTR)
+                        return 0;
+                CERROR("Cannot epoll_wait(2): errno=%d\n", errno);
+                return -errno;
+        }
+
+        for (i = 0; i < n; i++) {
+                conn = ev[i].data.ptr;
+                if (conn == NULL) {
+                        while (usocklnd_notifier_handler(
+                            pt_data->upt_notifier_fd) > 0)
+                                ;
+                        continue;
+                }
+                conn->uc_pt_revents |= usocklnd_epoll2poll(ev[i].events);
+                if (list_empty(&conn->uc_ready_list))
+                        list_add_tail(&conn->uc_ready_list,
+                                      &pt_data->upt_ready_list);
+        }
+
+        usocklnd_execute_epoll_handlers(pt_data);
+        return n;
+}
+#else
+int
+usocklnd_epoll_wait(__unusedx usock_pollthread_t *pt_data)
+{
+        return -ENOSYS;
+}
+#endif
+
 int
 usocklnd_calculate_chunk_size(int num)
 {
@@ -536,7 +747,7 @@ void
 usocklnd_wakeup_pollthread(int i)
 {
         usock_pollthread_t *pt = &usock_data.ud_pollthreads[i];
-        int                 notification = 0;
+        __u64               notification = 1; /* eventfd(2) counter */
         int                 rc;
 
         rc = syscall(SYS_write, pt->upt_notifier_fd, &notification,
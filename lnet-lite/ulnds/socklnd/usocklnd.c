@@ -45,6 +45,10 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/eventfd.h>
+#endif
+
 #include <arpa/inet.h>
 
 #include "pfl/opstats.h"
@@ -94,6 +98,9 @@ usock_tunables_t usock_tuns = {
         .ut_poll_timeout    = 1,
         .ut_fair_limit      = 1,
         .ut_npollthreads    = 0,
+#ifdef HAVE_EPOLL
+        .ut_epoll           = 1,
+#endif
         .ut_min_bulk        = 1<<10,
         .ut_txcredits       = 256,
         .ut_peertxcredits   = 8,
@@ -190,8 +197,16 @@ usocklnd_release_poll_states(int n)
         for (i = 0; i < n; i++) {
                 usock_pollthread_t *pt = &usock_data.ud_pollthreads[i];
 
+                if (pt->upt_pollfd[0].fd != pt->upt_notifier_fd)
+                        close(pt->upt_pollfd[0].fd);
                 close(pt->upt_notifier_fd);
-                close(pt->upt_pollfd[0].fd);
+#ifdef HAVE_EPOLL
+                if (pt->upt_epfd != -1) {
+                        close(pt->upt_epfd);
+                        LIBCFS_FREE (pt->upt_events,
+                                     sizeof(struct epoll_event) * UPT_NEVENTS);
+                }
+#endif
 
                 pthread_mutex_destroy(&pt->upt_pollrequests_lock);
                 cfs_fini_completion(&pt->upt_completion);
@@ -228,6 +243,11 @@ usocklnd_update_tunables()
         if (rc)
                 return rc;
 
+        rc = cfs_parse_int_tunable(&usock_tuns.ut_epoll,
+                                      "USOCK_EPOLL");
+        if (rc)
+                return rc;
+
         rc = cfs_parse_int_tunable(&usock_tuns.ut_fair_limit,
                                       "USOCK_FAIR_LIMIT");
         if (rc)
@@ -404,9 +424,20 @@ usocklnd_base_startup(void)
 
                 pt->upt_npollfd = pt->upt_nfd2idx = UPT_START_SIZ;
 
+#ifdef HAVE_EPOLL
+                /* a single eventfd(2) serves as both ends */
+                notifier[0] = notifier[1] = eventfd(0,
+                    EFD_NONBLOCK | EFD_CLOEXEC);
+                if (notifier[0] == -1) {
+                        rc = -errno;
+                        CERROR("Cannot create eventfd: %d\n", rc);
+                        goto base_startup_failed_4;
+                }
+#else
                 rc = libcfs_socketpair(notifier);
                 if (rc != 0)
                         goto base_startup_failed_4;
+#endif
 
                 pt->upt_notifier_fd = notifier[0];
 
@@ -414,6 +445,41 @@ usocklnd_base_startup(void)
                 pt->upt_pollfd[0].events = POLLIN;
                 pt->upt_pollfd[0].revents = 0;
 
+                pt->upt_epfd = -1;
+                CFS_INIT_LIST_HEAD (&pt->upt_ready_list);
+#ifdef HAVE_EPOLL
+                if (usock_tuns.ut_epoll) {
+                        struct epoll_event ev;
+
+                        rc = -ENOMEM;
+                        LIBCFS_ALLOC (pt->upt_events,
+                                      sizeof(struct epoll_event) *
+                                      UPT_NEVENTS);
+                        if (pt->upt_events == NULL)
+                                goto base_startup_failed_5;
+
+                        pt->upt_epfd = epoll_create1(EPOLL_CLOEXEC);
+                        if (pt->upt_epfd == -1) {
+                                rc = -errno;
+                                CERROR("Cannot create epoll fd: %d\n", rc);
+                                goto base_startup_failed_6;
+                        }
+
+                        /* notifier is level-triggered; conns are not */
+                        memset(&ev, 0, sizeof(ev));
+                        ev.events = EPOLLIN;
+                        ev.data.ptr = NULL;
+                        if (epoll_ctl(pt->upt_epfd, EPOLL_CTL_ADD,
+                            pt->upt_notifier_fd, &ev) == -1) {
+                                rc = -errno;
+                                CERROR("Cannot add notifier to epoll "
+                                       "set: %d\n", rc);
+                                close(pt->upt_epfd);
+                                goto base_startup_failed_6;
+                        }
+                }
+#endif
+
                 pt->upt_nfds = 1;
                 pt->upt_idx2conn[0] = NULL;
 
@@ -462,6 +528,13 @@ usocklnd_base_startup(void)
 
         return 0;
 
+#ifdef HAVE_EPOLL
+  base_startup_failed_6:
+        LIBCFS_FREE (pt->upt_events,
+                     sizeof(struct epoll_event) * UPT_NEVENTS);
+  base_startup_failed_5:
+        close(pt->upt_notifier_fd);
+#endif
   base_startup_failed_4:
         LIBCFS_FREE (pt->upt_skip, sizeof(int) * UPT_START_SIZ);
   base_startup_failed_3:
@@ -43,6 +43,10 @@
 
 #include <pthread.h>
 #include <poll.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include <lnet/lib-lnet.h>
 #include <lnet/socklnd.h>
 
@@ -77,6 +81,8 @@ typedef struct {
         __u32                 uc_peer_ip;    /* IP address of the peer */
         __u16                 uc_peer_port;  /* port of the peer */
         struct list_head      uc_stale_list; /* orphaned connections */
+        short                 uc_pt_revents; /* undrained events (epoll) */
+        struct list_head      uc_ready_list; /* on upt_ready_list */
 
         /* Receive state */
         int                uc_rx_state;      /* message or hello state */
@@ -146,6 +152,11 @@ typedef struct usock_peer_s {
 
 typedef struct {
         int               upt_notifier_fd;       /* notifier fd for writing */
+        int               upt_epfd;              /* epoll(7) fd or -1 */
+        struct epoll_event *upt_events;          /* epoll_wait(2) results */
+        struct list_head  upt_ready_list;        /* conns with undrained
+                                                  * edge-triggered events */
+        pthread_t         upt_thread;            /* poll thread itself */
         struct pollfd    *upt_pollfd;            /* poll fds */
         int               upt_nfds;              /* active poll fds */
         int               upt_npollfd;           /* allocated poll fds */
@@ -168,6 +179,9 @@ typedef struct {
  * at initialization time. Will be resized on demand */
 #define UPT_START_SIZ 32
 
+/* # of events reaped by one epoll_wait(2) */
+#define UPT_NEVENTS 256
+
 /* # peer lists */
 #define UD_PEER_HASH_SIZE  101
 
@@ -206,6 +220,7 @@ typedef struct {
         int ut_poll_timeout;  /* the third arg for poll(2) (seconds) */
         int ut_timeout;       /* "stuck" socket timeout (seconds) */
         int ut_npollthreads;  /* number of poll thread to spawn */
+        int ut_epoll;         /* use edge-triggered epoll(7) backend */
         int ut_fair_limit;    /* how many packets can we receive or transmit
                                * without calling poll(2) */
         int ut_min_bulk;      /* smallest "large" message */
@@ -279,9 +294,23 @@ usocklnd_peer_decref(usock_peer_t *peer)
                 usocklnd_destroy_peer(peer);
 }
 
+/*
+ * Map a peer to a poll thread with a jump consistent hash (Lamping &
+ * Veach) so connections spread evenly regardless of how peer addresses
+ * are allocated, and all conns to one peer share a poll thread.
+ */
 static inline int
 usocklnd_ip2pt_idx(__u32 ip) {
-        return ip % usock_data.ud_npollthreads;
+        __u64 key = ((__u64)ip + 1) * 0x9e3779b97f4a7c15ULL;
+        __s64 b = -1, j = 0;
+
+        while (j < usock_data.ud_npollthreads) {
+                b = j;
+                key = key * 2862933555777941757ULL + 1;
+                j = (b + 1) * ((double)(1LL << 31) /
+                    (double)((key >> 33) + 1));
+        }
+        return b;
 }
 
 static inline struct list_head *
@@ -306,6 +335,7 @@ void usocklnd_add_killrequest(usock_conn_t *conn);
 int usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                                  usock_pollthread_t *pt_data);
 void usocklnd_execute_handlers(usock_pollthread_t *pt_data);
+int usocklnd_epoll_wait(usock_pollthread_t *pt_data);
 int usocklnd_calculate_chunk_size(int num);
 void usocklnd_wakeup_pollthread(int i);
 
@@ -92,8 +92,6 @@ usocklnd_send_tx_immediately(usock_conn_t *conn, usock_tx_t *tx)
                 rc2 = usocklnd_add_pollrequest(conn, POLL_TX_SET_REQUEST, POLLOUT);
                 if (rc2 != 0)
                         usocklnd_conn_kill_locked(conn);
-                else
-                        usocklnd_wakeup_pollthread(conn->uc_pt_idx);
         }
 
         pthread_mutex_unlock(&conn->uc_lock);
@@ -173,7 +171,16 @@ usocklnd_recv(__unusedx lnet_ni_t *ni, void *private, lnet_msg_t *msg,
                         usocklnd_conn_kill_locked(conn);
                         goto recv_out;
                 }
-                usocklnd_wakeup_pollthread(conn->uc_pt_idx);
+        } else if (conn->uc_rx_state == UC_RX_PARSE) {
+                /* The read handler returned while lnet_parse() deferred
+                 * us, so an edge-triggered poll thread has already
+                 * dropped POLLIN.  Payload bytes queued meanwhile raise
+                 * no new edge: re-arm to have them reported again. */
+                rc = usocklnd_add_pollrequest(conn, POLL_RX_SET_REQUEST, POLLIN);
+                if (rc != 0) {
+                        usocklnd_conn_kill_locked(conn);
+                        goto recv_out;
+                }
         }
 
         conn->uc_rx_state = UC_RX_LNET_PAYLOAD;
@@ -198,8 +205,6 @@ usocklnd_accept(lnet_ni_t *ni, struct lnet_xport *lx)
         lnet_ni_addref(ni);
 
         rc = usocklnd_add_pollrequest(conn, POLL_ADD_REQUEST, POLLIN);
-        if (rc == 0)
-                usocklnd_wakeup_pollthread(conn->uc_pt_idx);
 
         /* NB: conn reference counter was incremented while adding
          * poll request if rc == 0 */
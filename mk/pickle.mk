@@ -127,6 +127,10 @@ ifeq ($(filter $(realpath ${ROOTDIR})/compat/%,${CURDIR}),)
   DEFINES+=						-DHAVE_INOTIFY
  endif
 
+ ifdef PICKLE_HAVE_EPOLL
+  DEFINES+=						-DHAVE_EPOLL
+ endif
+
  ifdef PICKLE_HAVE_ATSYSCALLS
   DEFINES+=						-DHAVE_ATSYSCALLS
  endif
@@ -161,6 +165,10 @@ ifeq ($(filter $(realpath ${ROOTDIR})/compat/%,${CURDIR}),)
   DEFINES+=						-DHAVE_FUSE_REQ_GETCHANNEL
  endif
 
+ ifdef PICKLE_HAVE_FUSE_REPLY_DATA
+  DEFINES+=						-DHAVE_FUSE_REPLY_DATA
+ endif
+
  ifdef PICKLE_HAVE_FUSE
   DEFINES+=						-DHAVE_FUSE
   PSCFS_SRCS+=						${PFL_BASE}/fuse.c
@@ -240,6 +248,10 @@ ifeq ($(filter $(realpath ${ROOTDIR})/compat/%,${CURDIR}),)
   DEFINES+=						-DHAVE_AIO
  endif
 
+ ifdef PICKLE_HAVE_IO_URING
+  DEFINES+=						-DHAVE_IO_URING
+ endif
+
  ifdef PICKLE_HAVE_GETMNTINFO
   DEFINES+=						-DHAVE_GETMNTINFO
  endif
@@ -20,8 +20,19 @@
  * PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+# include <cpuid.h>
+# include <immintrin.h>
+# define PFL_CRC64_HAVE_CLMUL
+#endif
+
+#include "pfl/cdefs.h"
 #include "pfl/crc.h"
 
 const uint64_t psc_crc64_table[] = {
@@ -156,25 +167,344 @@ const uint64_t psc_crc64_table[] = {
 };
 
 /*
- * psc_crc64_add - Accumulate bytes into a 64-bit CRC buffer.
- * @cp: pointer to an initialized CRC buffer.
- * @datap: data region to add to CRC over.
- * @len: amount of data.
+ * Slice-by-N tables derived from psc_crc64_table at startup:
+ * psc_crc64_stable[k][b] is the contribution of byte b followed by k
+ * zero bytes.
  */
-__inline void
-psc_crc64_add(uint64_t *cp, const void *datap, int len)
+__static uint64_t	psc_crc64_stable[16][256];
+
+#ifdef PFL_CRC64_HAVE_CLMUL
+/*
+ * Folding constants for the carry-less multiply kernel.  Entry f holds
+ * { x^(128f) mod P, x^(128f + 64) mod P } for folding an accumulator
+ * across f 16-byte blocks.
+ */
+__static uint64_t	psc_crc64_fold[5][2];
+#endif
+
+__static pthread_once_t	psc_crc64_once = PTHREAD_ONCE_INIT;
+__static void		psc_crc64_add_resolve(uint64_t *, const void *, size_t);
+
+void (*psc_crc64_add_fn)(uint64_t *, const void *, size_t) =
+    psc_crc64_add_resolve;
+int psc_crc64_kernel = -1;
+
+const char *psc_crc64_kernel_names[] = {
+	"table",
+	"slice8",
+	"slice16",
+	"clmul"
+};
+
+#define CRC64_TBL(crc, b)						\
+	(psc_crc64_table[((int)((crc) >> 56) ^ (b)) & 0xff] ^ ((crc) << 8))
+
+static __inline uint64_t
+psc_crc64_loadbe(const uint8_t *p)
+{
+	return ((uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 |
+	    (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 |
+	    (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+	    (uint64_t)p[6] <<  8 | (uint64_t)p[7]);
+}
+
+/*
+ * Reference kernel: one byte per iteration through psc_crc64_table.
+ */
+__static void
+psc_crc64_add_table(uint64_t *cp, const void *datap, size_t len)
 {
 	const uint8_t *data = datap;
 	uint64_t crc0 = *cp;
-	int idx;
 
-	while (len-- > 0) {
-		idx = ((int)(crc0 >> 56) ^ *data++) & 0xff;
-		crc0 = psc_crc64_table[idx] ^ (crc0 << 8);
+	while (len-- > 0)
+		crc0 = CRC64_TBL(crc0, *data++);
+	*cp = crc0;
+}
+
+#define SB8(crc, t)							\
+	(psc_crc64_stable[(t) + 7][(crc) >> 56] ^			\
+	 psc_crc64_stable[(t) + 6][((crc) >> 48) & 0xff] ^		\
+	 psc_crc64_stable[(t) + 5][((crc) >> 40) & 0xff] ^		\
+	 psc_crc64_stable[(t) + 4][((crc) >> 32) & 0xff] ^		\
+	 psc_crc64_stable[(t) + 3][((crc) >> 24) & 0xff] ^		\
+	 psc_crc64_stable[(t) + 2][((crc) >> 16) & 0xff] ^		\
+	 psc_crc64_stable[(t) + 1][((crc) >>  8) & 0xff] ^		\
+	 psc_crc64_stable[(t)    ][ (crc)        & 0xff])
+
+/*
+ * Slice-by-8 kernel: eight table lookups per 64-bit word.
+ */
+__static void
+psc_crc64_add_slice8(uint64_t *cp, const void *datap, size_t len)
+{
+	const uint8_t *data = datap;
+	uint64_t crc0 = *cp;
+
+	for (; len >= 8; len -= 8, data += 8) {
+		crc0 ^= psc_crc64_loadbe(data);
+		crc0 = SB8(crc0, 0);
 	}
+	while (len-- > 0)
+		crc0 = CRC64_TBL(crc0, *data++);
 	*cp = crc0;
 }
 
+/*
+ * Slice-by-16 kernel: two independent 64-bit words per iteration.
+ */
+__static void
+psc_crc64_add_slice16(uint64_t *cp, const void *datap, size_t len)
+{
+	const uint8_t *data = datap;
+	uint64_t crc0 = *cp, w;
+
+	for (; len >= 16; len -= 16, data += 16) {
+		crc0 ^= psc_crc64_loadbe(data);
+		w = psc_crc64_loadbe(data + 8);
+		crc0 = SB8(crc0, 8) ^ SB8(w, 0);
+	}
+	for (; len >= 8; len -= 8, data += 8) {
+		crc0 ^= psc_crc64_loadbe(data);
+		crc0 = SB8(crc0, 0);
+	}
+	while (len-- > 0)
+		crc0 = CRC64_TBL(crc0, *data++);
+	*cp = crc0;
+}
+
+#ifdef PFL_CRC64_HAVE_CLMUL
+
+#define CLMUL_TARGET	__attribute__((target("pclmul,sse4.1")))
+
+/*
+ * Multiply both halves of the accumulator by their folding constants,
+ * yielding a 128-bit value congruent to x * x^(128f) mod P.
+ */
+#define CLMUL_FOLD(x, k)						\
+	_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00),		\
+	    _mm_clmulepi64_si128((x), (k), 0x11))
+
+/*
+ * Load 16 message bytes as a polynomial: the first byte holds the most
+ * significant coefficients since this CRC is not bit-reflected.
+ */
+#define CLMUL_LOAD(p, bswap)						\
+	_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p)), (bswap))
+
+/*
+ * Carry-less multiplication folding kernel (PCLMULQDQ).  The message
+ * is folded four 16-byte lanes at a time down to a single 128-bit
+ * residue, which is then reduced with the table kernel.
+ */
+CLMUL_TARGET __static void
+psc_crc64_add_clmul(uint64_t *cp, const void *datap, size_t len)
+{
+	const uint8_t *data = datap;
+	__m128i bswap, k, x0, x1, x2, x3;
+	uint8_t buf[16];
+	uint64_t crc0;
+
+	if (len < 16) {
+		psc_crc64_add_slice8(cp, datap, len);
+		return;
+	}
+
+	bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+	    13, 14, 15);
+
+	/*
+	 * Feeding CRC state c into n >= 8 bytes is equivalent to
+	 * starting from zero with c XOR'd into the leading eight
+	 * bytes.
+	 */
+	x0 = _mm_xor_si128(CLMUL_LOAD(data, bswap),
+	    _mm_set_epi64x(*cp, 0));
+	data += 16;
+	len -= 16;
+
+	if (len >= 48) {
+		x1 = CLMUL_LOAD(data, bswap);
+		x2 = CLMUL_LOAD(data + 16, bswap);
+		x3 = CLMUL_LOAD(data + 32, bswap);
+		data += 48;
+		len -= 48;
+
+		k = _mm_loadu_si128((const __m128i *)psc_crc64_fold[4]);
+		for (; len >= 64; len -= 64, data += 64) {
+			x0 = _mm_xor_si128(CLMUL_FOLD(x0, k),
+			    CLMUL_LOAD(data, bswap));
+			x1 = _mm_xor_si128(CLMUL_FOLD(x1, k),
+			    CLMUL_LOAD(data + 16, bswap));
+			x2 = _mm_xor_si128(CLMUL_FOLD(x2, k),
+			    CLMUL_LOAD(data + 32, bswap));
+			x3 = _mm_xor_si128(CLMUL_FOLD(x3, k),
+			    CLMUL_LOAD(data + 48, bswap));
+		}
+
+		x0 = CLMUL_FOLD(x0, _mm_loadu_si128(
+		    (const __m128i *)psc_crc64_fold[3]));
+		x1 = CLMUL_FOLD(x1, _mm_loadu_si128(
+		    (const __m128i *)psc_crc64_fold[2]));
+		x2 = CLMUL_FOLD(x2, _mm_loadu_si128(
+		    (const __m128i *)psc_crc64_fold[1]));
+		x0 = _mm_xor_si128(_mm_xor_si128(x0, x1),
+		    _mm_xor_si128(x2, x3));
+	}
+
+	k = _mm_loadu_si128((const __m128i *)psc_crc64_fold[1]);
+	for (; len >= 16; len -= 16, data += 16)
+		x0 = _mm_xor_si128(CLMUL_FOLD(x0, k),
+		    CLMUL_LOAD(data, bswap));
+
+	/*
+	 * Reduce the residue: running the table kernel from zero over
+	 * its 16 bytes computes residue * x^64 mod P.
+	 */
+	_mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(x0, bswap));
+	crc0 = 0;
+	psc_crc64_add_slice8(&crc0, buf, sizeof(buf));
+	psc_crc64_add_slice8(&crc0, data, len);
+	*cp = crc0;
+}
+
+/*
+ * Compute x^n mod P.
+ */
+__static uint64_t
+psc_crc64_xpow(int n)
+{
+	uint64_t r = 1;
+
+	while (n-- > 0)
+		r = (r << 1) ^ (r >> 63 ? psc_crc64_table[1] : 0);
+	return (r);
+}
+
+__static int
+psc_crc64_have_clmul(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return (0);
+	return ((ecx & bit_PCLMUL) && (ecx & bit_SSE4_1));
+}
+
+#endif
+
+void (*psc_crc64_kernels[])(uint64_t *, const void *, size_t) = {
+	psc_crc64_add_table,
+	psc_crc64_add_slice8,
+	psc_crc64_add_slice16,
+#ifdef PFL_CRC64_HAVE_CLMUL
+	psc_crc64_add_clmul
+#else
+	NULL
+#endif
+};
+
+__static void
+psc_crc64_init_tables(void)
+{
+	const char *p;
+	int b, k;
+
+	for (b = 0; b < 256; b++)
+		psc_crc64_stable[0][b] = psc_crc64_table[b];
+	for (k = 1; k < 16; k++)
+		for (b = 0; b < 256; b++)
+			psc_crc64_stable[k][b] =
+			    CRC64_TBL(psc_crc64_stable[k - 1][b], 0);
+
+#ifdef PFL_CRC64_HAVE_CLMUL
+	for (k = 1; k < 5; k++) {
+		psc_crc64_fold[k][0] = psc_crc64_xpow(128 * k);
+		psc_crc64_fold[k][1] = psc_crc64_xpow(128 * k + 64);
+	}
+	if (!psc_crc64_have_clmul())
+		psc_crc64_kernels[PFL_CRC64_CLMUL] = NULL;
+#endif
+
+	k = PFL_CRC64_CLMUL;
+	p = getenv("PSC_CRC64_KERNEL");
+	if (p)
+		for (k = 0; k < PFL_CRC64_NKERNELS; k++)
+			if (strcmp(p, psc_crc64_kernel_names[k]) == 0)
+				break;
+	for (; k >= 0; k--)
+		if (k < PFL_CRC64_NKERNELS && psc_crc64_kernels[k])
+			break;
+	if (k < 0)
+		k = PFL_CRC64_SLICE16;
+	psc_crc64_kernel = k;
+	psc_crc64_add_fn = psc_crc64_kernels[k];
+}
+
+__static void
+psc_crc64_add_resolve(uint64_t *cp, const void *datap, size_t len)
+{
+	pthread_once(&psc_crc64_once, psc_crc64_init_tables);
+	psc_crc64_add_fn(cp, datap, len);
+}
+
+/*
+ * psc_crc64_setkernel - Select the CRC64 implementation.
+ * @k: kernel index (PFL_CRC64_*).
+ *
+ * Returns zero on success or ENOTSUP if the kernel is not usable on
+ * this machine.  All kernels produce identical results.
+ */
+int
+psc_crc64_setkernel(int k)
+{
+	pthread_once(&psc_crc64_once, psc_crc64_init_tables);
+	if (k < 0 || k >= PFL_CRC64_NKERNELS || !psc_crc64_kernels[k])
+		return (ENOTSUP);
+	psc_crc64_kernel = k;
+	psc_crc64_add_fn = psc_crc64_kernels[k];
+	return (0);
+}
+
+/*
+ * psc_crc64_kernel_avail - Determine if a CRC64 kernel is usable.
+ * @k: kernel index (PFL_CRC64_*).
+ */
+int
+psc_crc64_kernel_avail(int k)
+{
+	pthread_once(&psc_crc64_once, psc_crc64_init_tables);
+	return (k >= 0 && k < PFL_CRC64_NKERNELS &&
+	    psc_crc64_kernels[k] != NULL);
+}
+
+/*
+ * psc_crc64_add_kernel - Accumulate bytes using a specific kernel.
+ * @k: kernel index (PFL_CRC64_*), which must be available.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc64_add_kernel(int k, uint64_t *cp, const void *datap, size_t len)
+{
+	pthread_once(&psc_crc64_once, psc_crc64_init_tables);
+	psc_crc64_kernels[k](cp, datap, len);
+}
+
+/*
+ * psc_crc64_add - Accumulate bytes into a 64-bit CRC buffer.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc64_add(uint64_t *cp, const void *datap, int len)
+{
+	if (len > 0)
+		psc_crc64_add_fn(cp, datap, len);
+}
+
 __inline int
 psc_crc64_verify(uint64_t c, const void *datap, int len)
 {
@@ -28,10 +28,18 @@
 #ifndef _PFL_CRC_H_
 #define _PFL_CRC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "pfl/cdefs.h"
 
+/* CRC64 kernels, in increasing order of preference */
+#define PFL_CRC64_TABLE		0	/* byte-at-a-time table walk */
+#define PFL_CRC64_SLICE8	1	/* slice-by-8 tables */
+#define PFL_CRC64_SLICE16	2	/* slice-by-16 tables */
+#define PFL_CRC64_CLMUL		3	/* carry-less multiply folding */
+#define PFL_CRC64_NKERNELS	4
+
 /**
  * psc_crc64_calc - Compute a 64-bit CRC of some data.
  * @cp: pointer to an uninitialized CRC buffer.
@@ -66,6 +74,17 @@ int	psc_crc32_verify(uint32_t, const void *, int);
 void	psc_crc64_add(uint64_t *, const void *, int);
 int	psc_crc64_verify(uint64_t, const void *, int);
 
+#ifndef USE_GCRCUTIL
+
+void	psc_crc64_add_kernel(int, uint64_t *, const void *, size_t);
+int	psc_crc64_kernel_avail(int);
+int	psc_crc64_setkernel(int);
+
+extern int		 psc_crc64_kernel;
+extern const char	*psc_crc64_kernel_names[];
+
+#endif
+
 #ifdef USE_GCRCUTIL
 
 void	psc_crc32_init(uint32_t *);
@@ -74,6 +74,7 @@ struct psc_ctlmsg_hashtable {
 	int32_t			pcht_usedbucks;
 	int32_t			pcht_nents;
 	int32_t			pcht_maxbucklen;
+	int32_t			pcht_lenpctl[PHT_NPCTL];
 	int32_t			pcht_flags;
 	char			pcht_name[PSC_HTNAME_MAX];
 };
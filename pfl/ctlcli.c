@@ -553,9 +553,9 @@ psc_ctlmsg_hashtable_prhdr(__unusedx struct psc_ctlmsghdr *mh,
     __unusedx const void *m)
 {
 	printf("%-30s %5s %7s %7s "
-	    "%6s %6s %6s %6s\n",
+	    "%6s %6s %6s %6s %4s %4s %4s\n",
 	    "hash-table", "flags", "#fill", "#bkts",
-	    "%fill", "#ents", "avglen", "maxlen");
+	    "%fill", "#ents", "avglen", "maxlen", "p50", "p90", "p99");
 }
 
 void
@@ -570,14 +570,15 @@ psc_ctlmsg_hashtable_prdat(__unusedx const struct psc_ctlmsghdr *mh,
 	    "%7d %7d "
 	    "%6s %6d "
 	    "%6.1f "
-	    "%6d\n",
+	    "%6d %4d %4d %4d\n",
 	    pcht->pcht_name,
 	    pcht->pcht_flags & PHTF_RESORT ? 'R' : '-',
 	    pcht->pcht_flags & PHTF_STR ? 'S' : '-',
 	    pcht->pcht_usedbucks, pcht->pcht_totalbucks,
 	    rbuf, pcht->pcht_nents,
 	    pcht->pcht_nents * 1.0 / pcht->pcht_totalbucks,
-	    pcht->pcht_maxbucklen);
+	    pcht->pcht_maxbucklen, pcht->pcht_lenpctl[0],
+	    pcht->pcht_lenpctl[1], pcht->pcht_lenpctl[2]);
 }
 
 void
@@ -642,8 +643,12 @@ psc_ctlmsg_opstat_prdat(__unusedx const struct psc_ctlmsghdr *mh,
 	printf("%-38s ", pco->pco_name);
 
 	// 11.2
-	psc_ctl_prnumber(base10, opst->opst_avg, 11, "/s ");
-	psc_ctl_prnumber(base10, opst->opst_intv, 11, "/s ");
+	if (opst->opst_flags & OPSTF_NORATE)
+		printf("%13s %13s ", "-", "-");
+	else {
+		psc_ctl_prnumber(base10, opst->opst_avg, 11, "/s ");
+		psc_ctl_prnumber(base10, opst->opst_intv, 11, "/s ");
+	}
 	psc_ctl_prnumber(base10, psc_atomic64_read(&opst->opst_lifetime), 13, "");
 	printf("\n");
 }
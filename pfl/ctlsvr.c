@@ -395,7 +395,7 @@ psc_ctlrep_gethashtable(int fd, struct psc_ctlmsghdr *mh, void *m)
 			psc_hashtbl_getstats(pht,
 			    &pcht->pcht_totalbucks,
 			    &pcht->pcht_usedbucks, &pcht->pcht_nents,
-			    &pcht->pcht_maxbucklen);
+			    &pcht->pcht_maxbucklen, pcht->pcht_lenpctl);
 			rc = psc_ctlmsg_sendv(fd, mh, pcht);
 			if (!rc)
 				break;
@@ -510,7 +510,8 @@ psc_ctlrep_getpool(int fd, struct psc_ctlmsghdr *mh, void *msg)
 				    psc_multiwaitcond_nwaiters(
 					&m->ppm_ml.pml_mwcond_empty);
 			} else {
-				pcpl->pcpl_free = lc_nitems(&m->ppm_lc);
+				pcpl->pcpl_free = lc_nitems(&m->ppm_lc) +
+				    psc_pool_nmagged(m);
 				pcpl->pcpl_nw_want = psc_waitq_nwaiters(
 				    &m->ppm_lc.plc_wq_want);
 				pcpl->pcpl_nw_empty =
@@ -1856,6 +1857,7 @@ psc_ctlparam_opstats(int fd, struct psc_ctlmsghdr *mh,
 		if (nlevels < 2 ||
 		    strcmp(levels[1], opst->opst_name) == 0) {
 			found = 1;
+			pfl_opstat_fold(opst);
 
 			if (reset) {
 				errno = 0;
@@ -1908,7 +1910,9 @@ psc_ctlrep_getopstat(int fd, struct psc_ctlmsghdr *mh, void *m)
 		if (all || fnmatch(name, opst->opst_name, 0) == 0) {
 			found = 1;
 
+			pfl_opstat_fold(opst);
 			pcop->pco_opst = *opst;
+			pcop->pco_opst.opst_shards = NULL;
 			strlcpy(pcop->pco_name, opst->opst_name,
 			    sizeof(pcop->pco_name));
 			rc = psc_ctlmsg_sendv(fd, mh, pcop);
@@ -597,8 +597,8 @@ pscrpc_ni_init(int type, int nmsgs)
 	pscrpc_imp_pool = psc_poolmaster_getmgr(&pscrpc_imp_poolmaster);
 
 	psc_poolmaster_init(&pscrpc_rq_poolmaster,
-	    struct pscrpc_request, rq_lentry, PPMF_AUTO, 64, 64, 0,
-	    NULL, NULL, NULL, "rpcrq");
+	    struct pscrpc_request, rq_lentry, PPMF_AUTO | PPMF_MAGAZINE,
+	    64, 64, 0, NULL, NULL, NULL, "rpcrq");
 	pscrpc_rq_pool = psc_poolmaster_getmgr(&pscrpc_rq_poolmaster);
 
 	pscrpc_conns_init();
@@ -206,5 +206,8 @@ void	pflfs_modules_wrpin(void);
 void	pflfs_modules_wrunpin(void);
 
 extern struct psc_dynarray		pscfs_modules;
+extern int				pscfs_fuse_clonefd;
+extern int				pscfs_fuse_splice;
+extern int				pscfs_nthreads;
 
 #endif /* _PFL_FS_H_ */
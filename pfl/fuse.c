@@ -29,7 +29,12 @@
 #include <sys/select.h>
 #endif
 
+#ifdef __linux
+#include <sys/ioctl.h>
+#endif
+
 #include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <pthread.h>
 #include <pwd.h>
@@ -62,6 +67,16 @@
 #define MAX_FILESYSTEMS			5
 #define MAX_FDS				(MAX_FILESYSTEMS + 1)
 
+/*
+ * Clone a /dev/fuse descriptor so it is attached to the same
+ * connection as an existing one (Linux 4.2 and later).  Requests are
+ * handed out to whichever clone reads first, and replies must be
+ * written to the clone the request was read from.
+ */
+#if defined(__linux) && !defined(FUSE_DEV_IOC_CLONE)
+#define FUSE_DEV_IOC_CLONE		_IOR(229, 0, uint32_t)
+#endif
+
 #define fi_getdata(fi)			((void *)(unsigned long)(fi)->fh)
 #define fi_setdata(fi, data)		((fi)->fh = (unsigned long)(data))
 
@@ -104,12 +119,18 @@ struct psc_dynarray		 pscfs_modules;
 extern struct pscfs		 pscfs_default_ops;
 
 int				 pscfs_exit_fuse_listener;
+int				 pscfs_nthreads = NUM_THREADS;
+int				 pscfs_fuse_clonefd;	/* per-thread /dev/fuse */
+int				 pscfs_fuse_splice;	/* splice(2) read replies */
 int				 newfs_fd[2];
 int				 pscfs_nfds;
 struct pollfd			 pscfs_fds[MAX_FDS];
 static fuse_fs_info_t		 fsinfo[MAX_FDS];
 static char			*mountpoints[MAX_FDS];
-static pthread_t		 fuse_threads[NUM_THREADS];
+static pthread_t		*fuse_threads;
+#ifdef FUSE_DEV_IOC_CLONE
+static struct fuse_chan	       **fuse_clonechans;
+#endif
 struct fuse_session		*fuse_session;
 
 #ifdef HAVE_NO_POLL_DEV
@@ -403,6 +424,162 @@ pscfs_fuse_listener_loop(__unusedx void *arg)
 	return (NULL);
 }
 
+#ifdef FUSE_DEV_IOC_CLONE
+/*
+ * Channel operations for a cloned /dev/fuse descriptor.  libfuse only
+ * allows one channel per session and its kernel channel operations
+ * expect to be attached to one, so clones get their own minimal
+ * receive/send implementation.  The channel private data is the
+ * session the clone belongs to.
+ */
+static int
+pscfs_fuse_clonechan_receive(struct fuse_chan **chp, char *buf,
+    size_t size)
+{
+	struct fuse_chan *ch = *chp;
+	ssize_t rc;
+
+	rc = read(fuse_chan_fd(ch), buf, size);
+	if (rc == -1) {
+		int error = errno;
+
+		/* ENOENT: request was interrupted before being read. */
+		if (error == EINTR || error == EAGAIN || error == ENOENT)
+			return (0);
+
+		/* ENODEV: the file system was unmounted. */
+		if (error == ENODEV) {
+			fuse_session_exit(fuse_chan_data(ch));
+			return (0);
+		}
+		psclog_error("read /dev/fuse clone");
+		return (-error);
+	}
+	return (rc);
+}
+
+static int
+pscfs_fuse_clonechan_send(struct fuse_chan *ch,
+    const struct iovec iov[], size_t count)
+{
+	if (iov == NULL)
+		return (0);
+	if (writev(fuse_chan_fd(ch), iov, count) == -1) {
+		int error = errno;
+
+		/* ENOENT: request was interrupted, reply is dropped. */
+		if (error != ENOENT &&
+		    !fuse_session_exited(fuse_chan_data(ch)))
+			psclog_error("write /dev/fuse clone");
+		return (-error);
+	}
+	return (0);
+}
+
+static void
+pscfs_fuse_clonechan_destroy(struct fuse_chan *ch)
+{
+	close(fuse_chan_fd(ch));
+}
+
+static struct fuse_chan_ops pscfs_fuse_clonechan_ops = {
+	pscfs_fuse_clonechan_receive,
+	pscfs_fuse_clonechan_send,
+	pscfs_fuse_clonechan_destroy
+};
+
+/*
+ * Open another descriptor on the FUSE connection of the given file
+ * system.
+ */
+static struct fuse_chan *
+pscfs_fuse_clonechan(const fuse_fs_info_t *fs)
+{
+	struct fuse_chan *ch;
+	uint32_t srcfd;
+	int fd;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd == -1) {
+		psclog_warn("open /dev/fuse");
+		return (NULL);
+	}
+	srcfd = fs->fd;
+	if (ioctl(fd, FUSE_DEV_IOC_CLONE, &srcfd) == -1) {
+		psclog_warn("ioctl FUSE_DEV_IOC_CLONE");
+		close(fd);
+		return (NULL);
+	}
+	ch = fuse_chan_new(&pscfs_fuse_clonechan_ops, fd, fs->bufsize,
+	    fs->se);
+	if (ch == NULL)
+		close(fd);
+	return (ch);
+}
+
+/*
+ * Worker bound to its own channel on the (single) mounted file system.
+ * There is no shared poll set and no hand-off: the thread blocks in
+ * read(2) on its channel and processes whatever request it receives,
+ * so file system handlers run directly in the thread that read the
+ * request.
+ */
+static void *
+pscfs_fuse_clone_loop(void *arg)
+{
+	struct fuse_session *se = fsinfo[1].se;
+	struct fuse_chan *ch = arg, *tch;
+	size_t bufsize;
+	char *buf;
+	int res;
+
+	bufsize = fuse_chan_bufsize(ch);
+	buf = PSCALLOC(bufsize);
+	while (!pscfs_exit_fuse_listener && !fuse_session_exited(se)) {
+		tch = ch;
+		res = fuse_chan_recv(&tch, buf, bufsize);
+		if (res == -EINTR || res == -EAGAIN || res == 0)
+			continue;
+		if (res < 0)
+			break;
+		fuse_session_process(se, buf, res, tch);
+	}
+	PSCFREE(buf);
+	return (NULL);
+}
+
+/*
+ * Set up one channel per worker thread.  The first worker uses the
+ * channel created by fuse_mount(); the rest use clones.  Returns the
+ * number of channels available, which is less than requested if the
+ * kernel does not support cloning.
+ */
+static int
+pscfs_fuse_clonechans_init(int n)
+{
+	int i;
+
+	fuse_clonechans = PSCALLOC(n * sizeof(*fuse_clonechans));
+	fuse_clonechans[0] = fsinfo[1].ch;
+	for (i = 1; i < n; i++) {
+		fuse_clonechans[i] = pscfs_fuse_clonechan(&fsinfo[1]);
+		if (fuse_clonechans[i] == NULL)
+			break;
+	}
+	return (i);
+}
+
+static void
+pscfs_fuse_clonechans_destroy(int n)
+{
+	int i;
+
+	for (i = 1; i < n; i++)
+		fuse_chan_destroy(fuse_clonechans[i]);
+	PSCFREE(fuse_clonechans);
+}
+#endif
+
 #ifdef PFL_CTL
 #ifdef HAVE_FUSE_DEBUGLEVEL
 void
@@ -498,6 +675,9 @@ int
 pscfs_main(int privsiz)
 {
 	int i;
+#ifdef FUSE_DEV_IOC_CLONE
+	int nchans = 0;
+#endif
 
 	pflfs_module_add(PFLFS_MOD_POS_LAST, &pscfs_default_ops);
 
@@ -548,18 +728,60 @@ pscfs_main(int privsiz)
 	    pscfs_ctlparam_attr_timeout_set);
 #endif
 
-	for (i = 0; i < NUM_THREADS; i++)
-		psc_assert(pthread_create(&fuse_threads[i], NULL,
-		    pscfs_fuse_listener_loop, NULL) == 0);
+	if (pscfs_nthreads < 1)
+		pscfs_nthreads = 1;
+	fuse_threads = PSCALLOC(pscfs_nthreads * sizeof(*fuse_threads));
+
+#ifdef FUSE_DEV_IOC_CLONE
+	/*
+	 * In cloned descriptor mode, pick up the file system mounted by
+	 * pscfs_mount() now instead of from the listener loop since
+	 * each worker needs its own channel to it before starting.
+	 */
+	if (pscfs_fuse_clonefd && pscfs_nfds == 1) {
+		pscfs_fuse_new();
+		if (pscfs_nfds == 2) {
+			nchans = pscfs_fuse_clonechans_init(
+			    pscfs_nthreads);
+			if (nchans < pscfs_nthreads)
+				psclog_warnx("FUSE descriptor cloning "
+				    "unavailable; using shared listener");
+		}
+	}
+	if (nchans == pscfs_nthreads) {
+		psclog_info("FUSE: %d workers with cloned descriptors",
+		    nchans);
+		for (i = 0; i < pscfs_nthreads; i++)
+			psc_assert(pthread_create(&fuse_threads[i],
+			    NULL, pscfs_fuse_clone_loop,
+			    fuse_clonechans[i]) == 0);
+	} else
+#endif
+	{
+#ifdef FUSE_DEV_IOC_CLONE
+		if (nchans)
+			pscfs_fuse_clonechans_destroy(nchans);
+		nchans = 0;
+#endif
+		for (i = 0; i < pscfs_nthreads; i++)
+			psc_assert(pthread_create(&fuse_threads[i],
+			    NULL, pscfs_fuse_listener_loop, NULL) == 0);
+	}
 
 	pfl_atexit(pfl_fuse_atexit);
 
-	for (i = 0; i < NUM_THREADS; i++) {
+	for (i = 0; i < pscfs_nthreads; i++) {
 		int ret = pthread_join(fuse_threads[i], NULL);
 		if (ret != 0)
 			fprintf(stderr, "Warning: pthread_join() on "
 			    "thread %i returned %i\n", i, ret);
 	}
+	PSCFREE(fuse_threads);
+
+#ifdef FUSE_DEV_IOC_CLONE
+	if (nchans)
+		pscfs_fuse_clonechans_destroy(nchans);
+#endif
 
 #ifdef DEBUG
 	fprintf(stderr, "Exiting...\n");
@@ -1346,6 +1568,28 @@ pscfs_reply_read(struct pscfs_req *pfr, struct iovec *iov, int nio,
 			size += iov[i].iov_len;
 		pfl_opstat_add(pfr->pfr_mod->pf_opst_read_reply, size);
 
+#ifdef HAVE_FUSE_REPLY_DATA
+		/*
+		 * Let libfuse vmsplice(2) the reply pages into the
+		 * kernel instead of copying them through writev(2).
+		 * The pages are not gifted so the caller may reuse them
+		 * as soon as we return.
+		 */
+		if (pscfs_fuse_splice && nio > 0) {
+			struct fuse_bufvec *bv;
+
+			bv = PSCALLOC(sizeof(*bv) + (nio - 1) *
+			    sizeof(bv->buf[0]));
+			bv->count = nio;
+			for (i = 0; i < nio; i++) {
+				bv->buf[i].mem = iov[i].iov_base;
+				bv->buf[i].size = iov[i].iov_len;
+			}
+			PFR_REPLY(data, pfr, bv, 0);
+			PSCFREE(bv);
+			return;
+		}
+#endif
 		PFR_REPLY(iov, pfr, iov, nio);
 	}
 }
@@ -1550,6 +1794,16 @@ pscfs_mount(const char *mp, struct pscfs_args *pfa)
 	pscfs_addarg(pfa, "-o");
 	pscfs_addarg(pfa, nameopt);
 
+#ifdef HAVE_FUSE_REPLY_DATA
+	if (pscfs_fuse_splice) {
+		pscfs_addarg(pfa, "-o");
+		pscfs_addarg(pfa, "splice_write");
+	}
+#else
+	if (pscfs_fuse_splice)
+		psclog_warnx("FUSE splice not supported by this libfuse");
+#endif
+
 	ch = fuse_mount(mp, &pfa->pfa_av);
 	if (ch == NULL)
 		psc_fatal("fuse_mount");
@@ -27,6 +27,8 @@
 
 #include <sys/param.h>
 
+#include <limits.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -42,17 +44,108 @@
 struct psc_lockedlist psc_hashtbls =
     PLL_INIT_NOLOG(&psc_hashtbls, struct psc_hashtbl, pht_lentry);
 
+const int psc_hashtbl_pctls[PHT_NPCTL] = { 50, 90, 99 };
+
 #if PFL_DEBUG > 0
 # include <math.h>
 #endif
 
+/*
+ * pht_nbuckets is read without the table lock; it is published only
+ * after the bucket it covers has been populated.
+ */
+#define PHT_LOAD_NB(t)		__atomic_load_n(&(t)->pht_nbuckets, __ATOMIC_ACQUIRE)
+#define PHT_STORE_NB(t, n)	__atomic_store_n(&(t)->pht_nbuckets, (n), __ATOMIC_RELEASE)
+
 void
-_psc_hashbkt_init(struct psc_hashtbl *t, struct psc_hashbkt *b)
+_psc_hashbkt_init(struct psc_hashbkt *b)
 {
 	INIT_PSCLIST_HEAD(&b->phb_listhd);
 	INIT_SPINLOCK_NOLOG(&b->phb_lock);
 	psc_atomic32_set(&b->phb_nitems, 0);
-	b->phb_gen = t->pht_gen;
+	b->phb_refcnt = 0;
+}
+
+/*
+ * Map a bucket index to its segment: segment 0 holds the initial
+ * buckets and each later segment doubles the table.
+ */
+__static int
+_psc_hashtbl_bkt2seg(const struct psc_hashtbl *t, int i, int *off)
+{
+	int k;
+
+	if (i < t->pht_nbuckets0) {
+		*off = i;
+		return (0);
+	}
+	for (k = 1; i >= t->pht_nbuckets0 << k; k++)
+		;
+	*off = i - (t->pht_nbuckets0 << (k - 1));
+	return (k);
+}
+
+__static int
+_psc_hashtbl_segsize(const struct psc_hashtbl *t, int k)
+{
+	return (k ? t->pht_nbuckets0 << (k - 1) : t->pht_nbuckets0);
+}
+
+__static struct psc_hashbkt *
+_psc_hashtbl_getbkt(const struct psc_hashtbl *t, int i)
+{
+	int k, off;
+
+	k = _psc_hashtbl_bkt2seg(t, i, &off);
+	return (&t->pht_segs[k][off]);
+}
+
+/*
+ * Find the bucket following @b, or the first bucket if @b is NULL.
+ */
+struct psc_hashbkt *
+_psc_hashtbl_nextbkt(const struct psc_hashtbl *t,
+    const struct psc_hashbkt *b)
+{
+	int i, k, base;
+
+	if (b == NULL)
+		return (t->pht_segs[0]);
+	for (k = 0, base = 0; k < PHT_NSEGS && t->pht_segs[k];
+	    base += _psc_hashtbl_segsize(t, k), k++)
+		if (b >= t->pht_segs[k] &&
+		    b < t->pht_segs[k] + _psc_hashtbl_segsize(t, k))
+			break;
+	psc_assert(k < PHT_NSEGS && t->pht_segs[k]);
+	i = base + (b - t->pht_segs[k]) + 1;
+	if (i >= PHT_LOAD_NB(t))
+		return (NULL);
+	return (_psc_hashtbl_getbkt(t, i));
+}
+
+__static uint64_t
+_psc_hashtbl_hashkey(const struct psc_hashtbl *t, const void *key)
+{
+	return (t->pht_flags & PHTF_STR ? psc_str_hashify(key) :
+	    *(uint64_t *)key);
+}
+
+/*
+ * Compute the bucket index of a hash value in a table of @nb buckets:
+ * buckets below the split point have already been split and use the
+ * next level's modulus.
+ */
+__static int
+_psc_hashtbl_hash2bkt(const struct psc_hashtbl *t, int nb, uint64_t h)
+{
+	uint64_t lvl, i;
+
+	for (lvl = t->pht_nbuckets0; lvl * 2 <= (uint64_t)nb; lvl *= 2)
+		;
+	i = h % lvl;
+	if (i < nb - lvl)
+		i = h % (lvl * 2);
+	return (i);
 }
 
 int
@@ -81,13 +174,12 @@ _psc_hashtbl_init(struct psc_hashtbl *t, int flags,
 	memset(t, 0, sizeof(*t));
 	INIT_PSC_LISTENTRY(&t->pht_lentry);
 	INIT_SPINLOCK(&t->pht_lock);
-	_psc_waitq_init(&t->pht_waitq, flags & PHTF_NOLOG ?
-	    PWQF_NOLOG : 0);
 	t->pht_nbuckets = nb;
+	t->pht_nbuckets0 = nb;
 	if (flags & PHTF_STRP)
 		flags |= PHTF_STR;
 	t->pht_flags = flags;
-	t->pht_buckets = psc_alloc(nb * sizeof(*t->pht_buckets),
+	t->pht_segs[0] = psc_alloc(nb * sizeof(*b),
 	    _psc_hashtbl_getmemflags(t));
 	t->pht_idoff = idoff;
 	t->pht_hentoff = hentoff;
@@ -109,8 +201,8 @@ _psc_hashtbl_init(struct psc_hashtbl *t, int flags,
  }
 #endif
 
-	for (i = 0, b = t->pht_buckets; i < nb; i++, b++)
-		_psc_hashbkt_init(t, b);
+	for (i = 0, b = t->pht_segs[0]; i < nb; i++, b++)
+		_psc_hashbkt_init(b);
 	pll_add(&psc_hashtbls, t);
 }
 
@@ -138,52 +230,110 @@ psc_hashtbl_lookup(const char *name)
 void
 psc_hashtbl_destroy(struct psc_hashtbl *t)
 {
-	int i;
+	struct psc_hashbkt *b;
+	int k;
 
 	pll_remove(&psc_hashtbls, t);
-	for (i = 0; i < t->pht_nbuckets; i++)
-		if (psc_atomic32_read(&t->pht_buckets[i].phb_nitems))
+	PSC_HASHTBL_FOREACH_BUCKET(b, t)
+		if (psc_atomic32_read(&b->phb_nitems))
 			psc_fatalx("psc_hashtbl_destroy: "
 			    "hash table not empty");
-	PSCFREE(t->pht_buckets);
+	for (k = 0; k < PHT_NSEGS && t->pht_segs[k]; k++)
+		psc_free(t->pht_segs[k], _psc_hashtbl_getmemflags(t));
 }
 
-void
-psc_hashbkt_put(struct psc_hashtbl *t, struct psc_hashbkt *b)
+/*
+ * Split the next bucket in linear hashing order, moving the items
+ * that now hash to the bucket appended to the end of the table.  Only
+ * the bucket being split is locked so the rest of the table remains
+ * available.  A bucket that is referenced is skipped for now as its
+ * holder may drop the bucket lock and expect its items to remain.
+ * Returns 1 if a bucket was split, 0 if the split should be retried
+ * later, or -1 if the table cannot grow further.
+ */
+__static int
+_psc_hashtbl_split(struct psc_hashtbl *t)
 {
-	int locked;
+	struct psc_hashbkt *b, *bn;
+	int k, off, nb, src, rc = 0;
+	uint64_t lvl;
+	void *p, *pn;
 
-	psc_hashbkt_reqlock(b);
+	PSC_HASHTBL_LOCK(t);
+	if (t->pht_flags & PHTF_RESIZING) {
+		PSC_HASHTBL_ULOCK(t);
+		return (0);
+	}
+	t->pht_flags |= PHTF_RESIZING;
+	PSC_HASHTBL_ULOCK(t);
 
-	if (--b->phb_refcnt)
+	nb = t->pht_nbuckets;
+	k = nb >= INT_MAX / 2 ? PHT_NSEGS :
+	    _psc_hashtbl_bkt2seg(t, nb, &off);
+	if (k >= PHT_NSEGS) {
+		rc = -1;
 		goto out;
+	}
+	if (t->pht_segs[k] == NULL) {
+		bn = psc_alloc(_psc_hashtbl_segsize(t, k) * sizeof(*bn),
+		    _psc_hashtbl_getmemflags(t) | PAF_NOZERO);
+		for (off = 0; off < _psc_hashtbl_segsize(t, k); off++)
+			_psc_hashbkt_init(&bn[off]);
+		__atomic_store_n(&t->pht_segs[k], bn, __ATOMIC_RELEASE);
+	}
 
-	if (b->phb_gen == t->pht_gen ||
-	    (t->pht_flags & PHTF_RESIZING) == 0)
-		goto out;
+	for (lvl = t->pht_nbuckets0; lvl * 2 <= (uint64_t)nb; lvl *= 2)
+		;
+	src = nb - lvl;
+	b = _psc_hashtbl_getbkt(t, src);
+	bn = _psc_hashtbl_getbkt(t, nb);
 
-	if (b->phb_died)
+	if (!psc_hashbkt_trylock(b))
 		goto out;
-	b->phb_died = 1;
-
-	locked = PSC_HASHTBL_RLOCK(t);
-	if (--t->pht_ocntr == 0) {
-		psc_free(t->pht_obuckets, _psc_hashtbl_getmemflags(t));
-		t->pht_obuckets = NULL;
-		t->pht_flags &= ~PHTF_RESIZING;
+	if (b->phb_refcnt) {
+		psc_hashbkt_unlock(b);
+		goto out;
+	}
+	psc_hashbkt_lock(bn);
+	PSC_HASHBKT_FOREACH_ENTRY_SAFE(t, p, pn, b) {
+		if (_psc_hashtbl_hash2bkt(t, nb + 1,
+		    _psc_hashtbl_hashkey(t, PSC_AGP(p, t->pht_idoff))) ==
+		    src)
+			continue;
+		psclist_del(psc_hashent_getlentry(t, p), &b->phb_listhd);
+		psc_atomic32_dec(&b->phb_nitems);
+		psclist_add(psc_hashent_getlentry(t, p), &bn->phb_listhd);
+		psc_atomic32_inc(&bn->phb_nitems);
 	}
-	PSC_HASHTBL_URLOCK(t, locked);
-	b = NULL;
+	PHT_STORE_NB(t, nb + 1);
+	psc_hashbkt_unlock(bn);
+	psc_hashbkt_unlock(b);
+	rc = 1;
 
  out:
-	if (b)
-		psc_hashbkt_unlock(b);
-	psc_waitq_wakeall(&t->pht_waitq);
+	PSC_HASHTBL_LOCK(t);
+	t->pht_flags &= ~PHTF_RESIZING;
+	PSC_HASHTBL_ULOCK(t);
+	return (rc);
 }
 
-#define GETBKT(t, bv, nb, key)						\
-	&(bv)[ ( (t)->pht_flags & PHTF_STR ? psc_str_hashify(key) :	\
-	    *(uint64_t *)(key) ) % (nb) ]
+void
+psc_hashbkt_put(struct psc_hashtbl *t, struct psc_hashbkt *b)
+{
+	int i;
+
+	psc_hashbkt_reqlock(b);
+	psc_assert(b->phb_refcnt > 0);
+	b->phb_refcnt--;
+	psc_hashbkt_unlock(b);
+
+	if ((t->pht_flags & PHTF_NOGROW) == 0)
+		for (i = 0; i < PHT_NSPLIT &&
+		    psc_atomic32_read(&t->pht_nitems) >
+		    PHT_LOAD_NB(t) * PHT_MAXLOAD; i++)
+			if (_psc_hashtbl_split(t) <= 0)
+				break;
+}
 
 /*
  * Locate the bucket containing an item with the given ID.
@@ -194,27 +344,27 @@ struct psc_hashbkt *
 psc_hashbkt_get(struct psc_hashtbl *t, const void *key)
 {
 	struct psc_hashbkt *b;
-	int locked, gen;
-
- begin:
-	gen = t->pht_gen;
-	b = GETBKT(t, t->pht_buckets, t->pht_nbuckets, key);
-
-	if (gen != t->pht_gen)
-		goto begin;
-
-	psc_hashbkt_reqlock(b);
-	b->phb_refcnt++;
-	if (t->pht_gen != b->phb_gen) {
-		psc_hashbkt_put(t, b);
-		locked = PSC_HASHTBL_RLOCK(t);
-		while (t->pht_flags & PHTF_RESIZING)
-			psc_waitq_wait(&t->pht_waitq,
-			    &t->pht_lock);
-		PSC_HASHTBL_URLOCK(t, locked);
-		goto begin;
+	int locked, nb, i;
+	uint64_t h;
+
+	h = _psc_hashtbl_hashkey(t, key);
+	for (;;) {
+		nb = PHT_LOAD_NB(t);
+		i = _psc_hashtbl_hash2bkt(t, nb, h);
+		b = _psc_hashtbl_getbkt(t, i);
+		locked = psc_hashbkt_reqlock(b);
+
+		/*
+		 * Splitting requires the lock of the bucket being
+		 * split, so if our bucket is still the right one now,
+		 * it will stay so for as long as we hold it.
+		 */
+		if (nb == PHT_LOAD_NB(t) ||
+		    _psc_hashtbl_hash2bkt(t, PHT_LOAD_NB(t), h) == i)
+			break;
+		psc_hashbkt_ureqlock(b, locked);
 	}
-
+	b->phb_refcnt++;
 	return (b);
 }
 
@@ -267,6 +417,7 @@ _psc_hashbkt_search(struct psc_hashtbl *t, struct psc_hashbkt *b,
 		psclist_del(psc_hashent_getlentry(t, p),
 		    &b->phb_listhd);
 		psc_atomic32_dec(&b->phb_nitems);
+		psc_atomic32_dec(&t->pht_nitems);
 	}
 	ureqlock(&b->phb_lock, locked);
 	return (p);
@@ -316,6 +467,7 @@ psc_hashbkt_del_item(struct psc_hashtbl *t, struct psc_hashbkt *b,
 	psclist_del(psc_hashent_getlentry(t, p), &b->phb_listhd);
 	psc_assert(psc_atomic32_read(&b->phb_nitems) > 0);
 	psc_atomic32_dec(&b->phb_nitems);
+	psc_atomic32_dec(&t->pht_nitems);
 	ureqlock(&b->phb_lock, locked);
 }
 
@@ -325,7 +477,7 @@ psc_hashbkt_del_item(struct psc_hashtbl *t, struct psc_hashbkt *b,
  * @p: item to add.
  */
 void
-psc_hashbkt_add_item(const struct psc_hashtbl *t, struct psc_hashbkt *b,
+psc_hashbkt_add_item(struct psc_hashtbl *t, struct psc_hashbkt *b,
     void *p)
 {
 	int locked;
@@ -333,6 +485,7 @@ psc_hashbkt_add_item(const struct psc_hashtbl *t, struct psc_hashbkt *b,
 	locked = reqlock(&b->phb_lock);
 	psclist_add(psc_hashent_getlentry(t, p), &b->phb_listhd);
 	psc_atomic32_inc(&b->phb_nitems);
+	psc_atomic32_inc(&t->pht_nitems);
 	ureqlock(&b->phb_lock, locked);
 }
 
@@ -377,26 +530,41 @@ psc_hashent_conjoint(struct psc_hashtbl *t, void *p)
  * @usedbucks: value-result pointer to # of buckets in use.
  * @nents: value-result pointer to # items in hash table.
  * @maxbucklen: value-result pointer to maximum bucket length.
+ * @pctl: value-result array of the psc_hashtbl_pctls[] percentiles of
+ *	the lengths of buckets in use.
  */
 void
 psc_hashtbl_getstats(const struct psc_hashtbl *t, int *totalbucks,
-    int *usedbucks, int *nents, int *maxbucklen)
+    int *usedbucks, int *nents, int *maxbucklen, int *pctl)
 {
+	int bucklen, hist[64], i, n, k;
 	struct psc_hashbkt *b;
-	int bucklen;
 
+	memset(hist, 0, sizeof(hist));
 	*nents = 0;
 	*usedbucks = 0;
 	*maxbucklen = 0;
-	*totalbucks = t->pht_nbuckets;
+	*totalbucks = PHT_LOAD_NB(t);
 	PSC_HASHTBL_FOREACH_BUCKET(b, t) {
 		bucklen = psc_atomic32_read(&b->phb_nitems);
 		if (bucklen) {
 			++*usedbucks;
 			*nents += bucklen;
 			*maxbucklen = MAX(*maxbucklen, bucklen);
+			hist[MIN(bucklen, nitems(hist) - 1)]++;
 		}
 	}
+
+	/* lengths past the histogram are reported as the maximum */
+	for (k = 0; k < PHT_NPCTL; k++) {
+		n = (*usedbucks * psc_hashtbl_pctls[k] + 99) / 100;
+		for (i = 1; i < nitems(hist) - 1; i++)
+			if ((n -= hist[i]) <= 0)
+				break;
+		pctl[k] = i < nitems(hist) - 1 ? i : *maxbucklen;
+		if (*usedbucks == 0)
+			pctl[k] = 0;
+	}
 }
 
 /*
@@ -406,12 +574,16 @@ psc_hashtbl_getstats(const struct psc_hashtbl *t, int *totalbucks,
 void
 psc_hashtbl_prstats(const struct psc_hashtbl *t)
 {
-	int totalbucks, usedbucks, nents, maxbucklen;
+	int totalbucks, usedbucks, nents, maxbucklen, pctl[PHT_NPCTL];
 
 	psc_hashtbl_getstats(t, &totalbucks, &usedbucks, &nents,
-	    &maxbucklen);
-	printf("used %d/total %d, nents=%d, maxlen=%d\n",
-	    usedbucks, totalbucks, nents, maxbucklen);
+	    &maxbucklen, pctl);
+	printf("used %d/total %d, nents=%d, maxlen=%d, "
+	    "p%d=%d p%d=%d p%d=%d\n",
+	    usedbucks, totalbucks, nents, maxbucklen,
+	    psc_hashtbl_pctls[0], pctl[0],
+	    psc_hashtbl_pctls[1], pctl[1],
+	    psc_hashtbl_pctls[2], pctl[2]);
 }
 
 void
@@ -451,54 +623,24 @@ psc_hashtbl_estnbuckets(int n)
 	return (t);
 }
 
+/*
+ * Grow a hash table to at least the given number of buckets.  Buckets
+ * are split one at a time so lookups proceed meanwhile.  Tables grow
+ * only; a smaller size is ignored.
+ * @t: the hash table.
+ * @nb: desired number of buckets.
+ */
 void
 psc_hashtbl_resize(struct psc_hashtbl *t, int nb)
 {
-	struct psc_hashbkt *bnew, *b, *bn;
-	void *p, *pn, *pk;
-	int i, oldnb;
-
-	bnew = psc_alloc(nb * sizeof(*b), _psc_hashtbl_getmemflags(t));
+	int rc;
 
-	PSC_HASHTBL_LOCK(t);
-	while (t->pht_flags & PHTF_RESIZING) {
-		psc_waitq_wait(&t->pht_waitq, &t->pht_lock);
-		PSC_HASHTBL_LOCK(t);
-	}
-
-	t->pht_gen++;
-
-	for (b = bnew, i = 0; i < nb; i++, b++)
-		_psc_hashbkt_init(t, b);
-
-	t->pht_flags |= PHTF_RESIZING;
-	t->pht_obuckets = t->pht_buckets;
-	t->pht_ocntr = oldnb = t->pht_nbuckets;
-
-	for (i = 0, b = t->pht_buckets; i < oldnb; i++, b++) {
-		psc_hashbkt_lock(b);
-		while (b->phb_refcnt) {
-			psc_waitq_wait(&t->pht_waitq, &t->pht_lock);
-			psc_hashbkt_lock(b);
-		}
-
-		PSC_HASHBKT_FOREACH_ENTRY_SAFE(t, p, pn, b) {
-			psc_hashbkt_del_item(t, b, p);
-
-			pk = PSC_AGP(p, t->pht_idoff);
-			bn = GETBKT(t, bnew, nb, pk);
-			psc_hashbkt_add_item(t, bn, p);
-		}
-		psc_hashbkt_unlock(b);
-	}
-
-	t->pht_buckets = bnew;
-	t->pht_nbuckets = nb;
-	PSC_HASHTBL_ULOCK(t);
-
-	for (i = 0, b = t->pht_obuckets; i < oldnb; i++, b++) {
-		psc_hashbkt_lock(b);
-		b->phb_refcnt++;
-		psc_hashbkt_put(t, b);
+	while (PHT_LOAD_NB(t) < nb) {
+		rc = _psc_hashtbl_split(t);
+		if (rc == -1)
+			break;
+		/* bucket in use or concurrent split; retry */
+		if (rc == 0)
+			sched_yield();
 	}
 }
@@ -42,13 +42,24 @@
 
 #define PSC_HTNAME_MAX		32
 
+/*
+ * Tables grow by linear hashing: once the average chain exceeds
+ * PHT_MAXLOAD items, each table operation splits up to PHT_NSPLIT
+ * buckets.  Buckets live in segments that double in size and are never
+ * moved, so bucket pointers stay valid as the table grows.
+ */
+#define PHT_MAXLOAD		2
+#define PHT_NSPLIT		2
+#define PHT_NSEGS		24
+
+/* chain length percentiles reported by psc_hashtbl_getstats() */
+#define PHT_NPCTL		3
+
 struct psc_hashbkt {
 	struct psclist_head	  phb_listhd;
 	psc_spinlock_t		  phb_lock;
 	psc_atomic32_t		  phb_nitems;
-	int			  phb_refcnt:16;
-	int			  phb_gen:16;
-	int			  phb_died:1;
+	int			  phb_refcnt;
 };
 
 struct psc_hashtbl {
@@ -58,12 +69,10 @@ struct psc_hashtbl {
 	ptrdiff_t		  pht_idoff;	/* offset into item to its ID field */
 	ptrdiff_t		  pht_hentoff;	/* offset to the hash table linkage */
 	int			  pht_flags;	/* hash table flags, see below */
-	int			  pht_gen;	/* generation # */
-	int			  pht_nbuckets;
-	int			  pht_ocntr;	/* # free buckets (when resizing) */
-	struct psc_waitq	  pht_waitq;
-	struct psc_hashbkt	 *pht_buckets;
-	struct psc_hashbkt	 *pht_obuckets;	/* old buckets (when resizing */
+	int			  pht_nbuckets;	/* # buckets in use */
+	int			  pht_nbuckets0;/* initial # buckets (segment 0) */
+	psc_atomic32_t		  pht_nitems;
+	struct psc_hashbkt	 *pht_segs[PHT_NSEGS];
 	int			(*pht_cmpf)(const void *, const void *);
 };
 
@@ -74,16 +83,20 @@ struct psc_hashtbl {
 #define PHTF_RESORT	(1 << 1)	/* reorder queues on lookup */
 #define PHTF_NOMEMGUARD	(1 << 2)	/* disable memalloc guard */
 #define PHTF_NOLOG	(1 << 3)	/* do not psclog */
-#define PHTF_RESIZING	(1 << 4)
+#define PHTF_RESIZING	(1 << 4)	/* bucket split in progress */
+#define PHTF_NOGROW	(1 << 5)	/* do not grow automatically */
 
 /* Lookup flags. */
 #define PHLF_NONE	0		/* no lookup flags specified */
 #define PHLF_DEL	(1 << 0)	/* find and remove item from table */
 
+/*
+ * Walk the buckets of a table.  Items may be moved to a bucket not yet
+ * visited by a concurrent split, so a walk may encounter an item twice.
+ */
 #define PSC_HASHTBL_FOREACH_BUCKET(b, t)				\
-	for ((b) = (t)->pht_buckets;					\
-	    (b) - (t)->pht_buckets < (t)->pht_nbuckets;			\
-	    (b)++)
+	for ((b) = _psc_hashtbl_nextbkt((t), NULL); (b);		\
+	    (b) = _psc_hashtbl_nextbkt((t), (b)))
 
 #define PSC_HASHBKT_FOREACH_ENTRY(t, p, b)				\
 	psclist_for_each_entry2((p), &(b)->phb_listhd, (t)->pht_hentoff)
@@ -154,7 +167,7 @@ struct psc_hashtbl *
 	  psc_hashtbl_lookup(const char *);
 void	  psc_hashtbl_add_item(struct psc_hashtbl *, void *);
 void	  psc_hashtbl_prstats(const struct psc_hashtbl *);
-void	  psc_hashtbl_getstats(const struct psc_hashtbl *, int *, int *, int *, int *);
+void	  psc_hashtbl_getstats(const struct psc_hashtbl *, int *, int *, int *, int *, int *);
 void	  psc_hashtbl_destroy(struct psc_hashtbl *);
 void	  psc_hashtbl_resize(struct psc_hashtbl *, int);
 void	*_psc_hashtbl_search(struct psc_hashtbl *, int,
@@ -163,6 +176,9 @@ void	*_psc_hashtbl_search(struct psc_hashtbl *, int,
 void	 _psc_hashtbl_init(struct psc_hashtbl *, int, ptrdiff_t,
 	     ptrdiff_t, int, int (*)(const void *, const void *),
 	     const char *, ...);
+struct psc_hashbkt *
+	 _psc_hashtbl_nextbkt(const struct psc_hashtbl *,
+	     const struct psc_hashbkt *);
 
 /*
  * Search a bucket for an item by its hash ID.
@@ -211,7 +227,7 @@ struct psc_hashbkt *
 void	  psc_hashbkt_put(struct psc_hashtbl *, struct psc_hashbkt *);
 void	  psc_hashbkt_del_item(struct psc_hashtbl *,
 		struct psc_hashbkt *, void *);
-void	  psc_hashbkt_add_item(const struct psc_hashtbl *,
+void	  psc_hashbkt_add_item(struct psc_hashtbl *,
 		struct psc_hashbkt *, void *);
 void	*_psc_hashbkt_search(struct psc_hashtbl *, struct psc_hashbkt *,
 		int, int (*)(const void *, const void *), const void *,
@@ -240,6 +256,7 @@ struct psc_hashbkt *
 					    psc_hashent_getlentry((t), (p)))
 
 extern struct psc_lockedlist psc_hashtbls;
+extern const int psc_hashtbl_pctls[PHT_NPCTL];
 
 static __inline struct psclist_head *
 psc_hashent_getlentry(const struct psc_hashtbl *t, void *p)
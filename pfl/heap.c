@@ -42,12 +42,27 @@ _pfl_heap_swap(struct pfl_heap *ph, struct pfl_heap_entry *phe,
 }
 
 void
-pfl_heap_add(struct pfl_heap *ph, void *c)
+_pfl_heap_bubbleup(struct pfl_heap *ph, void *c)
 {
 	struct pfl_heap_entry *che, *phe;
-	size_t nalloc;
 	void *p;
 
+	che = PSC_AGP(c, ph->ph_entoff);
+	while (che->phe_idx > 0) {
+		p = ph->ph_base[(che->phe_idx - 1) / 2];
+		if (ph->ph_cmpf(p, c) != 1)
+			break;
+		phe = PSC_AGP(p, ph->ph_entoff);
+		_pfl_heap_swap(ph, phe, che);
+	}
+}
+
+void
+pfl_heap_add(struct pfl_heap *ph, void *c)
+{
+	struct pfl_heap_entry *che;
+	size_t nalloc;
+
 	psc_assert(c);
 	che = PSC_AGP(c, ph->ph_entoff);
 	if (ph->ph_nitems == ph->ph_nalloc) {
@@ -57,14 +72,7 @@ pfl_heap_add(struct pfl_heap *ph, void *c)
 		ph->ph_nalloc = nalloc;
 	}
 	ph->ph_base[che->phe_idx = ph->ph_nitems++] = c;
-	/* bubble up */
-	while (che->phe_idx > 0) {
-		p = ph->ph_base[(che->phe_idx - 1) / 2];
-		if (ph->ph_cmpf(p, c) != 1)
-			break;
-		phe = PSC_AGP(p, ph->ph_entoff);
-		_pfl_heap_swap(ph, phe, che);
-	}
+	_pfl_heap_bubbleup(ph, c);
 }
 
 void
@@ -78,10 +86,20 @@ pfl_heap_remove(struct pfl_heap *ph, void *p)
 
 	psc_assert(p);
 	phe = PSC_AGP(p, ph->ph_entoff);
-	p = ph->ph_base[idx = phe->phe_idx] =
-	    ph->ph_base[--ph->ph_nitems];
+	idx = phe->phe_idx;
+	if (idx == --ph->ph_nitems)
+		return;
+	p = ph->ph_base[idx] = ph->ph_base[ph->ph_nitems];
 	phe = PSC_AGP(p, ph->ph_entoff);
 	phe->phe_idx = idx;
+
+	/*
+	 * The item moved into the hole came from the bottom of the heap
+	 * but not necessarily from below the removed item, so it may
+	 * belong further up as well as further down.
+	 */
+	_pfl_heap_bubbleup(ph, p);
+
 	/* bubble down */
 	for (;;) {
 		for (minc = p, idx = phe->phe_idx * 2 + 1, i = 0;
@@ -144,6 +162,14 @@ pfl_heap_nitems(struct pfl_heap *ph)
 	return (ph->ph_nitems);
 }
 
+void
+pfl_heap_destroy(struct pfl_heap *ph)
+{
+	psc_assert(ph->ph_nitems == 0);
+	PSCFREE(ph->ph_base);
+	ph->ph_nalloc = 0;
+}
+
 void
 _pfl_heap_init(struct pfl_heap *ph, int entoff,
     int (*cmpf)(const void *, const void *))
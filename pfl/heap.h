@@ -51,6 +51,7 @@ struct pfl_heap_entry {
 	_pfl_heap_init((hp), offsetof(type, memb), cmpf)
 
 void	 pfl_heap_add(struct pfl_heap *, void *);
+void	 pfl_heap_destroy(struct pfl_heap *);
 void	_pfl_heap_init(struct pfl_heap *, int, int (*)(const void *, const void *));
 int	 pfl_heap_nitems(struct pfl_heap *);
 void	*pfl_heap_peek(struct pfl_heap *);
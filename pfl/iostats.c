@@ -25,6 +25,7 @@
  * %PSC_END_COPYRIGHT%
  */
 
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -38,6 +39,26 @@
 
 struct psc_spinlock	pfl_opstats_lock = SPINLOCK_INIT;
 struct psc_dynarray	pfl_opstats = DYNARRAY_INIT;
+struct psc_dynarray	pfl_opstat_hists = DYNARRAY_INIT;
+
+/* shard + 1 of this thread, assigned on first sharded update */
+__threadx int		pfl_opstat_shardidx;
+psc_atomic32_t		pfl_opstat_nextshard = PSC_ATOMIC32_INIT(0);
+
+/*
+ * Shard slots are carved out of slabs holding PFL_OPSTAT_SLABSLOTS
+ * counters for each shard, laid out shard-major so counters sharing a
+ * cache line are only ever updated by threads of the same shard.
+ * Slots of destroyed opstats are recycled.
+ */
+static psc_atomic64_t	*pfl_opstat_slab;
+static int		 pfl_opstat_slabnext = PFL_OPSTAT_SLABSLOTS;
+static struct psc_dynarray pfl_opstat_freeslots = DYNARRAY_INIT;
+
+/* per-mille ranks reported for each histogram */
+static const int	pfl_opstat_hist_pctl[PFL_OPHIST_NPCTL] = {
+	500, 900, 990, 999
+};
 
 int
 _pfl_opstat_cmp(const void *a, const void *b)
@@ -48,6 +69,31 @@ _pfl_opstat_cmp(const void *a, const void *b)
 	return (strcmp(name, opst->opst_name));
 }
 
+/*
+ * Obtain the shard 0 slot for a new sharded opstat.  Must be called
+ * with pfl_opstats_lock held.
+ */
+static psc_atomic64_t *
+_pfl_opstat_getslot(void)
+{
+	psc_atomic64_t *slot;
+	int n;
+
+	n = psc_dynarray_len(&pfl_opstat_freeslots);
+	if (n) {
+		slot = psc_dynarray_getpos(&pfl_opstat_freeslots, n - 1);
+		psc_dynarray_removepos(&pfl_opstat_freeslots, n - 1);
+		return (slot);
+	}
+	if (pfl_opstat_slabnext == PFL_OPSTAT_SLABSLOTS) {
+		pfl_opstat_slab = psc_alloc(PFL_OPSTAT_NSHARDS *
+		    PFL_OPSTAT_SLABSLOTS * sizeof(*pfl_opstat_slab),
+		    PAF_PAGEALIGN);
+		pfl_opstat_slabnext = 0;
+	}
+	return (&pfl_opstat_slab[pfl_opstat_slabnext++]);
+}
+
 struct pfl_opstat *
 pfl_opstat_initf(int flags, const char *namefmt, ...)
 {
@@ -74,6 +120,8 @@ pfl_opstat_initf(int flags, const char *namefmt, ...)
 	opst = PSCALLOC(sizeof(*opst));
 	opst->opst_name = name;
 	opst->opst_flags = flags;
+	if (flags & OPSTF_SHARDED)
+		opst->opst_shards = _pfl_opstat_getslot();
 	psc_dynarray_splice(&pfl_opstats, pos, 0, &opst, 1);
 	freelock(&pfl_opstats_lock);
 	return (opst);
@@ -82,18 +130,205 @@ pfl_opstat_initf(int flags, const char *namefmt, ...)
 void
 pfl_opstat_destroy(struct pfl_opstat *opst)
 {
-	int pos;
+	int pos, i;
 
 	spinlock(&pfl_opstats_lock);
 	pos = psc_dynarray_bsearch(&pfl_opstats, opst->opst_name,
 	    _pfl_opstat_cmp);
 	psc_assert(psc_dynarray_getpos(&pfl_opstats, pos) == opst);
 	psc_dynarray_splice(&pfl_opstats, pos, 1, NULL, 0);
+	if (opst->opst_shards) {
+		for (i = 0; i < PFL_OPSTAT_NSHARDS; i++)
+			psc_atomic64_set(PFL_OPSTAT_SHARD(opst, i), 0);
+		psc_dynarray_add(&pfl_opstat_freeslots,
+		    opst->opst_shards);
+	}
 	freelock(&pfl_opstats_lock);
 	PSCFREE(opst->opst_name);
 	PSCFREE(opst);
 }
 
+int
+_pfl_opstat_getshard(void)
+{
+	return (psc_atomic32_inc_getnew(&pfl_opstat_nextshard) %
+	    PFL_OPSTAT_NSHARDS + 1);
+}
+
+/*
+ * Move any pending per-thread deltas of a sharded opstat into its
+ * lifetime counter.
+ */
+void
+pfl_opstat_fold(struct pfl_opstat *opst)
+{
+	int64_t n = 0;
+	int i;
+
+	if (opst->opst_shards == NULL)
+		return;
+	for (i = 0; i < PFL_OPSTAT_NSHARDS; i++)
+		n += psc_atomic64_xchg(PFL_OPSTAT_SHARD(opst, i), 0);
+	if (n)
+		psc_atomic64_add(&opst->opst_lifetime, n);
+}
+
+/*
+ * Map a sample to its histogram bucket: values below PFL_OPHIST_NSUB
+ * are exact and every power of two above is split into PFL_OPHIST_NSUB
+ * equal sub-buckets, bounding relative error by 1/PFL_OPHIST_NSUB.
+ */
+int
+pfl_opstat_hist_bucket(uint64_t v)
+{
+	int msb;
+
+	if (v < PFL_OPHIST_NSUB)
+		return (v);
+	msb = 63 - __builtin_clzll(v);
+	return (PFL_OPHIST_NSUB * (msb - PFL_OPHIST_SUBBITS + 1) +
+	    ((v >> (msb - PFL_OPHIST_SUBBITS)) & (PFL_OPHIST_NSUB - 1)));
+}
+
+/*
+ * Obtain the range [lo, hi] of values covered by a histogram bucket.
+ */
+void
+pfl_opstat_hist_bounds(int i, uint64_t *lo, uint64_t *hi)
+{
+	int shift;
+
+	if (i < PFL_OPHIST_NSUB) {
+		*lo = *hi = i;
+		return;
+	}
+	shift = i / PFL_OPHIST_NSUB - 1;
+	*lo = (uint64_t)(PFL_OPHIST_NSUB + i % PFL_OPHIST_NSUB) << shift;
+	*hi = *lo + (UINT64_C(1) << shift) - 1;
+}
+
+/*
+ * Find a registered histogram by name.  Must be called with
+ * pfl_opstats_lock held.
+ */
+static struct pfl_opstat_hist *
+_pfl_opstat_hist_lookup(const char *name)
+{
+	struct pfl_opstat_hist *oph;
+	int i;
+
+	DYNARRAY_FOREACH(oph, i, &pfl_opstat_hists)
+		if (strcmp(oph->oph_name, name) == 0)
+			return (oph);
+	return (NULL);
+}
+
+struct pfl_opstat_hist *
+pfl_opstat_hist_init(int flags, const char *name)
+{
+	struct pfl_opstat_hist *oph, *t;
+	int i;
+
+	spinlock(&pfl_opstats_lock);
+	oph = _pfl_opstat_hist_lookup(name);
+	freelock(&pfl_opstats_lock);
+	if (oph)
+		return (oph);
+
+	oph = PSCALLOC(sizeof(*oph));
+	oph->oph_name = pfl_strdup(name);
+	oph->oph_flags = flags | OPSTF_SHARDED;
+	oph->oph_sum = pfl_opstat_initf(oph->oph_flags, "%s", name);
+	oph->oph_count = pfl_opstat_initf(oph->oph_flags, "%s-count",
+	    name);
+	for (i = 0; i < PFL_OPHIST_NPCTL; i++)
+		oph->oph_pctl[i] = pfl_opstat_initf(flags | OPSTF_NORATE,
+		    "%s-p%d.%d", name, pfl_opstat_hist_pctl[i] / 10,
+		    pfl_opstat_hist_pctl[i] % 10);
+
+	/*
+	 * Another thread may have registered the same histogram while
+	 * the lock was dropped.  Its opstats are the ones just looked
+	 * up by name, so only our container needs to be discarded.
+	 */
+	spinlock(&pfl_opstats_lock);
+	t = _pfl_opstat_hist_lookup(name);
+	if (t == NULL)
+		psc_dynarray_add(&pfl_opstat_hists, oph);
+	freelock(&pfl_opstats_lock);
+	if (t) {
+		PSCFREE(oph->oph_name);
+		PSCFREE(oph);
+		oph = t;
+	}
+	return (oph);
+}
+
+void
+pfl_opstat_hist_add(struct pfl_opstat_hist *oph, int64_t v)
+{
+	struct pfl_opstat *opst;
+	uint64_t lo, hi;
+	int i;
+
+	if (v < 0)
+		v = 0;
+	i = pfl_opstat_hist_bucket(v);
+	opst = oph->oph_buckets[i];
+	if (opst == NULL) {
+		/*
+		 * Racing initializers receive the same opstat by name
+		 * so the duplicate store is harmless.
+		 */
+		pfl_opstat_hist_bounds(i, &lo, &hi);
+		opst = pfl_opstat_initf(oph->oph_flags,
+		    "%s:%03d:%"PRIu64"-%"PRIu64, oph->oph_name, i, lo,
+		    hi);
+		oph->oph_buckets[i] = opst;
+	}
+	pfl_opstat_incr(opst);
+	pfl_opstat_incr(oph->oph_count);
+	pfl_opstat_add(oph->oph_sum, v);
+}
+
+/*
+ * Recompute the published percentiles of a histogram from its
+ * buckets.  Each is reported as the upper bound of the bucket holding
+ * that rank.
+ */
+void
+pfl_opstat_hist_update(struct pfl_opstat_hist *oph)
+{
+	int64_t cnt[PFL_OPHIST_NBUCKETS], total = 0, cum, rank;
+	uint64_t lo, hi;
+	int i, j;
+
+	for (i = 0; i < PFL_OPHIST_NBUCKETS; i++) {
+		cnt[i] = 0;
+		if (oph->oph_buckets[i] == NULL)
+			continue;
+		pfl_opstat_fold(oph->oph_buckets[i]);
+		cnt[i] = psc_atomic64_read(
+		    &oph->oph_buckets[i]->opst_lifetime);
+		total += cnt[i];
+	}
+	if (total == 0)
+		return;
+
+	for (j = 0, i = 0, cum = 0; j < PFL_OPHIST_NPCTL; j++) {
+		rank = (total * pfl_opstat_hist_pctl[j] + 999) / 1000;
+		for (; i < PFL_OPHIST_NBUCKETS; i++) {
+			if (cum + cnt[i] >= rank)
+				break;
+			cum += cnt[i];
+		}
+		if (i == PFL_OPHIST_NBUCKETS)
+			i--;
+		pfl_opstat_hist_bounds(i, &lo, &hi);
+		psc_atomic64_set(&oph->oph_pctl[j]->opst_lifetime, hi);
+	}
+}
+
 void
 pfl_iostats_grad_init(struct pfl_iostats_grad *ist0, int flags,
     const char *prefix)
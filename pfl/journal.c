@@ -27,6 +27,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <err.h>
 #include <errno.h>
@@ -59,11 +60,23 @@ struct psc_journalthr {
 	struct psc_journal *pjt_pj;
 };
 
+/*
+ * A log entry queued for group commit.  These live on the stack of the
+ * writer, which does not return until the batch holding it is durable.
+ */
+struct pjournal_gcent {
+	struct psclist_head		 pge_lentry;
+	struct psc_journal_enthdr	*pge_pje;
+	uint32_t			 pge_slot;
+	int				 pge_done;
+};
+
 __static void		pjournal_logwrite(struct psc_journal_xidhndl *, int,
 				struct psc_journal_enthdr *, int);
 
-__static int		pjournal_logwrite_internal(struct psc_journal *,
-				struct psc_journal_enthdr *, uint32_t);
+__static void		pjournal_logwrite_internal(struct psc_journal *,
+				struct psc_journal_xidhndl *,
+				struct psc_journal_enthdr *);
 
 psc_spinlock_t		pjournal_count = SPINLOCK_INIT;
 psc_spinlock_t		pjournal_reserve = SPINLOCK_INIT;
@@ -73,6 +86,9 @@ psc_spinlock_t		pjournal_waitqlock = SPINLOCK_INIT;
 struct psc_lockedlist	pfl_journals = PLL_INIT(&pfl_journals,
 				struct psc_journal, pj_lentry);
 
+/* # of distilled entries held before forcing the handler to flush */
+#define PJ_DISTILL_MAXSTAGED	256
+
 #define JIO_READ	0
 #define JIO_WRITE	1
 
@@ -82,6 +98,32 @@ struct psc_lockedlist	pfl_journals = PLL_INIT(&pfl_journals,
 struct psc_poolmaster	 pfl_xidhndl_poolmaster;
 struct psc_poolmgr	*pfl_xidhndl_pool;
 
+/**
+ * psc_journal_sync - Flush a range of the journal store to stable
+ *	storage.
+ * @pj: the journal.
+ * @len: length of range.
+ * @off: offset into backing store.
+ */
+__static int
+psc_journal_sync(struct psc_journal *pj, size_t len, off_t off)
+{
+	int rc;
+
+	if (pj->pj_flags & PJF_ISBLKDEV) {
+#ifdef HAVE_SYNC_FILE_RANGE
+		rc = sync_file_range(pj->pj_fd, off, len,
+		    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+		(void)len;
+		(void)off;
+		rc = fdatasync(pj->pj_fd);
+#endif
+	} else
+		rc = fsync(pj->pj_fd);
+	return (rc == -1 ? errno : 0);
+}
+
 /**
  * psc_journal_io - Perform a low-level I/O operation on the journal store.
  * @pj: the journal.
@@ -129,17 +171,7 @@ psc_journal_io(struct psc_journal *pj, void *p, size_t len, off_t off,
 
 		if (rw == JIO_WRITE) {
 			PFL_GETTIMESPEC(&ts[0]);
-			if (pj->pj_flags & PJF_ISBLKDEV) {
-#ifdef HAVE_SYNC_FILE_RANGE
-				rc = sync_file_range(pj->pj_fd, off,
-				    len, SYNC_FILE_RANGE_WRITE |
-				    SYNC_FILE_RANGE_WAIT_AFTER);
-#else
-				rc = fdatasync(pj->pj_fd);
-#endif
-			} else
-				rc = fsync(pj->pj_fd);
-
+			rc = psc_journal_sync(pj, len, off);
 			PFL_GETTIMESPEC(&ts[1]);
 			timespecsub(&ts[1], &ts[0], &synctime);
 
@@ -456,18 +488,151 @@ pjournal_put_buf(struct psc_journal *pj, void *buf)
 }
 
 /**
- * pjournal_logwrite_internal - Write a new log entry for a transaction.
+ * pjournal_gc_hist - Find the histogram bucket for a value given a
+ *	bucket base and a power-of-two growth factor.
+ */
+__static int
+pjournal_gc_hist(uint64_t v, uint64_t base, int shift)
+{
+	int i;
+
+	for (i = 0; i < PJ_NHIST - 1 && v >= base; i++)
+		base <<= shift;
+	return (i);
+}
+
+/**
+ * pjournal_gc_flush - Write out the oldest batch of queued log entries
+ *	with one vectored write per contiguous slot run and one flush.
+ * @pj: the journal, with pj_gclock held, which is reacquired on
+ *	return.
+ */
+__static void
+pjournal_gc_flush(struct psc_journal *pj)
+{
+	struct pjournal_gcent *e, *batch[PJ_MAX_BATCH];
+	struct timespec ts0, ts1, tsd;
+	struct iovec iov[PJ_MAX_BATCH];
+	int i, n, run, nruns, rc = 0, ntries;
+	int runstart[2], runlen[2];
+	uint64_t usecs;
+	ssize_t nb;
+	size_t len;
+
+	pj->pj_gcflushing = 1;
+
+	/*
+	 * Optionally linger so that writers arriving shortly after
+	 * us share the same device flush.
+	 */
+	if (pj->pj_commit_usecs > 0 && pj->pj_gcqlen < PJ_MAX_BATCH) {
+		psc_waitq_waitrel_us(&pj->pj_gcleadwq, &pj->pj_gclock,
+		    pj->pj_commit_usecs);
+		spinlock(&pj->pj_gclock);
+	}
+
+	/*
+	 * Slots were assigned in queue order so the batch occupies a
+	 * contiguous range, except when it wraps around the end of
+	 * the journal.
+	 */
+	n = 0;
+	nruns = 0;
+	while (n < PJ_MAX_BATCH && (e = psc_listhd_first_obj(
+	    &pj->pj_gcq, struct pjournal_gcent, pge_lentry)) != NULL) {
+		psclist_del(&e->pge_lentry, &pj->pj_gcq);
+		pj->pj_gcqlen--;
+		if (n == 0 || e->pge_slot != batch[n - 1]->pge_slot + 1) {
+			psc_assert(nruns < 2);
+			runstart[nruns] = n;
+			runlen[nruns++] = 0;
+		}
+		runlen[nruns - 1]++;
+		iov[n].iov_base = e->pge_pje;
+		iov[n].iov_len = PJ_PJESZ(pj);
+		batch[n++] = e;
+	}
+	freelock(&pj->pj_gclock);
+
+	PFL_GETTIMESPEC(&ts0);
+	for (run = 0; run < nruns && rc == 0; run++) {
+		i = runstart[run];
+		len = (size_t)runlen[run] * PJ_PJESZ(pj);
+		for (ntries = PJ_MAX_TRY; ntries > 0; ntries--) {
+			nb = pwritev(pj->pj_fd, &iov[i], runlen[run],
+			    PJ_GETENTOFF(pj, batch[i]->pge_slot));
+			if (nb == -1)
+				rc = errno;
+			else if ((size_t)nb != len)
+				rc = ENOSPC;
+			else
+				rc = 0;
+			if (rc != EAGAIN)
+				break;
+			usleep(100);
+		}
+		if (rc)
+			psc_fatalx("failed writing journal log entries at "
+			    "slots %u-%u: %s", batch[i]->pge_slot,
+			    batch[i]->pge_slot + runlen[run] - 1,
+			    strerror(rc));
+		pfl_opstat_add(pj->pj_iostats.wr, len);
+	}
+	for (run = 0; run < nruns; run++) {
+		i = runstart[run];
+		rc = psc_journal_sync(pj,
+		    (size_t)runlen[run] * PJ_PJESZ(pj),
+		    PJ_GETENTOFF(pj, batch[i]->pge_slot));
+		if (rc)
+			psc_fatalx("failed flushing journal log entries: "
+			    "%s", strerror(rc));
+		/* a full flush covers both runs */
+		if (!(pj->pj_flags & PJF_ISBLKDEV))
+			break;
+	}
+	PFL_GETTIMESPEC(&ts1);
+	timespecsub(&ts1, &ts0, &tsd);
+	usecs = tsd.tv_sec * UINT64_C(1000000) + tsd.tv_nsec / 1000;
+
+	pfl_opstat_incr(pj->pj_gcbatches);
+	pfl_opstat_add(pj->pj_gcentries, n);
+	pfl_opstat_add(pj->pj_gcflushus, usecs);
+	pfl_opstat_incr(pj->pj_gcbatchhist[pjournal_gc_hist(n, 2, 1)]);
+	pfl_opstat_incr(pj->pj_gcflushhist[pjournal_gc_hist(usecs, 16,
+	    2)]);
+
+	psclog_diag("group commit slot=%u nents=%d nruns=%d "
+	    "flush="PSCPRI_TIMESPEC, batch[0]->pge_slot, n, nruns,
+	    PFLPRI_PTIMESPEC_ARGS(&tsd));
+
+	spinlock(&pj->pj_gclock);
+	for (i = 0; i < n; i++) {
+		DPRINTF_PJE(PLL_DEBUG, batch[i]->pge_pje, "written "
+		    "successfully slot=%d", batch[i]->pge_slot);
+		batch[i]->pge_done = 1;
+	}
+	pj->pj_gcflushing = 0;
+	psc_waitq_wakeall(&pj->pj_gcwaitq);
+}
+
+/**
+ * pjournal_logwrite_internal - Write a new log entry for a transaction
+ *	and wait until it is on stable storage.
  * @pj: the journal.
+ * @xh: transaction, which is assigned its slot here.
  * @pje: the log entry to be written.
- * @slot: the slot to contain the entry.
- * Returns: 0 on success, -1 on error.
+ *
+ * Concurrent writers are batched: each queues its entry in slot order
+ * and the first to find no write in progress becomes the leader which
+ * commits everything queued so far, while the rest sleep until a
+ * leader has made their entry durable.
  */
-__static int
+__static void
 pjournal_logwrite_internal(struct psc_journal *pj,
-    struct psc_journal_enthdr *pje, uint32_t slot)
+    struct psc_journal_xidhndl *xh, struct psc_journal_enthdr *pje)
 {
+	struct pjournal_gcent e;
 	uint64_t chksum;
-	int rc, ntries;
 
 	/* calculate the CRC checksum, excluding the checksum field itself */
 	psc_crc64_init(&chksum);
@@ -477,33 +642,26 @@ pjournal_logwrite_internal(struct psc_journal *pj,
 	psc_crc64_fini(&chksum);
 	pje->pje_chksum = chksum;
 
-	/* commit the log entry on disk before we can return */
-	ntries = PJ_MAX_TRY;
-	while (ntries > 0) {
-		psclog_vdebug("io_start slot=%u", slot);
-		rc = psc_journal_write(pj, pje, PJ_PJESZ(pj),
-		    PJ_GETENTOFF(pj, slot));
-		psclog_vdebug("io_done slot=%u (rc=%d)", slot, rc);
-		if (rc == EAGAIN) {
-			ntries--;
-			usleep(100);
+	memset(&e, 0, sizeof(e));
+	INIT_PSC_LISTENTRY(&e.pge_lentry);
+	e.pge_pje = pje;
+
+	spinlock(&pj->pj_gclock);
+	pjournal_next_slot(xh);
+	e.pge_slot = xh->pjx_slot;
+	psclist_add_tail(&e.pge_lentry, &pj->pj_gcq);
+	if (++pj->pj_gcqlen >= PJ_MAX_BATCH && pj->pj_gcflushing)
+		psc_waitq_wakeone(&pj->pj_gcleadwq);
+
+	while (!e.pge_done) {
+		if (!pj->pj_gcflushing) {
+			pjournal_gc_flush(pj);
 			continue;
 		}
-		break;
+		psc_waitq_wait(&pj->pj_gcwaitq, &pj->pj_gclock);
+		spinlock(&pj->pj_gclock);
 	}
-
-	/*
-	 * We may want to turn off logging at this point and force
-	 * write-through instead.
-	 */
-	if (rc)
-		psc_fatalx("failed writing journal log entry at "
-		    "slot %d, tries=%d: %s", slot, ntries,
-		    strerror(rc));
-	else
-		DPRINTF_PJE(PLL_DEBUG, pje, "written successfully "
-		    "slot=%d", slot);
-	return (0);
+	freelock(&pj->pj_gclock);
 }
 
 /**
@@ -517,7 +675,6 @@ __static void
 pjournal_logwrite(struct psc_journal_xidhndl *xh, int type,
     struct psc_journal_enthdr *pje, int size)
 {
-	static psc_spinlock_t writelock = SPINLOCK_INIT;
 	struct psc_journal *pj;
 
 	pj = xh->pjx_pj;
@@ -534,11 +691,7 @@ pjournal_logwrite(struct psc_journal_xidhndl *xh, int type,
 	pje->pje_xid = xh->pjx_xid;
 	pje->pje_txg = xh->pjx_txg;
 
-	/* paranoid: make sure that an earlier slot is written first. */
-	spinlock(&writelock);
-	pjournal_next_slot(xh);
-	pjournal_logwrite_internal(pj, pje, xh->pjx_slot);
-	freelock(&writelock);
+	pjournal_logwrite_internal(pj, xh, pje);
 
 	/*
 	 * If this log entry needs further processing, hand it
@@ -715,6 +868,41 @@ pjournal_scan_slots(struct psc_journal *pj)
 	return (rc);
 }
 
+/**
+ * pjournal_gc_initstats - Register group commit counters and the
+ *	batch size and flush latency histograms, named after the
+ *	graduated I/O stats so they sort together.
+ */
+__static void
+pjournal_gc_initstats(struct psc_journal *pj, const char *basefn)
+{
+	uint64_t lo, hi;
+	int i;
+
+	pj->pj_gcbatches = pfl_opstat_initf(OPSTF_BASE10,
+	    "jrnlgc-%s-batches", basefn);
+	pj->pj_gcentries = pfl_opstat_initf(OPSTF_BASE10,
+	    "jrnlgc-%s-entries", basefn);
+	pj->pj_gcflushus = pfl_opstat_initf(OPSTF_BASE10,
+	    "jrnlgc-%s-flush-usecs", basefn);
+
+	for (i = 0, lo = 1, hi = 2; i < PJ_NHIST - 1;
+	    i++, lo = hi, hi <<= 1)
+		pj->pj_gcbatchhist[i] = pfl_opstat_initf(OPSTF_BASE10,
+		    "jrnlgc-%s-nent:%d:%"PRIu64"-<%"PRIu64, basefn, i,
+		    lo, hi);
+	pj->pj_gcbatchhist[i] = pfl_opstat_initf(OPSTF_BASE10,
+	    "jrnlgc-%s-nent:%d:>=%"PRIu64, basefn, i, lo);
+
+	for (i = 0, lo = 0, hi = 16; i < PJ_NHIST - 1;
+	    i++, lo = hi, hi <<= 2)
+		pj->pj_gcflushhist[i] = pfl_opstat_initf(OPSTF_BASE10,
+		    "jrnlgc-%s-flush:%d:%"PRIu64"-<%"PRIu64"us", basefn,
+		    i, lo, hi);
+	pj->pj_gcflushhist[i] = pfl_opstat_initf(OPSTF_BASE10,
+	    "jrnlgc-%s-flush:%d:>=%"PRIu64"us", basefn, i, lo);
+}
+
 /**
  * pjournal_open - Initialize the in-memory representation of a journal.
  * @fn: path to journal on file system.
@@ -746,6 +934,10 @@ pjournal_open(const char *name, const char *fn)
 		basefn = fn;
 	pj->pj_iostats.rd = pfl_opstat_init("jrnlrd-%s", basefn);
 	pj->pj_iostats.wr = pfl_opstat_init("jrnlwr-%s", basefn);
+	pj->pj_opst_distlag = pfl_opstat_init("jrnl-distill-lag-%s",
+	    basefn);
+	pj->pj_opst_inuse = pfl_opstat_init("jrnl-slots-inuse-%s",
+	    basefn);
 
 	/*
 	 * O_DIRECT may impose alignment restrictions so align the
@@ -809,6 +1001,13 @@ pjournal_open(const char *name, const char *fn)
 	psc_waitq_init(&pj->pj_waitq);
 	psc_dynarray_init(&pj->pj_bufs);
 
+	INIT_SPINLOCK(&pj->pj_gclock);
+	INIT_PSCLIST_HEAD(&pj->pj_gcq);
+	psc_waitq_init(&pj->pj_gcwaitq);
+	psc_waitq_init(&pj->pj_gcleadwq);
+	pj->pj_commit_usecs = PJ_COMMIT_USECS;
+	pjournal_gc_initstats(pj, basefn);
+
 	pll_add(&pfl_journals, pj);
 
 	psc_poolmaster_init(&pfl_xidhndl_poolmaster,
@@ -844,25 +1043,188 @@ pjournal_release(struct psc_journal *pj)
 	PSCFREE(pj);
 }
 
+/*
+ * Distill shard state.  Every distilled entry is handed to each shard
+ * in xid order; the application's handler decides which part of the
+ * entry belongs to which shard, so anything that must stay ordered
+ * (e.g. appends to one log) is processed by a single shard.
+ */
+struct pjournal_distiller {
+	struct psc_journal		 *pjd_pj;
+	int				  pjd_shard;
+	psc_spinlock_t			  pjd_lock;
+	struct psc_waitq		  pjd_waitq;
+	struct psc_journal_xidhndl	**pjd_ring;	/* queued entries */
+	uint32_t			  pjd_nring;
+	uint32_t			  pjd_head;
+	uint32_t			  pjd_tail;
+	uint64_t			  pjd_xid;	/* last xid released */
+};
+
+/*
+ * Release distilled transactions once the distill handler has written
+ * them out.  A transaction leaves the journal only after every shard
+ * has released it.
+ */
+__static void
+pjournal_release_staged(struct pjournal_distiller *pjd,
+    struct psc_dynarray *staged)
+{
+	struct psc_journal *pj = pjd->pjd_pj;
+	struct psc_journal_xidhndl *xh;
+	uint64_t txg, xid = 0;
+	int i;
+
+	PJ_LOCK(pj);
+	txg = pj->pj_current_txg + 1;
+	PJ_ULOCK(pj);
+
+	/*
+	 * Once we clear the distill flag, xh can be freed after its
+	 * associated txg has been committed by the ZFS.
+	 */
+	DYNARRAY_FOREACH(xh, i, staged) {
+		spinlock(&xh->pjx_lock);
+		xid = xh->pjx_xid;
+
+		if (txg > xh->pjx_txg)
+			xh->pjx_txg = txg;
+
+		psc_assert(xh->pjx_ndistill > 0);
+		if (--xh->pjx_ndistill == 0)
+			xh->pjx_flags &= ~PJX_DISTILL;
+		freelock(&xh->pjx_lock);
+	}
+	psc_dynarray_reset(staged);
+
+	spinlock(&pjd->pjd_lock);
+	psc_assert(pjd->pjd_xid < xid);
+	pjd->pjd_xid = xid;
+	freelock(&pjd->pjd_lock);
+
+	spinlock(&pjournal_waitqlock);
+	psc_waitq_wakeall(&pjournal_waitq);
+	freelock(&pjournal_waitqlock);
+}
+
+void
+pjournal_distillthr_main(struct psc_thread *thr)
+{
+	struct psc_dynarray staged = DYNARRAY_INIT;
+	struct pjournal_distiller *pjd;
+	struct psc_journal_enthdr *pje;
+	struct psc_journal_xidhndl *xh;
+	struct psc_journal *pj;
+	int rc, last;
+
+	pjd = thr->pscthr_private;
+	pj = pjd->pjd_pj;
+	while (pscthr_run(thr)) {
+		spinlock(&pjd->pjd_lock);
+		if (pjd->pjd_head == pjd->pjd_tail) {
+			if (psc_dynarray_len(&staged)) {
+				freelock(&pjd->pjd_lock);
+				rc = pj->pj_distill_handler(NULL,
+				    pjd->pjd_shard, pj->pj_npeers, 0);
+				psc_assert(rc != PJ_DISTILL_STAGED);
+				pjournal_release_staged(pjd, &staged);
+				continue;
+			}
+			psc_waitq_waitrel_s(&pjd->pjd_waitq,
+			    &pjd->pjd_lock, 30);
+			continue;
+		}
+		xh = pjd->pjd_ring[pjd->pjd_head];
+		pjd->pjd_head = (pjd->pjd_head + 1) % pjd->pjd_nring;
+		freelock(&pjd->pjd_lock);
+
+		pje = xh->pjx_data;
+		rc = pj->pj_distill_handler(pje, pjd->pjd_shard,
+		    pj->pj_npeers, 0);
+
+		spinlock(&xh->pjx_lock);
+		last = --xh->pjx_nhandle == 0;
+		if (last)
+			xh->pjx_data = NULL;
+		freelock(&xh->pjx_lock);
+		if (last)
+			pjournal_put_buf(pj, PJE_DATA(pje));
+
+		/*
+		 * Until the handler has written out what it distilled,
+		 * the entry must stay in the journal.
+		 */
+		psc_dynarray_add(&staged, xh);
+		if (rc == PJ_DISTILL_STAGED &&
+		    psc_dynarray_len(&staged) >= PJ_DISTILL_MAXSTAGED)
+			rc = pj->pj_distill_handler(NULL,
+			    pjd->pjd_shard, pj->pj_npeers, 0);
+		if (rc != PJ_DISTILL_STAGED)
+			pjournal_release_staged(pjd, &staged);
+	}
+}
+
+/*
+ * Hand a written transaction to every distill shard.
+ */
+__static void
+pjournal_distill_dispatch(struct psc_journal *pj,
+    struct psc_journal_xidhndl *xh)
+{
+	struct pjournal_distiller *pjd;
+	int i;
+
+	xh->pjx_nhandle = pj->pj_ndistill;
+	xh->pjx_ndistill = pj->pj_ndistill;
+	for (i = 0; i < pj->pj_ndistill; i++) {
+		pjd = pj->pj_distillers[i];
+		spinlock(&pjd->pjd_lock);
+		/* at most one queued entry per journal slot */
+		psc_assert((pjd->pjd_tail + 1) % pjd->pjd_nring !=
+		    pjd->pjd_head);
+		pjd->pjd_ring[pjd->pjd_tail] = xh;
+		pjd->pjd_tail = (pjd->pjd_tail + 1) % pjd->pjd_nring;
+		psc_waitq_wakeall(&pjd->pjd_waitq);
+		freelock(&pjd->pjd_lock);
+	}
+}
+
+/*
+ * The lowest xid every shard has distilled past.
+ */
+__static uint64_t
+pjournal_distill_lwm(struct psc_journal *pj)
+{
+	struct pjournal_distiller *pjd;
+	uint64_t xid = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < pj->pj_ndistill; i++) {
+		pjd = pj->pj_distillers[i];
+		spinlock(&pjd->pjd_lock);
+		xid = MIN(xid, pjd->pjd_xid);
+		freelock(&pjd->pjd_lock);
+	}
+	return (xid);
+}
+
 void
 pjournal_thr_main(struct psc_thread *thr)
 {
 	static int once = 0;
-	struct psc_journal_enthdr *pje;
 	struct psc_journal_xidhndl *xh;
 	struct psc_journalthr *pjt;
 	struct psc_journal *pj;
-	uint64_t xid, txg;
 	int last_reclaimed = 1, reclaimed = 0;
+	uint64_t xid, txg;
 
 	pjt = thr->pscthr_private;
 	pj = pjt->pjt_pj;
-	xid = pj->pj_distill_xid;
 	while (pscthr_run(thr)) {
 		/*
-		 * Walk the list until we find a log entry that needs
-		 * processing.  We also make sure that we distill in
-		 * order of transaction IDs.
+		 * Walk the list until we find a log entry that is not
+		 * yet written.  Entries are handed to the distill
+		 * shards in order of transaction IDs.
 		 */
 		while ((xh = pll_peekhead(&pj->pj_distillxids))) {
 			psclog_debug("xh=%p xh->pjx_flags=%d", xh,
@@ -874,39 +1236,17 @@ pjournal_thr_main(struct psc_thread *thr)
 				freelock(&xh->pjx_lock);
 				break;
 			}
-			pje = xh->pjx_data;
-			xh->pjx_data = NULL;
 			xh->pjx_flags &= ~PJX_WRITTEN;
 			pll_remove(&pj->pj_distillxids, xh);
+			pjournal_distill_dispatch(pj, xh);
 			freelock(&xh->pjx_lock);
 
-			pj->pj_distill_handler(pje, 0, pj->pj_npeers, 0);
-
-			PJ_LOCK(pj);
-			txg = pj->pj_current_txg + 1;
-			PJ_ULOCK(pj);
-
-			/*
-			 * Once we clear the distill flag, xh can be
-			 * freed after its associated txg has been
-			 * committed by the ZFS.
-			 */
-			spinlock(&xh->pjx_lock);
-			psc_assert(xid < xh->pjx_xid);
-			xid = xh->pjx_xid;
-
-			if (txg > xh->pjx_txg)
-				xh->pjx_txg = txg;
-
-			xh->pjx_flags &= ~PJX_DISTILL;
-			freelock(&xh->pjx_lock);
-
-			pjournal_put_buf(pj, PJE_DATA(pje));
-
 			/* the logic only works when the system is otherwise quiet */
 			last_reclaimed = 1;
 		}
 
+		xid = pjournal_distill_lwm(pj);
+
 		/*
 		 * Free committed pending transactions to avoid hogging
 		 * memory.
@@ -951,6 +1291,11 @@ pjournal_thr_main(struct psc_thread *thr)
 			psc_assert(pj->pj_inuse > 0);
 			pj->pj_inuse--;
 		}
+
+		psc_atomic64_set(&pj->pj_opst_distlag->opst_lifetime,
+		    pj->pj_lastxid - pj->pj_distill_xid);
+		psc_atomic64_set(&pj->pj_opst_inuse->opst_lifetime,
+		    pj->pj_inuse);
 		PJ_ULOCK(pj);
 		/*
 		 * Some of the log entries are written after
@@ -980,17 +1325,21 @@ pjournal_thr_main(struct psc_thread *thr)
  * @thrname: application-specified thread name for distill processor.
  * @replay_handler: the journal replay callback.
  * @distill_handler: the distill processor callback.
+ * @ndistill: number of distill shards, each served by its own thread.
  */
 struct psc_thread *
 pjournal_replay(struct psc_journal *pj, int thrtype,
     const char *thrname, psc_replay_handler_t replay_handler,
-    psc_distill_handler_t distill_handler)
+    psc_distill_handler_t distill_handler, int ndistill)
 {
-	int i, rc, len, nerrs = 0, nentries;
+	int i, j, rc, len, nerrs = 0, nentries;
+	struct pjournal_distiller *pjd;
 	struct psc_journal_enthdr *pje;
 	struct psc_journalthr *pjt;
 	struct psc_thread *thr;
 
+	psc_assert(ndistill > 0);
+
 	pj->pj_flags |= PJF_REPLAYINPROG;
 
 	rc = pjournal_scan_slots(pj);
@@ -1008,11 +1357,13 @@ pjournal_replay(struct psc_journal *pj, int thrtype,
 
 		nentries++;
 
-		if (pje->pje_xid > pj->pj_distill_xid) {
-			rc = distill_handler(pje, 0, pj->pj_npeers, 1);
-			if (rc)
-				nerrs++;
-		}
+		if (pje->pje_xid > pj->pj_distill_xid)
+			for (j = 0; j < ndistill; j++) {
+				rc = distill_handler(pje, j,
+				    pj->pj_npeers, 1);
+				if (rc && rc != PJ_DISTILL_STAGED)
+					nerrs++;
+			}
 
 		if (pje->pje_txg > pj->pj_commit_txg) {
 			rc = replay_handler(pje);
@@ -1028,6 +1379,10 @@ pjournal_replay(struct psc_journal *pj, int thrtype,
 	}
 	psc_dynarray_free(&pj->pj_bufs);
 
+	for (j = 0; j < ndistill; j++)
+		if (distill_handler(NULL, j, pj->pj_npeers, 1))
+			nerrs++;
+
 	/*
 	 * Make the current replay in effect.  Otherwise, a crash may
 	 * lose previous work.
@@ -1052,6 +1407,25 @@ pjournal_replay(struct psc_journal *pj, int thrtype,
 
 	pj->pj_distill_handler = distill_handler;
 
+	pj->pj_ndistill = ndistill;
+	pj->pj_distillers = PSCALLOC(ndistill *
+	    sizeof(*pj->pj_distillers));
+	for (j = 0; j < ndistill; j++) {
+		thr = pscthr_init(thrtype, pjournal_distillthr_main, NULL,
+		    sizeof(*pjd), "%sdst%d", thrname, j);
+		pjd = thr->pscthr_private;
+		pjd->pjd_pj = pj;
+		pjd->pjd_shard = j;
+		pjd->pjd_xid = pj->pj_distill_xid;
+		INIT_SPINLOCK(&pjd->pjd_lock);
+		psc_waitq_init(&pjd->pjd_waitq);
+		pjd->pjd_nring = pj->pj_total + 1;
+		pjd->pjd_ring = PSCALLOC(pjd->pjd_nring *
+		    sizeof(*pjd->pjd_ring));
+		pj->pj_distillers[j] = pjd;
+		pscthr_setready(thr);
+	}
+
 	thr = pscthr_init(thrtype, pjournal_thr_main, NULL,
 	    sizeof(*pjt), thrname);
 
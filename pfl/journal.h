@@ -35,11 +35,15 @@
 #include "pfl/thread.h"
 #include "pfl/waitq.h"
 
+struct pjournal_distiller;
 struct psc_journal;
 struct psc_journal_enthdr;
 
 #define	PJ_MAX_TRY			3		/* number of retry before giving up */
 #define	PJ_MAX_BUF			1024		/* number of journal buffers to keep around */
+#define	PJ_MAX_BATCH			64		/* max log entries per group commit */
+#define	PJ_NHIST			8		/* # of group commit histogram buckets */
+#define	PJ_COMMIT_USECS			0		/* default group commit linger */
 
 #define PJH_MAGIC			UINT64_C(0x45678912aabbccff)
 #define PJH_VERSION			0x02
@@ -49,8 +53,19 @@ typedef int (*psc_replay_handler_t)(struct psc_journal_enthdr *);
  * Distill handler is used to further process certain log entries.
  * These log entries carry information that we might need to preserve a
  * longer time, and outside the journal.
+ *
+ * Every entry is passed once to each distill shard, identified by the
+ * second argument, and the shards run in parallel.  The handler should
+ * do in each shard only the work whose ordering that shard owns.
+ *
+ * A handler may buffer what it distills and return PJ_DISTILL_STAGED.
+ * The journal then keeps those entries until the handler either returns
+ * zero, meaning everything handed to it so far has been written out,
+ * or is called with a NULL entry to flush its buffers.
  */
-typedef int (*psc_distill_handler_t)(struct psc_journal_enthdr *, uint64_t, int, int);
+typedef int (*psc_distill_handler_t)(struct psc_journal_enthdr *, int, int, int);
+
+#define PJ_DISTILL_STAGED		1
 
 #define PJRNL_TXG_GET			0
 #define PJRNL_TXG_PUT			1
@@ -143,9 +158,32 @@ struct psc_journal {
 	uint32_t			 pj_nextwrite;		/* next entry slot to write to */
 	uint64_t			 pj_wraparound;		/* stats only */
 	psc_distill_handler_t		 pj_distill_handler;
+	struct pjournal_distiller	**pj_distillers;	/* distill shards */
+	int				 pj_ndistill;
 	int				 pj_fd;			/* file descriptor to backing disk file */
 
 	struct pfl_iostats_rw		 pj_iostats;		/* read/write I/O stats */
+	struct pfl_opstat		*pj_opst_distlag;	/* xids not yet distilled */
+	struct pfl_opstat		*pj_opst_inuse;		/* slots in use */
+
+	/*
+	 * Group commit: log writers queue their entries in slot order
+	 * and whichever finds no flush in progress writes out the
+	 * whole batch with a single vectored write and device flush.
+	 */
+	psc_spinlock_t			 pj_gclock;
+	struct psclist_head		 pj_gcq;		/* entries awaiting write */
+	int				 pj_gcqlen;
+	int				 pj_gcflushing;		/* a batch is being written */
+	int				 pj_commit_usecs;	/* max time to linger for a batch */
+	struct psc_waitq		 pj_gcwaitq;		/* writers awaiting durability */
+	struct psc_waitq		 pj_gcleadwq;		/* lingering batch leader */
+
+	struct pfl_opstat		*pj_gcbatches;		/* # of group commits */
+	struct pfl_opstat		*pj_gcentries;		/* # of entries written by them */
+	struct pfl_opstat		*pj_gcflushus;		/* cumulative flush latency */
+	struct pfl_opstat		*pj_gcbatchhist[PJ_NHIST];
+	struct pfl_opstat		*pj_gcflushhist[PJ_NHIST];
 };
 
 #define PJF_NONE			0
@@ -246,6 +284,8 @@ struct psc_journal_xidhndl {
 	psc_spinlock_t			 pjx_lock;
 	struct psc_journal		*pjx_pj;
 	void				*pjx_data;
+	int				 pjx_nhandle;		/* shards yet to see pjx_data */
+	int				 pjx_ndistill;		/* shards yet to release */
 };
 
 #define	PJX_SLOT_ANY			(~0U)
@@ -263,7 +303,7 @@ struct psc_journal
 	*pjournal_open(const char *, const char *);
 struct psc_thread
 	*pjournal_replay(struct psc_journal *, int, const char *,
-	    psc_replay_handler_t, psc_distill_handler_t);
+	    psc_replay_handler_t, psc_distill_handler_t, int);
 
 void	 pjournal_update_txg(struct psc_journal *, uint64_t);
 uint64_t pjournal_next_replay(struct psc_journal *);
@@ -34,6 +34,7 @@
 #include <sys/syscall.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include <ctype.h>
@@ -56,6 +57,7 @@
 #include "pfl/fmtstr.h"
 #include "pfl/hashtbl.h"
 #include "pfl/log.h"
+#include "pfl/opstats.h"
 #include "pfl/pfl.h"
 #include "pfl/str.h"
 #include "pfl/thread.h"
@@ -75,6 +77,41 @@ FILE				*pflog_ttyfp;
 struct psc_dynarray		_pfl_logpoints = DYNARRAY_INIT_NOLOG;
 struct psc_hashtbl		_pfl_logpoints_hashtbl;
 
+/*
+ * Asynchronous logging (PSC_LOG_ASYNC).  Each thread formats messages
+ * into its own single-producer ring and a dedicated writer thread
+ * drains all rings with batched writev(2), so threads logging at a
+ * high rate no longer serialize on the stderr lock.  Messages from
+ * different threads are therefore not strictly ordered in the output;
+ * the timestamps are.
+ *
+ * A message that does not fit in its ring is dropped and counted in
+ * the `log-async-drop' opstat.  PLL_FATAL messages bypass the rings
+ * after everything staged so far has been written out.
+ */
+#define PFLOG_RING_SIZE		(64 * 1024)
+#define PFLOG_ASYNC_NRINGS	32		/* rings per writev(2) */
+#define PFLOG_ASYNC_INTV	10		/* writer idle period (ms) */
+
+#define PFLOG_LOAD_ACQ(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PFLOG_STORE_REL(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct pflog_ring {
+	struct pflog_ring	*pr_next;
+	uint64_t		 pr_head;	/* bytes produced */
+	uint64_t		 pr_tail;	/* bytes written out */
+	int			 pr_orphan;	/* owning thread exited */
+	char			 pr_buf[PFLOG_RING_SIZE];
+};
+
+int				 psclog_async;
+__static pthread_mutex_t	 pflog_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+__static pthread_cond_t		 pflog_async_cond = PTHREAD_COND_INITIALIZER;
+__static pthread_once_t		 pflog_async_once = PTHREAD_ONCE_INIT;
+__static struct pflog_ring	*pflog_rings;		/* active */
+__static struct pflog_ring	*pflog_rings_free;
+__static uint64_t		 pflog_async_ndrops;
+
 int pfl_syslog_map[] = {
 /* fatal */	LOG_EMERG,
 /* error */	LOG_ERR,
@@ -167,6 +204,10 @@ psc_log_init(void)
 			errx(1, "invalid PSC_LOG_LEVEL: %s", p);
 	}
 
+	p = getenv("PSC_LOG_ASYNC");
+	if (p && strcmp(p, "0"))
+		psclog_async = 1;
+
 	_psc_hashtbl_init(&_pfl_logpoints_hashtbl, PHTF_STRP |
 	    PHTF_NOLOG, offsetof(struct pfl_logpoint, plogpt_key),
 	    sizeof(struct pfl_logpoint), 3067, NULL, "logpoints");
@@ -302,6 +343,235 @@ pfl_fmtlogdate(const struct timeval *tv, const char **s)
 	return (bufp);
 }
 
+/*
+ * Write out a batch of log data, retrying short writes.  Data that
+ * cannot be written is discarded.
+ */
+__static void
+pflog_async_writev(struct iovec *iov, int niov)
+{
+	ssize_t rc;
+
+	flockfile(stderr);
+	while (niov) {
+		rc = writev(fileno(stderr), iov, niov);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (; niov && (size_t)rc >= iov->iov_len; iov++, niov--)
+			rc -= iov->iov_len;
+		if (niov) {
+			iov->iov_base = (char *)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+	funlockfile(stderr);
+}
+
+/*
+ * Drain all staged log messages.  The caller must hold
+ * pflog_async_mutex, which makes it the sole consumer of every ring.
+ */
+__static void
+pflog_async_drain_locked(void)
+{
+	struct pflog_ring *pr, **prp, *batch[PFLOG_ASYNC_NRINGS];
+	struct iovec iov[PFLOG_ASYNC_NRINGS * 2];
+	uint64_t len, off, lens[PFLOG_ASYNC_NRINGS];
+	int i, niov, nr;
+
+	pr = pflog_rings;
+	while (pr) {
+		niov = nr = 0;
+		for (; pr && nr < PFLOG_ASYNC_NRINGS; pr = pr->pr_next) {
+			len = PFLOG_LOAD_ACQ(&pr->pr_head) - pr->pr_tail;
+			if (len == 0)
+				continue;
+			off = pr->pr_tail % PFLOG_RING_SIZE;
+			iov[niov].iov_base = pr->pr_buf + off;
+			iov[niov].iov_len = MIN(len, PFLOG_RING_SIZE - off);
+			if (iov[niov].iov_len < len) {
+				iov[niov + 1].iov_base = pr->pr_buf;
+				iov[niov + 1].iov_len = len -
+				    iov[niov].iov_len;
+				niov++;
+			}
+			niov++;
+			batch[nr] = pr;
+			lens[nr++] = len;
+		}
+		if (nr == 0)
+			break;
+		pflog_async_writev(iov, niov);
+		for (i = 0; i < nr; i++)
+			PFLOG_STORE_REL(&batch[i]->pr_tail,
+			    batch[i]->pr_tail + lens[i]);
+	}
+
+	/* Recycle rings of threads that have exited once empty. */
+	for (prp = &pflog_rings; (pr = *prp); ) {
+		if (PFLOG_LOAD_ACQ(&pr->pr_orphan) &&
+		    PFLOG_LOAD_ACQ(&pr->pr_head) == pr->pr_tail) {
+			*prp = pr->pr_next;
+			pr->pr_next = pflog_rings_free;
+			pflog_rings_free = pr;
+		} else
+			prp = &pr->pr_next;
+	}
+}
+
+/*
+ * Publish the number of messages dropped since the last call.
+ */
+__static void
+pflog_async_countdrops(void)
+{
+	uint64_t n;
+
+	n = __atomic_exchange_n(&pflog_async_ndrops, 0,
+	    __ATOMIC_RELAXED);
+	if (n)
+		OPSTAT_ADD("log-async-drop", n);
+}
+
+void
+psclog_async_flush(void)
+{
+	pthread_mutex_lock(&pflog_async_mutex);
+	pflog_async_drain_locked();
+	pthread_mutex_unlock(&pflog_async_mutex);
+	pflog_async_countdrops();
+}
+
+__static void *
+pflog_async_main(__unusedx void *arg)
+{
+	struct timespec ts;
+
+	for (;;) {
+		pthread_mutex_lock(&pflog_async_mutex);
+		pflog_async_drain_locked();
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += PFLOG_ASYNC_INTV * 1000 * 1000;
+		if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+			ts.tv_nsec -= 1000 * 1000 * 1000;
+			ts.tv_sec++;
+		}
+		pthread_cond_timedwait(&pflog_async_cond,
+		    &pflog_async_mutex, &ts);
+		pthread_mutex_unlock(&pflog_async_mutex);
+
+		/* Done without the mutex as this may log itself. */
+		pflog_async_countdrops();
+	}
+	return (NULL);
+}
+
+__static void
+pflog_async_start(void)
+{
+	pthread_t pt;
+	int rc;
+
+	rc = pthread_create(&pt, NULL, pflog_async_main, NULL);
+	if (rc)
+		errx(1, "pthread_create: %s", strerror(rc));
+	atexit(psclog_async_flush);
+}
+
+/*
+ * Stage a formatted message in the calling thread's ring.
+ */
+__static void
+pflog_async_put(struct psclog_data *d, const char *buf, size_t len)
+{
+	struct pflog_ring *pr;
+	uint64_t head, tail;
+	const char *p;
+	size_t n, eollen;
+	int i;
+
+	pthread_once(&pflog_async_once, pflog_async_start);
+
+	pr = d->pld_ring;
+	if (pr == NULL) {
+		pthread_mutex_lock(&pflog_async_mutex);
+		pr = pflog_rings_free;
+		if (pr)
+			pflog_rings_free = pr->pr_next;
+		pthread_mutex_unlock(&pflog_async_mutex);
+		if (pr == NULL)
+			pr = psc_alloc(sizeof(*pr), PAF_NOLOG |
+			    PAF_NOGUARD);
+		pr->pr_orphan = 0;
+
+		pthread_mutex_lock(&pflog_async_mutex);
+		pr->pr_next = pflog_rings;
+		pflog_rings = pr;
+		pthread_mutex_unlock(&pflog_async_mutex);
+		d->pld_ring = pr;
+	}
+
+	eollen = strlen(psclog_eol);
+	head = pr->pr_head;
+	tail = PFLOG_LOAD_ACQ(&pr->pr_tail);
+	if (PFLOG_RING_SIZE - (head - tail) < len + eollen) {
+		__atomic_add_fetch(&pflog_async_ndrops, 1,
+		    __ATOMIC_RELAXED);
+		pthread_cond_signal(&pflog_async_cond);
+		return;
+	}
+
+	for (i = 0, p = buf; i < 2; i++, p = psclog_eol, len = eollen)
+		while (len) {
+			n = MIN(len, PFLOG_RING_SIZE -
+			    head % PFLOG_RING_SIZE);
+			memcpy(pr->pr_buf + head % PFLOG_RING_SIZE, p, n);
+			head += n;
+			p += n;
+			len -= n;
+		}
+	PFLOG_STORE_REL(&pr->pr_head, head);
+
+	/* Wake the writer early once the ring is half full. */
+	if (head - tail > PFLOG_RING_SIZE / 2)
+		pthread_cond_signal(&pflog_async_cond);
+}
+
+/*
+ * Called when a thread exits: hand its ring back for reuse once the
+ * writer has drained it.
+ */
+void
+psclog_releasedata(struct psclog_data *d)
+{
+	if (d->pld_ring)
+		PFLOG_STORE_REL(&d->pld_ring->pr_orphan, 1);
+}
+
+/*
+ * Get the timestamp for a log message.  In asynchronous mode, the
+ * kernel's coarse clock is used, which is read from a cached value
+ * without a system call.
+ */
+__static void
+pflog_gettime(struct timeval *tv)
+{
+#ifdef CLOCK_REALTIME_COARSE
+	struct timespec ts;
+
+	if (psclog_async &&
+	    clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+		return;
+	}
+#endif
+	gettimeofday(tv, NULL);
+}
+
 __weak const char *
 pfl_strerror(int rc)
 {
@@ -318,7 +588,7 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 	struct psclog_data *d;
 	struct timeval tv;
 	const char *thrname;
-	int rc, save_errno;
+	int rc, async, save_errno;
 	pid_t thrid;
 	size_t len;
 
@@ -345,7 +615,7 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 		thrname = d->pld_nothrname;
 	}
 
-	gettimeofday(&tv, NULL);
+	pflog_gettime(&tv);
 	(void)FMTSTR(buf, sizeof(buf), psc_logfmt,
 		FMTSTRCASE('B', "s", pfl_basename(pci->pci_filename))
 		FMTSTRCASE('D', "s", pfl_fmtlogdate(&tv, &_t))
@@ -377,15 +647,26 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 	/* trim newline if present, since we add our own */
 	if (len && buf[len - 1] == '\n')
 		buf[--len] = '\0';
-	if (options & PLO_ERRNO)
+	if (options & PLO_ERRNO) {
 		snprintf(buf + len, sizeof(buf) - len,
 		    ": %s", pfl_strerror(save_errno));
+		len = strlen(buf);
+	}
+
+	async = psclog_async && level != PLL_FATAL;
+	if (async)
+		pflog_async_put(d, buf, len);
+	else {
+		/* Anything staged precedes a fatal message. */
+		if (psclog_async)
+			psclog_async_flush();
 
-	PSCLOG_LOCK();
+		PSCLOG_LOCK();
 
-	/* XXX consider using fprintf_unlocked() for speed */
-	fprintf(stderr, "%s%s", buf, psclog_eol);
-	fflush(stderr);
+		/* XXX consider using fprintf_unlocked() for speed */
+		fprintf(stderr, "%s%s", buf, psclog_eol);
+		fflush(stderr);
+	}
 
 	if (pfl_syslog && pfl_syslog[pci->pci_subsys] &&
 	    level >= 0 && level < (int)nitems(pfl_syslog_map))
@@ -402,7 +683,8 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 		pfl_abort();
 	}
 
-	PSCLOG_UNLOCK();
+	if (!async)
+		PSCLOG_UNLOCK();
 
 	d->pld_flags &= ~PLDF_INLOG;
 
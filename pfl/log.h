@@ -45,6 +45,7 @@
 #include "pfl/subsys.h"
 
 struct psc_thread;
+struct pflog_ring;
 
 /* per-thread */
 struct psclog_data {
@@ -55,6 +56,7 @@ struct psclog_data {
 	pid_t		 pld_thrid;
 	int		 pld_flags;	/* see PLDF_* */
 	const char	*pld_uprog;	/* userland program via FUSE */
+	struct pflog_ring *pld_ring;	/* staging for PSC_LOG_ASYNC */
 };
 
 #define PLDF_INLOG	(1 << 0)
@@ -329,6 +331,8 @@ struct pfl_logpoint {
 
 void	 psc_log_init(void);
 int	 psc_log_setfn(const char *, const char *);
+void	 psclog_async_flush(void);
+void	 psclog_releasedata(struct psclog_data *);
 void	 psc_log_setlevel(int, int);
 
 int	 psc_log_getlevel(int);
@@ -362,6 +366,7 @@ __dead void _psc_fatal(const struct pfl_callerinfo *, int, int,
     __attribute__((nonnull(4, 4)));
 
 extern const char		*psc_logfmt;
+extern int			 psclog_async;
 extern char			 psclog_eol[8];
 
 extern struct psc_dynarray	_pfl_logpoints;
@@ -26,6 +26,7 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
 #include <string.h>
 
 #include "pfl/alloc.h"
@@ -126,3 +127,41 @@ psc_memnode_getobj(int pos, void *(*initf)(void *), void *arg)
 	freelock(&pmn->pmn_lock);
 	return (p);
 }
+
+/*
+ * Return the number of memory nodes in the system.
+ */
+int
+psc_memnode_count(void)
+{
+#ifdef HAVE_NUMA
+	if (numa_available() != -1)
+		return (numa_max_node() + 1);
+#endif
+	return (1);
+}
+
+/*
+ * Return the memory node local to the CPU the calling thread is
+ * currently running on.  Unlike psc_memnode_getid(), which reports the
+ * thread's memory policy preference, this follows the scheduler.
+ */
+int
+psc_memnode_curid(void)
+{
+#ifdef HAVE_NUMA
+	int cpu, memnid;
+
+	if (numa_available() == -1)
+		return (0);
+	cpu = sched_getcpu();
+	if (cpu == -1)
+		return (0);
+	memnid = numa_node_of_cpu(cpu);
+	if (memnid == -1)
+		return (0);
+	return (memnid);
+#else
+	return (0);
+#endif
+}
@@ -48,6 +48,8 @@ struct psc_memnode {
 	struct psc_dynarray	pmn_keys;
 };
 
+int	 psc_memnode_count(void);
+int	 psc_memnode_curid(void);
 struct psc_memnode *
 	 psc_memnode_get(void);
 void	*psc_memnode_getkey(struct psc_memnode *, int);
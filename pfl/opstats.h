@@ -30,6 +30,17 @@
  * Every second, each registered opstat is recomputed to measure
  * instantaneous operation rates.  10-second weighted averages are also
  * computed.
+ *
+ * Sharded opstats (OPSTF_SHARDED) accumulate into per-thread slots,
+ * which are folded into the lifetime counter by the timer thread and
+ * whenever the value is queried.  The slots of all sharded opstats are
+ * packed shard-major into shared slabs so a thread only writes cache
+ * lines belonging to its own shard.
+ *
+ * Opstat histograms log-bucket samples with PFL_OPHIST_NSUB linear
+ * sub-buckets per power of two, each bucket an opstat created on
+ * first use, and publish percentiles as opstats of their own.
+ * Percentiles are gauges (OPSTF_NORATE) and report no rate.
  */
 
 #ifndef _PFL_OPSTATS_H_
@@ -40,10 +51,11 @@
 #include <stdint.h>
 
 #include "pfl/atomic.h"
+#include "pfl/cdefs.h"
 #include "pfl/list.h"
 #include "pfl/lockedlist.h"
 
-#define pfl_opstat_add(opst, n)		psc_atomic64_add(&(opst)->opst_lifetime, (n))
+#define pfl_opstat_add(opst, n)		_pfl_opstat_add((opst), (n))
 #define	pfl_opstat_incr(opst)		pfl_opstat_add((opst), 1)
 
 #define	OPSTATF_ADD(flags, name, n)					\
@@ -55,10 +67,27 @@
 		pfl_opstat_add(_opst, (n));				\
 	} while (0)
 
-#define	OPSTAT_INCR(name)	OPSTATF_ADD(OPSTF_BASE10, (name), 1)
-#define	OPSTAT_ADD(name, n)	OPSTATF_ADD(OPSTF_BASE10, (name), (n))
+#define	OPSTAT_INCR(name)	OPSTATF_ADD(OPSTF_BASE10 | OPSTF_SHARDED, (name), 1)
+#define	OPSTAT_ADD(name, n)	OPSTATF_ADD(OPSTF_BASE10 | OPSTF_SHARDED, (name), (n))
+
+#define	OPSTAT2_ADD(name, n)	OPSTATF_ADD(OPSTF_SHARDED, (name), (n))
+
+#define	OPSTAT_HIST_ADD(name, n)					\
+	do {								\
+		static struct pfl_opstat_hist *_oph;			\
+									\
+		if (_oph == NULL)					\
+			_oph = pfl_opstat_hist_init(OPSTF_BASE10,	\
+			    (name));					\
+		pfl_opstat_hist_add(_oph, (n));				\
+	} while (0)
+
+#define PFL_OPSTAT_NSHARDS	16
+#define PFL_OPSTAT_SLABSLOTS	64		/* opstats per shard slab */
 
-#define	OPSTAT2_ADD(name, n)	OPSTATF_ADD(0, (name), (n))
+/* an opstat's pending delta in shard i */
+#define PFL_OPSTAT_SHARD(opst, i)					\
+	(&(opst)->opst_shards[(i) * PFL_OPSTAT_SLABSLOTS])
 
 struct pfl_opstat {
 	char			*opst_name;
@@ -72,10 +101,28 @@ struct pfl_opstat {
 	int64_t			 opst_last;	/* last second lifetime value */
 	int64_t			 opst_intv;	/* last second counter */
 	double			 opst_avg;	/* 10-second average */
+
+	psc_atomic64_t		*opst_shards;	/* slab slot of shard 0 */
 };
 
 #define OPSTF_BASE10		(1 << 0)
 #define OPSTF_EXCL		(1 << 1)
+#define OPSTF_SHARDED		(1 << 2)	/* per-thread accumulators */
+#define OPSTF_NORATE		(1 << 3)	/* gauge: no meaningful rate */
+
+#define PFL_OPHIST_SUBBITS	2
+#define PFL_OPHIST_NSUB		(1 << PFL_OPHIST_SUBBITS)
+#define PFL_OPHIST_NBUCKETS	((64 - PFL_OPHIST_SUBBITS + 1) * PFL_OPHIST_NSUB)
+#define PFL_OPHIST_NPCTL	4
+
+struct pfl_opstat_hist {
+	char			*oph_name;
+	int			 oph_flags;
+	struct pfl_opstat	*oph_sum;	/* sum of samples, under base name */
+	struct pfl_opstat	*oph_count;	/* number of samples */
+	struct pfl_opstat	*oph_pctl[PFL_OPHIST_NPCTL];
+	struct pfl_opstat	*oph_buckets[PFL_OPHIST_NBUCKETS];
+};
 
 struct pfl_iostats_rw {
 	struct pfl_opstat	*wr;
@@ -97,7 +144,31 @@ struct pfl_opstat *
 
 void	pfl_iostats_grad_init(struct pfl_iostats_grad *, int, const char *);
 
+void	pfl_opstat_fold(struct pfl_opstat *);
+int	_pfl_opstat_getshard(void);
+
+struct pfl_opstat_hist *
+	pfl_opstat_hist_init(int, const char *);
+void	pfl_opstat_hist_add(struct pfl_opstat_hist *, int64_t);
+int	pfl_opstat_hist_bucket(uint64_t);
+void	pfl_opstat_hist_bounds(int, uint64_t *, uint64_t *);
+void	pfl_opstat_hist_update(struct pfl_opstat_hist *);
+
 extern struct psc_dynarray	pfl_opstats;
+extern struct psc_dynarray	pfl_opstat_hists;
 extern struct psc_spinlock	pfl_opstats_lock;
+extern __threadx int		pfl_opstat_shardidx;
+
+static __inline void
+_pfl_opstat_add(struct pfl_opstat *opst, int64_t n)
+{
+	if (opst->opst_shards) {
+		if (pfl_opstat_shardidx == 0)
+			pfl_opstat_shardidx = _pfl_opstat_getshard();
+		psc_atomic64_add(PFL_OPSTAT_SHARD(opst,
+		    pfl_opstat_shardidx - 1), n);
+	} else
+		psc_atomic64_add(&opst->opst_lifetime, n);
+}
 
 #endif /* _PFL_OPSTATS_H_ */
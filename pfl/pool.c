@@ -122,6 +122,10 @@ struct pfl_wkdata_poolreap {
 	struct psc_poolmgr *poolmgr;
 };
 
+/* magazine slot + 1 of this thread, assigned on first use */
+__static __threadx int	psc_pool_magslot;
+__static psc_atomic32_t	psc_pool_nextmagslot = PSC_ATOMIC32_INIT(0);
+
 __weak void
 _psc_mlist_init(__unusedx struct psc_mlist *m, __unusedx int flags,
     __unusedx void *arg, __unusedx ptrdiff_t offset,
@@ -179,6 +183,232 @@ _psc_poolmaster_init(struct psc_poolmaster *p, size_t entsize,
 	va_end(ap);
 }
 
+/*
+ * Set up the magazine layer of a pool: each slot starts with two empty
+ * magazines and the depot with PPM_DEPOT_NMAGS empty ones.  No
+ * magazine is ever allocated or freed afterwards.
+ * @m: the pool manager.
+ */
+__static void
+_psc_pool_initmags(struct psc_poolmgr *m)
+{
+	struct psc_pooldepot *pmd = &m->ppm_depot;
+	struct psc_poolmagslot *pms;
+	int i;
+
+	m->ppm_magslots = psc_alloc(PPM_MAG_NSLOTS *
+	    sizeof(*m->ppm_magslots), PAF_PAGEALIGN);
+	for (i = 0; i < PPM_MAG_NSLOTS; i++) {
+		pms = &m->ppm_magslots[i];
+		INIT_SPINLOCK(&pms->pms_lock);
+		pms->pms_loaded = PSCALLOC(sizeof(*pms->pms_loaded));
+		pms->pms_prev = PSCALLOC(sizeof(*pms->pms_prev));
+	}
+	INIT_SPINLOCK(&pmd->pmd_lock);
+	for (i = 0; i < PPM_DEPOT_NMAGS; i++)
+		pmd->pmd_empty[i] = PSCALLOC(sizeof(*pmd->pmd_empty[i]));
+	pmd->pmd_nempty = PPM_DEPOT_NMAGS;
+}
+
+__static struct psc_poolmagslot *
+_psc_pool_getmagslot(struct psc_poolmgr *m)
+{
+	if (psc_pool_magslot == 0)
+		psc_pool_magslot = psc_atomic32_inc_getnew(
+		    &psc_pool_nextmagslot) % PPM_MAG_NSLOTS + 1;
+	return (&m->ppm_magslots[psc_pool_magslot - 1]);
+}
+
+/*
+ * Take an item from the magazines of this thread's slot, trading an
+ * empty magazine for a full one from the depot if both are empty.
+ * Returns NULL if the depot has nothing to offer.
+ *
+ * Lock ordering is pool, then slot, then depot.
+ * @m: the pool manager.
+ */
+__static void *
+_psc_pool_magget(struct psc_poolmgr *m)
+{
+	struct psc_pooldepot *pmd = &m->ppm_depot;
+	struct psc_poolmagslot *pms;
+	struct psc_poolmag *pmg;
+	void *p = NULL;
+
+	pms = _psc_pool_getmagslot(m);
+	spinlock(&pms->pms_lock);
+	if (pms->pms_loaded->pmg_nrounds == 0) {
+		if (pms->pms_prev->pmg_nrounds)
+			SWAP(pms->pms_loaded, pms->pms_prev, pmg);
+		else {
+			spinlock(&pmd->pmd_lock);
+			if (pmd->pmd_nfull) {
+				pmd->pmd_empty[pmd->pmd_nempty++] =
+				    pms->pms_prev;
+				pms->pms_prev = pms->pms_loaded;
+				pms->pms_loaded =
+				    pmd->pmd_full[--pmd->pmd_nfull];
+				pms->pms_nrounds += PPM_MAG_NROUNDS;
+			}
+			freelock(&pmd->pmd_lock);
+		}
+	}
+	pmg = pms->pms_loaded;
+	if (pmg->pmg_nrounds) {
+		p = pmg->pmg_rounds[--pmg->pmg_nrounds];
+		pms->pms_nrounds--;
+	}
+	freelock(&pms->pms_lock);
+	return (p);
+}
+
+/*
+ * Park a returned item in the magazines of this thread's slot, trading
+ * a full magazine for an empty one from the depot if both are full.
+ * Returns zero if the item must go to the pool list instead.
+ * @m: the pool manager.
+ * @p: item being returned.
+ */
+__static int
+_psc_pool_magput(struct psc_poolmgr *m, void *p)
+{
+	struct psc_pooldepot *pmd = &m->ppm_depot;
+	struct psc_poolmagslot *pms;
+	struct psc_poolmag *pmg;
+	int rc = 0;
+
+	pms = _psc_pool_getmagslot(m);
+	spinlock(&pms->pms_lock);
+
+	/*
+	 * Checked under the slot lock: a thread about to sleep for an
+	 * item registers itself before flushing every slot, so either
+	 * we see it here or it sees our item in the flush.
+	 */
+	if (psc_atomic32_read(&m->ppm_nwaiters))
+		goto out;
+
+	if (pms->pms_loaded->pmg_nrounds == PPM_MAG_NROUNDS) {
+		if (pms->pms_prev->pmg_nrounds == 0)
+			SWAP(pms->pms_loaded, pms->pms_prev, pmg);
+		else {
+			spinlock(&pmd->pmd_lock);
+			if (pmd->pmd_nempty) {
+				pmd->pmd_full[pmd->pmd_nfull++] =
+				    pms->pms_prev;
+				pms->pms_prev = pms->pms_loaded;
+				pms->pms_loaded =
+				    pmd->pmd_empty[--pmd->pmd_nempty];
+				pms->pms_nrounds -= PPM_MAG_NROUNDS;
+			}
+			freelock(&pmd->pmd_lock);
+		}
+	}
+	pmg = pms->pms_loaded;
+	if (pmg->pmg_nrounds < PPM_MAG_NROUNDS) {
+		pmg->pmg_rounds[pmg->pmg_nrounds++] = p;
+		pms->pms_nrounds++;
+		rc = 1;
+	}
+ out:
+	freelock(&pms->pms_lock);
+	return (rc);
+}
+
+/*
+ * Move all items parked in magazines, both in the slots and in the
+ * depot, back onto the pool list so they are visible to waiters,
+ * shrinking and reaping.  May be called with the pool locked.
+ * @m: the pool manager.
+ */
+void
+psc_pool_magflush(struct psc_poolmgr *m)
+{
+	void *v[2 * PPM_MAG_NROUNDS];
+	struct psc_pooldepot *pmd = &m->ppm_depot;
+	struct psc_poolmagslot *pms;
+	struct psc_poolmag *pmg;
+	int i, n;
+
+	if (m->ppm_magslots == NULL)
+		return;
+
+	for (i = 0; i < PPM_MAG_NSLOTS; i++) {
+		pms = &m->ppm_magslots[i];
+		n = 0;
+		spinlock(&pms->pms_lock);
+		pmg = pms->pms_loaded;
+		while (pmg->pmg_nrounds)
+			v[n++] = pmg->pmg_rounds[--pmg->pmg_nrounds];
+		pmg = pms->pms_prev;
+		while (pmg->pmg_nrounds)
+			v[n++] = pmg->pmg_rounds[--pmg->pmg_nrounds];
+		pms->pms_nrounds = 0;
+		freelock(&pms->pms_lock);
+
+		while (n)
+			POOL_ADD_ITEM(m, v[--n]);
+	}
+
+	for (;;) {
+		n = 0;
+		spinlock(&pmd->pmd_lock);
+		if (pmd->pmd_nfull) {
+			pmg = pmd->pmd_full[--pmd->pmd_nfull];
+			while (pmg->pmg_nrounds)
+				v[n++] = pmg->pmg_rounds[--pmg->pmg_nrounds];
+			pmd->pmd_empty[pmd->pmd_nempty++] = pmg;
+		}
+		freelock(&pmd->pmd_lock);
+		if (n == 0)
+			break;
+
+		while (n)
+			POOL_ADD_ITEM(m, v[--n]);
+	}
+}
+
+/*
+ * Count the items parked in the magazine layer.  All slot locks are
+ * held together so that a magazine moving between a slot and the depot
+ * is counted exactly once.
+ * @m: the pool manager.
+ */
+int
+psc_pool_nmagged(struct psc_poolmgr *m)
+{
+	struct psc_pooldepot *pmd = &m->ppm_depot;
+	int i, n;
+
+	if (m->ppm_magslots == NULL)
+		return (0);
+
+	for (i = 0; i < PPM_MAG_NSLOTS; i++)
+		spinlock(&m->ppm_magslots[i].pms_lock);
+	spinlock(&pmd->pmd_lock);
+	n = pmd->pmd_nfull * PPM_MAG_NROUNDS;
+	freelock(&pmd->pmd_lock);
+	for (i = 0; i < PPM_MAG_NSLOTS; i++) {
+		n += m->ppm_magslots[i].pms_nrounds;
+		freelock(&m->ppm_magslots[i].pms_lock);
+	}
+	return (n);
+}
+
+/*
+ * Flush the magazine layer and retry the pool list.  The pool must be
+ * locked.
+ * @m: the pool manager.
+ */
+__static void *
+_psc_pool_magflush_get(struct psc_poolmgr *m)
+{
+	if (m->ppm_magslots == NULL)
+		return (NULL);
+	psc_pool_magflush(m);
+	return (POOL_TRYGETOBJ(m));
+}
+
 int
 psc_pool_cmp(const void *a, const void *b)
 {
@@ -240,7 +470,8 @@ _psc_poolmaster_initmgr(struct psc_poolmaster *p, struct psc_poolmgr *m)
 	    "pool.%s.grows", m->ppm_name);
 	m->ppm_opst_shrinks = pfl_opstat_initf(OPSTF_BASE10,
 	    "pool.%s.shrinks", m->ppm_name);
-	m->ppm_opst_returns = pfl_opstat_initf(OPSTF_BASE10,
+	m->ppm_opst_returns = pfl_opstat_initf(OPSTF_BASE10 |
+	    (m->ppm_flags & PPMF_MAGAZINE ? OPSTF_SHARDED : 0),
 	    "pool.%s.returns", m->ppm_name);
 	m->ppm_opst_preaps = pfl_opstat_initf(OPSTF_BASE10,
 	    "pool.%s.preaps", m->ppm_name);
@@ -250,6 +481,9 @@ _psc_poolmaster_initmgr(struct psc_poolmaster *p, struct psc_poolmgr *m)
 	n = p->pms_total;
 	ureqlock(&p->pms_lock, locked);
 
+	if ((m->ppm_flags & PPMF_MAGAZINE) && !POOL_IS_MLIST(m))
+		_psc_pool_initmags(m);
+
 	pll_add_sorted(&psc_pools, m, psc_pool_cmp);
 
 	if (n)
@@ -374,6 +608,7 @@ _psc_pool_shrink(struct psc_poolmgr *m, int n, int failok)
 	void *p;
 
 	psc_assert(n > 0);
+	psc_pool_magflush(m);
 	for (i = 0; i < n; i++) {
 		p = NULL;
 		locked = POOL_RLOCK(m);
@@ -486,7 +721,8 @@ _psc_poolset_reap(struct psc_poolset *s,
 
 		if (!POOL_TRYRLOCK(m, &locked))
 			continue;
-		tmx = m->ppm_entsize * m->ppm_nfree;
+		tmx = m->ppm_entsize * (m->ppm_nfree +
+		    psc_pool_nmagged(m));
 		nobj = MAX(size / m->ppm_entsize, 1);
 		POOL_URLOCK(m, locked);
 
@@ -571,8 +807,17 @@ _psc_pool_get(struct psc_poolmgr *m, int flags)
 	int desperate = 0, locked, n;
 	void *p;
 
+	if (m->ppm_magslots) {
+		p = _psc_pool_magget(m);
+		if (p)
+			return (p);
+	}
+
 	POOL_LOCK(m);
 	p = POOL_TRYGETOBJ(m);
+	if (p == NULL)
+		/* Other threads may be holding items in magazines. */
+		p = _psc_pool_magflush_get(m);
 	if (p || (flags & PPGF_NONBLOCK))
 		PFL_GOTOERR(gotitem, 0);
 
@@ -686,6 +931,11 @@ _psc_pool_get(struct psc_poolmgr *m, int flags)
 		 * our sleep).
 		 */
 		psc_atomic32_inc(&m->ppm_nwaiters);
+		p = _psc_pool_magflush_get(m);
+		if (p) {
+			psc_atomic32_dec(&m->ppm_nwaiters);
+			PFL_GOTOERR(gotitem, 0);
+		}
 		psc_waitq_waitrel_us(&m->ppm_lc.plc_wq_empty,
 		    &m->ppm_lc.plc_lock, 100);
 		psc_atomic32_dec(&m->ppm_nwaiters);
@@ -699,12 +949,20 @@ _psc_pool_get(struct psc_poolmgr *m, int flags)
 	}
 
 	/* Nothing else we can do; wait for an item to return. */
-	p = lc_getwait(&m->ppm_lc);
+	if (m->ppm_magslots) {
+		psc_atomic32_inc(&m->ppm_nwaiters);
+		p = _psc_pool_magflush_get(m);
+		if (p == NULL)
+			p = lc_getwait(&m->ppm_lc);
+		psc_atomic32_dec(&m->ppm_nwaiters);
+	} else
+		p = lc_getwait(&m->ppm_lc);
 	POOL_ULOCK(m);
 	return (p);
 
  gotitem:
 	if (p && m->ppm_reclaimcb && !m->ppm_nfree &&
+	    !psc_pool_nmagged(m) &&
 	    (m->ppm_flags & (PPMF_NOPREEMPT | PPMF_PREEMPTQ)) == 0 &&
 	    m != pfl_workrq_pool && pfl_workrq_pool) {
 		struct pfl_wkdata_poolreap *wk;
@@ -734,7 +992,15 @@ _psc_pool_return(struct psc_poolmgr *m, void *p)
 {
 	int locked;
 
+	if (m->ppm_magslots && _psc_pool_magput(m, p)) {
+		pfl_opstat_incr(m->ppm_opst_returns);
+		return;
+	}
+
 	/*
+	 * Items parked in magazines are not counted toward the free
+	 * threshold below; the depot bounds how many there can be.
+	 *
 	 * If pool max < total (e.g. when an administrator lowers max
 	 * beyond current total) or we reached the auto resize
 	 * threshold, directly free this item.
@@ -778,7 +1044,7 @@ psc_pool_inuse(struct psc_poolmgr *m)
 	int locked, rc;
 
 	locked = POOL_RLOCK(m);
-	rc = m->ppm_total != m->ppm_nfree;
+	rc = m->ppm_total != m->ppm_nfree + psc_pool_nmagged(m);
 	POOL_URLOCK(m, locked);
 	return (rc);
 }
@@ -793,7 +1059,7 @@ psc_pool_nfree(struct psc_poolmgr *m)
 	int locked, nf;
 
 	locked = POOL_RLOCK(m);
-	nf = m->ppm_nfree;
+	nf = m->ppm_nfree + psc_pool_nmagged(m);
 	POOL_URLOCK(m, locked);
 	return (nf);
 }
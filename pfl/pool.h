@@ -47,6 +47,45 @@
 
 struct psc_poolmgr;
 
+#define PPM_MAG_NSLOTS		16		/* magazine slots per pool */
+#define PPM_MAG_NROUNDS		16		/* items per magazine */
+#define PPM_DEPOT_NMAGS		8		/* magazines in depot */
+
+/*
+ * A magazine is a small stack of free items ("rounds") that a thread
+ * can take from or add to without touching the shared pool list.
+ */
+struct psc_poolmag {
+	int			  pmg_nrounds;
+	void			 *pmg_rounds[PPM_MAG_NROUNDS];
+};
+
+/*
+ * Each thread is bound to one of PPM_MAG_NSLOTS slots, each holding a
+ * loaded and a previous magazine as in Bonwick's design.  Both
+ * magazines are swapped whole with the depot so the slot lock is the
+ * only one taken on the fast path.
+ */
+struct psc_poolmagslot {
+	psc_spinlock_t		  pms_lock;
+	int			  pms_nrounds;		/* in both magazines */
+	struct psc_poolmag	 *pms_loaded;
+	struct psc_poolmag	 *pms_prev;
+} __aligned(64);
+
+/*
+ * The depot holds a fixed number of magazines; every exchange with a
+ * slot trades a full magazine for an empty one or vice versa, which
+ * keeps the number of items parked outside the pool list bounded.
+ */
+struct psc_pooldepot {
+	psc_spinlock_t		  pmd_lock;
+	int			  pmd_nfull;
+	int			  pmd_nempty;
+	struct psc_poolmag	 *pmd_full[PPM_DEPOT_NMAGS];
+	struct psc_poolmag	 *pmd_empty[PPM_DEPOT_NMAGS];
+};
+
 /*
  * Poolsets contain a group of poolmgrs which can reap memory from each
  * other.
@@ -108,6 +147,9 @@ struct psc_poolmgr {
 	psc_atomic32_t		  ppm_nwaiters;		/* #thrs waiting for item */
 	struct pfl_mutex	  ppm_reclaim_mutex;	/* exclusive reclamation */
 
+	struct psc_poolmagslot	 *ppm_magslots;		/* PPMF_MAGAZINE */
+	struct psc_pooldepot	  ppm_depot;
+
 	struct pfl_opstat	 *ppm_opst_grows;
 	struct pfl_opstat	 *ppm_opst_shrinks;
 	struct pfl_opstat	 *ppm_opst_returns;
@@ -140,6 +182,7 @@ struct psc_poolmgr {
 #define PPMF_ALIGN		(1 << 5)	/* align to system page boundaries */
 #define PPMF_NOPREEMPT		(1 << 6)	/* do reactive reaping */
 #define PPMF_PREEMPTQ		(1 << 7)	/* queued for preemptive reaping */
+#define PPMF_MAGAZINE		(1 << 8)	/* per-thread magazine layer */
 
 #define POOL_LOCK(m)		PLL_LOCK(&(m)->ppm_pll)
 #define POOL_TRYLOCK(m)		PLL_TRYLOCK(&(m)->ppm_pll)
@@ -251,6 +294,8 @@ void	*_psc_pool_get(struct psc_poolmgr *, int);
 int	  psc_pool_gettotal(struct psc_poolmgr *);
 int	  psc_pool_grow(struct psc_poolmgr *, int);
 int	  psc_pool_inuse(struct psc_poolmgr *);
+void	  psc_pool_magflush(struct psc_poolmgr *);
+int	  psc_pool_nmagged(struct psc_poolmgr *);
 int	  psc_pool_nfree(struct psc_poolmgr *);
 void	  psc_pool_reap(struct psc_poolmgr *, int);
 void	  psc_pool_reapmem(size_t);
@@ -170,6 +170,7 @@ struct pscrpc_connection {
 	struct pscrpc_uuid		 c_remote_uuid;
 	struct pscrpc_export		*c_exp;
 	struct pscrpc_import		*c_imp;
+	uint32_t			 c_bulkauth;	/* app-negotiated bulk authenticator */
 };
 
 struct pscrpc_request_pool {
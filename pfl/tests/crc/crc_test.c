@@ -29,13 +29,76 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "pfl/alloc.h"
 #include "pfl/cdefs.h"
 #include "pfl/crc.h"
+#include "pfl/log.h"
 #include "pfl/pfl.h"
+#include "pfl/random.h"
 #include "pfl/types.h"
 
+#define BUFSZ		(1024 * 1024 + 64)
+
 const char *progname;
 
+#ifndef USE_GCRCUTIL
+/*
+ * Ensure every available kernel matches the reference table walk over
+ * all short lengths and alignments plus a handful of large buffers,
+ * including CRCs accumulated across several calls.
+ */
+void
+check_kernels(void)
+{
+	uint64_t ref, crc;
+	size_t len, off, split;
+	unsigned char *buf;
+	int k;
+
+	buf = PSCALLOC(BUFSZ);
+	pfl_random_getbytes(buf, BUFSZ);
+
+	for (len = 0; len < 1024; len++)
+		for (off = 0; off < 16; off++) {
+			psc_crc64_init(&ref);
+			psc_crc64_add_kernel(PFL_CRC64_TABLE, &ref,
+			    buf + off, len);
+			split = len ? psc_random32u(len) : 0;
+			for (k = 0; k < PFL_CRC64_NKERNELS; k++) {
+				if (!psc_crc64_kernel_avail(k))
+					continue;
+				psc_crc64_init(&crc);
+				psc_crc64_add_kernel(k, &crc, buf + off,
+				    split);
+				psc_crc64_add_kernel(k, &crc, buf + off +
+				    split, len - split);
+				if (crc != ref)
+					psc_fatalx("%s: mismatch len=%zu "
+					    "off=%zu split=%zu: %"PSCPRIxCRC64
+					    " vs %"PSCPRIxCRC64,
+					    psc_crc64_kernel_names[k], len,
+					    off, split, crc, ref);
+			}
+		}
+
+	for (off = 0; off < 64; off += 7) {
+		len = BUFSZ - 64;
+		psc_crc64_init(&ref);
+		psc_crc64_add_kernel(PFL_CRC64_TABLE, &ref, buf + off, len);
+		for (k = 0; k < PFL_CRC64_NKERNELS; k++) {
+			if (!psc_crc64_kernel_avail(k))
+				continue;
+			psc_crc64_init(&crc);
+			psc_crc64_add_kernel(k, &crc, buf + off, len);
+			if (crc != ref)
+				psc_fatalx("%s: mismatch len=%zu off=%zu",
+				    psc_crc64_kernel_names[k], len, off);
+		}
+	}
+	PSCFREE(buf);
+}
+#endif
+
 __dead void
 usage(void)
 {
@@ -58,5 +121,13 @@ main(int argc, char *argv[])
 
 	psc_crc64_calc(&crc, "LER*##kdj3m-=z{]]]e3\\=O$I3llf0934", 24);
 	printf("%"PSCPRIxCRC64"\n", crc);
+#ifndef USE_GCRCUTIL
+	if (crc != UINT64_C(0x5c3a35065b5b2fa2))
+		psc_fatalx("unexpected CRC %"PSCPRIxCRC64, crc);
+
+	check_kernels();
+	printf("default kernel: %s\n",
+	    psc_crc64_kernel_names[psc_crc64_kernel]);
+#endif
 	exit(0);
 }
@@ -26,6 +26,7 @@
  */
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -40,7 +41,11 @@ struct item {
 	uint64_t		id;
 };
 
+#define NTHR		4
+#define NITEMS		20000
+
 const char *progname;
+struct psc_hashtbl gt;
 
 __dead void
 usage(void)
@@ -49,13 +54,35 @@ usage(void)
 	exit(1);
 }
 
+/*
+ * Add and look up items while the table is growing underneath.
+ */
+void *
+thrmain(void *arg)
+{
+	uint64_t n, key, base = (uintptr_t)arg * NITEMS;
+	struct item *i;
+
+	for (n = 0; n < NITEMS; n++) {
+		i = PSCALLOC(sizeof(*i));
+		psc_hashent_init(&gt, i);
+		i->id = base + n;
+		psc_hashtbl_add_item(&gt, i);
+
+		key = base + n / 2;
+		psc_assert(psc_hashtbl_search(&gt, &key));
+	}
+	return (NULL);
+}
+
 int
 main(int argc, char *argv[])
 {
+	pthread_t thr[NTHR];
 	struct psc_hashtbl t;
 	struct item *i;
 	uint64_t key;
-	int c;
+	int c, n;
 
 	pfl_init();
 	if ((c = getopt(argc, argv, "")) != -1)
@@ -97,5 +124,20 @@ main(int argc, char *argv[])
 	i = psc_hashtbl_search(&t, &key);
 	printf("%"PRId64"\n", i->id);
 
+	psc_hashtbl_init(&gt, 0, struct item, id, hentry, 31, NULL,
+	    "gt");
+	for (n = 0; n < NTHR; n++)
+		pthread_create(&thr[n], NULL, thrmain,
+		    (void *)(uintptr_t)n);
+	for (n = 0; n < NTHR; n++)
+		pthread_join(thr[n], NULL);
+	for (key = 0; key < NTHR * NITEMS; key++) {
+		i = psc_hashtbl_searchdel(&gt, &key);
+		psc_assert(i && i->id == key);
+		PSCFREE(i);
+	}
+	psc_assert(gt.pht_nbuckets >= NTHR * NITEMS / PHT_MAXLOAD / 2);
+	psc_assert(psc_atomic32_read(&gt.pht_nitems) == 0);
+
 	exit(0);
 }
@@ -77,7 +77,7 @@ prheap(void)
 	printf("\n");
 }
 
-void
+struct a *
 add(int v)
 {
 	struct a *p;
@@ -85,13 +85,29 @@ add(int v)
 	p = PSCALLOC(sizeof(*p));
 	p->val = v;
 	pfl_heap_add(&hp, p);
+	return (p);
+}
+
+void
+drain(void)
+{
+	struct a *p;
+	int last;
+
+	last = -1;
+	while ((p = pfl_heap_shift(&hp))) {
+		printf("%d\n", p->val);
+		psc_assert(p->val >= last);
+		last = p->val;
+		PSCFREE(p);
+	}
 }
 
 int
 main(__unusedx int argc, char *argv[])
 {
-	struct a *p;
-	int i, last;
+	struct a *p, *v[1000];
+	int i, j;
 
 	progname = argv[0];
 	pfl_init();
@@ -100,14 +116,20 @@ main(__unusedx int argc, char *argv[])
 
 	for (i = 0; i < 1000; i++) 
 		add(psc_random32u(100));
+	drain();
 
-	last = -1;
-	while ((p = pfl_heap_shift(&hp))) {
-		printf("%d\n", p->val);
-		psc_assert(p->val >= last);
-		last = p->val;
+	/* remove arbitrary items from the middle of the heap */
+	for (i = 0; i < 1000; i++) 
+		v[i] = add(psc_random32u(100));
+	for (i = 0; i < 500; i++) {
+		j = psc_random32u(1000 - i);
+		p = v[j];
+		v[j] = v[1000 - i - 1];
+		pfl_heap_remove(&hp, p);
 		PSCFREE(p);
 	}
+	psc_assert(pfl_heap_nitems(&hp) == 500);
+	drain();
 
 	exit(0);
 }
@@ -0,0 +1,130 @@
+/* $Id$ */
+/*
+ * %PSC_START_COPYRIGHT%
+ * -----------------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ *
+ * Permission to use, copy, modify, and distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice
+ * appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+ * THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pittsburgh Supercomputing Center	phone: 412.268.4960  fax: 412.268.5832
+ * 300 S. Craig Street			e-mail: remarks@psc.edu
+ * Pittsburgh, PA 15213			web: http://www.psc.edu/
+ * -----------------------------------------------------------------------------
+ * %PSC_END_COPYRIGHT%
+ */
+
+/*
+ * Exercise asynchronous logging: every message logged by a set of
+ * short-lived threads must either appear intact in the log file or be
+ * accounted for as a drop.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/pfl.h"
+
+#define NTHRS	8
+#define NROUNDS	4
+#define NITER	20000
+
+const char *progname;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s\n", progname);
+	exit(1);
+}
+
+void *
+thr_main(void *arg)
+{
+	int i, id = (int)(intptr_t)arg;
+
+	for (i = 0; i < NITER; i++)
+		psclog_notice("logtest %d %d", id, i);
+	return (NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char fn[PATH_MAX], line[BUFSIZ], *p;
+	int i, j, id, n, prev[NTHRS * NROUNDS];
+	struct pfl_opstat *opst;
+	pthread_t thr[NTHRS];
+	int64_t nlines, ndrops;
+	FILE *fp;
+
+	snprintf(fn, sizeof(fn), "/tmp/pfl_log_test.%d", getpid());
+	setenv("PSC_LOG_FILE", fn, 1);
+	setenv("PSC_LOG_ASYNC", "1", 1);
+	setenv("PSC_LOG_LEVEL", "notice", 1);
+	pfl_init();
+	progname = argv[0];
+	if (getopt(argc, argv, "") != -1)
+		usage();
+	argc -= optind;
+	if (argc)
+		usage();
+
+	psc_assert(psclog_async);
+
+	/* later rounds reuse the rings of exited threads */
+	for (j = 0; j < NROUNDS; j++) {
+		for (i = 0; i < NTHRS; i++)
+			psc_assert(pthread_create(&thr[i], NULL,
+			    thr_main, (void *)(intptr_t)
+			    (j * NTHRS + i)) == 0);
+		for (i = 0; i < NTHRS; i++)
+			pthread_join(thr[i], NULL);
+	}
+	psclog_async_flush();
+
+	/* each thread's surviving messages are intact and in order */
+	for (i = 0; i < NTHRS * NROUNDS; i++)
+		prev[i] = -1;
+	nlines = 0;
+	fp = fopen(fn, "r");
+	psc_assert(fp);
+	while (fgets(line, sizeof(line), fp)) {
+		p = strstr(line, "logtest ");
+		if (p == NULL)
+			continue;
+		psc_assert(sscanf(p, "logtest %d %d", &id, &n) == 2);
+		psc_assert(id >= 0 && id < NTHRS * NROUNDS);
+		psc_assert(n > prev[id] && n < NITER);
+		psc_assert(line[strlen(line) - 1] == '\n');
+		prev[id] = n;
+		nlines++;
+	}
+	fclose(fp);
+	unlink(fn);
+
+	opst = pfl_opstat_init("log-async-drop");
+	pfl_opstat_fold(opst);
+	ndrops = psc_atomic64_read(&opst->opst_lifetime);
+	psc_assert(nlines + ndrops == NTHRS * NROUNDS * NITER);
+
+	exit(0);
+}
@@ -0,0 +1,150 @@
+/* $Id$ */
+/*
+ * %PSC_START_COPYRIGHT%
+ * -----------------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ *
+ * Permission to use, copy, modify, and distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice
+ * appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+ * THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pittsburgh Supercomputing Center	phone: 412.268.4960  fax: 412.268.5832
+ * 300 S. Craig Street			e-mail: remarks@psc.edu
+ * Pittsburgh, PA 15213			web: http://www.psc.edu/
+ * -----------------------------------------------------------------------------
+ * %PSC_END_COPYRIGHT%
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/pfl.h"
+
+#define NTHRS	8
+#define NITER	100000
+
+const char *progname;
+
+struct pfl_opstat *sharded;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s\n", progname);
+	exit(1);
+}
+
+void *
+thr_main(__unusedx void *arg)
+{
+	int i;
+
+	for (i = 0; i < NITER; i++) {
+		pfl_opstat_incr(sharded);
+		OPSTAT_ADD("test-macro", 2);
+	}
+	return (NULL);
+}
+
+int64_t
+opstat_value(const char *name)
+{
+	struct pfl_opstat *opst;
+
+	opst = pfl_opstat_init("%s", name);
+	pfl_opstat_fold(opst);
+	return (psc_atomic64_read(&opst->opst_lifetime));
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pfl_opstat_hist *oph;
+	struct pfl_opstat *opst;
+	pthread_t thr[NTHRS];
+	uint64_t lo, hi, plo, phi, v;
+	int i, b;
+
+	pfl_init();
+	progname = argv[0];
+	if (getopt(argc, argv, "") != -1)
+		usage();
+	argc -= optind;
+	if (argc)
+		usage();
+
+	/* bucket boundaries must tile the value space */
+	phi = 0;
+	for (b = 0; b < PFL_OPHIST_NBUCKETS; b++) {
+		pfl_opstat_hist_bounds(b, &lo, &hi);
+		psc_assert(lo <= hi);
+		psc_assert(b == 0 || lo == phi + 1);
+		psc_assert(pfl_opstat_hist_bucket(lo) == b);
+		psc_assert(pfl_opstat_hist_bucket(hi) == b);
+		phi = hi;
+	}
+	psc_assert(phi == UINT64_MAX);
+
+	/* relative error is bounded by the sub-bucket count */
+	for (v = 1; v < UINT64_C(1) << 40; v = v * 3 + 1) {
+		pfl_opstat_hist_bounds(pfl_opstat_hist_bucket(v), &plo,
+		    &phi);
+		psc_assert(plo <= v && v <= phi);
+		psc_assert(phi - plo <= plo / PFL_OPHIST_NSUB);
+	}
+
+	/* sharded counters lose no updates */
+	sharded = pfl_opstat_initf(OPSTF_SHARDED, "test-sharded");
+	psc_assert(sharded->opst_shards);
+	for (i = 0; i < NTHRS; i++)
+		psc_assert(pthread_create(&thr[i], NULL, thr_main,
+		    NULL) == 0);
+	for (i = 0; i < NTHRS; i++)
+		pthread_join(thr[i], NULL);
+	psc_assert(opstat_value("test-sharded") == NTHRS * NITER);
+	psc_assert(opstat_value("test-macro") == 2 * NTHRS * NITER);
+
+	/* recycled shard slots start out empty */
+	opst = pfl_opstat_initf(OPSTF_SHARDED, "test-recycle");
+	psc_assert(opst->opst_shards != sharded->opst_shards);
+	pfl_opstat_incr(opst);
+	pfl_opstat_destroy(opst);
+	opst = pfl_opstat_initf(OPSTF_SHARDED, "test-recycle");
+	psc_assert(opstat_value("test-recycle") == 0);
+	pfl_opstat_destroy(opst);
+
+	/* percentiles of 1..1000 */
+	oph = pfl_opstat_hist_init(0, "test-hist");
+	psc_assert(pfl_opstat_hist_init(0, "test-hist") == oph);
+	psc_assert(oph->oph_pctl[0]->opst_flags & OPSTF_NORATE);
+	for (v = 1; v <= 1000; v++)
+		pfl_opstat_hist_add(oph, v);
+	pfl_opstat_hist_update(oph);
+	psc_assert(opstat_value("test-hist-count") == 1000);
+	psc_assert(opstat_value("test-hist") == 1000 * 1001 / 2);
+	for (i = 0; i < PFL_OPHIST_NPCTL; i++) {
+		int64_t want[] = { 500, 900, 990, 999 }, got;
+
+		got = psc_atomic64_read(&oph->oph_pctl[i]->opst_lifetime);
+		psc_assert(got >= want[i]);
+		psc_assert(got - want[i] <= want[i] / PFL_OPHIST_NSUB);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,198 @@
+/* $Id$ */
+/*
+ * %PSC_START_COPYRIGHT%
+ * -----------------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ *
+ * Permission to use, copy, modify, and distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice
+ * appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+ * THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pittsburgh Supercomputing Center	phone: 412.268.4960  fax: 412.268.5832
+ * 300 S. Craig Street			e-mail: remarks@psc.edu
+ * Pittsburgh, PA 15213			web: http://www.psc.edu/
+ * -----------------------------------------------------------------------------
+ * %PSC_END_COPYRIGHT%
+ */
+
+/*
+ * Compare multithreaded get/return throughput of a plain pool against
+ * one with the per-thread magazine layer and check that the pool
+ * counts stay exact either way.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/list.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+#include "pfl/pool.h"
+#include "pfl/time.h"
+
+#define NITEMS		1024
+#define BATCH		8
+
+struct item {
+	struct psc_listentry	lentry;
+	uint64_t		val;
+};
+
+const char *progname;
+
+int			 nthr = 16;
+int			 niter = 100000;
+struct psc_poolmgr	*curpool;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-i niter] [-n nthr]\n", progname);
+	exit(1);
+}
+
+void *
+thrmain(__unusedx void *arg)
+{
+	struct item *v[BATCH];
+	int i, j;
+
+	for (i = 0; i < niter; i++) {
+		for (j = 0; j < BATCH; j++) {
+			v[j] = psc_pool_get(curpool);
+			v[j]->val++;
+		}
+		for (j = 0; j < BATCH; j++)
+			psc_pool_return(curpool, v[j]);
+	}
+	return (NULL);
+}
+
+double
+run(struct psc_poolmgr *m)
+{
+	struct timespec ts0, ts1;
+	pthread_t *thr;
+	int i;
+
+	curpool = m;
+	thr = PSCALLOC(nthr * sizeof(*thr));
+	PFL_GETTIMESPEC_MONO(&ts0);
+	for (i = 0; i < nthr; i++)
+		psc_assert(pthread_create(&thr[i], NULL, thrmain,
+		    NULL) == 0);
+	for (i = 0; i < nthr; i++)
+		pthread_join(thr[i], NULL);
+	PFL_GETTIMESPEC_MONO(&ts1);
+	PSCFREE(thr);
+
+	/* every item must be accounted for once all are returned */
+	psc_assert(psc_pool_gettotal(m) == NITEMS);
+	psc_assert(psc_pool_nfree(m) == NITEMS);
+	psc_assert(!psc_pool_inuse(m));
+
+	timespecsub(&ts1, &ts0, &ts1);
+	return (2. * nthr * niter * BATCH / (ts1.tv_sec +
+	    ts1.tv_nsec * 1e-9));
+}
+
+void *
+drainmain(void *arg)
+{
+	struct psc_poolmgr *m = arg;
+	struct item *v[NITEMS];
+	int i;
+
+	/* items parked in another thread's magazines must be found */
+	for (i = 0; i < NITEMS; i++) {
+		v[i] = psc_pool_tryget(m);
+		psc_assert(v[i]);
+	}
+	psc_assert(psc_pool_tryget(m) == NULL);
+	for (i = 0; i < NITEMS; i++)
+		psc_pool_return(m, v[i]);
+	return (NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct psc_poolmaster plain_master, mag_master;
+	struct psc_poolmgr *plain, *mag;
+	struct item *v[BATCH];
+	pthread_t thr;
+	double r0, r1;
+	int c, i;
+
+	pfl_init();
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "i:n:")) != -1)
+		switch (c) {
+		case 'i':
+			niter = atoi(optarg);
+			break;
+		case 'n':
+			nthr = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || niter <= 0 || nthr <= 0)
+		usage();
+
+	psc_poolmaster_init(&plain_master, struct item, lentry,
+	    PPMF_NONE, NITEMS, NITEMS, NITEMS, NULL, NULL, NULL,
+	    "plain");
+	plain = psc_poolmaster_getmgr(&plain_master);
+
+	psc_poolmaster_init(&mag_master, struct item, lentry,
+	    PPMF_MAGAZINE, NITEMS, NITEMS, NITEMS, NULL, NULL, NULL,
+	    "mag");
+	mag = psc_poolmaster_getmgr(&mag_master);
+	psc_assert(mag->ppm_magslots);
+
+	/* a returned item stays in this thread's magazine */
+	for (i = 0; i < BATCH; i++)
+		v[i] = psc_pool_get(mag);
+	for (i = 0; i < BATCH; i++)
+		psc_pool_return(mag, v[i]);
+	psc_assert(psc_pool_nmagged(mag) == BATCH);
+	psc_assert(psc_pool_nfree(mag) == NITEMS);
+
+	psc_assert(pthread_create(&thr, NULL, drainmain, mag) == 0);
+	pthread_join(thr, NULL);
+
+	/* shrinking must see items held in magazines */
+	psc_pool_magflush(mag);
+	for (i = 0; i < BATCH; i++)
+		v[i] = psc_pool_get(mag);
+	for (i = 0; i < BATCH; i++)
+		psc_pool_return(mag, v[i]);
+	mag->ppm_min = 0;
+	psc_assert(psc_pool_settotal(mag, 0) == NITEMS);
+	psc_assert(psc_pool_gettotal(mag) == 0);
+	psc_assert(psc_pool_nmagged(mag) == 0);
+	psc_assert(psc_pool_grow(mag, NITEMS) == NITEMS);
+
+	r0 = run(plain);
+	r1 = run(mag);
+	printf("%d threads: plain %.0f ops/s, magazine %.0f ops/s "
+	    "(%.2fx)\n", nthr, r0, r1, r1 / r0);
+
+	exit(0);
+}
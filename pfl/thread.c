@@ -100,6 +100,8 @@ _pfl_tls_release(void *arg)
 	void **tbl = arg;
 	int i;
 
+	if (tbl[PFL_TLSIDX_LOGDATA])
+		psclog_releasedata(tbl[PFL_TLSIDX_LOGDATA]);
 	for (i = 0; i < PFL_TLSIDX_MAX; i++)
 		psc_free(tbl[i], PAF_NOGUARD | PAF_NOLOG);
 	psc_free(tbl, PAF_NOGUARD | PAF_NOLOG);
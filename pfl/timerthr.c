@@ -50,6 +50,7 @@ void
 pfl_opstimerthr_main(struct psc_thread *thr)
 {
 	struct psc_waitq dummy = PSC_WAITQ_INIT;
+	struct pfl_opstat_hist *oph;
 	struct pfl_opstat *opst;
 	struct timespec ts;
 	double alpha = .25;
@@ -68,7 +69,13 @@ pfl_opstimerthr_main(struct psc_thread *thr)
 		psc_waitq_waitabs(&dummy, NULL, &ts);
 
 		spinlock(&pfl_opstats_lock);
+		DYNARRAY_FOREACH(opst, i, &pfl_opstats)
+			pfl_opstat_fold(opst);
+		DYNARRAY_FOREACH(oph, i, &pfl_opstat_hists)
+			pfl_opstat_hist_update(oph);
 		DYNARRAY_FOREACH(opst, i, &pfl_opstats) {
+			if (opst->opst_flags & OPSTF_NORATE)
+				continue;
 
 			/* update last second rate */
 			curr = psc_atomic64_read(&opst->opst_lifetime);
@@ -0,0 +1,295 @@
+/* $Id$ */
+/*
+ * %PSC_START_COPYRIGHT%
+ * -----------------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ *
+ * Permission to use, copy, modify, and distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice
+ * appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+ * THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pittsburgh Supercomputing Center	phone: 412.268.4960  fax: 412.268.5832
+ * 300 S. Craig Street			e-mail: remarks@psc.edu
+ * Pittsburgh, PA 15213			web: http://www.psc.edu/
+ * -----------------------------------------------------------------------------
+ * %PSC_END_COPYRIGHT%
+ */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/uring.h"
+
+#ifdef HAVE_IO_URING
+
+#define URING_LOAD_ACQ(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define URING_STORE_REL(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * Create a ring.
+ * @pur: ring to initialize.
+ * @nsqe: number of submission queue entries.
+ * @ncqe: number of completion queue entries, or zero for the kernel
+ *	default of twice @nsqe.
+ * Returns zero or negative errno.
+ */
+int
+pfl_uring_init(struct pfl_uring *pur, unsigned nsqe, unsigned ncqe)
+{
+	struct io_uring_params p;
+	void *sqp, *cqp;
+	int rc;
+
+	memset(pur, 0, sizeof(*pur));
+	memset(&p, 0, sizeof(p));
+	if (ncqe) {
+		p.flags |= IORING_SETUP_CQSIZE;
+		p.cq_entries = ncqe;
+	}
+	pur->pur_fd = syscall(__NR_io_uring_setup, nsqe, &p);
+	if (pur->pur_fd == -1)
+		return (-errno);
+	pur->pur_features = p.features;
+
+	pur->pur_sq_ringsz = p.sq_off.array + p.sq_entries *
+	    sizeof(unsigned);
+	pur->pur_cq_ringsz = p.cq_off.cqes + p.cq_entries *
+	    sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (pur->pur_cq_ringsz > pur->pur_sq_ringsz)
+			pur->pur_sq_ringsz = pur->pur_cq_ringsz;
+		pur->pur_cq_ringsz = pur->pur_sq_ringsz;
+	}
+
+	sqp = mmap(NULL, pur->pur_sq_ringsz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, pur->pur_fd, IORING_OFF_SQ_RING);
+	if (sqp == MAP_FAILED)
+		goto error;
+	pur->pur_sq_ring = sqp;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cqp = sqp;
+	else {
+		cqp = mmap(NULL, pur->pur_cq_ringsz, PROT_READ |
+		    PROT_WRITE, MAP_SHARED | MAP_POPULATE, pur->pur_fd,
+		    IORING_OFF_CQ_RING);
+		if (cqp == MAP_FAILED)
+			goto error;
+	}
+	pur->pur_cq_ring = cqp;
+
+	pur->pur_sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	pur->pur_sqes = mmap(NULL, pur->pur_sqes_sz, PROT_READ |
+	    PROT_WRITE, MAP_SHARED | MAP_POPULATE, pur->pur_fd,
+	    IORING_OFF_SQES);
+	if (pur->pur_sqes == MAP_FAILED) {
+		pur->pur_sqes = NULL;
+		goto error;
+	}
+
+	pur->pur_sq_head = (void *)((char *)sqp + p.sq_off.head);
+	pur->pur_sq_tail = (void *)((char *)sqp + p.sq_off.tail);
+	pur->pur_sq_array = (void *)((char *)sqp + p.sq_off.array);
+	pur->pur_sq_mask = *(unsigned *)((char *)sqp +
+	    p.sq_off.ring_mask);
+	pur->pur_sq_entries = p.sq_entries;
+	pur->pur_sqe_tail = *pur->pur_sq_tail;
+
+	pur->pur_cq_head = (void *)((char *)cqp + p.cq_off.head);
+	pur->pur_cq_tail = (void *)((char *)cqp + p.cq_off.tail);
+	pur->pur_cqes = (void *)((char *)cqp + p.cq_off.cqes);
+	pur->pur_cq_mask = *(unsigned *)((char *)cqp +
+	    p.cq_off.ring_mask);
+	pur->pur_cq_entries = p.cq_entries;
+	return (0);
+
+ error:
+	rc = -errno;
+	pfl_uring_destroy(pur);
+	return (rc);
+}
+
+void
+pfl_uring_destroy(struct pfl_uring *pur)
+{
+	if (pur->pur_sqes)
+		munmap(pur->pur_sqes, pur->pur_sqes_sz);
+	if (pur->pur_cq_ring && pur->pur_cq_ring != pur->pur_sq_ring)
+		munmap(pur->pur_cq_ring, pur->pur_cq_ringsz);
+	if (pur->pur_sq_ring)
+		munmap(pur->pur_sq_ring, pur->pur_sq_ringsz);
+	if (pur->pur_fd >= 0)
+		close(pur->pur_fd);
+	memset(pur, 0, sizeof(*pur));
+	pur->pur_fd = -1;
+}
+
+/*
+ * Obtain a free submission queue entry, or NULL if the queue is full
+ * and pfl_uring_submit() must be called first.
+ */
+struct io_uring_sqe *
+pfl_uring_get_sqe(struct pfl_uring *pur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head;
+
+	head = URING_LOAD_ACQ(pur->pur_sq_head);
+	if (pur->pur_sqe_tail - head >= pur->pur_sq_entries)
+		return (NULL);
+	sqe = &pur->pur_sqes[pur->pur_sqe_tail & pur->pur_sq_mask];
+	pur->pur_sq_array[pur->pur_sqe_tail & pur->pur_sq_mask] =
+	    pur->pur_sqe_tail & pur->pur_sq_mask;
+	pur->pur_sqe_tail++;
+	return (sqe);
+}
+
+/*
+ * Take back the submission queue entry most recently obtained with
+ * pfl_uring_get_sqe(), e.g. after pfl_uring_submit() failed.  Returns
+ * 0 on success or -EBUSY if the kernel has already consumed it, in
+ * which case its completion will still be delivered.
+ */
+int
+pfl_uring_unget_sqe(struct pfl_uring *pur)
+{
+	if (pur->pur_sqe_tail == URING_LOAD_ACQ(pur->pur_sq_head))
+		return (-EBUSY);
+	pur->pur_sqe_tail--;
+	if ((int)(*pur->pur_sq_tail - pur->pur_sqe_tail) > 0)
+		URING_STORE_REL(pur->pur_sq_tail, pur->pur_sqe_tail);
+	return (0);
+}
+
+/*
+ * Publish all prepared submission queue entries to the kernel.
+ * Returns the number of entries consumed or negative errno.
+ */
+int
+pfl_uring_submit(struct pfl_uring *pur)
+{
+	unsigned n;
+	int rc;
+
+	/*
+	 * Count everything the kernel has not yet consumed so entries
+	 * left over from a short prior submission are retried.
+	 */
+	URING_STORE_REL(pur->pur_sq_tail, pur->pur_sqe_tail);
+	n = pur->pur_sqe_tail - URING_LOAD_ACQ(pur->pur_sq_head);
+	if (n == 0)
+		return (0);
+	do
+		rc = syscall(__NR_io_uring_enter, pur->pur_fd, n, 0, 0,
+		    NULL, 0);
+	while (rc == -1 && errno == EINTR);
+	return (rc == -1 ? -errno : rc);
+}
+
+/*
+ * Wait for a completion.  The entry remains owned by the caller until
+ * pfl_uring_cqe_seen() is invoked.
+ */
+int
+pfl_uring_wait_cqe(struct pfl_uring *pur, struct io_uring_cqe **cqep)
+{
+	unsigned head;
+	int rc;
+
+	for (;;) {
+		head = *pur->pur_cq_head;
+		if (head != URING_LOAD_ACQ(pur->pur_cq_tail)) {
+			*cqep = &pur->pur_cqes[head & pur->pur_cq_mask];
+			return (0);
+		}
+		rc = syscall(__NR_io_uring_enter, pur->pur_fd, 0, 1,
+		    IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc == -1 && errno != EINTR)
+			return (-errno);
+	}
+}
+
+void
+pfl_uring_cqe_seen(struct pfl_uring *pur)
+{
+	URING_STORE_REL(pur->pur_cq_head, *pur->pur_cq_head + 1);
+}
+
+/*
+ * Register an empty fixed buffer table of the given size, to be
+ * populated with pfl_uring_update_buffer().
+ */
+int
+pfl_uring_register_sparse(struct pfl_uring *pur, unsigned nbufs)
+{
+	struct io_uring_rsrc_register rr;
+
+	memset(&rr, 0, sizeof(rr));
+	rr.nr = nbufs;
+	rr.flags = IORING_RSRC_REGISTER_SPARSE;
+	if (syscall(__NR_io_uring_register, pur->pur_fd,
+	    IORING_REGISTER_BUFFERS2, &rr, sizeof(rr)) == -1)
+		return (-errno);
+	pur->pur_flags |= PURF_FIXEDBUFS;
+	return (0);
+}
+
+/*
+ * Install (or, with a NULL base, remove) a fixed buffer at the given
+ * table index.
+ */
+int
+pfl_uring_update_buffer(struct pfl_uring *pur, unsigned idx,
+    void *base, size_t len)
+{
+	struct io_uring_rsrc_update2 up;
+	struct iovec iov;
+
+	iov.iov_base = base;
+	iov.iov_len = base ? len : 0;
+	memset(&up, 0, sizeof(up));
+	up.offset = idx;
+	up.data = (uintptr_t)&iov;
+	up.nr = 1;
+	if (syscall(__NR_io_uring_register, pur->pur_fd,
+	    IORING_REGISTER_BUFFERS_UPDATE, &up, sizeof(up)) == -1)
+		return (-errno);
+	return (0);
+}
+
+/*
+ * Fill in a read or write submission entry.
+ * @bufidx: fixed buffer index or -1.
+ * @data: opaque value returned in the completion's user_data.
+ */
+void
+pfl_uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, void *buf,
+    size_t len, off_t off, int bufidx, uint64_t data)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	if (bufidx != -1)
+		sqe->buf_index = bufidx;
+	sqe->user_data = data;
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,106 @@
+/* $Id$ */
+/*
+ * %PSC_START_COPYRIGHT%
+ * -----------------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ *
+ * Permission to use, copy, modify, and distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice
+ * appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+ * THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pittsburgh Supercomputing Center	phone: 412.268.4960  fax: 412.268.5832
+ * 300 S. Craig Street			e-mail: remarks@psc.edu
+ * Pittsburgh, PA 15213			web: http://www.psc.edu/
+ * -----------------------------------------------------------------------------
+ * %PSC_END_COPYRIGHT%
+ */
+
+/*
+ * Minimal io_uring(7) interface built directly on the system calls so
+ * no external library is required.  Submission must be serialized by
+ * the caller; completions are expected to be reaped by a single
+ * thread.
+ */
+
+#ifndef _PFL_URING_H_
+#define _PFL_URING_H_
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef HAVE_IO_URING
+#  include <linux/io_uring.h>
+
+struct pfl_uring {
+	int			 pur_fd;
+	unsigned		 pur_features;
+
+	/* submission queue */
+	unsigned		*pur_sq_head;
+	unsigned		*pur_sq_tail;
+	unsigned		*pur_sq_array;
+	unsigned		 pur_sq_mask;
+	unsigned		 pur_sq_entries;
+	unsigned		 pur_sqe_tail;	/* local, not yet published */
+	struct io_uring_sqe	*pur_sqes;
+
+	/* completion queue */
+	unsigned		*pur_cq_head;
+	unsigned		*pur_cq_tail;
+	unsigned		 pur_cq_mask;
+	unsigned		 pur_cq_entries;
+	struct io_uring_cqe	*pur_cqes;
+
+	void			*pur_sq_ring;
+	size_t			 pur_sq_ringsz;
+	void			*pur_cq_ring;
+	size_t			 pur_cq_ringsz;
+	size_t			 pur_sqes_sz;
+	int			 pur_flags;	/* see PURF_* */
+};
+
+/* pur_flags */
+#define PURF_FIXEDBUFS		(1 << 0)	/* sparse buffer table registered */
+
+int	pfl_uring_init(struct pfl_uring *, unsigned, unsigned);
+void	pfl_uring_destroy(struct pfl_uring *);
+
+struct io_uring_sqe *
+	pfl_uring_get_sqe(struct pfl_uring *);
+int	pfl_uring_submit(struct pfl_uring *);
+int	pfl_uring_unget_sqe(struct pfl_uring *);
+int	pfl_uring_wait_cqe(struct pfl_uring *, struct io_uring_cqe **);
+void	pfl_uring_cqe_seen(struct pfl_uring *);
+
+int	pfl_uring_register_sparse(struct pfl_uring *, unsigned);
+int	pfl_uring_update_buffer(struct pfl_uring *, unsigned, void *,
+	    size_t);
+
+void	pfl_uring_prep_rw(struct io_uring_sqe *, int, int, void *,
+	    size_t, off_t, int, uint64_t);
+
+#define pfl_uring_prep_read(sqe, fd, buf, len, off, bufidx, data)	\
+	pfl_uring_prep_rw((sqe), (bufidx) == -1 ? IORING_OP_READ :	\
+	    IORING_OP_READ_FIXED, (fd), (buf), (len), (off), (bufidx),	\
+	    (data))
+
+#define pfl_uring_prep_write(sqe, fd, buf, len, off, bufidx, data)	\
+	pfl_uring_prep_rw((sqe), (bufidx) == -1 ? IORING_OP_WRITE :	\
+	    IORING_OP_WRITE_FIXED, (fd), (buf), (len), (off), (bufidx),	\
+	    (data))
+
+#endif /* HAVE_IO_URING */
+
+#endif /* _PFL_URING_H_ */
@@ -0,0 +1,321 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Connection-scaling benchmark for the userland socket LND poll thread
+ * dispatch strategies.  A single dispatcher thread owns the server end
+ * of N connections and echoes whatever arrives, the way a usocklnd poll
+ * thread services its peers; a client thread sends one message at a
+ * time to a randomly chosen peer and times the round trip.  Only one
+ * peer is active at any moment, so the difference between backends is
+ * the per-wakeup cost of having N - 1 idle connections registered.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/pfl.h"
+#include "pfl/random.h"
+#include "pfl/time.h"
+
+#define MSGSZ		64
+
+enum {
+	BK_POLL,
+	BK_EPOLL,
+	NBK
+};
+
+const char	*bk_names[] = {
+	"poll",
+	"epoll"
+};
+
+struct bench {
+	int		 b_backend;
+	int		 b_npeers;
+	int		 b_niter;
+	int		*b_cli;		/* client ends (blocking) */
+	int		*b_srv;		/* server ends (nonblocking) */
+	int		 b_done;
+};
+
+const char	*progname;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: %s [-b backend] [-n iterations] [npeers ...]\n",
+	    progname);
+	exit(1);
+}
+
+/*
+ * Service one readable server end: echo everything pending.
+ * Returns 0 once the socket would block, -1 on EOF.
+ */
+int
+echo(int fd)
+{
+	char buf[MSGSZ * 4];
+	ssize_t rc;
+
+	for (;;) {
+		rc = read(fd, buf, sizeof(buf));
+		if (rc == -1 && errno == EAGAIN)
+			return (0);
+		if (rc == -1)
+			err(1, "read");
+		if (rc == 0)
+			return (-1);
+		if (write(fd, buf, rc) != rc)
+			err(1, "write");
+	}
+}
+
+/* poll(2) over every conn, then scan them all for revents. */
+void *
+dispatch_poll(void *arg)
+{
+	struct bench *b = arg;
+	struct pollfd *pfd;
+	int i, n, rc;
+
+	n = b->b_npeers;
+	pfd = PSCALLOC(n * sizeof(*pfd));
+	for (i = 0; i < n; i++) {
+		pfd[i].fd = b->b_srv[i];
+		pfd[i].events = POLLIN;
+	}
+	while (!b->b_done) {
+		rc = poll(pfd, n, 100);
+		if (rc == -1 && errno != EINTR)
+			err(1, "poll");
+		for (i = 0; rc > 0 && i < n; i++)
+			if (pfd[i].revents & POLLIN) {
+				echo(pfd[i].fd);
+				rc--;
+			}
+	}
+	PSCFREE(pfd);
+	return (NULL);
+}
+
+#ifdef HAVE_EPOLL
+/* Edge-triggered epoll(7): cost scales with ready conns only. */
+void *
+dispatch_epoll(void *arg)
+{
+	struct epoll_event ev, evs[64];
+	struct bench *b = arg;
+	int i, n, epfd;
+
+	epfd = epoll_create1(0);
+	if (epfd == -1)
+		err(1, "epoll_create1");
+	for (i = 0; i < b->b_npeers; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = b->b_srv[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, b->b_srv[i], &ev) == -1)
+			err(1, "epoll_ctl");
+	}
+	while (!b->b_done) {
+		n = epoll_wait(epfd, evs, nitems(evs), 100);
+		if (n == -1 && errno != EINTR)
+			err(1, "epoll_wait");
+		for (i = 0; i < n; i++)
+			echo(evs[i].data.fd);
+	}
+	close(epfd);
+	return (NULL);
+}
+#endif
+
+int
+cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return (CMP(*x, *y));
+}
+
+void
+run(int backend, int npeers, int niter)
+{
+	struct timespec ts0, ts1, tsd;
+	char msg[MSGSZ], rsp[MSGSZ];
+	struct bench b;
+	pthread_t thr;
+	uint64_t *lat, sum = 0;
+	ssize_t rc, got;
+	int i, k, sv[2];
+
+	memset(&b, 0, sizeof(b));
+	b.b_backend = backend;
+	b.b_npeers = npeers;
+	b.b_niter = niter;
+	b.b_cli = PSCALLOC(npeers * sizeof(int));
+	b.b_srv = PSCALLOC(npeers * sizeof(int));
+	for (i = 0; i < npeers; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+			err(1, "socketpair (npeers=%d); raise RLIMIT_NOFILE",
+			    npeers);
+		if (fcntl(sv[1], F_SETFL, O_NONBLOCK) == -1)
+			err(1, "fcntl");
+		b.b_cli[i] = sv[0];
+		b.b_srv[i] = sv[1];
+	}
+
+	lat = PSCALLOC(niter * sizeof(*lat));
+	memset(msg, 'x', sizeof(msg));
+
+	if (pthread_create(&thr, NULL,
+#ifdef HAVE_EPOLL
+	    backend == BK_EPOLL ? dispatch_epoll :
+#endif
+	    dispatch_poll, &b))
+		errx(1, "pthread_create");
+
+	for (i = 0; i < niter; i++) {
+		k = psc_random32u(npeers);
+		PFL_GETTIMESPEC(&ts0);
+		if (write(b.b_cli[k], msg, sizeof(msg)) != sizeof(msg))
+			err(1, "write");
+		for (got = 0; got < (ssize_t)sizeof(rsp); got += rc) {
+			rc = read(b.b_cli[k], rsp + got, sizeof(rsp) - got);
+			if (rc <= 0)
+				err(1, "read");
+		}
+		PFL_GETTIMESPEC(&ts1);
+		timespecsub(&ts1, &ts0, &tsd);
+		lat[i] = tsd.tv_sec * UINT64_C(1000000000) + tsd.tv_nsec;
+		sum += lat[i];
+	}
+
+	b.b_done = 1;
+	pthread_join(thr, NULL);
+
+	qsort(lat, niter, sizeof(*lat), cmp_u64);
+	printf("%-6s %7d %10.2f %10.2f %10.2f\n", bk_names[backend],
+	    npeers, sum / 1e3 / niter, lat[niter / 2] / 1e3,
+	    lat[niter * 99 / 100] / 1e3);
+
+	for (i = 0; i < npeers; i++) {
+		close(b.b_cli[i]);
+		close(b.b_srv[i]);
+	}
+	PSCFREE(lat);
+	PSCFREE(b.b_cli);
+	PSCFREE(b.b_srv);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c, i, k, niter = 10000, backend = -1;
+	int defpeers[] = { 100, 1000, 10000 };
+	struct rlimit rlim;
+	char *endp;
+	long l;
+
+	pfl_init();
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "b:n:")) != -1)
+		switch (c) {
+		case 'b':
+			for (backend = 0; backend < NBK; backend++)
+				if (strcmp(optarg, bk_names[backend]) == 0)
+					break;
+			if (backend == NBK)
+				errx(1, "%s: unknown backend", optarg);
+			break;
+		case 'n':
+			l = strtol(optarg, &endp, 10);
+			if (l <= 0 || l > INT_MAX || *endp)
+				errx(1, "%s: invalid iterations", optarg);
+			niter = l;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+
+#ifndef HAVE_EPOLL
+	if (backend == BK_EPOLL)
+		errx(1, "epoll: not supported on this platform");
+	if (backend == -1)
+		backend = BK_POLL;
+#endif
+
+	/* two descriptors per peer */
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == -1)
+		err(1, "getrlimit");
+	if (rlim.rlim_cur < rlim.rlim_max) {
+		rlim.rlim_cur = rlim.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rlim) == -1)
+			getrlimit(RLIMIT_NOFILE, &rlim);
+	}
+
+	printf("%-6s %7s %10s %10s %10s\n", "engine", "peers",
+	    "mean(us)", "p50(us)", "p99(us)");
+	for (i = 0; i < (argc ? argc : (int)nitems(defpeers)); i++) {
+		if (argc) {
+			l = strtol(argv[i], &endp, 10);
+			if (l <= 0 || l > INT_MAX / 2 || *endp)
+				errx(1, "%s: invalid peer count", argv[i]);
+		} else
+			l = defpeers[i];
+		if (rlim.rlim_cur != RLIM_INFINITY &&
+		    (rlim_t)l * 2 + 16 > rlim.rlim_cur) {
+			warnx("%ld peers: RLIMIT_NOFILE %ld too low; "
+			    "skipping", l, (long)rlim.rlim_cur);
+			continue;
+		}
+		for (k = 0; k < NBK; k++)
+			if (backend == -1 || backend == k)
+				run(k, l, niter);
+	}
+	exit(0);
+}
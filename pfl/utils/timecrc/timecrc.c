@@ -26,15 +26,20 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 
+#include <err.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "pfl/alloc.h"
 #include "pfl/cdefs.h"
 #include "pfl/crc.h"
 #include "pfl/log.h"
+#include "pfl/pfl.h"
+#include "pfl/random.h"
 #include "pfl/time.h"
 #include "pfl/types.h"
 
@@ -43,10 +48,61 @@ const char *progname;
 __dead void
 usage(void)
 {
-	fprintf(stderr, "usage: %s file\n", progname);
+	fprintf(stderr,
+	    "usage: %s [-k kernel] file\n"
+	    "       %s -b [-n iterations] [-s bufsize]\n",
+	    progname, progname);
 	exit(1);
 }
 
+#define TV2SEC(tv)	((tv)->tv_sec + (tv)->tv_usec * 1e-6)
+
+/*
+ * Run every available CRC64 kernel over the same in-memory buffer,
+ * verify they agree, and report throughput.
+ */
+void
+bench(size_t bufsz, int niter)
+{
+	struct timeval tm0, tm1, tmd;
+	uint64_t crc, ref = 0;
+	int i, k, first = 1;
+	void *buf;
+
+	buf = PSCALLOC(bufsz);
+	pfl_random_getbytes(buf, bufsz);
+
+	for (k = 0; k < PFL_CRC64_NKERNELS; k++) {
+		if (!psc_crc64_kernel_avail(k)) {
+			printf("%-8s unavailable\n",
+			    psc_crc64_kernel_names[k]);
+			continue;
+		}
+
+		PFL_GETTIMEVAL(&tm0);
+		for (i = 0; i < niter; i++) {
+			psc_crc64_init(&crc);
+			psc_crc64_add_kernel(k, &crc, buf, bufsz);
+			psc_crc64_fini(&crc);
+		}
+		PFL_GETTIMEVAL(&tm1);
+		timersub(&tm1, &tm0, &tmd);
+
+		if (first)
+			ref = crc;
+		first = 0;
+		printf("%-8s crc %"PSCPRIxCRC64" %8.3f GB/s%s%s\n",
+		    psc_crc64_kernel_names[k], crc,
+		    (double)bufsz * niter / TV2SEC(&tmd) / 1e9,
+		    k == psc_crc64_kernel ? " (default)" : "",
+		    crc == ref ? "" : " MISMATCH");
+		if (crc != ref)
+			psc_fatalx("%s: CRC mismatch",
+			    psc_crc64_kernel_names[k]);
+	}
+	PSCFREE(buf);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -54,16 +110,56 @@ main(int argc, char *argv[])
 	struct stat stb;
 	char buf[BUFSIZ];
 	uint64_t crc;
-	const char *fn;
-	int fd, pad;
-	size_t acsz;
+	const char *fn, *kern = NULL;
+	int c, k, fd, pad, bflag = 0, niter = 1000;
+	size_t acsz, bufsz = 1024 * 1024;
 	ssize_t rc;
+	char *endp;
+	long l;
 
+	pfl_init();
 	progname = argv[0];
-	if (getopt(argc, argv, "") != -1)
-		usage();
+	while ((c = getopt(argc, argv, "bk:n:s:")) != -1)
+		switch (c) {
+		case 'b':
+			bflag = 1;
+			break;
+		case 'k':
+			kern = optarg;
+			break;
+		case 'n':
+			l = strtol(optarg, &endp, 10);
+			if (l <= 0 || l > INT_MAX || *endp)
+				errx(1, "%s: invalid iterations", optarg);
+			niter = l;
+			break;
+		case 's':
+			l = strtol(optarg, &endp, 10);
+			if (l <= 0 || *endp)
+				errx(1, "%s: invalid buffer size", optarg);
+			bufsz = l;
+			break;
+		default:
+			usage();
+		}
 	argc -= optind;
 	argv += optind;
+
+	if (kern) {
+		for (k = 0; k < PFL_CRC64_NKERNELS; k++)
+			if (strcmp(kern, psc_crc64_kernel_names[k]) == 0)
+				break;
+		if (psc_crc64_setkernel(k))
+			errx(1, "%s: unknown or unavailable kernel", kern);
+	}
+
+	if (bflag) {
+		if (argc)
+			usage();
+		bench(bufsz, niter);
+		exit(0);
+	}
+
 	if (argc != 1)
 		usage();
 	fn = argv[0];
@@ -107,7 +203,10 @@ main(int argc, char *argv[])
 	close(fd);
 
 	psc_crc64_fini(&crc);
-	printf("\rcrc %"PSCPRIxCRC64" size %"PSCPRIdOFFT" time %.3fs\n",
-	    crc, stb.st_size, tm_total.tv_sec + tm_total.tv_usec * 1e-6);
+	printf("\rcrc %"PSCPRIxCRC64" size %"PSCPRIdOFFT" time %.3fs "
+	    "(%.3f GB/s, %s)\n", crc, stb.st_size, TV2SEC(&tm_total),
+	    TV2SEC(&tm_total) ? stb.st_size / TV2SEC(&tm_total) / 1e9 : 0.,
+	    psc_crc64_kernel == -1 ? "none" :
+	    psc_crc64_kernel_names[psc_crc64_kernel]);
 	exit(0);
 }
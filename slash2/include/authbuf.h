@@ -39,16 +39,34 @@ struct pscrpc_request;
 #define AUTHBUF_ALGLEN		32
 #define AUTHBUF_KEYSIZE		1024
 
+/*
+ * Bulk data authenticators.  Peers advertise the set they have enabled
+ * at CONNECT time and both sides settle on the highest numbered one in
+ * common, so the choice is the same regardless of who connected first.
+ */
+#define AUTHBUF_BULKALG_SHA256	0		/* keyed SHA-256 (SHA-NI if present) */
+#define AUTHBUF_BULKALG_BLAKE2B	1		/* keyed BLAKE2b-256 */
+#define AUTHBUF_BULKALG_BLAKE2S	2		/* keyed BLAKE2s-256 */
+#define AUTHBUF_BULKALG_MAX	3
+
+#define AUTHBUF_BULKALG_MASK(alg)	(1 << (alg))
+
 int	authbuf_check(struct pscrpc_request *, int, int);
 void	authbuf_sign(struct pscrpc_request *, int);
 
 void	authbuf_checkkey(const char *, struct stat *);
 void	authbuf_checkkeyfile(void);
 void	authbuf_createkeyfile(void);
-void	authbuf_readkeyfile(void);
+void	authbuf_readkeyfile(int);
+
+int	authbuf_bulkalg_open(int, gcry_md_hd_t *, const void *, size_t);
+int	authbuf_bulkalg_select(uint32_t);
 
 extern psc_atomic64_t	sl_authbuf_nonce;
 extern unsigned char	sl_authbuf_key[AUTHBUF_KEYSIZE];
 extern gcry_md_hd_t	sl_authbuf_hd;
+extern gcry_md_hd_t	sl_authbuf_bulkhd[AUTHBUF_BULKALG_MAX];
+extern uint32_t		sl_authbuf_bulkalgs;
+extern const char	*authbuf_bulkalg_names[AUTHBUF_BULKALG_MAX];
 
 #endif /* _SL_AUTHBUF_H_ */
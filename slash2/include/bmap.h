@@ -109,6 +109,7 @@ struct bmap {
 	uint32_t		 bcm_flags;	/* see BMAP_* below */
 	struct fidc_membh	*bcm_fcmh;	/* pointer to fid info */
 	psc_atomic32_t		 bcm_opcnt;	/* pending opcnt (# refs) */
+	psc_atomic32_t		 bcm_pincnt;	/* lookups waiting on bcm_lock */
 	psc_spinlock_t		 bcm_lock;
 	RB_ENTRY(bmap)		 bcm_tentry;	/* entry in fcmh's bmap tree */
 	struct psc_listentry	 bcm_lentry;	/* free pool and flush queue */
@@ -34,8 +34,6 @@
 # define SL_PATH_ETC_DIR	"/etc/slash"
 #endif
 
-#define SL_PATH_DEV_SHM		"/dev/shm"
-
 #define SL_PATH_SLMCTLSOCK	SL_PATH_RUNTIME_DIR"/slashd.%h.sock"
 #define SL_PATH_SLICTLSOCK	SL_PATH_RUNTIME_DIR"/sliod.%h.sock"
 #define SL_PATH_MSCTLSOCK	SL_PATH_RUNTIME_DIR"/mount_slash.%h.sock"
@@ -47,7 +45,7 @@
 #define SL_FN_AUTHBUFKEY	"authbuf.key"
 #define SL_FN_MAPFILE		"mapfile"
 #define SL_FN_OPJOURNAL		"op-journal"
-#define SL_FN_UPSCHDB		"upsch.db"
+#define SL_FN_UPSCHLOG		"upsch.log"
 
 /* configuration files */
 #define SL_PATH_CONF		SL_PATH_ETC_DIR"/slcfg"
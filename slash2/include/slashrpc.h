@@ -187,7 +187,8 @@ enum {
 	SRMT_PRECLAIM,				/* 48: partial file reclaim */
 	SRMT_BATCH_RQ,				/* 49: async batch request */
 	SRMT_BATCH_RP,				/* 50: async batch reply */
-	SRMT_CTL				/* 51: generic control */
+	SRMT_CTL,				/* 51: generic control */
+	SRMT_GETBMAPS				/* 52: get client leases for a run of bmaps */
 };
 
 /* ----------------------------- BEGIN MESSAGES ----------------------------- */
@@ -467,6 +468,39 @@ struct srm_leasebmap_rep {
 	struct srt_inode	ino;		/* if SRM_LEASEBMAPF_GETINODE */
 } __packed;
 
+/*
+ * Lease a run of consecutive bmaps in a single round trip.  The reply
+ * carries the inode and the number of leases granted; the per-bmap
+ * descriptors are returned via bulk as an array of srt_bmaplease.
+ * Granting stops at the first bmap that fails to load.
+ */
+#define SRM_LEASEBMAPS_MAX	16
+
+struct srm_leasebmaps_req {
+	struct sl_fidgen	fg;
+	sl_ios_id_t		prefios[NPREFIOS];/* client's preferred IOS ID */
+	sl_bmapno_t		bmapno;		/* starting bmap index number */
+	 int32_t		nbmaps;		/* length of run requested */
+	 int32_t		rw;		/* 'enum rw' value for access */
+	uint32_t		flags;		/* see SRM_LEASEBMAPF_* */
+	 int32_t		_pad;
+} __packed;
+
+struct srm_leasebmaps_rep {
+	 int32_t		rc;		/* 0 for success or slerrno */
+	 int32_t		nbmaps;		/* number of leases granted */
+	uint32_t		flags;		/* return SRM_LEASEBMAPF_* success */
+	 int32_t		_pad;
+	struct srt_inode	ino;		/* if SRM_LEASEBMAPF_GETINODE */
+} __packed;
+
+struct srt_bmaplease {
+	struct srt_bmapdesc	sbd;		/* descriptor for bmap */
+	uint8_t			repls[SL_REPLICA_NBYTES];
+	 int32_t		rc;		/* 0 for success or slerrno */
+	 int32_t		_pad;
+} __packed;
+
 struct srm_leasebmapext_req {
 	struct srt_bmapdesc	sbd;
 } __packed;
@@ -651,7 +685,7 @@ struct srt_reclaim_entry {
 struct srm_connect_req {
 	uint64_t		magic;
 	uint32_t		version;
-	 int32_t		nnids;
+	uint32_t		bulkauth;	/* mask of bulk authenticators */
 	uint64_t		fsuuid;		/* file system unique ID */
 	uint32_t		stkvers;	/* software stack version */
 	uint32_t		upnonce;	/* uptime instance */
@@ -663,6 +697,19 @@ struct srm_connect_rep {
 	 int32_t		stkvers;
 } __packed;
 
+/*
+ * CONNECT reply sent only to peers that offered a bulk authenticator
+ * mask: older peers post a reply buffer sized for srm_connect_rep and
+ * are sent that instead.
+ */
+struct srm_connect_bulkauth_rep {
+	uint64_t		fsuuid;
+	 int32_t		rc;
+	 int32_t		stkvers;
+	uint32_t		bulkauth;	/* selected bulk authenticator */
+	 int32_t		_pad;
+} __packed;
+
 struct srm_ping_req {
 	 int32_t		rc;
 	uint32_t		upnonce;	/* system uptime nonce to detect reboots */
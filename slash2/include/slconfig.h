@@ -149,8 +149,15 @@ struct sl_site {
 	struct psc_listentry	 site_lentry;
 	struct psc_dynarray	 site_resources;
 	sl_siteid_t		 site_id;
+	int			 site_ios_select;	/* see SLCFG_IOSSEL_* */
 };
 
+/* site_ios_select write lease I/O server selection policies */
+#define SLCFG_IOSSEL_RANDOM	0	/* uniform shuffle */
+#define SLCFG_IOSSEL_FREESPACE	1	/* random, weighted by free space */
+#define SLCFG_IOSSEL_LEASTLOAD	2	/* fewest leases and queued bandwidth */
+#define SLCFG_IOSSEL_MAX	3
+
 /* highest allowed site ID */
 #define SITE_MAXID		((1 << SLASH_FID_MDSID_BITS) - 1)
 
@@ -183,10 +190,18 @@ struct slcfg_local {
 	char			 cfg_prefios[RES_NAME_MAX];
 	char			 cfg_zpname[NAME_MAX + 1];
 	char			*cfg_selftest;
-	int			 cfg_async_io:1;
+	size_t			 cfg_slab_cache_size;	/* sliver arena bytes */
+	int			 cfg_async_io;		/* see SLCFG_ASYNCIO_* */
+	size_t			 cfg_direct_io_min;	/* cache bypass threshold */
+	int			 cfg_bulk_auth;		/* see AUTHBUF_BULKALG_* */
 	int			 cfg_root_squash:1;
 };
 
+/* cfg_async_io backing store read engines */
+#define SLCFG_ASYNCIO_NONE	0	/* synchronous pread(2) */
+#define SLCFG_ASYNCIO_POSIX	1	/* POSIX aio_read(3) + SIGIO */
+#define SLCFG_ASYNCIO_URING	2	/* io_uring(7) */
+
 /* SLASH2 deployment settings shared by all nodes */
 struct sl_config {
 	char			 gconf_lroutes[256];
@@ -313,6 +328,8 @@ extern char		 cfg_filename[];
 extern int		 cfg_lineno;
 extern struct psclist_head cfg_lnetif_pairs;
 
+extern const char	*slcfg_iossel_names[SLCFG_IOSSEL_MAX];
+
 extern uint32_t		 sl_sys_upnonce;
 
 /**
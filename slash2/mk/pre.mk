@@ -23,7 +23,6 @@ INCL_SLASH2_PRE_MK=1
 
 INCLUDES+=		-I${SLASH_BASE}/include
 INCLUDES+=		-I${SLASH_BASE}
-INCLUDES+=		${SQLITE3_INCLUDES}
 
 DEFINES+=		-DSL_STK_VERSION=$$(git log | grep -c ^commit)
 SRCS+=			${SLASH_BASE}/share/slerr.c
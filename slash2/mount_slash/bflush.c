@@ -24,6 +24,15 @@
  * Logic for bmap flushing: sending RPCs of dirty data modified by
  * clients to the IO systems they are bound to.  Write coalescing
  * (bwc) occurs to reduce RPC overhead.
+ *
+ * Bmaps with new biorqs are queued on the I/O server they are leased
+ * to, and I/O servers with queued bmaps are put on slc_bflush_rdyq,
+ * which the flusher threads service in turn.  Each bmap may have up to
+ * slc_bflush_maxinfl write RPCs outstanding; while its pipeline is
+ * full, newly written data accumulates and is sent in larger RPCs once
+ * a slot opens up.  A periodic sweep of slc_bmapflushq picks up what
+ * is not driven by biorq arrival or RPC completion: runs held back
+ * which have since aged out and bmaps whose biorqs must be discarded.
  */
 
 #define PSC_SUBSYS SLSS_BMAP
@@ -46,11 +55,13 @@
 #include "pfl/rpc.h"
 #include "pfl/rpclog.h"
 #include "pfl/rsx.h"
+#include "pfl/time.h"
 #include "pfl/tree.h"
 #include "pfl/treeutil.h"
 
 #include "bmap.h"
 #include "bmap_cli.h"
+#include "coalesce.h"
 #include "pgcache.h"
 #include "mount_slash.h"
 #include "rpc_cli.h"
@@ -59,12 +70,17 @@
 
 struct timespec			 bmapFlushWaitSecs = { 1, 0L };
 struct timespec			 msl_bflush_maxage = { 0, 10000000L };	/* 10 milliseconds */
+struct timespec			 msl_bflush_maxhold = { 0, 50000000L };	/* 50 milliseconds */
 struct psc_listcache		 slc_bmapflushq;
 struct psc_listcache		 slc_bmaptimeoutq;
+struct psc_listcache		 slc_bflush_rdyq;	/* IOSs with bmaps to flush */
+struct timespec			 slc_bflush_sweep;	/* next slc_bmapflushq sweep */
+int				 slc_bflush_kick;	/* sweep moved up; under rdyq lock */
 
 int				 slc_max_nretries = 256;
+int				 slc_bflush_maxinfl = 8;	/* write RPCs in flight per bmap */
 
-#define MIN_COALESCE_RPC_SZ	LNET_MTU
+#define MAX_COALESCE_RPC_SZ	LNET_MTU
 
 struct psc_waitq		 slc_bflush_waitq = PSC_WAITQ_INIT;
 psc_spinlock_t			 slc_bflush_lock = SPINLOCK_INIT;
@@ -90,6 +106,25 @@ bmap_flush_biorq_expired(const struct bmpc_ioreq *a)
 	return (0);
 }
 
+/*
+ * Determine if a biorq must be flushed even if the run it belongs to
+ * could still grow: it has been forcibly expired or has been held back
+ * for msl_bflush_maxhold.
+ */
+__static int
+bmap_flush_biorq_forced(const struct bmpc_ioreq *a)
+{
+	struct timespec ts, hold;
+
+	if (a->biorq_flags & BIORQ_EXPIRE)
+		return (1);
+
+	PFL_GETTIMESPEC(&ts);
+	timespecsub(&msl_bflush_maxhold, &msl_bflush_maxage, &hold);
+	timespecadd(&a->biorq_expire, &hold, &hold);
+	return (timespeccmp(&hold, &ts, <=));
+}
+
 void
 bmap_free_all_locked(struct fidc_membh *f)
 {
@@ -241,9 +276,105 @@ _bmap_flushq_wake(const struct pfl_callerinfo *pci, int reason)
 	if (reason == BMAPFLSH_TRUNCATE)
 		psc_waitq_wakeall(&slc_bmaptimeoutq.plc_wq_empty);
 
+	/* bmaps may need their biorqs discarded; sweep now */
+	if (reason == BMAPFLSH_TRUNCATE || reason == BMAPFLSH_REAP) {
+		spinlock(&slc_bflush_lock);
+		PFL_GETTIMESPEC(&slc_bflush_sweep);
+		freelock(&slc_bflush_lock);
+
+		/*
+		 * A flusher that read the old sweep time but has not
+		 * gone to sleep yet sees the kick under the rdyq lock.
+		 */
+		LIST_CACHE_LOCK(&slc_bflush_rdyq);
+		slc_bflush_kick++;
+		psc_waitq_wakeone(&slc_bflush_rdyq.plc_wq_empty);
+		LIST_CACHE_ULOCK(&slc_bflush_rdyq);
+	}
+
 	psclog_diag("wakeup flusher: reason=%x wake=%d", reason, wake);
 }
 
+/*
+ * Put an I/O server on slc_bflush_rdyq if it has bmaps waiting to be
+ * flushed and room for more RPCs.  Otherwise it is requeued when one
+ * of its write RPCs completes.
+ */
+__static void
+bmap_flush_ios_ready_locked(struct resm_cli_info *rmci)
+{
+	LOCK_ENSURE(&slc_bflush_lock);
+
+	if ((rmci->rmci_flags & RMCIF_FLUSHRDY) ||
+	    psc_listhd_empty(&rmci->rmci_flushq) ||
+	    psc_atomic32_read(&rmci->rmci_infl_rpcs) >=
+	    RESM_MAX_OUTSTANDING_RPCS)
+		return;
+
+	rmci->rmci_flags |= RMCIF_FLUSHRDY;
+	lc_addtail(&slc_bflush_rdyq, rmci);
+}
+
+/*
+ * Queue a bmap with new biorqs for the flusher threads.
+ */
+void
+bmap_flush_ready(struct bmap *b)
+{
+	struct bmap_cli_info *bci = bmap_2_bci(b);
+	struct resm_cli_info *rmci;
+	struct sl_resm *m;
+
+	BMAP_LOCK_ENSURE(b);
+
+	if (RB_EMPTY(&bmap_2_bmpc(b)->bmpc_new_biorqs) ||
+	    (b->bcm_flags & BMAPF_FLUSHRDY))
+		return;
+
+	/*
+	 * If a flusher is working on this bmap, it will requeue the
+	 * bmap when it is done.
+	 */
+	b->bcm_flags |= BMAPF_FLUSHRDY;
+	if (b->bcm_flags & BMAPF_SCHED)
+		return;
+
+	m = libsl_try_ios2resm(bmap_2_ios(b));
+	if (m == NULL) {
+		/* leave it to the flushq sweep */
+		b->bcm_flags &= ~BMAPF_FLUSHRDY;
+		return;
+	}
+	rmci = resm2rmci(m);
+
+	bmap_op_start_type(b, BMAP_OPCNT_FLUSH);
+
+	spinlock(&slc_bflush_lock);
+	psclist_add_tail(&bci->bci_flush_lentry, &rmci->rmci_flushq);
+	bmap_flush_ios_ready_locked(rmci);
+	freelock(&slc_bflush_lock);
+
+	DEBUG_BMAP(PLL_DIAG, b, "queued to flush ios=%#x",
+	    m->resm_res_id);
+}
+
+/*
+ * A write RPC for a bmap has completed or failed to launch: free its
+ * slot in the bmap's pipeline and requeue the bmap if it has more
+ * biorqs.
+ */
+__static void
+bmap_flush_rpcdone(struct bmap *b)
+{
+	struct bmap_cli_info *bci = bmap_2_bci(b);
+
+	BMAP_LOCK(b);
+	psc_assert(bci->bci_flush_infl > 0);
+	bci->bci_flush_infl--;
+	bmap_flush_ready(b);
+	bmap_op_done_type(b, BMAP_OPCNT_FLUSH);
+}
+
 __static int
 msl_ric_bflush_cb(struct pscrpc_request *rq,
     struct pscrpc_async_args *args)
@@ -254,10 +385,15 @@ msl_ric_bflush_cb(struct pscrpc_request *rq,
 	struct sl_resm *m = args->pointer_arg[MSL_CBARG_RESM];
 	struct resm_cli_info *rmci = resm2rmci(m);
 	struct bmpc_ioreq *r;
+	struct bmap *b;
 	int i, rc;
 
 	psc_atomic32_dec(&rmci->rmci_infl_rpcs);
 
+	spinlock(&slc_bflush_lock);
+	bmap_flush_ios_ready_locked(rmci);
+	freelock(&slc_bflush_lock);
+
 	SL_GET_RQ_STATUS_TYPE(csvc, rq, struct srm_io_rep, rc);
 
 	psclog_diag("callback to write RPC bwc=%p ios=%d infl=%d rc=%d",
@@ -266,6 +402,9 @@ msl_ric_bflush_cb(struct pscrpc_request *rq,
 
 	bwc_unpin_pages(bwc);
 
+	r = psc_dynarray_getpos(&bwc->bwc_biorqs, 0);
+	b = r->biorq_bmap;
+
 	DYNARRAY_FOREACH(r, i, &bwc->bwc_biorqs) {
 		if (rc) {
 			bmap_flush_resched(r, rc);
@@ -279,6 +418,7 @@ msl_ric_bflush_cb(struct pscrpc_request *rq,
 
 	bwc_release(bwc);
 	sl_csvc_decref(csvc);
+	bmap_flush_rpcdone(b);
 	bmap_flushq_wake(BMAPFLSH_RPCDONE);
 
 	return (0);
@@ -483,6 +623,8 @@ bmap_flush_send_rpcs(struct bmpc_write_coalescer *bwc)
 		    r);
 		pll_remove(&bmpc->bmpc_new_biorqs_exp, r);
 	}
+	bmap_2_bci(b)->bci_flush_infl++;
+	bmap_op_start_type(b, BMAP_OPCNT_FLUSH);
 	BMAP_ULOCK(b);
 
 	psclog_diag("bwc cb arg (%p) size=%zu nbiorqs=%d",
@@ -492,6 +634,13 @@ bmap_flush_send_rpcs(struct bmpc_write_coalescer *bwc)
 	if (!rc)
 		return;
 
+	DYNARRAY_FOREACH(r, i, &bwc->bwc_biorqs)
+		bmap_flush_resched(r, rc);
+	sl_csvc_decref(csvc);
+	bwc_release(bwc);
+	bmap_flush_rpcdone(b);
+	return;
+
  out:
 	DYNARRAY_FOREACH(r, i, &bwc->bwc_biorqs)
 		bmap_flush_resched(r, rc);
@@ -643,119 +792,6 @@ bmap_flushable(struct bmap *b)
 	return (flush);
 }
 
-static void
-bwc_desched(struct bmpc_write_coalescer *bwc)
-{
-	psc_dynarray_reset(&bwc->bwc_biorqs);
-	bwc->bwc_soff = bwc->bwc_size = 0;
-}
-
-/*
- * Scan the given array of I/O requests for candidates to flush.  We
- * only flush when (1) a request has aged out or (2) we can construct a
- * large enough I/O.
- */
-__static struct bmpc_write_coalescer *
-bmap_flush_trycoalesce(const struct psc_dynarray *biorqs, int *indexp)
-{
-	int idx, large = 0, expired = 0;
-	struct bmpc_write_coalescer *bwc;
-	struct bmpc_ioreq *curr, *last = NULL;
-	int32_t sz = 0;
-
-	psc_assert(psc_dynarray_len(biorqs) > *indexp);
-
-	bwc = psc_pool_get(bwc_pool);
-
-	for (idx = 0; idx + *indexp < psc_dynarray_len(biorqs);
-	    idx++, last = curr) {
-		curr = psc_dynarray_getpos(biorqs, idx + *indexp);
-
-		/*
-		 * If any member is expired then we'll push everything
-		 * out.
-		 */
-		if (!expired)
-			expired = bmap_flush_biorq_expired(curr);
-
-		DEBUG_BIORQ(PLL_DIAG, curr, "biorq #%d (expired=%d)",
-		    idx, expired);
-
-		if (idx)
-			/* Assert 'lowest to highest' ordering. */
-			psc_assert(curr->biorq_off >= last->biorq_off);
-		else {
-			bwc->bwc_size = curr->biorq_len;
-			bwc->bwc_soff = curr->biorq_off;
-			psc_dynarray_add(&bwc->bwc_biorqs, curr);
-			continue;
-		}
-
-		/*
-		 * The next request, 'curr', can be added to the
-		 * coalesce group because 'curr' overlaps or extends
-		 * 'last'.
-		 */
-		if (curr->biorq_off <= biorq_voff_get(last)) {
-			sz = biorq_voff_get(curr) - biorq_voff_get(last);
-			if (sz > 0) {
-				if (sz + bwc->bwc_size >
-				    MIN_COALESCE_RPC_SZ) {
-					/*
-					 * Adding this biorq will push
-					 * us over the limit.
-					 */
-					large = 1;
-					break;
-				} else {
-					bwc->bwc_size += sz;
-				}
-				OPSTAT_INCR("bmap-flush-coalesce-contig");
-			}
-			/*
-			 * All subsequent requests that do not extend
-			 * our range should be collapsed here.
-			 */
-			psc_dynarray_add(&bwc->bwc_biorqs, curr);
-
-			/* keep the old last if we didn't extend */
-			if (sz < 0)
-				curr = last;
-
-		} else if (expired) {
-			/*
-			 * Biorq is not contiguous with the previous.
-			 * If the current set is expired send it out
-			 * now.
-			 */
-			OPSTAT_INCR("bmap-flush-coalesce-expire");
-			break;
-
-		} else {
-			/*
-			 * Otherwise, deschedule the current set and
-			 * resume activity with 't' as the base.
-			 */
-			bwc_desched(bwc);
-			bwc->bwc_size = curr->biorq_len;
-			bwc->bwc_soff = curr->biorq_off;
-			psc_dynarray_add(&bwc->bwc_biorqs, curr);
-			OPSTAT_INCR("bmap-flush-coalesce-restart");
-		}
-	}
-
-	if (!(large || expired)) {
-		/* Clean up any lingering biorq's. */
-		bwc_desched(bwc);
-		bwc_release(bwc);
-		bwc = NULL;
-	}
-
-	*indexp += idx;
-
-	return (bwc);
-}
-
 int
 _msl_resm_throttle(struct sl_resm *m, int wait)
 {
@@ -858,19 +894,180 @@ msbwatchthr_main(struct psc_thread *thr)
 }
 
 /*
- * Send out SRMT_WRITE RPCs to the I/O server.
+ * A run is being held back in the hope that it grows; make sure the
+ * flushq sweep runs no later than when the run has to be sent: once
+ * its newest member ages out or its oldest has been held too long.
  */
-__static int
-bmap_flush(void)
+__static void
+bmap_flush_hold(const struct psc_dynarray *reqs, int start, int nrun)
+{
+	struct timespec oldest, newest, hold;
+	struct bmpc_ioreq *r;
+	int i;
+
+	OPSTAT_INCR("bmap-flush-coalesce-hold");
+
+	r = psc_dynarray_getpos(reqs, start);
+	oldest = newest = r->biorq_expire;
+	for (i = start + 1; i < start + nrun; i++) {
+		r = psc_dynarray_getpos(reqs, i);
+		if (timespeccmp(&r->biorq_expire, &oldest, <))
+			oldest = r->biorq_expire;
+		if (timespeccmp(&r->biorq_expire, &newest, >))
+			newest = r->biorq_expire;
+	}
+	timespecsub(&msl_bflush_maxhold, &msl_bflush_maxage, &hold);
+	timespecadd(&oldest, &hold, &hold);
+	if (timespeccmp(&hold, &newest, <))
+		newest = hold;
+
+	spinlock(&slc_bflush_lock);
+	if (timespeccmp(&newest, &slc_bflush_sweep, <))
+		slc_bflush_sweep = newest;
+	freelock(&slc_bflush_lock);
+}
+
+/*
+ * Send out SRMT_WRITE RPCs to the I/O server for a bmap taken off its
+ * ready queue.  The bmap's biorqs are carved into maximal contiguous
+ * runs of up to one bulk RPC each; runs which are complete or have
+ * aged out are sent while the bmap has room in its pipeline.
+ */
+__static void
+bmap_flush_bmap(struct bmap *b)
 {
-	struct psc_dynarray reqs = DYNARRAY_INIT,
-	    bmaps = DYNARRAY_INIT;
+	struct psc_dynarray reqs = DYNARRAY_INIT;
 	struct bmpc_write_coalescer *bwc;
 	struct bmap_pagecache *bmpc;
-	struct sl_resm *m = NULL;
+	struct bmap_cli_info *bci;
+	struct bwc_ext *ext;
+	struct bmpc_ioreq *r;
+	struct sl_resm *m;
+	uint32_t soff, sz;
+	int i, j, n, nrun, full, rc;
+
+	bmpc = bmap_2_bmpc(b);
+	bci = bmap_2_bci(b);
+
+	BMAP_LOCK(b);
+	psc_assert(b->bcm_flags & BMAPF_FLUSHRDY);
+	b->bcm_flags &= ~BMAPF_FLUSHRDY;
+
+	/*
+	 * Bmaps whose biorqs have to be discarded, that are being
+	 * reassigned, or whose lease is about to expire are left to the
+	 * flushq sweep.
+	 */
+	if ((b->bcm_flags & (BMAPF_TOFREE | BMAPF_LEASEFAILED |
+	    BMAPF_REASSIGNREQ)) || !bmap_flushable(b)) {
+		bmap_op_done_type(b, BMAP_OPCNT_FLUSH);
+		return;
+	}
+
+	b->bcm_flags |= BMAPF_SCHED;
+	m = libsl_ios2resm(bmap_2_ios(b));
+	DEBUG_BMAP(PLL_DIAG, b, "try flush");
+
+	RB_FOREACH(r, bmpc_biorq_tree, &bmpc->bmpc_new_biorqs) {
+		DEBUG_BIORQ(PLL_DEBUG, r, "flushable");
+		psc_dynarray_add(&reqs, r);
+	}
+	BMAP_ULOCK(b);
+
+	n = psc_dynarray_len(&reqs);
+	ext = PSCALLOC(n * sizeof(*ext));
+	DYNARRAY_FOREACH(r, i, &reqs) {
+		ext[i].be_off = r->biorq_off;
+		ext[i].be_len = r->biorq_len;
+		ext[i].be_expired = bmap_flush_biorq_expired(r);
+		ext[i].be_forced = bmap_flush_biorq_forced(r);
+	}
+
+	for (i = 0; (rc = bwc_nextrun(ext, n, i, MAX_COALESCE_RPC_SZ,
+	    SLASH_BMAP_SIZE, &nrun, &soff, &sz)) != BWC_RUN_NONE;
+	    i += nrun) {
+		if (rc == BWC_RUN_HOLD) {
+			bmap_flush_hold(&reqs, i, nrun);
+			continue;
+		}
+
+		/*
+		 * Once the pipeline is full, remaining runs keep
+		 * growing until an RPC completes and requeues us.
+		 */
+		BMAP_LOCK(b);
+		full = slc_bflush_maxinfl > 0 &&
+		    bci->bci_flush_infl >= slc_bflush_maxinfl;
+		BMAP_ULOCK(b);
+		if (full) {
+			OPSTAT_INCR("bmap-flush-pipeline-full");
+			break;
+		}
+
+		bwc = psc_pool_get(bwc_pool);
+		for (j = i; j < i + nrun; j++)
+			psc_dynarray_add(&bwc->bwc_biorqs,
+			    psc_dynarray_getpos(&reqs, j));
+		bwc->bwc_soff = soff;
+		bwc->bwc_size = sz;
+		if (nrun > 1)
+			OPSTAT_ADD("bmap-flush-coalesce-contig",
+			    nrun - 1);
+
+		bmap_flush_coalesce_map(bwc);
+		msl_resm_throttle_wait(m);
+		bmap_flush_send_rpcs(bwc);
+	}
+
+	PSCFREE(ext);
+	psc_dynarray_free(&reqs);
+
+	BMAP_LOCK(b);
+	b->bcm_flags &= ~BMAPF_SCHED;
+	if (b->bcm_flags & BMAPF_FLUSHRDY) {
+		/* more work arrived while we were busy */
+		b->bcm_flags &= ~BMAPF_FLUSHRDY;
+		bmap_flush_ready(b);
+	}
+	bmap_op_done_type(b, BMAP_OPCNT_FLUSH);
+}
+
+/*
+ * Take the next bmap off an I/O server's ready queue.  The I/O server
+ * goes to the back of slc_bflush_rdyq if it has more so that all I/O
+ * servers are serviced in turn.
+ */
+__static struct bmap *
+bmap_flush_getready(struct resm_cli_info *rmci)
+{
+	struct bmap_cli_info *bci;
+
+	spinlock(&slc_bflush_lock);
+	bci = psc_listhd_first_obj(&rmci->rmci_flushq,
+	    struct bmap_cli_info, bci_flush_lentry);
+	if (bci)
+		psclist_del(&bci->bci_flush_lentry, &rmci->rmci_flushq);
+	rmci->rmci_flags &= ~RMCIF_FLUSHRDY;
+	bmap_flush_ios_ready_locked(rmci);
+	freelock(&slc_bflush_lock);
+
+	return (bci ? bci_2_bmap(bci) : NULL);
+}
+
+/*
+ * Sweep slc_bmapflushq for work not driven by biorq arrival or RPC
+ * completion: discard the biorqs of bmaps being freed or whose lease
+ * could not be obtained, and queue bmaps with aged out biorqs that
+ * were held back or skipped while their lease was being extended.
+ */
+__static void
+bmap_flush_sweep(void)
+{
+	struct psc_dynarray bmaps = DYNARRAY_INIT;
+	struct bmap_pagecache *bmpc;
 	struct bmpc_ioreq *r;
 	struct bmap *b, *tmpb;
-	int i, j, didwork = 0;
+	int i;
 
 	LIST_CACHE_LOCK(&slc_bmapflushq);
 	LIST_CACHE_FOREACH_SAFE(b, tmpb, &slc_bmapflushq) {
@@ -882,78 +1079,46 @@ bmap_flush(void)
 
 		psc_assert(b->bcm_flags & BMAPF_FLUSHQ);
 
-		if ((b->bcm_flags & BMAPF_SCHED) ||
-		    (b->bcm_flags & BMAPF_REASSIGNREQ)) {
+		if (b->bcm_flags & (BMAPF_SCHED | BMAPF_FLUSHRDY |
+		    BMAPF_REASSIGNREQ)) {
 			BMAP_ULOCK(b);
 			continue;
 		}
 
-		if (bmap_flushable(b) ||
-		   (b->bcm_flags & BMAPF_TOFREE) ||
-		   (b->bcm_flags & BMAPF_LEASEFAILED)) {
+		if (b->bcm_flags & (BMAPF_TOFREE | BMAPF_LEASEFAILED)) {
 			b->bcm_flags |= BMAPF_SCHED;
 			psc_dynarray_add(&bmaps, b);
 			bmap_op_start_type(b, BMAP_OPCNT_FLUSH);
+		} else if (bmap_flushable(b)) {
+			bmpc = bmap_2_bmpc(b);
+			PLL_FOREACH(r, &bmpc->bmpc_new_biorqs_exp) {
+				if (bmap_flush_biorq_expired(r)) {
+					bmap_flush_ready(b);
+					break;
+				}
+			}
 		}
 		BMAP_ULOCK(b);
-
-		if (psc_dynarray_len(&bmaps) >= RESM_MAX_OUTSTANDING_RPCS)
-			break;
 	}
 	LIST_CACHE_ULOCK(&slc_bmapflushq);
 
-	for (i = 0; i < psc_dynarray_len(&bmaps); i++) {
-		b = psc_dynarray_getpos(&bmaps, i);
-		bmpc = bmap_2_bmpc(b);
-
-		/*
-		 * Try to catch recently expired bmaps before they are
-		 * processed by the write back flush mechanism.
-		 */
-		BMAP_LOCK(b);
-		if (b->bcm_flags & (BMAPF_TOFREE | BMAPF_LEASEFAILED)) {
-			b->bcm_flags &= ~BMAPF_SCHED;
-			bmpc_biorqs_destroy_locked(b,
-			    bmap_2_bci(b)->bci_error);
-			goto next;
-		}
-
-		m = libsl_ios2resm(bmap_2_ios(b));
-		DEBUG_BMAP(PLL_DIAG, b, "try flush");
-
-		RB_FOREACH(r, bmpc_biorq_tree, &bmpc->bmpc_new_biorqs) {
-			DEBUG_BIORQ(PLL_DEBUG, r, "flushable");
-			psc_dynarray_add(&reqs, r);
-		}
-		BMAP_ULOCK(b);
-
-		j = 0;
-		while (j < psc_dynarray_len(&reqs) &&
-		    (bwc = bmap_flush_trycoalesce(&reqs, &j))) {
-			didwork = 1;
-			bmap_flush_coalesce_map(bwc);
-			msl_resm_throttle_wait(m);
-			bmap_flush_send_rpcs(bwc);
-		}
-		psc_dynarray_reset(&reqs);
-
- next:
+	DYNARRAY_FOREACH(b, i, &bmaps) {
 		BMAP_LOCK(b);
-		b->bcm_flags &= ~BMAPF_SCHED;
+		b->bcm_flags &= ~(BMAPF_SCHED | BMAPF_FLUSHRDY);
+		bmpc_biorqs_destroy_locked(b, bmap_2_bci(b)->bci_error);
 		bmap_op_done_type(b, BMAP_OPCNT_FLUSH);
 	}
-
-	psc_dynarray_free(&reqs);
 	psc_dynarray_free(&bmaps);
-
-	return (didwork);
 }
 
 void
 msflushthr_main(struct psc_thread *thr)
 {
-	struct timespec work, wait, tmp1, tmp2;
 	struct msflush_thread *mflt;
+	struct resm_cli_info *rmci;
+	struct timespec ts, wait;
+	struct bmap *b;
+	int sweep, kick = 0;
 
 	mflt = msflushthr(thr);
 	while (pscthr_run(thr)) {
@@ -964,35 +1129,46 @@ msflushthr_main(struct psc_thread *thr)
 		 */
 		mflt->mflt_failcnt = 1;
 
-		/* wait until some work appears */
-		lc_peekheadwait(&slc_bmapflushq);
-
-		OPSTAT_INCR("bmap-flush");
-
-		PFL_GETTIMESPEC(&tmp1);
-		while (bmap_flush())
-			;
-		PFL_GETTIMESPEC(&tmp2);
-
-		timespecsub(&tmp2, &tmp1, &work);
-
-		PFL_GETTIMESPEC(&tmp1);
-
-		spinlock(&slc_bflush_lock);
-		slc_bflush_tmout_flags |= BMAPFLSH_RPCWAIT;
-		psc_waitq_waitrel_ts(&slc_bflush_waitq,
-		    &slc_bflush_lock, &bmapFlushWaitSecs);
+		sweep = 0;
+		PFL_GETTIMESPEC(&ts);
 		spinlock(&slc_bflush_lock);
-		slc_bflush_tmout_flags &= ~BMAPFLSH_RPCWAIT;
+		if (timespeccmp(&ts, &slc_bflush_sweep, >=)) {
+			timespecadd(&ts, &bmapFlushWaitSecs,
+			    &slc_bflush_sweep);
+			sweep = 1;
+		}
+		wait = slc_bflush_sweep;
 		freelock(&slc_bflush_lock);
 
-		PFL_GETTIMESPEC(&tmp2);
-		timespecsub(&tmp2, &tmp1, &wait);
+		if (sweep) {
+			OPSTAT_INCR("bmap-flush-sweep");
+			bmap_flush_sweep();
+		}
+
+		/*
+		 * Wait until some work appears or the next sweep,
+		 * unless the sweep was moved up after we read it.
+		 */
+		rmci = lc_getnb(&slc_bflush_rdyq);
+		if (rmci == NULL) {
+			LIST_CACHE_LOCK(&slc_bflush_rdyq);
+			sweep = kick != slc_bflush_kick;
+			kick = slc_bflush_kick;
+			if (lc_empty(&slc_bflush_rdyq) && !sweep)
+				psc_waitq_waitabs(
+				    &slc_bflush_rdyq.plc_wq_empty,
+				    LIST_CACHE_GETLOCK(&slc_bflush_rdyq),
+				    &wait);
+			else
+				LIST_CACHE_ULOCK(&slc_bflush_rdyq);
+			continue;
+		}
 
-		psclogs_debug(SLSS_BMAP, "work time ("PSCPRI_TIMESPEC"),"
-		    "wait time ("PSCPRI_TIMESPEC")",
-		    PSCPRI_TIMESPEC_ARGS(&work),
-		    PSCPRI_TIMESPEC_ARGS(&wait));
+		b = bmap_flush_getready(rmci);
+		if (b) {
+			OPSTAT_INCR("bmap-flush");
+			bmap_flush_bmap(b);
+		}
 	}
 }
 
@@ -1027,6 +1203,10 @@ msbmapthr_spawn(void)
 	lc_reginit(&slc_bmaptimeoutq, struct bmap_cli_info,
 	    bci_lentry, "bmaptimeout");
 
+	lc_reginit(&slc_bflush_rdyq, struct resm_cli_info,
+	    rmci_flush_lentry, "bflushrdyq");
+	PFL_GETTIMESPEC(&slc_bflush_sweep);
+
 	for (i = 0; i < NUM_BMAP_FLUSH_THREADS; i++) {
 		thr = pscthr_init(MSTHRT_FLUSH, msflushthr_main, NULL,
 		    sizeof(struct msflush_thread), "msflushthr%d", i);
@@ -76,6 +76,7 @@ msl_bmap_init(struct bmap *b)
 	bmpc_init(&bci->bci_bmpc);
 	pfl_rwlock_init(&bci->bci_rwlock);
 	INIT_PSC_LISTENTRY(&bci->bci_lentry);
+	INIT_PSC_LISTENTRY(&bci->bci_flush_lentry);
 }
 
 /*
@@ -781,6 +782,193 @@ msl_bmap_retrieve(struct bmap *b, int flags)
 	return (rc);
 }
 
+__static int
+msl_rmc_bmlrange_cb(struct pscrpc_request *rq,
+    struct pscrpc_async_args *args)
+{
+	struct slashrpc_cservice *csvc = args->pointer_arg[MSL_BMLRANGE_CBARG_CSVC];
+	struct srt_bmaplease *bl = args->pointer_arg[MSL_BMLRANGE_CBARG_LEASES];
+	struct bmap **bmaps = args->pointer_arg[MSL_BMLRANGE_CBARG_BMAPS];
+	struct srm_leasebmaps_req *mq;
+	struct srm_leasebmaps_rep *mp;
+	struct fidc_membh *f;
+	struct iovec iov;
+	int i, rc, ngot = 0;
+	struct bmap *b;
+
+	mq = pscrpc_msg_buf(rq->rq_reqmsg, 0, sizeof(*mq));
+	f = bmaps[0]->bcm_fcmh;
+
+	SL_GET_RQ_STATUSF(csvc, rq, mp,
+	    SRPCWAITF_DEFER_BULK_AUTHBUF_CHECK, rc);
+	if (!rc) {
+		iov.iov_base = bl;
+		iov.iov_len = mq->nbmaps * sizeof(*bl);
+		rc = slrpc_bulk_checkmsg(rq, rq->rq_repmsg, &iov, 1);
+	}
+	if (!rc && (mp->nbmaps < 1 || mp->nbmaps > mq->nbmaps))
+		rc = -EBADMSG;
+	if (rc)
+		DEBUG_FCMH(PLL_DIAG, f, "bmap range lease failed "
+		    "(bmapno=%u n=%d) rc=%d", mq->bmapno, mq->nbmaps,
+		    rc);
+	else {
+		FCMH_LOCK(f);
+		msl_fcmh_stash_inode(f, &mp->ino);
+		FCMH_ULOCK(f);
+
+		ngot = mp->nbmaps;
+		OPSTAT_ADD("bmap-lease-range", ngot);
+	}
+
+	/*
+	 * Bmaps not granted are merely released; the next bmap_getf()
+	 * on any of them retrieves it the regular way.
+	 */
+	for (i = 0; i < mq->nbmaps; i++) {
+		b = bmaps[i];
+		BMAP_LOCK(b);
+		if (i < ngot) {
+			msl_bmap_stash_lease(b, &bl[i].sbd, 0,
+			    "getrange");
+			memcpy(bmap_2_bci(b)->bci_repls, bl[i].repls,
+			    sizeof(bl[i].repls));
+			msl_bmap_reap_init(b);
+			b->bcm_flags |= BMAPF_LOADED;
+		}
+		b->bcm_flags &= ~BMAPF_LOADING;
+		bmap_op_done_type(b, BMAP_OPCNT_ASYNC);
+	}
+
+	PSCFREE(bmaps);
+	PSCFREE(bl);
+	sl_csvc_decref(csvc);
+	return (0);
+}
+
+/*
+ * Acquire leases for a run of bmaps with a single SRMT_GETBMAPS RPC so
+ * that an application streaming through a large file does not stall
+ * on an MDS round trip at every bmap boundary.  Bmaps that are already
+ * cached are skipped; the run is cut short at the first one found past
+ * the beginning.
+ *
+ * The bmaps of the run are instantiated here and stay BMAPF_LOADING
+ * until msl_rmc_bmlrange_cb() runs, so the RPC is not waited on and
+ * other lookups of them wait for it instead of racing it.  Any failure
+ * is left for the regular per-bmap path to deal with.
+ *
+ * @f: file.
+ * @bno: first bmap of the run.
+ * @nbmaps: length of the run.
+ * @rw: read or write access.
+ */
+int
+msl_bmap_lease_range(struct fidc_membh *f, sl_bmapno_t bno, int nbmaps,
+    enum rw rw)
+{
+	struct slashrpc_cservice *csvc = NULL;
+	struct pscrpc_request *rq = NULL;
+	struct srm_leasebmaps_req *mq;
+	struct srm_leasebmaps_rep *mp;
+	struct srt_bmaplease *bl = NULL;
+	struct bmap *b, **bmaps = NULL;
+	int i, n, rc, new_bmap;
+	struct iovec iov;
+
+	nbmaps = MIN(nbmaps, SRM_LEASEBMAPS_MAX);
+	for (; nbmaps; bno++, nbmaps--) {
+		new_bmap = 0;
+		b = bmap_lookup_cache(f, bno, 0, &new_bmap);
+		if (b == NULL)
+			break;
+		bmap_op_done(b);
+	}
+	for (n = 0; n < nbmaps; n++) {
+		new_bmap = 0;
+		b = bmap_lookup_cache(f, bno + n, 0, &new_bmap);
+		if (b) {
+			bmap_op_done(b);
+			break;
+		}
+	}
+	/* A single bmap is better served by the regular path. */
+	if (n < 2)
+		return (0);
+
+	rc = slc_rmc_getcsvc1(&csvc, fcmh_2_fci(f)->fci_resm);
+	if (rc)
+		PFL_GOTOERR(out, rc);
+	rc = SL_RSX_NEWREQ(csvc, SRMT_GETBMAPS, rq, mq, mp);
+	if (rc)
+		PFL_GOTOERR(out, rc);
+
+	bmaps = PSCALLOC(n * sizeof(*bmaps));
+	for (i = 0; i < n; i++) {
+		new_bmap = 1;
+		b = bmap_lookup_cache(f, bno + i,
+		    rw == SL_WRITE ? BMAPF_WR : BMAPF_RD, &new_bmap);
+		if (!new_bmap) {
+			/* Raced with a regular lookup; stop the run. */
+			OPSTAT_INCR("bmap-lease-range-race");
+			bmap_op_done(b);
+			break;
+		}
+		b->bcm_flags |= BMAPF_LOADING;
+		bmap_op_start_type(b, BMAP_OPCNT_ASYNC);
+		bmap_op_done(b);
+		bmaps[i] = b;
+	}
+	n = i;
+	if (n == 0)
+		PFL_GOTOERR(out, rc = 0);
+
+	mq->fg = f->fcmh_fg;
+	mq->prefios[0] = msl_pref_ios;
+	mq->bmapno = bno;
+	mq->nbmaps = n;
+	mq->rw = rw;
+	mq->flags = SRM_LEASEBMAPF_GETINODE | SRM_LEASEBMAPF_NODIO;
+
+	bl = PSCALLOC(n * sizeof(*bl));
+	iov.iov_base = bl;
+	iov.iov_len = n * sizeof(*bl);
+	rq->rq_bulk_abortable = 1;
+	rc = slrpc_bulkclient(rq, BULK_PUT_SINK, SRMC_BULK_PORTAL, &iov,
+	    1);
+	if (rc)
+		PFL_GOTOERR(out, rc);
+
+	DEBUG_FCMH(PLL_DIAG, f, "retrieving bmaps (bmapno=%u n=%d)", bno,
+	    n);
+
+	rq->rq_async_args.pointer_arg[MSL_BMLRANGE_CBARG_CSVC] = csvc;
+	rq->rq_async_args.pointer_arg[MSL_BMLRANGE_CBARG_BMAPS] = bmaps;
+	rq->rq_async_args.pointer_arg[MSL_BMLRANGE_CBARG_LEASES] = bl;
+	rq->rq_interpret_reply = msl_rmc_bmlrange_cb;
+	rc = SL_NBRQSET_ADD(csvc, rq);
+	if (!rc)
+		return (0);
+
+ out:
+	for (i = 0; bmaps && i < n; i++) {
+		b = bmaps[i];
+		BMAP_LOCK(b);
+		b->bcm_flags &= ~BMAPF_LOADING;
+		bmap_op_done_type(b, BMAP_OPCNT_ASYNC);
+	}
+	if (rc)
+		DEBUG_FCMH(PLL_DIAG, f, "bmap range lease failed "
+		    "(bmapno=%u n=%d) rc=%d", bno, n, rc);
+	if (rq)
+		pscrpc_req_finished(rq);
+	if (csvc)
+		sl_csvc_decref(csvc);
+	PSCFREE(bmaps);
+	PSCFREE(bl);
+	return (rc);
+}
+
 /*
  * Called from rcm.c (SRMT_BMAPDIO).
  *
@@ -792,9 +980,10 @@ msl_bmap_cache_rls(struct bmap *b)
 	struct bmap_pagecache *bmpc = bmap_2_bmpc(b);
 	struct bmap_cli_info *bci = bmap_2_bci(b);
 	struct bmap_pagecache_entry *e;
+	int i;
 
 	pfl_rwlock_rdlock(&bci->bci_rwlock);
-	RB_FOREACH(e, bmap_pagecachetree, &bmpc->bmpc_tree) {
+	BMPC_FOREACH(bmpc, e, i) {
 		BMPCE_LOCK(e);
 		e->bmpce_flags |= BMPCEF_DISCARD;
 		BMPCE_ULOCK(e);
@@ -1186,7 +1375,8 @@ msl_bmap_final_cleanup(struct bmap *b)
 {
 	struct bmap_pagecache *bmpc = bmap_2_bmpc(b);
 
-	psc_assert(!(b->bcm_flags & BMAPF_FLUSHQ));
+	psc_assert(!(b->bcm_flags & (BMAPF_FLUSHQ | BMAPF_FLUSHRDY)));
+	psc_assert(!bmap_2_bci(b)->bci_flush_infl);
 
 	psc_assert(pll_empty(&bmpc->bmpc_pndg_biorqs));
 	psc_assert(RB_EMPTY(&bmpc->bmpc_new_biorqs));
@@ -1200,7 +1390,7 @@ msl_bmap_final_cleanup(struct bmap *b)
 	DEBUG_BMAP(PLL_DIAG, b, "start freeing");
 
 	bmpc_freeall(b);
-	psc_assert(RB_EMPTY(&bmpc->bmpc_tree));
+	psc_assert(bmpc->bmpc_npages == 0);
 
 	DEBUG_BMAP(PLL_DIAG, b, "done freeing");
 
@@ -1222,6 +1412,7 @@ dump_bmap_flags(uint32_t flags)
 	PFL_PRFLAG(BMAPF_BENCH, &flags, &seq);
 	PFL_PRFLAG(BMAPF_FLUSHQ, &flags, &seq);
 	PFL_PRFLAG(BMAPF_TIMEOQ, &flags, &seq);
+	PFL_PRFLAG(BMAPF_FLUSHRDY, &flags, &seq);
 	if (flags)
 		printf(" unknown: %#x\n", flags);
 	printf("\n");
@@ -45,9 +45,11 @@ struct bmap_cli_info {
 	struct pfl_rwlock	 bci_rwlock;		/* page tree rwlock */
 	int			 bci_error;		/* lease request error */
 	int			 bci_flush_rc;		/* flush error */
+	int			 bci_flush_infl;	/* write RPCs in flight */
 	int			 bci_nreassigns;	/* number of reassigns */
 	sl_ios_id_t		 bci_prev_sliods[SL_MAX_IOSREASSIGN];
 	struct psc_listentry	 bci_lentry;		/* bmap flushq */
+	struct psc_listentry	 bci_flush_lentry;	/* IOS ready flush queue */
 	uint8_t			 bci_repls[SL_REPLICA_NBYTES];
 };
 
@@ -60,6 +62,7 @@ struct bmap_cli_info {
 #define BMAPF_BENCH		(_BMAPF_SHIFT << 5)	/* generated by benchmarker */
 #define BMAPF_FLUSHQ		(_BMAPF_SHIFT << 6)	/* bmap is on writer flushq */
 #define BMAPF_TIMEOQ		(_BMAPF_SHIFT << 7)	/* on timeout queue */
+#define BMAPF_FLUSHRDY		(_BMAPF_SHIFT << 8)	/* queued for the flusher */
 
 /* XXX change horribly named flags */
 #define BMAP_CLI_MAX_LEASE	60			/* seconds */
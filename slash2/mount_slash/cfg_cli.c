@@ -52,6 +52,8 @@ slcfg_init_resm(struct sl_resm *resm)
 		    car_lentry, "aiorq-%s:%d", r->res_name,
 		    psc_dynarray_len(&r->res_members));
 	psc_atomic32_set(&rmci->rmci_infl_rpcs, 0);
+	INIT_PSCLIST_HEAD(&rmci->rmci_flushq);
+	INIT_PSC_LISTENTRY(&rmci->rmci_flush_lentry);
 }
 
 void
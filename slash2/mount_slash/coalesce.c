@@ -0,0 +1,92 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Write coalescing run construction, see coalesce.h.
+ */
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+
+#include "coalesce.h"
+
+/*
+ * Build the run of extents beginning at index @start of the @n sorted
+ * extents in @e.  Extents that overlap or abut the run are merged into
+ * it as long as the region covered stays within @maxsz bytes.
+ *
+ * The run is to be sent if it is full (the next extent would push it
+ * past @maxsz or it already spans @maxsz), if it reaches @limit (the
+ * end of the bmap, so it cannot grow), if all of its members have
+ * expired (nothing has been added to it lately), or if any member must
+ * be flushed regardless.  Otherwise it is held so more data may be
+ * coalesced into it.
+ *
+ * Returns the verdict and fills in the number of extents in the run
+ * and the region it covers.
+ */
+int
+bwc_nextrun(const struct bwc_ext *e, int n, int start, uint32_t maxsz,
+    uint32_t limit, int *nrunp, uint32_t *soffp, uint32_t *sizep)
+{
+	uint32_t soff, end, eend;
+	int i, full = 0, expired, forced;
+
+	if (start >= n)
+		return (BWC_RUN_NONE);
+
+	soff = e[start].be_off;
+	end = soff + e[start].be_len;
+	expired = e[start].be_expired;
+	forced = e[start].be_forced;
+
+	for (i = start + 1; i < n; i++) {
+		/* assert 'lowest to highest' ordering */
+		psc_assert(e[i].be_off >= e[i - 1].be_off);
+
+		/* a hole ends the run */
+		if (e[i].be_off > end)
+			break;
+
+		eend = e[i].be_off + e[i].be_len;
+		if (eend > end) {
+			if (eend - soff > maxsz) {
+				full = 1;
+				break;
+			}
+			end = eend;
+		}
+		if (!e[i].be_expired)
+			expired = 0;
+		if (e[i].be_forced)
+			forced = 1;
+	}
+
+	*nrunp = i - start;
+	*soffp = soff;
+	*sizep = end - soff;
+
+	if (full || expired || forced || end - soff >= maxsz ||
+	    end >= limit)
+		return (BWC_RUN_SEND);
+	return (BWC_RUN_HOLD);
+}
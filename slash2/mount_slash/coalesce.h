@@ -0,0 +1,54 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Write coalescing policy for the bmap flusher.
+ *
+ * The flusher hands the offsets of a bmap's pending biorqs, sorted by
+ * offset, to bwc_nextrun() which carves them into contiguous runs no
+ * larger than one bulk RPC.  A run is sent once it cannot grow any
+ * further; runs that may still be extended by the writer are held back
+ * until the writer has left them alone for the flush age, so streaming
+ * writers produce full-sized RPCs even when they write slowly.
+ */
+
+#ifndef _SL_COALESCE_H_
+#define _SL_COALESCE_H_
+
+#include <stdint.h>
+
+struct bwc_ext {
+	uint32_t		 be_off;	/* bmap-relative offset */
+	uint32_t		 be_len;
+	int			 be_expired;	/* biorq has aged out */
+	int			 be_forced;	/* must not be held back */
+};
+
+/* bwc_nextrun() verdicts */
+#define BWC_RUN_NONE		0		/* no extents left */
+#define BWC_RUN_SEND		1		/* run should be flushed now */
+#define BWC_RUN_HOLD		2		/* run may still grow */
+
+int	bwc_nextrun(const struct bwc_ext *, int, int, uint32_t, uint32_t,
+	    int *, uint32_t *, uint32_t *);
+
+#endif /* _SL_COALESCE_H_ */
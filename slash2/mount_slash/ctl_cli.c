@@ -675,7 +675,7 @@ msctlrep_getbmpce(int fd, struct psc_ctlmsghdr *mh, void *m)
 	struct psc_hashbkt *hb;
 	struct fidc_membh *f;
 	struct bmap *b;
-	int rc = 1;
+	int i, rc = 1;
 
 	PSC_HASHTBL_FOREACH_BUCKET(hb, &sl_fcmh_hashtbl) {
 		psc_hashbkt_lock(hb);
@@ -684,8 +684,7 @@ msctlrep_getbmpce(int fd, struct psc_ctlmsghdr *mh, void *m)
 			RB_FOREACH(b, bmaptree, &f->fcmh_bmaptree) {
 				bci = bmap_2_bci(b);
 				pfl_rwlock_rdlock(&bci->bci_rwlock);
-				RB_FOREACH(e, bmap_pagecachetree,
-				    &bmap_2_bmpc(b)->bmpc_tree) {
+				BMPC_FOREACH(bmap_2_bmpc(b), e, i) {
 					rc = msctlmsg_bmpce_send(fd, mh,
 					    mpce, b, e);
 					if (!rc)
@@ -845,6 +844,8 @@ msctlthr_spawn(void)
 	psc_ctlparam_register_simple("sys.version",
 	    slctlparam_version_get, NULL);
 
+	psc_ctlparam_register_var("sys.bflush_max_inflight",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slc_bflush_maxinfl);
 	psc_ctlparam_register_var("sys.bmap-max-cache",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &bmap_max_cache);
 	/* XXX: add max_fs_iosz */
@@ -867,6 +868,9 @@ msctlthr_spawn(void)
 	psc_ctlparam_register_var("sys.predio_issue_maxpages",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
 	    &msl_predio_issue_maxpages);
+	psc_ctlparam_register_var("sys.predio_lease_nbmaps",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
+	    &msl_predio_lease_nbmaps);
 	psc_ctlparam_register_var("sys.root_squash", PFLCTL_PARAMT_INT,
 	    PFLCTL_PARAMF_RDWR, &slc_root_squash);
 
@@ -44,6 +44,7 @@
 #include "pfl/opstats.h"
 #include "pfl/pool.h"
 #include "pfl/str.h"
+#include "pfl/treeutil.h"
 #include "pfl/workthr.h"
 
 #include "dircache.h"
@@ -60,6 +61,9 @@ struct psc_poolmgr	*dircache_ent_pool;
 
 struct psc_lockedlist	 msl_dircache_pages_lru;
 
+RB_GENERATE(dircache_page_tree, dircache_page, dcp_tentry,
+    dircache_page_cmp)
+
 /*
  * Initialize per-fcmh dircache structures.
  */
@@ -69,8 +73,8 @@ dircache_init(struct fidc_membh *d)
 	struct fcmh_cli_info *fci = fcmh_2_fci(d);
 
 	if ((d->fcmh_flags & FCMH_CLI_INITDIRCACHE) == 0) {
-		pll_init(&fci->fci_dc_pages, struct dircache_page,
-		    dcp_lentry, &d->fcmh_lock);
+		RB_INIT(&fci->fci_dc_pages);
+		fci->fcid_npages = 0;
 		pfl_rwlock_init(&fci->fcid_dircache_rwlock);
 		d->fcmh_flags |= FCMH_CLI_INITDIRCACHE;
 	}
@@ -197,7 +201,8 @@ _dircache_free_page(const struct pfl_callerinfo *pci,
 	while (p->dcp_refcnt)
 		DIRCACHE_WAIT(d);
 
-	pll_remove(&fci->fci_dc_pages, p);
+	RB_REMOVE(dircache_page_tree, &fci->fci_dc_pages, p);
+	fci->fcid_npages--;
 
 	if (p->dcp_dents_off) {
 		DYNARRAY_FOREACH(dce, i, p->dcp_dents_off) {
@@ -229,14 +234,14 @@ int
 dircache_walk_wkcb(void *arg)
 {
 	struct slc_wkdata_dircache *wk = arg;
-	struct dircache_page *p, *np;
 	struct fcmh_cli_info *fci;
+	struct dircache_page *p;
 	struct dircache_ent *dce;
 	int n;
 
 	fci = fcmh_2_fci(wk->d);
 	DIRCACHE_RDLOCK(wk->d);
-	PLL_FOREACH_SAFE(p, np, &fci->fci_dc_pages) {
+	RB_FOREACH(p, dircache_page_tree, &fci->fci_dc_pages) {
 		if (p->dcp_rc || p->dcp_flags & DIRCACHEPGF_LOADING)
 			continue;
 		DYNARRAY_FOREACH(dce, n, p->dcp_dents_off)
@@ -283,8 +288,11 @@ dircache_purge(struct fidc_membh *d)
 
 	fci = fcmh_2_fci(d);
 	DIRCACHE_WRLOCK(d);
-	PLL_FOREACH_SAFE(p, np, &fci->fci_dc_pages)
+	for (p = RB_MIN(dircache_page_tree, &fci->fci_dc_pages); p;
+	    p = np) {
+		np = RB_NEXT(dircache_page_tree, &fci->fci_dc_pages, p);
 		dircache_free_page(d, p);
+	}
 	DIRCACHE_ULOCK(d);
 }
 
@@ -316,74 +324,129 @@ dircache_hasoff(struct dircache_page *p, off_t off)
 }
 
 /*
- * Allocate a new page of dirents.
+ * Find the page holding the dirent at the specified directory offset,
+ * or the last page if @off is the end of the directory.  Offset cookies
+ * increase through a directory, so only the page starting at or just
+ * before @off needs to be examined.  A page still loading is returned
+ * if it may cover @off; the caller should wait and look again.
+ * @d: directory handle.
+ * @off: offset of desired dirent.
+ */
+struct dircache_page *
+dircache_lookup_page(struct fidc_membh *d, off_t off)
+{
+	struct dircache_page *p, q;
+	struct fcmh_cli_info *fci;
+
+	fci = fcmh_2_fci(d);
+	q.dcp_off = off;
+	p = RB_NFIND(dircache_page_tree, &fci->fci_dc_pages, &q);
+	if (p && p->dcp_off == off)
+		return (p);
+	p = p ? RB_PREV(dircache_page_tree, &fci->fci_dc_pages, p) :
+	    RB_MAX(dircache_page_tree, &fci->fci_dc_pages);
+	if (p == NULL)
+		return (NULL);
+	if (p->dcp_flags & DIRCACHEPGF_LOADING)
+		return (p);
+	if (off == p->dcp_nextoff && p->dcp_flags & DIRCACHEPGF_EOF)
+		return (p);
+	return (dircache_hasoff(p, off) ? p : NULL);
+}
+
+/*
+ * Release expired pages.  This walks all pages of the directory so it
+ * is rate limited; pages are also checked as lookups come across them.
+ * @d: directory handle.
+ */
+__static void
+dircache_sweep(struct fidc_membh *d)
+{
+	struct dircache_expire dexp;
+	struct dircache_page *p, *np;
+	struct fcmh_cli_info *fci;
+	struct pfl_timespec now;
+
+	fci = fcmh_2_fci(d);
+	PFL_GETPTIMESPEC(&now);
+	if (now.tv_sec < fci->fcid_sweep + DIRCACHEPG_SOFT_TIMEO)
+		return;
+	fci->fcid_sweep = now.tv_sec;
+
+	DIRCACHEPG_INITEXP(&dexp);
+	for (p = RB_MIN(dircache_page_tree, &fci->fci_dc_pages); p;
+	    p = np) {
+		np = RB_NEXT(dircache_page_tree, &fci->fci_dc_pages, p);
+		if ((p->dcp_flags & DIRCACHEPGF_LOADING) == 0 &&
+		    DIRCACHEPG_EXPIRED(d, p, &dexp))
+			dircache_free_page(d, p);
+	}
+}
+
+/*
+ * Allocate a new page of dirents.  The page is entered into the
+ * directory's index right away as a stub marked LOADING so readers of
+ * this offset wait for it instead of issuing their own READDIR.
  * @d: directory handle.
  * @off: offset into directory for this slew of dirents.
- * @wait: whether this call should be non-blocking or not.
+ * @wait: whether this call should be non-blocking or not.  A
+ *	non-blocking call is a readahead: it does not replace a page
+ *	already holding @off.
  */
 struct dircache_page *
 dircache_new_page(struct fidc_membh *d, off_t off, int wait)
 {
-	struct dircache_page *p, *np, *newp;
+	struct dircache_page *p, *newp;
 	struct dircache_expire dexp;
 	struct fcmh_cli_info *fci;
 
 	newp = psc_pool_get(dircache_page_pool);
 
 	DIRCACHE_WRLOCK(d);
+	dircache_sweep(d);
 
  restart:
 	DIRCACHEPG_INITEXP(&dexp);
 
 	fci = fcmh_2_fci(d);
-	PLL_FOREACH_SAFE(p, np, &fci->fci_dc_pages) {
-		if (DIRCACHEPG_EXPIRED(d, p, &dexp)) {
-			dircache_free_page(d, p);
-			continue;
+	p = dircache_lookup_page(d, off);
+	if (p && p->dcp_flags &
+	    (DIRCACHEPGF_LOADING | DIRCACHEPGF_FREEING)) {
+		if (wait) {
+			DIRCACHE_WAIT(d);
+			goto restart;
 		}
-		if (p->dcp_flags & DIRCACHEPGF_LOADING) {
-			if (p->dcp_off == off) {
-				if (wait) {
-					DIRCACHE_WAIT(d);
-					goto restart;
-				}
-
-				/*
-				 * Someone is already taking care of
-				 * this page for us.
-				 */
-				p = NULL;
-				goto out;
-			}
-			if (wait) {
-				DIRCACHE_WAIT(d);
-				goto restart;
-			}
-			continue;
+
+		/* Someone is already taking care of this page for us. */
+		p = NULL;
+		goto out;
+	}
+	if (p) {
+		if (!wait && !DIRCACHEPG_EXPIRED(d, p, &dexp)) {
+			OPSTAT_INCR("dircache-ra-cached");
+			p = NULL;
+			goto out;
 		}
-		if (dircache_hasoff(p, off)) {
-			/* Stale page in cache; purge and refresh. */
-			if (wait)
-				dircache_free_page(d, p);
-			else if (!dircache_free_page_nowait(d, p)) {
-				p = NULL;
-				goto out;
-			}
+
+		/* Stale page in cache; purge and refresh. */
+		if (wait) {
+			dircache_free_page(d, p);
+			goto restart;
+		}
+		if (!dircache_free_page_nowait(d, p)) {
 			p = NULL;
-			break;
+			goto out;
 		}
 	}
 
-	if (p == NULL) {
-		memset(newp, 0, sizeof(*newp));
-		INIT_PSC_LISTENTRY(&newp->dcp_lentry);
-		newp->dcp_off = off;
-		pll_addtail(&fci->fci_dc_pages, newp);
-		p = newp;
-		newp = NULL;
-	}
-	psc_assert((p->dcp_flags & DIRCACHEPGF_LOADING) == 0);
-	p->dcp_flags |= DIRCACHEPGF_LOADING;
+	memset(newp, 0, sizeof(*newp));
+	INIT_PSC_LISTENTRY(&newp->dcp_lentry);
+	newp->dcp_off = off;
+	newp->dcp_flags |= DIRCACHEPGF_LOADING;
+	PSC_RB_XINSERT(dircache_page_tree, &fci->fci_dc_pages, newp);
+	fci->fcid_npages++;
+	p = newp;
+	newp = NULL;
 	p->dcp_refcnt++;
 	PFLOG_DIRCACHEPG(PLL_DEBUG, p, "incref");
 
@@ -761,7 +824,7 @@ dircache_dbgpr(struct fidc_membh *d)
 	struct slc_wkdata_dircache wk;
 	void *p = NULL;
 
-	printf("pages %d\n", pll_nitems(&fcmh_2_fci(d)->fci_dc_pages));
+	printf("pages %d\n", fcmh_2_fci(d)->fcid_npages);
 	memset(&wk, 0, sizeof(wk));
 	wk.d = d;
 	wk.cbf = dircache_ent_dbgpr;
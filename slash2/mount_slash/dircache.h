@@ -69,6 +69,8 @@ struct fidc_membh;
 #define DIRCACHEPG_SOFT_TIMEO	4		/* expiration after page read */
 #define DIRCACHEPG_HARD_TIMEO	30		/* expiration regardless if read */
 
+#define DIRCACHE_RA_NPAGES	4		/* readdir pages to read ahead */
+
 /*
  * This consitutes a block of 'struct dirent' members (dircache_ent)
  * belonging to a READDIR request, which may be one of many for
@@ -82,11 +84,13 @@ struct dircache_page {
 	off_t			 dcp_nextoff;	/* next getdents(2) 'offset' cookie */
 	struct pfl_timespec	 dcp_local_tm;	/* local clock when populated */
 	struct pfl_timespec	 dcp_remote_tm;	/* remote clock when populated */
-	struct psc_listentry	 dcp_lentry;	/* chain on dci  */
+	struct psc_listentry	 dcp_lentry;	/* pool membership */
+	RB_ENTRY(dircache_page)	 dcp_tentry;	/* dir's offset index */
 	struct psc_dynarray	*dcp_dents_off;	/* dircache_ents sorted by pfd_off */
 	void			*dcp_base;	/* pscfs_dirents */
 	slfgen_t		 dcp_dirgen;	/* directory generation; used to detect stale pages */
 	int			 dcp_refcnt;
+	int			 dcp_ranpages;	/* readahead pages to chain after this */
 };
 
 /* dcp_flags */
@@ -243,12 +247,25 @@ dce_sort_cmp_off(const void *x, const void *y)
 	return (dce_cmp_off(a, b));
 }
 
+static __inline int
+dircache_page_cmp(const void *a, const void *b)
+{
+	const struct dircache_page *x = a, *y = b;
+
+	return (CMP(x->dcp_off, y->dcp_off));
+}
+
+RB_PROTOTYPE(dircache_page_tree, dircache_page, dcp_tentry,
+    dircache_page_cmp)
+
 #define dircache_free_page(d, p)					\
 	_dircache_free_page(PFL_CALLERINFO(), (d), (p), 1)
 
 #define dircache_free_page_nowait(d, p)					\
 	_dircache_free_page(PFL_CALLERINFO(), (d), (p), 0)
 
+struct dircache_page *
+	dircache_lookup_page(struct fidc_membh *, off_t);
 struct dircache_page *
 	dircache_new_page(struct fidc_membh *, off_t, int);
 int	dircache_hasoff(struct dircache_page *, off_t);
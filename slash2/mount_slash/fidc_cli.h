@@ -25,6 +25,11 @@
 
 #include "pfl/list.h"
 #include "pfl/lock.h"
+#include "pfl/tree.h"
+
+/* dircache.h, included below, needs this tree type */
+struct dircache_page;
+RB_HEAD(dircache_page_tree, dircache_page);
 
 #include "sltypes.h"
 #include "fidcache.h"
@@ -42,7 +47,9 @@ struct fcmh_cli_info_file {
 };
 
 struct fcmh_cli_info_dir {
-	struct psc_lockedlist	 pages;
+	struct dircache_page_tree pages;	/* indexed by dcp_off */
+	int			 npages;
+	time_t			 sweep;		/* last expired page sweep */
 	struct psc_dynarray	 ents;		/* dircache ents not in a page */
 	struct pfl_rwlock	 dircache_rwlock;
 
@@ -65,7 +72,8 @@ struct fcmh_cli_info_dir {
  *	quick access.
  * @fcif_mapstircnt: how many times @idxmap has been used since last
  *	stir.
- * @fci_dc_pages: dircache pages.
+ * @fci_dc_pages: dircache pages, ordered by offset.
+ * @fcid_npages: number of dircache pages.
  * @fcid_lookup_age: second-resolution of last dircache LOOKUP miss.
  * @fcid_lookup_misses: how many LOOKUPs did not hit dircache since @age.
  * @fci_lentry: cache membership.
@@ -84,6 +92,8 @@ struct fcmh_cli_info {
 
 		struct fcmh_cli_info_dir d;
 #define fci_dc_pages		u.d.pages
+#define fcid_npages		u.d.npages
+#define fcid_sweep		u.d.sweep
 #define fcid_dircache_rwlock	u.d.dircache_rwlock
 #define fcid_ents		u.d.ents
 #define fcid_lookup_age		u.d.lookup_age
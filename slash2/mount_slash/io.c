@@ -82,6 +82,7 @@ struct timespec		 msl_bmap_timeo_inc = { BMAP_CLI_TIMEO_INC, 0 };
 int			 msl_predio_window_size = 4 * 1024 * 1024;
 int			 msl_predio_issue_minpages = LNET_MTU / BMPC_BUFSZ;
 int			 msl_predio_issue_maxpages = SLASH_BMAP_SIZE / BMPC_BUFSZ * 8;
+int			 msl_predio_lease_nbmaps = 8;
 
 struct pfl_iostats_rw	 slc_dio_iostats;
 struct pfl_opstat	*slc_rdcache_iostats;
@@ -160,7 +161,7 @@ _msl_biorq_page_valid(struct bmpc_ioreq *r, int idx, int accounting)
  */
 void
 predio_enqueue(const struct sl_fidgen *fgp, sl_bmapno_t bno,
-    enum rw rw, uint32_t off, int npages)
+    enum rw rw, uint32_t off, int npages, int nbmaps)
 {
 	struct readaheadrq *rarq;
 
@@ -174,6 +175,7 @@ predio_enqueue(const struct sl_fidgen *fgp, sl_bmapno_t bno,
 	rarq->rarq_bno = bno;
 	rarq->rarq_off = off;
 	rarq->rarq_npages = npages;
+	rarq->rarq_nbmaps = nbmaps;
 	lc_add(&msl_readaheadq, rarq);
 }
 
@@ -1167,7 +1169,7 @@ msl_pages_schedflush(struct bmpc_ioreq *r)
 		lc_addtail(&slc_bmapflushq, b);
 		DEBUG_BMAP(PLL_DIAG, b, "add to slc_bmapflushq");
 	}
-	bmap_flushq_wake(BMAPFLSH_TIMEOA);
+	bmap_flush_ready(b);
 
 	DEBUG_BMAP(PLL_DIAG, b, "biorq=%p list_empty=%d",
 	    r, pll_empty(&bmpc->bmpc_pndg_biorqs));
@@ -1684,7 +1686,7 @@ msl_issue_predio(struct msl_fhent *mfh, sl_bmapno_t bno, enum rw rw,
     uint32_t off, int npages)
 {
 	sl_bmapno_t orig_bno = bno;
-	int bsize, tpages, rapages;
+	int bsize, tpages, rapages, nbmaps;
 	off_t absoff, newissued;
 	struct fidc_membh *f;
 
@@ -1733,8 +1735,10 @@ msl_issue_predio(struct msl_fhent *mfh, sl_bmapno_t bno, enum rw rw,
 			    msl_predio_issue_maxpages);
 		} else
 			mfh->mfh_predio_nseq = npages;
-	} else
+	} else {
 		mfh->mfh_predio_nseq = 0;
+		mfh->mfh_predio_leased = 0;
+	}
 
 	mfh->mfh_predio_lastoff = absoff;
 
@@ -1793,7 +1797,23 @@ msl_issue_predio(struct msl_fhent *mfh, sl_bmapno_t bno, enum rw rw,
 		if (rw == SL_WRITE && bno == orig_bno)
 			continue;
 
-		predio_enqueue(&f->fcmh_fg, bno, rw, off, tpages);
+		/*
+		 * Once the application is streaming at the maximum
+		 * window, lease the next several bmaps in one RPC
+		 * instead of taking an MDS round trip at each bmap
+		 * boundary.
+		 */
+		nbmaps = 1;
+		if (mfh->mfh_predio_nseq >= msl_predio_issue_maxpages &&
+		    msl_predio_lease_nbmaps > 1 &&
+		    bno >= mfh->mfh_predio_leased) {
+			nbmaps = MIN(msl_predio_lease_nbmaps,
+			    (int)(fcmh_2_nbmaps(f) - bno));
+			mfh->mfh_predio_leased = bno + nbmaps;
+		}
+
+		predio_enqueue(&f->fcmh_fg, bno, rw, off, tpages,
+		    nbmaps);
 	}
 
 	mfh->mfh_predio_issued = bno * SLASH_BMAP_SIZE + off;
@@ -2157,6 +2177,11 @@ msreadaheadthr_main(struct psc_thread *thr)
 		rc = sl_fcmh_peek_fg(&rarq->rarq_fg, &f);
 		if (rc)
 			goto end;
+		if (rarq->rarq_nbmaps > 1) {
+			msl_bmap_lease_range(f, rarq->rarq_bno,
+			    rarq->rarq_nbmaps, rarq->rarq_rw);
+			rarq->rarq_nbmaps = 0;
+		}
 		rc = bmap_getf(f, rarq->rarq_bno, rarq->rarq_rw,
 		    BMAPGETF_CREATE | BMAPGETF_NONBLOCK |
 		    BMAPGETF_NODIO, &b);
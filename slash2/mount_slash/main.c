@@ -1025,7 +1025,7 @@ slc_wk_issue_readdir(void *p)
 {
 	struct slc_wkdata_readdir *wk = p;
 
-	msl_readdir_issue(NULL, wk->d, wk->off, wk->size, 0);
+	msl_readdir_issue(NULL, wk->d, wk->off, wk->size, 0, 0);
 	FCMH_LOCK(wk->d);
 	wk->pg->dcp_refcnt--;
 	fcmh_op_done_type(wk->d, FCMH_OPCNT_WORKER);
@@ -1405,15 +1405,32 @@ msl_readdir_error(struct fidc_membh *d, struct dircache_page *p, int rc)
 	DIRCACHE_ULOCK(d);
 }
 
+/*
+ * Continue a chain of readahead READDIRs outside of RPC callback
+ * context.
+ */
+int
+msl_readdir_ra_wkcb(void *arg)
+{
+	struct slc_wkdata_readdir *wk = arg;
+
+	msl_readdir_issue(NULL, wk->d, wk->off, wk->size, wk->ranpages,
+	    0);
+	fcmh_op_done_type(wk->d, FCMH_OPCNT_WORKER);
+	return (0);
+}
+
 void
 msl_readdir_finish(struct fidc_membh *d, struct dircache_page *p,
-    int eof, int nents, int size, void *base)
+    int eof, int nents, int size, size_t rqsize, void *base)
 {
+	struct slc_wkdata_readdir *wk;
 	struct srt_readdir_ent *e;
 	struct sl_fidgen *fgp;
 	struct fidc_membh *f;
+	int i, ranpages = 0;
+	off_t raoff = 0;
 	void *ebase;
-	int i;
 
 	ebase = PSC_AGP(base, size);
 
@@ -1445,9 +1462,25 @@ msl_readdir_finish(struct fidc_membh *d, struct dircache_page *p,
 	}
 	DIRCACHE_WRLOCK(d);
 	p->dcp_base = psc_realloc(p->dcp_base, size, 0);
+	if (!eof && p->dcp_ranpages > 1) {
+		raoff = p->dcp_nextoff;
+		ranpages = p->dcp_ranpages - 1;
+		fcmh_op_start_type(d, FCMH_OPCNT_WORKER);
+	}
 	p->dcp_refcnt--;
 	PFLOG_DIRCACHEPG(PLL_DEBUG, p, "decref");
 	DIRCACHE_ULOCK(d);
+
+	if (ranpages) {
+		OPSTAT_INCR("dircache-ra-chain");
+		wk = pfl_workq_getitem(msl_readdir_ra_wkcb,
+		    struct slc_wkdata_readdir);
+		wk->d = d;
+		wk->off = raoff;
+		wk->size = rqsize;
+		wk->ranpages = ranpages;
+		pfl_workq_putitem(wk);
+	}
 }
 
 int
@@ -1492,7 +1525,7 @@ msl_readdir_cb(struct pscrpc_request *rq, struct pscrpc_async_args *av)
 				PFL_GOTOERR(error, rc);
 		}
 		msl_readdir_finish(d, p, mp->eof, mp->nents, mp->size,
-		    dentbuf);
+		    mq->size, dentbuf);
 		dentbuf = NULL;
 	}
 	fcmh_op_done_type(d, FCMH_OPCNT_READDIR);
@@ -1505,7 +1538,7 @@ msl_readdir_cb(struct pscrpc_request *rq, struct pscrpc_async_args *av)
 
 int
 msl_readdir_issue(struct pscfs_req *pfr, struct fidc_membh *d,
-    off_t off, size_t size, int wait)
+    off_t off, size_t size, int ranpages, int wait)
 {
 	void *dentbuf = NULL;
 	struct slashrpc_cservice *csvc = NULL;
@@ -1519,6 +1552,7 @@ msl_readdir_issue(struct pscfs_req *pfr, struct fidc_membh *d,
 	p = dircache_new_page(d, off, wait);
 	if (p == NULL)
 		return (-ESRCH);
+	p->dcp_ranpages = ranpages;
 
 	fcmh_op_start_type(d, FCMH_OPCNT_READDIR);
 
@@ -1578,11 +1612,10 @@ void
 mslfsop_readdir(struct pscfs_req *pfr, size_t size, off_t off,
     void *data)
 {
-	int hit = 1, j, nd, issue, rc;
-	struct dircache_page *p, *np;
+	int hit = 1, j, nd, issue, ranpages, rc;
 	struct msl_fhent *mfh = data;
 	struct dircache_expire dexp;
-	struct fcmh_cli_info *fci;
+	struct dircache_page *p;
 	struct pscfs_dirent *pfd;
 	struct pscfs_creds pcr;
 	struct fidc_membh *d;
@@ -1612,7 +1645,6 @@ mslfsop_readdir(struct pscfs_req *pfr, size_t size, off_t off,
 		PFL_GOTOERR(out, rc);
 
 	DIRCACHE_WRLOCK(d);
-	fci = fcmh_2_fci(d);
 
  restart:
 	DIRCACHEPG_INITEXP(&dexp);
@@ -1620,97 +1652,95 @@ mslfsop_readdir(struct pscfs_req *pfr, size_t size, off_t off,
 	issue = 1;
 
 	/*
-	 * XXX Large directories will page in lots of buffers so this
-	 * code should really be changed to create a stub and wait for
-	 * it to be filled in instead of rescanning the entire list.
+	 * Pages being loaded sit in the index as stubs, so wait only if
+	 * the page we need is one of them.
 	 */
-	PLL_FOREACH_SAFE(p, np, &fci->fci_dc_pages) {
-
-		if (p->dcp_flags & DIRCACHEPGF_LOADING) {
-			// XXX need to wake up if csvc fails
-			OPSTAT_INCR("dircache-wait");
-			DIRCACHE_WAIT(d);
-			goto restart;
-		}
-		if (DIRCACHEPG_EXPIRED(d, p, &dexp)) {
-			dircache_free_page(d, p);
-			continue;
-		}
+	p = dircache_lookup_page(d, off);
+	if (p && p->dcp_flags &
+	    (DIRCACHEPGF_LOADING | DIRCACHEPGF_FREEING)) {
+		// XXX need to wake up if csvc fails
+		OPSTAT_INCR("dircache-wait");
+		DIRCACHE_WAIT(d);
+		goto restart;
+	}
+	if (p && DIRCACHEPG_EXPIRED(d, p, &dexp)) {
+		dircache_free_page(d, p);
+		goto restart;
+	}
 
+	if (p && off == p->dcp_nextoff &&
+	    p->dcp_flags & DIRCACHEPGF_EOF) {
 		/* We found the last page; return EOF. */
-		if (off == p->dcp_nextoff &&
-		    p->dcp_flags & DIRCACHEPGF_EOF) {
+		DIRCACHE_ULOCK(d);
+		OPSTAT_INCR("dircache-hit-eof");
+		pscfs_reply_readdir(pfr, NULL, 0, rc);
+		return;
+	} else if (p && p->dcp_rc) {
+		rc = p->dcp_rc;
+		dircache_free_page(d, p);
+		if (!slc_rmc_retry(pfr, &rc)) {
 			DIRCACHE_ULOCK(d);
-			OPSTAT_INCR("dircache-hit-eof");
 			pscfs_reply_readdir(pfr, NULL, 0, rc);
 			return;
 		}
+	} else if (p) {
+		off_t poff, thisoff = p->dcp_off;
+		size_t len, tlen;
+
+		/* find starting entry */
+		poff = 0;
+		nd = psc_dynarray_len(p->dcp_dents_off);
+		for (j = 0, pfd = p->dcp_base; j < nd; j++) {
+			if (off == thisoff)
+				break;
+			poff += PFL_DIRENT_SIZE(pfd->pfd_namelen);
+			thisoff = pfd->pfd_off;
+			pfd = PSC_AGP(p->dcp_base, poff);
+		}
 
-		if (dircache_hasoff(p, off)) {
-			if (p->dcp_rc) {
-				rc = p->dcp_rc;
-				dircache_free_page(d, p);
-				if (!slc_rmc_retry(pfr, &rc)) {
-					DIRCACHE_ULOCK(d);
-					pscfs_reply_readdir(pfr, NULL,
-					    0, rc);
-					return;
-				}
+		/* determine size */
+		for (len = 0; j < nd; j++)  {
+			tlen = PFL_DIRENT_SIZE(pfd->pfd_namelen);
+			if (tlen + len > size)
 				break;
-			} else {
-				off_t poff, thisoff = p->dcp_off;
-				size_t len, tlen;
-
-				/* find starting entry */
-				poff = 0;
-				nd = psc_dynarray_len(p->dcp_dents_off);
-				for (j = 0, pfd = p->dcp_base;
-				    j < nd; j++) {
-					if (off == thisoff)
-						break;
-					poff += PFL_DIRENT_SIZE(
-					    pfd->pfd_namelen);
-					thisoff = pfd->pfd_off;
-					pfd = PSC_AGP(p->dcp_base,
-					    poff);
-				}
-
-				/* determine size */
-				for (len = 0; j < nd; j++)  {
-					tlen = PFL_DIRENT_SIZE(
-					    pfd->pfd_namelen);
-					if (tlen + len > size)
-						break;
-					len += tlen;
-					pfd = PSC_AGP(p->dcp_base,
-					    poff + len);
-				}
-
-				// XXX I/O: remove from lock
-				pscfs_reply_readdir(pfr,
-				    p->dcp_base + poff, len, 0);
-				p->dcp_flags |= DIRCACHEPGF_READ;
-				if (hit)
-					OPSTAT_INCR("dircache-hit");
-
-				if ((p->dcp_flags &
-				    DIRCACHEPGF_EOF) == 0) {
-					/*
-					 * The reply_readdir() up ahead
-					 * may be followed by a RELEASE
-					 * so take an extra reference to
-					 * avoid use-after-free on the
-					 * fcmh.
-					 */
-					fcmh_op_start_type(d,
-					    FCMH_OPCNT_READAHEAD);
-					raoff = p->dcp_nextoff;
-				}
-
-				issue = 0;
+			len += tlen;
+			pfd = PSC_AGP(p->dcp_base, poff + len);
+		}
+
+		// XXX I/O: remove from lock
+		pscfs_reply_readdir(pfr, p->dcp_base + poff, len, 0);
+		p->dcp_flags |= DIRCACHEPGF_READ;
+		if (hit)
+			OPSTAT_INCR("dircache-hit");
+
+		/*
+		 * Keep up to DIRCACHE_RA_NPAGES pages ahead of the
+		 * reader: skip over those already cached or in flight
+		 * and read ahead from the first one missing.
+		 */
+		for (ranpages = DIRCACHE_RA_NPAGES; ranpages &&
+		    (p->dcp_flags & DIRCACHEPGF_EOF) == 0; ranpages--) {
+			raoff = p->dcp_nextoff;
+			p = dircache_lookup_page(d, raoff);
+			if (p == NULL)
+				break;
+			if (p->dcp_flags & (DIRCACHEPGF_LOADING |
+			    DIRCACHEPGF_FREEING) || p->dcp_rc) {
+				ranpages = 0;
 				break;
 			}
 		}
+		if (ranpages && p == NULL) {
+			/*
+			 * The reply_readdir() up ahead may be followed
+			 * by a RELEASE so take an extra reference to
+			 * avoid use-after-free on the fcmh.
+			 */
+			fcmh_op_start_type(d, FCMH_OPCNT_READAHEAD);
+		} else
+			raoff = 0;
+
+		issue = 0;
 	}
 	DIRCACHE_ULOCK(d);
 
@@ -1720,7 +1750,7 @@ mslfsop_readdir(struct pscfs_req *pfr, size_t size, off_t off,
 		 * had an error.  Issue a READDIR then wait for a reply.
 		 */
 		hit = 0;
-		rc = msl_readdir_issue(pfr, d, off, size, 1);
+		rc = msl_readdir_issue(pfr, d, off, size, 0, 1);
 		if (rc && !slc_rmc_retry(pfr, &rc)) {
 			pscfs_reply_readdir(pfr, NULL, 0, rc);
 			return;
@@ -1738,7 +1768,7 @@ mslfsop_readdir(struct pscfs_req *pfr, size_t size, off_t off,
 		pscfs_reply_readdir(pfr, NULL, 0, rc);
 
 	if (raoff) {
-		msl_readdir_issue(NULL, d, raoff, size, 0);
+		msl_readdir_issue(NULL, d, raoff, size, ranpages, 0);
 		fcmh_op_done_type(d, FCMH_OPCNT_READAHEAD);
 	}
 }
@@ -3666,7 +3696,7 @@ msl_init(const char *cfgfn)
 	}
 
 	authbuf_checkkeyfile();
-	authbuf_readkeyfile();
+	authbuf_readkeyfile(slcfg_local->cfg_bulk_auth);
 
 	libsl_init(4096);//2 * (SRCI_NBUFS + SRCM_NBUFS));
 	fidc_init(sizeof(struct fcmh_cli_info));
@@ -3684,8 +3714,8 @@ msl_init(const char *cfgfn)
 	slc_async_req_pool = psc_poolmaster_getmgr(&slc_async_req_poolmaster);
 
 	psc_poolmaster_init(&slc_biorq_poolmaster,
-	    struct bmpc_ioreq, biorq_lentry, PPMF_AUTO, 64, 64, 0, NULL,
-	    NULL, NULL, "biorq");
+	    struct bmpc_ioreq, biorq_lentry, PPMF_AUTO | PPMF_MAGAZINE,
+	    64, 64, 0, NULL, NULL, NULL, "biorq");
 	slc_biorq_pool = psc_poolmaster_getmgr(&slc_biorq_poolmaster);
 
 	psc_poolmaster_init(&slc_mfh_poolmaster,
@@ -3815,6 +3845,7 @@ psc_usklndthr_get_namev(char buf[PSC_THRNAME_MAX], const char *namefmt,
 
 enum {
 	LOOKUP_TYPE_BOOL,
+	LOOKUP_TYPE_INT,
 	LOOKUP_TYPE_UINT64,
 };
 
@@ -3827,14 +3858,19 @@ opt_lookup(const char *opt)
 		void		*ptr;
 	} *io, opts[] = {
 		{ "acl",		LOOKUP_TYPE_BOOL,	&msl_acl },
+		{ "fuse_clonefd",	LOOKUP_TYPE_BOOL,	&pscfs_fuse_clonefd },
+		{ "fuse_splice",	LOOKUP_TYPE_BOOL,	&pscfs_fuse_splice },
+		{ "fuse_threads",	LOOKUP_TYPE_INT,	&pscfs_nthreads },
 		{ "mapfile",		LOOKUP_TYPE_BOOL,	&slc_use_mapfile },
 		{ "pagecache_maxsize",	LOOKUP_TYPE_UINT64,	&msl_pagecache_maxsize },
 		{ "root_squash",	LOOKUP_TYPE_BOOL,	&slc_root_squash },
 		{ NULL,			0,			NULL }
 	};
 	const char *val;
+	char *endp;
 	size_t optlen;
 	ssize_t sz;
+	long l;
 
 	val = strchr(opt, '=');
 	if (val) {
@@ -3849,6 +3885,17 @@ opt_lookup(const char *opt)
 			case LOOKUP_TYPE_BOOL:
 				*(int *)io->ptr = 1;
 				break;
+			case LOOKUP_TYPE_INT:
+				if (val == NULL)
+					errx(1, "%s: value required",
+					    io->name);
+				l = strtol(val, &endp, 10);
+				if (endp == val || *endp != '\0' ||
+				    l < 1 || l > INT_MAX)
+					errx(1, "%s: invalid value: %s",
+					    io->name, val);
+				*(int *)io->ptr = l;
+				break;
 			case LOOKUP_TYPE_UINT64:
 				sz = pfl_humantonum(val);
 				if (sz < 0)
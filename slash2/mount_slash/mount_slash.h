@@ -142,6 +142,7 @@ struct slc_wkdata_readdir {
 	struct dircache_page		*pg;
 	off_t				 off;
 	size_t				 size;
+	int				 ranpages;
 };
 
 /* file handle in struct fuse_file_info */
@@ -161,6 +162,7 @@ struct msl_fhent {
 	off_t				 mfh_predio_lastoff;	/* last offset */
 	off_t				 mfh_predio_issued;	/* how far prediction mechanism has dealt */
 	int				 mfh_predio_nseq;	/* num sequential IOs */
+	sl_bmapno_t			 mfh_predio_leased;	/* bmaps up to here were range leased */
 
 	/* stats */
 	struct timespec			 mfh_open_time;	/* clock_gettime(2) at open(2) time */
@@ -249,8 +251,14 @@ struct resm_cli_info {
 	struct srm_bmap_release_req	 rmci_bmaprls;
 	struct psc_listcache		 rmci_async_reqs;
 	psc_atomic32_t			 rmci_infl_rpcs;
+	int				 rmci_flags;
+	struct psclist_head		 rmci_flushq;		/* bmaps ready to flush */
+	struct psc_listentry		 rmci_flush_lentry;	/* slc_bflush_rdyq */
 };
 
+/* rmci_flags, protected by slc_bflush_lock */
+#define RMCIF_FLUSHRDY			(1 << 0)	/* on slc_bflush_rdyq */
+
 static __inline struct resm_cli_info *
 resm2rmci(struct sl_resm *resm)
 {
@@ -264,6 +272,7 @@ struct readaheadrq {
 	sl_bmapno_t			rarq_bno;
 	uint32_t			rarq_off;
 	int				rarq_npages;
+	int				rarq_nbmaps;	/* lease this many bmaps at once */
 };
 
 struct uid_mapping {
@@ -290,6 +299,7 @@ void	 msl_bmap_stash_lease(struct bmap *,
 	    const struct srt_bmapdesc *, int, const char *);
 int	 msl_bmap_to_csvc(struct bmap *, int, struct sl_resm **, struct slashrpc_cservice **);
 void	 msl_bmap_reap_init(struct bmap *);
+int	 msl_bmap_lease_range(struct fidc_membh *, sl_bmapno_t, int, enum rw);
 void	 msl_bmpces_fail(struct bmpc_ioreq *, int);
 void	_msl_biorq_release(const struct pfl_callerinfo *, struct bmpc_ioreq *);
 
@@ -300,6 +310,7 @@ ssize_t	 msl_io(struct pscfs_req *, struct msl_fhent *, char *, size_t, off_t, e
 int	 msl_stat(struct fidc_membh *, void *);
 
 int	 msl_read_cleanup(struct pscrpc_request *, int, struct pscrpc_async_args *);
+int	 msl_readdir_issue(struct pscfs_req *, struct fidc_membh *, off_t, size_t, int, int);
 int	 msl_dio_cleanup(struct pscrpc_request *, int, struct pscrpc_async_args *);
 
 ssize_t	 slc_getxattr(struct pscfs_req *pfr, const struct pscfs_creds *,
@@ -338,6 +349,7 @@ void	 parse_mapfile(void);
 	_bmap_flushq_wake(PFL_CALLERINFOSS(SLSS_BMAP), (reason))
 
 void	 _bmap_flushq_wake(const struct pfl_callerinfo *, int);
+void	  bmap_flush_ready(struct bmap *);
 void	  bmap_flush_resched(struct bmpc_ioreq *, int);
 
 /* bmap flush modes (bmap_flushq_wake) */
@@ -384,10 +396,12 @@ extern struct psc_poolmgr	*slc_mfh_pool;
 extern int			 slc_direct_io;
 extern int			 slc_root_squash;
 extern int			 slc_max_nretries;
+extern int			 slc_bflush_maxinfl;
 extern int			 msl_acl;
 extern int			 msl_predio_window_size;
 extern int			 msl_predio_issue_minpages;
 extern int			 msl_predio_issue_maxpages;
+extern int			 msl_predio_lease_nbmaps;
 extern uint64_t			 msl_pagecache_maxsize;
 
 extern int			 bmap_max_cache;
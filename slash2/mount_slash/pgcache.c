@@ -51,8 +51,6 @@ int			 msl_bmpces_max = 16 * 1024; /* 512MiB */
 struct psc_listcache	 msl_idle_pages;
 struct psc_listcache	 msl_readahead_pages;
 
-RB_GENERATE(bmap_pagecachetree, bmap_pagecache_entry, bmpce_tentry,
-    bmpce_cmp)
 RB_GENERATE(bmpc_biorq_tree, bmpc_ioreq, biorq_tentry, bmpc_biorq_cmp)
 
 /*
@@ -105,52 +103,54 @@ bmpce_destroy(void *p)
 	psc_free(e->bmpce_base, PAF_PAGEALIGN);
 }
 
+/*
+ * Find or create the page at a bmap offset and take a reference to it.
+ * Existing pages are found without the bci_rwlock; it is only taken in
+ * write mode to install a new page.
+ */
 int
 _bmpce_lookup(const struct pfl_callerinfo *pci,
     __unusedx struct bmpc_ioreq *r, struct bmap *b, int flags,
     uint32_t off, struct psc_waitq *wq,
     struct bmap_pagecache_entry **ep)
 {
-	int remove_idle = 0, remove_readalc = 0, wrlock = 0;
-	struct bmap_pagecache_entry q, *e = NULL, *e2 = NULL;
+	int remove_idle = 0, remove_readalc = 0, wait, ph = 0;
+	struct bmap_pagecache_entry *e = NULL, *e2 = NULL;
 	struct bmap_cli_info *bci = bmap_2_bci(b);
 	struct bmap_pagecache *bmpc;
+	struct bmpc_slot *slot;
 
 	bmpc = bmap_2_bmpc(b);
-	q.bmpce_off = off;
-
-	pfl_rwlock_rdlock(&bci->bci_rwlock);
 
 	for (;;) {
-		e = RB_FIND(bmap_pagecachetree, &bmpc->bmpc_tree, &q);
+		slot = bmpc_slot_get(bmpc, off, 0);
+		e = NULL;
+		if (slot) {
+			ph = bmpc_slot_enter(slot);
+			e = __atomic_load_n(&slot->bs_bmpce,
+			    __ATOMIC_SEQ_CST);
+		}
 		if (e) {
+			wait = 0;
+			BMPCE_LOCK(e);
 			if (e->bmpce_flags & BMPCEF_EIO) {
-				if (e->bmpce_flags & BMPCEF_READAHEAD) {
-					BMPCE_LOCK(e);
+				if (e->bmpce_flags & BMPCEF_READAHEAD)
 					e->bmpce_flags &= ~BMPCEF_EIO;
-					BMPCE_ULOCK(e);
-				} else {
+				else {
 					DEBUG_BMPCE(PLL_WARN, e,
 					    "skipping an EIO page");
 					OPSTAT_INCR("bmpce-eio");
- retry:
-					psc_waitq_waitrelf_us(
-					    &b->bcm_fcmh->fcmh_waitq,
-					    PFL_WAITQWF_RWLOCK,
-					    &bci->bci_rwlock, 100);
-					if (wrlock)
-						pfl_rwlock_wrlock(
-						    &bci->bci_rwlock);
-					else
-						pfl_rwlock_rdlock(
-						    &bci->bci_rwlock);
-					continue;
+					wait = 1;
 				}
 			}
-			BMPCE_LOCK(e);
-			if (e->bmpce_flags & BMPCEF_TOFREE) {
+			if (e->bmpce_flags & BMPCEF_TOFREE)
+				wait = 1;
+			if (wait) {
 				BMPCE_ULOCK(e);
-				goto retry;
+				bmpc_slot_exit(slot, ph);
+				psc_waitq_waitrel_us(
+				    &b->bcm_fcmh->fcmh_waitq, NULL, 100);
+				continue;
 			}
 
 			if (e->bmpce_ref == 1 &&
@@ -172,42 +172,49 @@ _bmpce_lookup(const struct pfl_callerinfo *pci,
 			DEBUG_BMPCE(PLL_DIAG, e,
 			    "add reference");
 			BMPCE_ULOCK(e);
+			bmpc_slot_exit(slot, ph);
 
 			OPSTAT_INCR("bmpce-hit");
 			break;
 		}
+		if (slot)
+			bmpc_slot_exit(slot, ph);
 
 		if (e2 == NULL) {
-			pfl_rwlock_unlock(&bci->bci_rwlock);
-
 			if (flags & BMPCEF_READAHEAD) {
 				e2 = psc_pool_shallowget(bmpce_pool);
 				if (e2 == NULL)
 					return (EAGAIN);
 			} else
 				e2 = psc_pool_get(bmpce_pool);
-			wrlock = 1;
-			pfl_rwlock_wrlock(&bci->bci_rwlock);
 			continue;
-		} else {
-			e = e2;
-			e2 = NULL;
-			e->bmpce_off = off;
-			e->bmpce_ref = 1;
-			e->bmpce_len = 0;
-			e->bmpce_start = off;
-			e->bmpce_waitq = wq;
-			e->bmpce_flags = flags;
-			e->bmpce_bmap = b;
-
-			PSC_RB_XINSERT(bmap_pagecachetree,
-			    &bmpc->bmpc_tree, e);
-
-			DEBUG_BMPCE(PLL_DIAG, e, "creating");
-			break;
 		}
+
+		pfl_rwlock_wrlock(&bci->bci_rwlock);
+		slot = bmpc_slot_get(bmpc, off, 1);
+		if (slot->bs_bmpce) {
+			/* Someone else installed the page first. */
+			pfl_rwlock_unlock(&bci->bci_rwlock);
+			continue;
+		}
+
+		e = e2;
+		e2 = NULL;
+		e->bmpce_off = off;
+		e->bmpce_ref = 1;
+		e->bmpce_len = 0;
+		e->bmpce_start = off;
+		e->bmpce_waitq = wq;
+		e->bmpce_flags = flags;
+		e->bmpce_bmap = b;
+
+		__atomic_store_n(&slot->bs_bmpce, e, __ATOMIC_SEQ_CST);
+		bmpc->bmpc_npages++;
+		pfl_rwlock_unlock(&bci->bci_rwlock);
+
+		DEBUG_BMPCE(PLL_DIAG, e, "creating");
+		break;
 	}
-	pfl_rwlock_unlock(&bci->bci_rwlock);
 
 	if (e2) {
 		OPSTAT_INCR("bmpce-gratuitous");
@@ -237,7 +244,8 @@ bmpce_free(struct bmap_pagecache_entry *e)
 {
 	struct bmap_pagecache *bmpc = bmap_2_bmpc(e->bmpce_bmap);
 	struct bmap_cli_info *bci = bmap_2_bci(e->bmpce_bmap);
-	int locked;
+	struct bmpc_slot *slot;
+	int locked, ph;
 
 	psc_assert(e->bmpce_ref == 0);
 	e->bmpce_flags |= BMPCEF_TOFREE;
@@ -247,7 +255,22 @@ bmpce_free(struct bmap_pagecache_entry *e)
 	locked = pfl_rwlock_haswrlock(&bci->bci_rwlock);
 	if (!locked)
 		pfl_rwlock_wrlock(&bci->bci_rwlock);
-	PSC_RB_XREMOVE(bmap_pagecachetree, &bmpc->bmpc_tree, e);
+	slot = bmpc_slot_get(bmpc, e->bmpce_off, 0);
+	psc_assert(slot && slot->bs_bmpce == e);
+	__atomic_store_n(&slot->bs_bmpce, NULL, __ATOMIC_SEQ_CST);
+	bmpc->bmpc_npages--;
+
+	/*
+	 * Lockless lookups that loaded the slot before we cleared it
+	 * will find BMPCEF_TOFREE; wait for them to let go before the
+	 * memory goes back to the pool.  Lookups starting from here on
+	 * count against the other phase and cannot see this page, so
+	 * the wait is bounded.  The write lock keeps another free of
+	 * this slot from flipping the phase back underneath us.
+	 */
+	ph = __atomic_fetch_xor(&slot->bs_phase, 1, __ATOMIC_SEQ_CST);
+	while (psc_atomic32_read(&slot->bs_busy[ph]))
+		pscthr_yield();
 	if (!locked)
 		pfl_rwlock_unlock(&bci->bci_rwlock);
 
@@ -373,7 +396,8 @@ bmpc_freeall(struct bmap *b)
 {
 	struct bmap_pagecache *bmpc = bmap_2_bmpc(b);
 	struct bmap_cli_info *bci = bmap_2_bci(b);
-	struct bmap_pagecache_entry *e, *next;
+	struct bmap_pagecache_entry *e;
+	int i;
 
 	psc_assert(RB_EMPTY(&bmpc->bmpc_new_biorqs));
 
@@ -393,10 +417,7 @@ bmpc_freeall(struct bmap *b)
 	 * go away some day.
 	 */
 	pfl_rwlock_wrlock(&bci->bci_rwlock);
-	for (e = RB_MIN(bmap_pagecachetree, &bmpc->bmpc_tree); e;
-	    e = next) {
-		next = RB_NEXT(bmap_pagecachetree, &bmpc->bmpc_tree, e);
-
+	BMPC_FOREACH(bmpc, e, i) {
 		BMPCE_LOCK(e);
 		e->bmpce_flags |= BMPCEF_DISCARD;
 		if (e->bmpce_flags & BMPCEF_REAPED) {
@@ -416,6 +437,11 @@ bmpc_freeall(struct bmap *b)
 		} else
 			psc_fatalx("impossible");
 	}
+	psc_assert(bmpc->bmpc_npages == 0);
+	for (i = 0; i < BMPC_NLEAVES; i++) {
+		PSCFREE(bmpc->bmpc_leaves[i]);
+		bmpc->bmpc_leaves[i] = NULL;
+	}
 	pfl_rwlock_unlock(&bci->bci_rwlock);
 }
 
@@ -440,6 +466,7 @@ bmpc_expire_biorqs(struct bmap_pagecache *bmpc)
 		DEBUG_BIORQ(PLL_DIAG, r, "force expire");
 		BIORQ_ULOCK(r);
 	}
+	bmap_flush_ready(bmpc_2_bmap(bmpc));
 	bmap_flushq_wake(BMAPFLSH_EXPIRE);
 }
 
@@ -585,9 +612,9 @@ bmpc_global_init(void)
 		msl_bmpces_max = msl_pagecache_maxsize / BMPC_BUFSZ;
 
 	psc_poolmaster_init(&bmpce_poolmaster,
-	    struct bmap_pagecache_entry, bmpce_lentry, PPMF_AUTO, 512,
-	    512, msl_bmpces_max, bmpce_init, bmpce_destroy, bmpce_reap,
-	    "bmpce");
+	    struct bmap_pagecache_entry, bmpce_lentry,
+	    PPMF_AUTO | PPMF_MAGAZINE, 512, 512, msl_bmpces_max,
+	    bmpce_init, bmpce_destroy, bmpce_reap, "bmpce");
 	bmpce_pool = psc_poolmaster_getmgr(&bmpce_poolmaster);
 
 	psc_poolmaster_init(&bwc_poolmaster,
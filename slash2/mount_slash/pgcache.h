@@ -30,6 +30,7 @@
 
 #include <time.h>
 
+#include "pfl/alloc.h"
 #include "pfl/atomic.h"
 #include "pfl/list.h"
 #include "pfl/listcache.h"
@@ -69,7 +70,6 @@ struct bmap_pagecache_entry {
 	void			*bmpce_base;	/* statically allocated pg contents */
 	struct psc_waitq	*bmpce_waitq;	/* others block here on I/O */
 	struct psc_lockedlist	 bmpce_pndgaios;
-	RB_ENTRY(bmap_pagecache_entry) bmpce_tentry;
 	struct psc_listentry	 bmpce_lentry;	/* chain on bmap LRU */
 };
 
@@ -138,17 +138,35 @@ struct bmap_pagecache_entry {
 	    (pg)->bmpce_off, (pg)->bmpce_base,				\
 	    (pg)->bmpce_ref, ## __VA_ARGS__)
 
-static __inline int
-bmpce_cmp(const void *x, const void *y)
-{
-	const struct bmap_pagecache_entry *a = x, *b = y;
+/*
+ * Pages are indexed by their slot (bmpce_off / BMPC_BUFSZ) in a
+ * two-level table: a fixed array of leaves in the bmap, each leaf
+ * allocated on first use.  Slots are installed and cleared under the
+ * bci_rwlock write lock but read without it.  A lockless reader bumps
+ * the bs_busy counter of the slot's current phase before loading the
+ * page pointer.  bmpce_free() clears the slot, flips the phase, and
+ * waits only for the old phase to drain, so a page cannot go back to
+ * the pool while a reader is about to lock it, and lookups arriving
+ * afterwards (e.g. for a new page at the same offset) cannot hold the
+ * free off indefinitely.
+ */
+#define BMPC_NSLOTS		(SLASH_BMAP_SIZE / BMPC_BUFSZ)
+#define BMPC_LEAF_SHIFT		6
+#define BMPC_LEAF_NSLOTS	(1 << BMPC_LEAF_SHIFT)
+#define BMPC_LEAF_MASK		(BMPC_LEAF_NSLOTS - 1)
+#define BMPC_NLEAVES		(BMPC_NSLOTS / BMPC_LEAF_NSLOTS)
+
+struct bmpc_slot {
+	struct bmap_pagecache_entry	*bs_bmpce;
+	psc_atomic32_t			 bs_busy[2];	/* lockless lookups in progress */
+	int				 bs_phase;	/* bs_busy[] new lookups use */
+};
 
-	return (CMP(a->bmpce_off, b->bmpce_off));
-}
+struct bmpc_leaf {
+	struct bmpc_slot		 bl_slots[BMPC_LEAF_NSLOTS];
+};
 
-RB_HEAD(bmap_pagecachetree, bmap_pagecache_entry);
-RB_PROTOTYPE(bmap_pagecachetree, bmap_pagecache_entry, bmpce_tentry,
-    bmpce_cmp)
+#define bmpce_2_slotno(off)	((off) / BMPC_BUFSZ)
 
 struct bmpc_ioreq {
 	char			*biorq_buf;
@@ -244,7 +262,8 @@ RB_HEAD(bmpc_biorq_tree, bmpc_ioreq);
 RB_PROTOTYPE(bmpc_biorq_tree, bmpc_ioreq, biorq_tentry, bmpc_biorq_cmp)
 
 struct bmap_pagecache {
-	struct bmap_pagecachetree	 bmpc_tree;		/* tree of entries */
+	struct bmpc_leaf		*bmpc_leaves[BMPC_NLEAVES];
+	int				 bmpc_npages;		/* under bci_rwlock */
 	struct psc_waitq		 bmpc_waitq;
 
 	/*
@@ -279,6 +298,75 @@ bmpce_usecheck(struct bmap_pagecache_entry *bmpce, __unusedx int op,
 	psc_assert(bmpce->bmpce_off == off);
 }
 
+/*
+ * Return the slot for a page offset, optionally allocating its leaf.
+ * Allocation must be done with the bci_rwlock write lock held.
+ */
+static __inline struct bmpc_slot *
+bmpc_slot_get(struct bmap_pagecache *bmpc, uint32_t off, int alloc)
+{
+	struct bmpc_leaf *l, **lp;
+	int n;
+
+	n = bmpce_2_slotno(off);
+	lp = &bmpc->bmpc_leaves[n >> BMPC_LEAF_SHIFT];
+	l = __atomic_load_n(lp, __ATOMIC_ACQUIRE);
+	if (l == NULL) {
+		if (!alloc)
+			return (NULL);
+		l = PSCALLOC(sizeof(*l));
+		__atomic_store_n(lp, l, __ATOMIC_RELEASE);
+	}
+	return (&l->bl_slots[n & BMPC_LEAF_MASK]);
+}
+
+/*
+ * Announce a lockless lookup of a slot.  Returns the phase to pass to
+ * bmpc_slot_exit().
+ */
+static __inline int
+bmpc_slot_enter(struct bmpc_slot *slot)
+{
+	int ph;
+
+	ph = __atomic_load_n(&slot->bs_phase, __ATOMIC_SEQ_CST);
+	psc_atomic32_inc(&slot->bs_busy[ph]);
+	return (ph);
+}
+
+static __inline void
+bmpc_slot_exit(struct bmpc_slot *slot, int ph)
+{
+	psc_atomic32_dec(&slot->bs_busy[ph]);
+}
+
+/*
+ * Return the next page at or after slot *ip, for walking all pages of
+ * a bmap with the bci_rwlock held.
+ */
+static __inline struct bmap_pagecache_entry *
+bmpc_next(struct bmap_pagecache *bmpc, int *ip)
+{
+	struct bmap_pagecache_entry *e;
+	struct bmpc_leaf *l;
+
+	while (*ip < BMPC_NSLOTS) {
+		l = bmpc->bmpc_leaves[*ip >> BMPC_LEAF_SHIFT];
+		if (l == NULL) {
+			*ip = (*ip | BMPC_LEAF_MASK) + 1;
+			continue;
+		}
+		e = l->bl_slots[*ip & BMPC_LEAF_MASK].bs_bmpce;
+		(*ip)++;
+		if (e)
+			return (e);
+	}
+	return (NULL);
+}
+
+#define BMPC_FOREACH(bmpc, e, i)					\
+	for ((i) = 0; ((e) = bmpc_next((bmpc), &(i))) != NULL; )
+
 #define biorq_getaligned_off(r, nbmpce)					\
 	(((r)->biorq_off & ~BMPC_BUFMASK) + ((nbmpce) * BMPC_BUFSZ))
 
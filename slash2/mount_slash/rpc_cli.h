@@ -47,6 +47,10 @@ enum {
 	MSL_BMLGET_CBARG_CSVC
 };
 
+#define MSL_BMLRANGE_CBARG_CSVC		0
+#define MSL_BMLRANGE_CBARG_BMAPS	1
+#define MSL_BMLRANGE_CBARG_LEASES	2
+
 #define MSL_READDIR_CBARG_CSVC		0
 #define MSL_READDIR_CBARG_FCMH		1
 #define MSL_READDIR_CBARG_PAGE		2
@@ -48,15 +48,103 @@
 psc_atomic64_t	sl_authbuf_nonce = PSC_ATOMIC64_INIT(0);
 unsigned char	sl_authbuf_key[AUTHBUF_KEYSIZE];
 gcry_md_hd_t	sl_authbuf_hd;
+gcry_md_hd_t	sl_authbuf_bulkhd[AUTHBUF_BULKALG_MAX];
+uint32_t	sl_authbuf_bulkalgs = AUTHBUF_BULKALG_MASK(AUTHBUF_BULKALG_SHA256);
+
+const char	*authbuf_bulkalg_names[AUTHBUF_BULKALG_MAX] = {
+	"sha256",
+	"blake2b",
+	"blake2s"
+};
+
+/*
+ * authbuf_bulkalg_open - Open a hash handle for a bulk authenticator
+ *	primed with the secret key.
+ * @alg: AUTHBUF_BULKALG_* value.
+ * @hdp: value-result handle.
+ * @key: secret key.
+ * @len: length of @key.
+ *
+ * SHA-256 keeps the historical keyed-prefix construction so peers that
+ * do not negotiate still interoperate.  The BLAKE2 variants use their
+ * native keyed mode with a key condensed from the secret, which avoids
+ * hashing the 1KB prefix for every bulk and is typically faster than
+ * SHA-256 on CPUs without SHA extensions.
+ */
+int
+authbuf_bulkalg_open(int alg, gcry_md_hd_t *hdp, const void *key,
+    size_t len)
+{
+	unsigned char dkey[64];
+	gcry_error_t gerr;
+	int mdalg, klen;
+
+	switch (alg) {
+	case AUTHBUF_BULKALG_SHA256:
+		gerr = gcry_md_open(hdp, GCRY_MD_SHA256, 0);
+		if (gerr)
+			return (gerr);
+		gcry_md_write(*hdp, key, len);
+		return (0);
+#if GCRYPT_VERSION_NUMBER >= 0x010800
+	case AUTHBUF_BULKALG_BLAKE2B:
+		mdalg = GCRY_MD_BLAKE2B_256;
+		klen = 64;
+		gcry_md_hash_buffer(GCRY_MD_SHA512, dkey, key, len);
+		break;
+	case AUTHBUF_BULKALG_BLAKE2S:
+		mdalg = GCRY_MD_BLAKE2S_256;
+		klen = 32;
+		gcry_md_hash_buffer(GCRY_MD_SHA256, dkey, key, len);
+		break;
+#endif
+	default:
+		return (GPG_ERR_DIGEST_ALGO);
+	}
+
+	psc_assert(gcry_md_get_algo_dlen(mdalg) == AUTHBUF_ALGLEN);
+
+	gerr = gcry_md_open(hdp, mdalg, 0);
+	if (gerr)
+		return (gerr);
+	gerr = gcry_md_setkey(*hdp, dkey, klen);
+	if (gerr) {
+		gcry_md_close(*hdp);
+		*hdp = NULL;
+	}
+	return (gerr);
+}
+
+/*
+ * authbuf_bulkalg_select - Pick the bulk authenticator to use with a
+ *	peer.
+ * @peeralgs: mask of AUTHBUF_BULKALG_* advertised by the peer; peers
+ *	predating negotiation send zero which implies SHA-256 only.
+ */
+int
+authbuf_bulkalg_select(uint32_t peeralgs)
+{
+	uint32_t algs;
+	int alg;
+
+	if (peeralgs == 0)
+		peeralgs = AUTHBUF_BULKALG_MASK(AUTHBUF_BULKALG_SHA256);
+	algs = peeralgs & sl_authbuf_bulkalgs;
+	for (alg = AUTHBUF_BULKALG_MAX - 1; alg > 0; alg--)
+		if (algs & AUTHBUF_BULKALG_MASK(alg))
+			break;
+	return (alg);
+}
 
 /*
  * authbuf_readkeyfile - Read the contents of a secret key file into
  *	memory.
+ * @bulkalg: additional bulk authenticator to offer peers.
  */
 void
-authbuf_readkeyfile(void)
+authbuf_readkeyfile(int bulkalg)
 {
-	char keyfn[PATH_MAX];
+	char keyfn[PATH_MAX], ebuf[BUFSIZ];
 	gcry_error_t gerr;
 	struct stat stb;
 	int alg, fd;
@@ -82,6 +170,21 @@ authbuf_readkeyfile(void)
 	gcry_md_write(sl_authbuf_hd, sl_authbuf_key,
 	    sizeof(sl_authbuf_key));
 
+	sl_authbuf_bulkhd[AUTHBUF_BULKALG_SHA256] = sl_authbuf_hd;
+	if (bulkalg != AUTHBUF_BULKALG_SHA256) {
+		gerr = authbuf_bulkalg_open(bulkalg,
+		    &sl_authbuf_bulkhd[bulkalg], sl_authbuf_key,
+		    sizeof(sl_authbuf_key));
+		if (gerr) {
+			gpg_strerror_r(gerr, ebuf, sizeof(ebuf));
+			psclog_warnx("bulk authenticator %s unavailable, "
+			    "using sha256: %s",
+			    authbuf_bulkalg_names[bulkalg], ebuf);
+		} else
+			sl_authbuf_bulkalgs |=
+			    AUTHBUF_BULKALG_MASK(bulkalg);
+	}
+
 	psc_atomic64_set(&sl_authbuf_nonce, psc_random64());
 }
 
@@ -75,6 +75,13 @@ bmap_remove(struct bmap *b)
 	PSC_RB_XREMOVE(bmaptree, &f->fcmh_bmaptree, b);
 	pfl_rwlock_unlock(&f->fcmh_rwlock);
 
+	/*
+	 * Lookups that found us before we left the tree may still be
+	 * about to lock us; they will see BMAPF_TOFREE and back off.
+	 */
+	while (psc_atomic32_read(&b->bcm_pincnt))
+		pscthr_yield();
+
 	fcmh_op_done_type(f, FCMH_OPCNT_BMAP);
 	psc_pool_return(bmap_pool, b);
 }
@@ -135,11 +142,15 @@ bmap_lookup_cache(struct fidc_membh *f, sl_bmapno_t n, int bmaprw,
 		pfl_rwlock_rdlock(&f->fcmh_rwlock);
 	b = RB_FIND(bmaptree, &f->fcmh_bmaptree, &lb);
 	if (b) {
-		if (!BMAP_TRYLOCK(b)) {
-			pfl_rwlock_unlock(&f->fcmh_rwlock);
-			usleep(30);
-			goto restart;
-		}
+		/*
+		 * Pin the bmap so its memory stays valid once the tree
+		 * lock is dropped, then block on the bmap lock without
+		 * holding the tree lock.  bmap_remove() waits for pins
+		 * to drain before the bmap can be reused.
+		 */
+		psc_atomic32_inc(&b->bcm_pincnt);
+		pfl_rwlock_unlock(&f->fcmh_rwlock);
+		BMAP_LOCK(b);
 
 		if (b->bcm_flags & BMAPF_TOFREE) {
 			/*
@@ -148,26 +159,25 @@ bmap_lookup_cache(struct fidc_membh *f, sl_bmapno_t n, int bmaprw,
 			 */
 			DEBUG_BMAP(PLL_DIAG, b, "wait on to-free bmap");
 			BMAP_ULOCK(b);
+			psc_atomic32_dec(&b->bcm_pincnt);
 			/*
 			 * We don't want to spin if we are waiting for a
 			 * flush to clear.
 			 */
-			psc_waitq_waitrelf_us(&f->fcmh_waitq,
-			    PFL_WAITQWF_RWLOCK, &f->fcmh_rwlock, 100);
+			psc_waitq_waitrel_us(&f->fcmh_waitq, NULL, 100);
 			goto restart;
 		}
 		bmap_op_start_type(b, BMAP_OPCNT_LOOKUP);
-	}
-	if (doalloc == 0 || b) {
+		psc_atomic32_dec(&b->bcm_pincnt);
+	} else if (doalloc == 0 || bnew == NULL)
 		pfl_rwlock_unlock(&f->fcmh_rwlock);
+	if (doalloc == 0 || b) {
 		if (bnew)
 			psc_pool_return(bmap_pool, bnew);
 		*new_bmap = 0;
 		return (b);
 	}
 	if (bnew == NULL) {
-		pfl_rwlock_unlock(&f->fcmh_rwlock);
-
 		if (sl_bmap_ops.bmo_reapf)
 			sl_bmap_ops.bmo_reapf();
 
@@ -333,7 +343,8 @@ bmap_cache_init(size_t priv_size)
 	_psc_poolmaster_init(&bmap_poolmaster,
 	    sizeof(struct bmap) + priv_size,
 	    offsetof(struct bmap, bcm_lentry),
-	    PPMF_AUTO, 64, 64, 0, NULL, NULL, NULL, NULL, "bmap");
+	    PPMF_AUTO | PPMF_MAGAZINE, 64, 64, 0, NULL, NULL, NULL, NULL,
+	    "bmap");
 	bmap_pool = psc_poolmaster_getmgr(&bmap_poolmaster);
 }
 
@@ -313,13 +313,19 @@ libsl_init(int nmsgs)
 		if (*t)
 			*p = *t;
 
-	if (nodeResm->resm_type == SLREST_ARCHIVAL_FS) {
+	if (nodeResm->resm_type == SLREST_ARCHIVAL_FS &&
+	    slcfg_local->cfg_async_io == SLCFG_ASYNCIO_NONE)
+		slcfg_local->cfg_async_io = SLCFG_ASYNCIO_POSIX;
+
 #ifndef HAVE_AIO
+	if (slcfg_local->cfg_async_io == SLCFG_ASYNCIO_POSIX)
 		psc_fatalx("asynchronous I/O not supported on "
 		    "this platform");
 #endif
-		slcfg_local->cfg_async_io = 1;
-	}
+#ifndef HAVE_IO_URING
+	if (slcfg_local->cfg_async_io == SLCFG_ASYNCIO_URING)
+		psc_fatalx("io_uring not supported on this platform");
+#endif
 
 	psclog_diag("node is a member of resource '%s'",
 	    nodeResm->resm_res->res_name);
@@ -363,7 +363,7 @@ fidc_init(int privsiz)
 	_psc_poolmaster_init(&fidcPoolMaster,
 	    sizeof(struct fidc_membh) + privsiz,
 	    offsetof(struct fidc_membh, fcmh_lentry),
-	    PPMF_AUTO, nobj, nobj, 0, NULL,
+	    PPMF_AUTO | PPMF_MAGAZINE, nobj, nobj, 0, NULL,
 	    NULL, fidc_reaper, NULL, "fcmh");
 	fidcPool = psc_poolmaster_getmgr(&fidcPoolMaster);
 
@@ -183,6 +183,32 @@ slrpc_connect_finish(struct slashrpc_cservice *csvc,
 	}
 }
 
+/*
+ * Record the bulk authenticator a peer selected in its CONNECT reply.
+ * Peers that predate negotiation send the short reply and SHA-256 is
+ * used.  Anything we did not offer is ignored in favor of the SHA-256
+ * default.
+ */
+__static void
+slrpc_connect_setbulkauth(struct pscrpc_connection *c,
+    struct pscrpc_request *rq)
+{
+	struct srm_connect_bulkauth_rep *mp;
+	uint32_t alg = AUTHBUF_BULKALG_SHA256;
+
+	if (pscrpc_msg_buflen(rq->rq_repmsg, 0) >= (int)sizeof(*mp)) {
+		mp = pscrpc_msg_buf(rq->rq_repmsg, 0, sizeof(*mp));
+		alg = mp->bulkauth;
+	}
+	if (alg >= AUTHBUF_BULKALG_MAX ||
+	    (sl_authbuf_bulkalgs & AUTHBUF_BULKALG_MASK(alg)) == 0) {
+		psclog_warnx("peer %s selected unknown bulk "
+		    "authenticator %u", libcfs_id2str(c->c_peer), alg);
+		alg = AUTHBUF_BULKALG_SHA256;
+	}
+	c->c_bulkauth = alg;
+}
+
 /*
  * Non-blocking CONNECT callback.
  */
@@ -206,6 +232,7 @@ slrpc_connect_cb(struct pscrpc_request *rq,
 		slrpc_connect_finish(csvc, imp, oimp, 0);
 	} else {
 		*stkversp = mp->stkvers;
+		slrpc_connect_setbulkauth(imp->imp_connection, rq);
 		slrpc_connect_finish(csvc, imp, oimp, 1);
 		sl_csvc_online(csvc);
 	}
@@ -247,6 +274,7 @@ slrpc_issue_connect(lnet_nid_t local, lnet_nid_t server,
 {
 	lnet_process_id_t server_id = { server, PSCRPC_SVR_PID };
 	struct pscrpc_import *imp, *oimp = NULL;
+	struct srm_connect_bulkauth_rep *bmp;
 	struct pscrpc_connection *c;
 	struct srm_connect_req *mq;
 	struct srm_connect_rep *mp;
@@ -278,7 +306,11 @@ slrpc_issue_connect(lnet_nid_t local, lnet_nid_t server,
 
 	CSVC_ULOCK(csvc);
 
-	rc = SL_RSX_NEWREQ(csvc, SRMT_CONNECT, rq, mq, mp);
+	/*
+	 * Leave room for the longer reply; a peer that predates bulk
+	 * authenticator negotiation sends the short one.
+	 */
+	rc = SL_RSX_NEWREQ(csvc, SRMT_CONNECT, rq, mq, bmp);
 	if (rc) {
 		CSVC_LOCK(csvc);
 		csvc->csvc_owner = 0;
@@ -291,6 +323,7 @@ slrpc_issue_connect(lnet_nid_t local, lnet_nid_t server,
 	mq->magic = csvc->csvc_magic;
 	mq->version = csvc->csvc_version;
 	mq->stkvers = SL_STK_VERSION;
+	mq->bulkauth = sl_authbuf_bulkalgs;
 
 	CSVC_LOCK(csvc);
 	csvc->csvc_tryref++;
@@ -332,6 +365,8 @@ slrpc_issue_connect(lnet_nid_t local, lnet_nid_t server,
 	if (rc == 0) {
 		rc = mp->rc;
 		*stkversp = mp->stkvers;
+		if (rc == 0)
+			slrpc_connect_setbulkauth(c, rq);
 	}
 	pscrpc_req_finished(rq);
 
@@ -393,7 +428,9 @@ slrpc_handle_connect(struct pscrpc_request *rq, uint64_t magic,
     uint32_t version, enum slconn_type peertype)
 {
 	struct pscrpc_export *e = rq->rq_export;
+	struct srm_connect_bulkauth_rep *bmp = NULL;
 	const struct srm_connect_req *mq;
+	struct pscrpc_connection *c;
 	struct srm_connect_rep *mp;
 	struct sl_resm *m;
 	struct {
@@ -401,7 +438,16 @@ slrpc_handle_connect(struct pscrpc_request *rq, uint64_t magic,
 		uint32_t stkvers;
 	} *expc;
 
-	SL_RSX_ALLOCREP(rq, mq, mp);
+	/*
+	 * Only a peer that offers bulk authenticators has room for the
+	 * reply that carries our selection.
+	 */
+	mq = pscrpc_msg_buf(rq->rq_reqmsg, 0, sizeof(*mq));
+	if (mq && mq->bulkauth) {
+		SL_RSX_ALLOCREP(rq, mq, bmp);
+		mp = (void *)bmp;
+	} else
+		SL_RSX_ALLOCREP(rq, mq, mp);
 	if (mq->magic != magic || mq->version != version)
 		mp->rc = -EINVAL;
 	switch (peertype) {
@@ -447,6 +493,12 @@ slrpc_handle_connect(struct pscrpc_request *rq, uint64_t magic,
 		psc_fatal("choke");
 	}
 	mp->stkvers = SL_STK_VERSION;
+	if (mp->rc == 0) {
+		c = pscrpc_req_getconn(rq);
+		c->c_bulkauth = authbuf_bulkalg_select(mq->bulkauth);
+		if (bmp)
+			bmp->bulkauth = c->c_bulkauth;
+	}
 	return (0);
 }
 
@@ -1189,16 +1241,24 @@ sl_exp_getpri_cli(struct pscrpc_export *exp, int populate)
 	return (p);
 }
 
+/*
+ * Hash bulk data with the authenticator negotiated for the peer
+ * connection at CONNECT time.
+ */
 void
-slrpc_bulk_sign(__unusedx struct pscrpc_request *rq, void *buf,
+slrpc_bulk_sign(struct pscrpc_request *rq, void *buf,
     struct iovec *iov, int n)
 {
+	struct pscrpc_connection *c;
 	char ebuf[BUFSIZ];
 	gcry_error_t gerr;
 	gcry_md_hd_t hd;
-	int i;
+	int i, alg;
+
+	c = pscrpc_req_getconn(rq);
+	alg = c ? c->c_bulkauth : AUTHBUF_BULKALG_SHA256;
 
-	gerr = gcry_md_copy(&hd, sl_authbuf_hd);
+	gerr = gcry_md_copy(&hd, sl_authbuf_bulkhd[alg]);
 	if (gerr) {
 		gpg_strerror_r(gerr, ebuf, sizeof(ebuf));
 		psc_fatalx("gcry_md_copy: %s [%d]", ebuf, gerr);
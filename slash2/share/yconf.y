@@ -53,6 +53,7 @@
 #include "pfl/rpc.h"
 #include "pfl/str.h"
 
+#include "authbuf.h"
 #include "fid.h"
 #include "slconfig.h"
 #include "slerr.h"
@@ -94,6 +95,9 @@ struct cfg_file {
 int		 lnet_match_networks(char **, char *, uint32_t *, char **, int);
 
 void		 slcfg_add_include(const char *);
+int		 slcfg_str2asyncio(const char *);
+int		 slcfg_str2bulkauth(const char *);
+int		 slcfg_str2iossel(const char *);
 int		 slcfg_str2restype(const char *);
 int		 slcfg_str2flags(const char *);
 void		 slcfg_store_tok_val(const char *, char *);
@@ -117,6 +121,7 @@ struct slconf_symbol sym_table[] = {
 	SYM_GLOBAL("port",	SL_TYPE_INT,	0,		gconf_port,	NULL),
 	SYM_GLOBAL("routes",	SL_TYPE_STR,	0,		gconf_lroutes,	NULL),
 
+	SYM_SITE("ios_select",	SL_TYPE_INT,	0,		site_ios_select, slcfg_str2iossel),
 	SYM_SITE("site_desc",	SL_TYPE_STRP,	0,		site_desc,	NULL),
 	SYM_SITE("site_id",	SL_TYPE_INT,	SITE_MAXID,	site_id,	NULL),
 
@@ -127,18 +132,28 @@ struct slconf_symbol sym_table[] = {
 
 	SYM_LOCAL("allow_exec",	SL_TYPE_STRP,	0,		cfg_allowexe,	NULL),
 	SYM_LOCAL("arc_max",	SL_TYPE_SIZET,	0,		cfg_arc_max,	NULL),
+	SYM_LOCAL("async_io",	SL_TYPE_INT,	0,		cfg_async_io,	slcfg_str2asyncio),
+	SYM_LOCAL("bulk_auth",	SL_TYPE_INT,	0,		cfg_bulk_auth,	slcfg_str2bulkauth),
+	SYM_LOCAL("direct_io_min",SL_TYPE_SIZET,0,		cfg_direct_io_min, NULL),
 	SYM_LOCAL("fidcachesz",	SL_TYPE_SIZET,	0,		cfg_fidcachesz,	NULL),
 	SYM_LOCAL("fsroot",	SL_TYPE_STRP,	0,		cfg_fsroot,	NULL),
 	SYM_LOCAL("journal",	SL_TYPE_STRP,	0,		cfg_journal,	NULL),
 	SYM_LOCAL("pref_ios",	SL_TYPE_STR,	0,		cfg_prefios,	NULL),
 	SYM_LOCAL("pref_mds",	SL_TYPE_STR,	0,		cfg_prefmds,	NULL),
 	SYM_LOCAL("self_test",	SL_TYPE_STRP,	0,		cfg_selftest,	NULL),
+	SYM_LOCAL("slab_cache_size",SL_TYPE_SIZET,0,		cfg_slab_cache_size, NULL),
 	SYM_LOCAL("zpool_cache",SL_TYPE_STRP,	0,		cfg_zpcachefn,	NULL),
 	SYM_LOCAL("zpool_name",	SL_TYPE_STR,	0,		cfg_zpname,	NULL),
 
 	{ NULL, SL_STRUCT_NONE, SL_TYPE_NONE, 0, 0, 0, NULL }
 };
 
+const char		  *slcfg_iossel_names[SLCFG_IOSSEL_MAX] = {
+	"random",
+	"freespace",
+	"leastload"
+};
+
 struct sl_config	   globalConfig;
 struct sl_resm		  *nodeResm;
 
@@ -396,6 +411,7 @@ statement	: bool_stmt
 		| glob_stmt
 		| hexnum_stmt
 		| lnetname_stmt
+		| name_stmt
 		| nidslist
 		| num_stmt
 		| path_stmt
@@ -506,6 +522,15 @@ quoteds_stmt	: NAME '=' QUOTEDS ';' {
 		}
 		;
 
+name_stmt	: NAME '=' NAME ';' {
+			psclog_debug("found name statement: "
+			    "tok '%s' val '%s'", $1, $3);
+			slcfg_store_tok_val($1, $3);
+			PSCFREE($1);
+			PSCFREE($3);
+		}
+		;
+
 lnetname_stmt	: NAME '=' LNETNAME ';' {
 			psclog_debug("found lnetname string statement: "
 			    "tok '%s' val '%s'", $1, $3);
@@ -720,6 +745,44 @@ slcfg_str2flags(const char *flags)
 	return (rc);
 }
 
+int
+slcfg_str2asyncio(const char *val)
+{
+	if (!strcasecmp(val, "no") || !strcasecmp(val, "none"))
+		return (SLCFG_ASYNCIO_NONE);
+	if (!strcasecmp(val, "yes") || !strcasecmp(val, "aio"))
+		return (SLCFG_ASYNCIO_POSIX);
+	if (!strcasecmp(val, "uring") || !strcasecmp(val, "io_uring"))
+		return (SLCFG_ASYNCIO_URING);
+	yyerror("%s: invalid async_io engine", val);
+	return (SLCFG_ASYNCIO_NONE);
+}
+
+int
+slcfg_str2bulkauth(const char *val)
+{
+	if (!strcasecmp(val, "sha256"))
+		return (AUTHBUF_BULKALG_SHA256);
+	if (!strcasecmp(val, "blake2b"))
+		return (AUTHBUF_BULKALG_BLAKE2B);
+	if (!strcasecmp(val, "blake2s"))
+		return (AUTHBUF_BULKALG_BLAKE2S);
+	yyerror("%s: invalid bulk_auth algorithm", val);
+	return (AUTHBUF_BULKALG_SHA256);
+}
+
+int
+slcfg_str2iossel(const char *val)
+{
+	int i;
+
+	for (i = 0; i < SLCFG_IOSSEL_MAX; i++)
+		if (!strcasecmp(val, slcfg_iossel_names[i]))
+			return (i);
+	yyerror("%s: invalid ios_select policy", val);
+	return (SLCFG_IOSSEL_RANDOM);
+}
+
 int
 slcfg_str2restype(const char *res_type)
 {
@@ -31,6 +31,7 @@
 #include "fidc_mds.h"
 #include "mdsio.h"
 #include "repl_mds.h"
+#include "slashd.h"
 #include "slerr.h"
 #include "up_sched_res.h"
 
@@ -99,64 +100,135 @@ mds_bmap_ensure_valid(struct bmap *b)
 		DEBUG_BMAP(PLL_FATAL, b, "bmap has no valid replicas");
 }
 
-struct bmap_nonce_cbarg {
-	struct bmap	*b;
-	int		 update;
-};
+void
+slm_bmap_resetnonce(struct bmap *b)
+{
+	struct slm_upsch_item v[SL_MAX_REPLICAS];
+	int i, n, idx, update = 0, tract[NBREPLST];
+
+	n = slm_upsch_idx_getbmap(bmap_2_fid(b), b->bcm_bmapno, v,
+	    nitems(v));
+	for (i = 0; i < n; i++) {
+		if (v[i].usi_nonce == sl_sys_upnonce)
+			continue;
+
+		update = 1;
+		idx = mds_repl_ios_lookup(current_vfsid,
+		    fcmh_2_inoh(b->bcm_fcmh), v[i].usi_resid);
+		psc_assert(idx >= 0);
+
+		brepls_init(tract, -1);
+		tract[BREPLST_REPL_SCHED] = BREPLST_REPL_QUEUED;
+		tract[BREPLST_GARBAGE_SCHED] = BREPLST_GARBAGE;
+		mds_repl_bmap_walk(b, tract, NULL, 0, &idx, 1);
+	}
 
+	if (update) {
+		slm_upsch_idx_setnonce(bmap_2_fid(b), b->bcm_bmapno,
+		    sl_sys_upnonce);
+		mds_bmap_write_logrepls(b);
+	}
+}
+
+/*
+ * Read the on-disk images of a run of bmaps with one vectored read on
+ * behalf of SRMT_GETBMAPS so that leasing a long stretch of a file
+ * does not cost a separate metafile read per bmap.  The images are
+ * stashed with the calling RMC thread and consumed by mds_bmap_read()
+ * as each bmap is instantiated.
+ *
+ * The images are only valid until mds_bmap_preread_done().  A bmap may
+ * be instantiated, written back, and freed by another thread in the
+ * meantime, so the images are refused once any bmap of the file has
+ * been written since they were read.
+ */
 int
-slm_bmap_resetnonce_cb(struct slm_sth *sth, void *p)
+mds_bmap_preread(struct fidc_membh *f, sl_bmapno_t bno, int n)
 {
-	struct bmap_nonce_cbarg *a = p;
-	int idx, tract[NBREPLST];
-	uint32_t nonce;
+	struct iovec iovs[SRM_LEASEBMAPS_MAX];
+	struct slmrmc_thread *smrct;
+	int i, rc, vfsid;
+	size_t nb;
 
-	nonce = sqlite3_column_int(sth->sth_sth, 0);
-	if (nonce == sl_sys_upnonce)
-		return (0);
+	psc_assert(n > 0 && n <= SRM_LEASEBMAPS_MAX);
+
+	smrct = slmrmcthr(pscthr_get());
+	if (smrct->smrct_prebuf == NULL)
+		smrct->smrct_prebuf = PSCALLOC(SRM_LEASEBMAPS_MAX *
+		    BMAP_OD_SZ);
 
-	a->update = 1;
-	idx = mds_repl_ios_lookup(current_vfsid,
-	    fcmh_2_inoh(a->b->bcm_fcmh),
-	    sqlite3_column_int(sth->sth_sth, 1));
-	psc_assert(idx >= 0);
+	for (i = 0; i < n; i++) {
+		iovs[i].iov_base = smrct->smrct_prebuf + i * BMAP_OD_SZ;
+		iovs[i].iov_len = BMAP_OD_SZ;
+	}
+
+	/*
+	 * Sample the generation first: a write that lands during the
+	 * read bumps it afterwards and so invalidates the images.
+	 */
+	smrct->smrct_pregen = psc_atomic64_read(
+	    &fcmh_2_fmi(f)->fmi_bmapgen);
 
-	brepls_init(tract, -1);
-	tract[BREPLST_REPL_SCHED] = BREPLST_REPL_QUEUED;
-	tract[BREPLST_GARBAGE_SCHED] = BREPLST_GARBAGE;
-	mds_repl_bmap_walk(a->b, tract, NULL, 0, &idx, 1);
+	slfid_to_vfsid(fcmh_2_fid(f), &vfsid);
+	rc = mdsio_preadv(vfsid, &rootcreds, iovs, n, &nb,
+	    (off_t)BMAP_OD_SZ * bno + SL_BMAP_START_OFF, fcmh_2_mfh(f));
+	if (rc)
+		return (rc);
 
+	smrct->smrct_pref = f;
+	smrct->smrct_prebno = bno;
+	smrct->smrct_pren = n;
+	smrct->smrct_prenb = nb;
+	OPSTAT_ADD("bmap-preread", n);
 	return (0);
 }
 
 void
-slm_bmap_resetnonce(struct bmap *b)
+mds_bmap_preread_done(void)
 {
-	struct bmap_nonce_cbarg a;
-
-	memset(&a, 0, sizeof(a));
-	a.b = b;
-
-	dbdo(slm_bmap_resetnonce_cb, &a,
-	    " SELECT	nonce,"
-	    "		resid"
-	    " FROM	upsch"
-	    " WHERE	fid = ?"
-	    "   AND	bno = ?",
-	    SQLITE_INTEGER64, bmap_2_fid(b),
-	    SQLITE_INTEGER, b->bcm_bmapno);
-
-	if (a.update) {
-		dbdo(NULL, NULL,
-		    " UPDATE	upsch"
-		    " SET	nonce = ?"
-		    " WHERE	fid = ?"
-		    "   AND	bno = ?",
-		    SQLITE_INTEGER, sl_sys_upnonce,
-		    SQLITE_INTEGER64, bmap_2_fid(b),
-		    SQLITE_INTEGER, b->bcm_bmapno);
-		mds_bmap_write_logrepls(b);
+	slmrmcthr(pscthr_get())->smrct_pref = NULL;
+}
+
+/*
+ * Satisfy a bmap read from images gathered by mds_bmap_preread(), if
+ * any.  Returns nonzero if the read was satisfied.
+ */
+__static int
+mds_bmap_preread_get(struct bmap *b, struct iovec *iovs, size_t *nb)
+{
+	struct slmrmc_thread *smrct;
+	struct psc_thread *thr;
+	size_t off;
+	char *p;
+	int i;
+
+	thr = pscthr_get();
+	if (thr->pscthr_type != SLMTHRT_RMC)
+		return (0);
+	smrct = slmrmcthr(thr);
+	if (smrct->smrct_pref != b->bcm_fcmh ||
+	    b->bcm_bmapno < smrct->smrct_prebno ||
+	    b->bcm_bmapno >= smrct->smrct_prebno + smrct->smrct_pren)
+		return (0);
+	if (psc_atomic64_read(&fcmh_2_fmi(b->bcm_fcmh)->fmi_bmapgen) !=
+	    smrct->smrct_pregen) {
+		OPSTAT_INCR("bmap-preread-stale");
+		return (0);
 	}
+
+	/* Reconstruct the outcome of a preadv(2) of this bmap alone. */
+	off = (size_t)(b->bcm_bmapno - smrct->smrct_prebno) *
+	    BMAP_OD_SZ;
+	*nb = 0;
+	if (smrct->smrct_prenb > off)
+		*nb = MIN(smrct->smrct_prenb - off, BMAP_OD_SZ);
+	p = smrct->smrct_prebuf + off;
+	for (i = 0, off = 0; i < 2; off += iovs[i++].iov_len)
+		if (*nb > off)
+			memcpy(iovs[i].iov_base, p + off,
+			    MIN(*nb - off, iovs[i].iov_len));
+	OPSTAT_INCR("bmap-preread-hit");
+	return (1);
 }
 
 /*
@@ -196,9 +268,12 @@ mds_bmap_read(struct bmap *b, int flags)
 	psclog_diag("read bmap: handle=%p fid="SLPRI_FID" bmapno=%d",
 	    bmap_2_mfh(b), f->fcmh_sstb.sst_fg.fg_fid, b->bcm_bmapno);
 
-	rc = mdsio_preadv(vfsid, &rootcreds, iovs, nitems(iovs), &nb,
-	    (off_t)BMAP_OD_SZ * b->bcm_bmapno + SL_BMAP_START_OFF,
-	    bmap_2_mfh(b));
+	if (mds_bmap_preread_get(b, iovs, &nb))
+		rc = 0;
+	else
+		rc = mdsio_preadv(vfsid, &rootcreds, iovs,
+		    nitems(iovs), &nb, (off_t)BMAP_OD_SZ *
+		    b->bcm_bmapno + SL_BMAP_START_OFF, bmap_2_mfh(b));
 
 	if (rc)
 		goto out1;
@@ -292,6 +367,9 @@ mds_bmap_write(struct bmap *b, void *logf, void *logarg)
 	if (logf)
 		mds_unreserve_slot(1);
 
+	/* invalidate any image mds_bmap_preread() holds for this file */
+	psc_atomic64_inc(&fcmh_2_fmi(f)->fmi_bmapgen);
+
 	if (rc == 0 && nb != BMAP_OD_SZ)
 		rc = SLERR_SHORTIO;
 	if (rc)
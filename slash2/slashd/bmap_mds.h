@@ -242,6 +242,8 @@ struct bmap_ios_assign {
 /* bia_flags */
 #define BIAF_DIO		(1 << 0)
 
+int	 mds_bmap_preread(struct fidc_membh *, sl_bmapno_t, int);
+void	 mds_bmap_preread_done(void);
 int	 mds_bmap_read(struct bmap *, int);
 int	 mds_bmap_write(struct bmap *, void *, void *);
 int	_mds_bmap_write_rel(const struct pfl_callerinfo *, struct bmap *, void *);
@@ -377,20 +377,6 @@ slmctlcmd_stop(__unusedx int fd, __unusedx struct psc_ctlmsghdr *mh,
 	exit(0);
 }
 
-int
-slmctlcmd_upsch_query(__unusedx int fd,
-    __unusedx struct psc_ctlmsghdr *mh, void *m)
-{
-	struct slmctlmsg_upsch_query *scuq = m;
-
-	/*
-	 * XXX if there are any bind parameters, users can craft code
-	 * that will make our va_arg crash
-	 */
-	dbdo(NULL, NULL, scuq->scuq_query);
-	return (0);
-}
-
 /*
  * Send a response to a "GETREPLQUEUED" inquiry.
  * @fd: client socket descriptor.
@@ -513,6 +499,26 @@ slmctlparam_nextfid_set(const char *val)
 	return (rc);
 }
 
+void
+slmctlparam_ios_select_get(char *val)
+{
+	strlcpy(val, slcfg_iossel_names[nodeSite->site_ios_select],
+	    PCP_VALUE_MAX);
+}
+
+int
+slmctlparam_ios_select_set(const char *val)
+{
+	int i;
+
+	for (i = 0; i < SLCFG_IOSSEL_MAX; i++)
+		if (strcmp(val, slcfg_iossel_names[i]) == 0) {
+			nodeSite->site_ios_select = i;
+			return (0);
+		}
+	return (-1);
+}
+
 int
 slctlmsg_bmap_send(int fd, struct psc_ctlmsghdr *mh,
     struct slctlmsg_bmap *scb, struct bmap *b)
@@ -580,12 +586,10 @@ struct psc_ctlop slmctlops[] = {
 	, { slmctlrep_getstatfs,	sizeof(struct slmctlmsg_statfs) }
 	, { slmctlcmd_stop,		0 }
 	, { slmctlrep_getbml,		sizeof(struct slmctlmsg_bml) }
-	, { slmctlcmd_upsch_query,	0 },
 };
 
 psc_ctl_thrget_t psc_ctl_thrgets[] = {
 /* BATCHRQ	*/ NULL,
-/* BKDB		*/ NULL,
 /* BMAPTIMEO	*/ NULL,
 /* COH		*/ NULL,
 /* CONN		*/ NULL,
@@ -604,6 +608,7 @@ psc_ctl_thrget_t psc_ctl_thrgets[] = {
 /* RMM		*/ NULL,
 /* OPSTIMER	*/ NULL,
 /* UPSCHED	*/ NULL,
+/* UPSCHLOG	*/ NULL,
 /* USKLNDPL	*/ NULL,
 /* WORKER	*/ NULL,
 /* ZFS_KSTAT	*/ NULL
@@ -638,8 +643,13 @@ slmctlthr_main(const char *fn)
 	    slmctlparam_namespace_stats);
 	psc_ctlparam_register_simple("sys.nextfid",
 	    slmctlparam_nextfid_get, slmctlparam_nextfid_set);
+	psc_ctlparam_register_simple("sys.ios_select",
+	    slmctlparam_ios_select_get, slmctlparam_ios_select_set);
 	psc_ctlparam_register_var("sys.global",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &use_global_mount);
+	psc_ctlparam_register_var("sys.jrnl_commit_usecs",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
+	    &slm_journal->pj_commit_usecs);
 	psc_ctlparam_register_var("sys.reclaim_xid",
 	    PFLCTL_PARAMT_UINT64, 0, &reclaim_prg.cur_xid);
 	psc_ctlparam_register_var("sys.reclaim_batchno",
@@ -23,6 +23,7 @@
 #ifndef _FIDC_MDS_H_
 #define _FIDC_MDS_H_
 
+#include "pfl/atomic.h"
 #include "pfl/dynarray.h"
 
 #include "fid.h"
@@ -46,6 +47,7 @@ struct fcmh_mds_info {
 	mio_fid_t		  fmi_mfid;		/* backing object inum */
 	struct mio_fh		  fmi_mfh;		/* file descriptor */
 	int			  fmi_ctor_rc;		/* constructor return code */
+	psc_atomic64_t		  fmi_bmapgen;		/* bumped on each bmap write */
 	union {
 		struct {
 			mio_fid_t fmid_dino_mfid;	/* for inode */
@@ -397,7 +397,7 @@ usage(void)
 int
 main(int argc, char *argv[])
 {
-	char *path_env, *zpcachefn = NULL, *zpname, *estr;
+	char *path_env, *zpcachefn = NULL, *zpname;
 	const char *cfn, *sfn, *p;
 	int rc, vfsid, c, found;
 	struct psc_thread *thr;
@@ -456,8 +456,7 @@ main(int argc, char *argv[])
 		usage();
 
 	pscthr_init(SLMTHRT_CTL, NULL, NULL,
-	    sizeof(struct psc_ctlthr) +
-	    sizeof(struct slmctl_thread), "slmctlthr0");
+	    sizeof(struct psc_ctlthr), "slmctlthr0");
 
 	sl_sys_upnonce = psc_random32();
 
@@ -495,7 +494,7 @@ main(int argc, char *argv[])
 	zfsslash2_register_suspend_hook(psc_suspend_filesystem);
 
 	authbuf_createkeyfile();
-	authbuf_readkeyfile();
+	authbuf_readkeyfile(slcfg_local->cfg_bulk_auth);
 
 	sl_drop_privs(1);
 
@@ -568,68 +567,11 @@ main(int argc, char *argv[])
 
 	mds_bmap_timeotbl_init();
 
-	sqlite3_enable_shared_cache(1);
-	//dbdo(NULL, NULL, "PRAGMA page_size=");
-	dbdo(NULL, NULL, "PRAGMA synchronous=OFF");
-	dbdo(NULL, NULL, "PRAGMA journal_mode=WAL");
-
-	/* no-op to test integrity */
-	rc = sqlite3_exec(slmctlthr_getpri(pscthr_get())->smct_dbh.dbh,
-	    " UPDATE	upsch"
-	    "	SET	id=0"
-	    " WHERE	id=0", NULL,
-	    NULL, &estr);
-	if (rc == SQLITE_ERROR) {
-		dbdo(NULL, NULL,
-		    "CREATE TABLE upsch ("
-		    "	id		INT PRIMARY KEY,"
-		    "	resid		UNSIGNED INT,"
-		    "	fid		UNSIGNED BIGINT,"
-		    "	uid		UNSIGNED INT,"
-		    "	gid		UNSIGNED INT,"
-		    "	bno		UNSIGNED INT,"
-		    "	status		CHAR(1),"
-		    "	sys_prio	INT,"
-		    "	usr_prio	INT,"
-		    "	nonce		UNSIGNED INT,"
-		    "	UNIQUE(resid, fid, bno)"
-		    ")");
-
-		dbdo(NULL, NULL,
-		    "CREATE INDEX 'upsch_resid_idx'"
-		    " ON 'upsch' ('resid')");
-		dbdo(NULL, NULL,
-		    "CREATE INDEX 'upsch_fid_idx'"
-		    " ON 'upsch' ('fid')");
-		dbdo(NULL, NULL,
-		    "CREATE INDEX 'upsch_bno_idx'"
-		    " ON 'upsch' ('bno')");
-		dbdo(NULL, NULL,
-		    "CREATE INDEX 'upsch_uid_idx'"
-		    " ON 'upsch' ('uid')");
-		dbdo(NULL, NULL,
-		    "CREATE INDEX 'upsch_gid_idx'"
-		    " ON 'upsch' ('gid')");
-
-		dbdo(NULL, NULL,
-		    "CREATE VIEW gsort AS"
-		    " SELECT	gid,"
-		    "		RANDOM() AS rnd"
-		    " FROM	upsch"
-		    " GROUP BY	gid");
-		dbdo(NULL, NULL,
-		    "CREATE VIEW usort AS"
-		    " SELECT	uid,"
-		    "		RANDOM() AS rnd"
-		    " FROM	upsch"
-		    " GROUP BY uid");
-	}
+	slm_upsch_idx_load();
 
 	slrpc_initcli();
 
-	dbdo(NULL, NULL, "BEGIN TRANSACTION");
 	mds_journal_init(zfs_mounts[current_vfsid].zm_uuid);
-	dbdo(NULL, NULL, "COMMIT");
 
 	pfl_workq_lock();
 	pfl_wkthr_spawn(SLMTHRT_WORKER, SLM_NWORKER_THREADS,
@@ -656,19 +598,10 @@ main(int argc, char *argv[])
 	psc_waitq_wait(&slm_db_hipri_workq.plc_wq_want,
 	    &slm_db_hipri_workq.plc_lock);
 
-	dbdo(slm_upsch_revert_cb, NULL,
-	    " SELECT	fid,"
-	    "		bno"
-	    " FROM	upsch"
-	    " WHERE	status = 'S'");
-
-	dbdo(NULL, NULL,
-	    " UPDATE	upsch"
-	    " SET	status = 'Q'"
-	    " WHERE	status = 'S'");
+	slm_upsch_idx_revert(slm_upsch_revert_cb);
 
-	pscthr_init(SLMTHRT_BKDB, slmbkdbthr_main, NULL, 0,
-	    "slmbkdbthr");
+	pscthr_init(SLMTHRT_UPSCHLOG, slmupschlogthr_main, NULL, 0,
+	    "slmupschlogthr");
 
 	pfl_odt_check(slm_bia_odt, mds_bia_odtable_startup_cb, NULL);
 	pfl_odt_check(slm_ptrunc_odt, slm_ptrunc_odt_startup_cb, NULL);
@@ -43,8 +43,6 @@
 #include "inode.h"
 #include "journal_mds.h"
 #include "mdsio.h"
-#include "mkfn.h"
-#include "pathnames.h"
 #include "repl_mds.h"
 #include "rpc_mds.h"
 #include "slashd.h"
@@ -336,9 +334,143 @@ slm_res_shuffle(struct psc_dynarray *a, int begin)
 		    psc_random32u(i + 1));
 }
 
+/*
+ * Snapshot of the state of an I/O server taken by the selection
+ * policies below so that each candidate's resource lock is only held
+ * briefly and the ordering itself runs unlocked.
+ */
+struct slm_ios_cand {
+	struct sl_resm		*ic_resm;
+	uint64_t		 ic_free;	/* available space in MiB */
+	int32_t			 ic_nleases;	/* outstanding write leases */
+	int32_t			 ic_bwq;	/* queued replication bw */
+	int			 ic_busy;	/* no replication bw headroom */
+	uint32_t		 ic_rnd;	/* tie breaker */
+};
+
+__static void
+slm_ios_cand_fill(struct slm_ios_cand *ic, struct sl_resm *m)
+{
+	struct resprof_mds_info *rpmi;
+	struct rpmi_ios *si;
+
+	rpmi = res2rpmi(m->resm_res);
+	si = res2rpmi_ios(m->resm_res);
+
+	ic->ic_resm = m;
+	ic->ic_nleases = psc_atomic32_read(&resm2rmmi(m)->rmmi_refcnt);
+	ic->ic_rnd = psc_random32();
+
+	RPMI_LOCK(rpmi);
+	ic->ic_free = (uint64_t)si->si_ssfb.sf_bavail *
+	    si->si_ssfb.sf_frsize >> 20;
+	ic->ic_bwq = si->si_bw_aggr.bwd_queued +
+	    si->si_bw_aggr.bwd_inflight;
+	RPMI_ULOCK(rpmi);
+
+	ic->ic_busy = ic->ic_bwq >= slm_bwqueuesz;
+}
+
+/*
+ * Order by: I/O servers with replication bandwidth to spare, fewest
+ * outstanding write leases, least queued replication traffic, most free
+ * space, then randomly.
+ */
+__static int
+slm_ios_cand_loadcmp(const void *a, const void *b)
+{
+	const struct slm_ios_cand *x = a, *y = b;
+	int rc;
+
+	rc = CMP(x->ic_busy, y->ic_busy);
+	if (rc)
+		return (rc);
+	rc = CMP(x->ic_nleases, y->ic_nleases);
+	if (rc)
+		return (rc);
+	rc = CMP(x->ic_bwq, y->ic_bwq);
+	if (rc)
+		return (rc);
+	rc = CMP(y->ic_free, x->ic_free);
+	if (rc)
+		return (rc);
+	return (CMP(x->ic_rnd, y->ic_rnd));
+}
+
+/*
+ * Draw candidates without replacement, each with probability
+ * proportional to its free space.  I/O servers that have not reported
+ * statfs yet (or are full) keep a minimal weight so they are still
+ * tried as a last resort.
+ */
+__static void
+slm_ios_order_freespace(struct slm_ios_cand *ic, int n)
+{
+	struct slm_ios_cand t;
+	uint64_t total, r;
+	int i, j;
+
+	for (i = 0, total = 0; i < n; i++) {
+		ic[i].ic_free++;
+		total += ic[i].ic_free;
+	}
+
+	for (i = 0; i < n - 1; i++) {
+		r = psc_random64() % total;
+		for (j = i; j < n - 1; j++) {
+			if (r < ic[j].ic_free)
+				break;
+			r -= ic[j].ic_free;
+		}
+		total -= ic[j].ic_free;
+		t = ic[i];
+		ic[i] = ic[j];
+		ic[j] = t;
+	}
+}
+
+/*
+ * Reorder the I/O server members at the tail of @a starting at @begin
+ * according to the local site's ios_select policy so that the most
+ * desirable candidates are tried first by slm_resm_select().
+ */
+__static void
+slm_ios_order(struct psc_dynarray *a, int begin)
+{
+	struct slm_ios_cand *ic;
+	int i, n, policy;
+
+	n = psc_dynarray_len(a) - begin;
+	policy = nodeSite->site_ios_select;
+	if (n < 2 || policy == SLCFG_IOSSEL_RANDOM) {
+		slm_res_shuffle(a, begin);
+		return;
+	}
+
+	ic = PSCALLOC(n * sizeof(*ic));
+	for (i = 0; i < n; i++)
+		slm_ios_cand_fill(&ic[i],
+		    psc_dynarray_getpos(a, begin + i));
+
+	switch (policy) {
+	case SLCFG_IOSSEL_FREESPACE:
+		slm_ios_order_freespace(ic, n);
+		break;
+	case SLCFG_IOSSEL_LEASTLOAD:
+		qsort(ic, n, sizeof(*ic), slm_ios_cand_loadcmp);
+		break;
+	}
+
+	for (i = 0; i < n; i++)
+		psc_dynarray_setpos(a, begin + i, ic[i].ic_resm);
+	PSCFREE(ic);
+
+	OPSTAT_INCR("ios-select");
+}
+
 __static void
 slm_res_fillmembers(struct sl_resource *r, struct psc_dynarray *a,
-    int shuffle)
+    int order)
 {
 	struct sl_resm *m;
 	int begin, i;
@@ -347,14 +479,15 @@ slm_res_fillmembers(struct sl_resource *r, struct psc_dynarray *a,
 	DYNARRAY_FOREACH(m, i, &r->res_members)
 		psc_dynarray_add_ifdne(a, m);
 
-	if (shuffle)
-		slm_res_shuffle(a, begin);
+	if (order)
+		slm_ios_order(a, begin);
 }
 
 /*
  * Gather a list of I/O servers.  This is used by the IOS selector and
  * should the client's preferred choices as well as factor in other
- * considerations.
+ * considerations.  Within each tier, candidates are ordered by the
+ * site's ios_select policy (see slm_ios_order()).
  *
  * XXX: Make sure that we don't give out dead IOS and possibly avoid
  * shuffling when there is only one IOS in the table.
@@ -397,7 +530,7 @@ slm_get_ioslist(struct fidc_membh *f, sl_ios_id_t piosid,
 		slm_res_fillmembers(r, a, 0);
 	}
 
-	slm_res_shuffle(a, begin);
+	slm_ios_order(a, begin);
 }
 
 /*
@@ -2299,230 +2432,6 @@ slm_ptrunc_wake_clients(void *p)
 	return (0);
 }
 
-/*
-	psc_mutex_lock(&slm_dbh_mut);
-	slm_dbh = NULL;
-	sqlite3_close(dbh);
-*/
-
-int
-str_escmeta(const char in[PATH_MAX], char out[PATH_MAX])
-{
-	const char *i;
-	char *o;
-
-	for (i = in, o = out; *i && o < out + PATH_MAX - 1; i++, o++) {
-		if (*i == '\\' || *i == '\'')
-			*o++ = '\\';
-		*o = *i;
-	}
-	out[PATH_MAX - 1] = '\0';
-	return (0);
-}
-
-void
-slmbkdbthr_main(struct psc_thread *thr)
-{
-	char dbfn[PATH_MAX], qdbfn[PATH_MAX],
-	     bkfn[PATH_MAX], qbkfn[PATH_MAX],
-	     cmd[LINE_MAX];
-
-	xmkfn(dbfn, "%s/%s", SL_PATH_DEV_SHM, SL_FN_UPSCHDB);
-	str_escmeta(dbfn, qdbfn);
-
-	xmkfn(bkfn, "%s/%s", sl_datadir, SL_FN_UPSCHDB);
-	str_escmeta(bkfn, qbkfn);
-
-	snprintf(cmd, sizeof(cmd),
-	    "echo .dump | sqlite3 '%s' > %s", qdbfn, qbkfn);
-	while (pscthr_run(thr)) {
-		// XXX sqlite3_backup_init()
-		sleep(120);
-		(void)system(cmd);
-	}
-}
-
-void
-_dbdo(const struct pfl_callerinfo *pci,
-    int (*cb)(struct slm_sth *, void *), void *cbarg,
-    const char *fmt, ...)
-{
-	static int check;
-	int type, log = 0, dbuf_off = 0, rc, n, j;
-	char *p, dbuf[LINE_MAX] = "";
-	struct timeval tv, tv0, tvd;
-	struct slmthr_dbh *dbh;
-	struct slm_sth *sth;
-	uint64_t key;
-	va_list ap;
-
-	dbh = slmthr_getdbh();
-
-	if (dbh->dbh == NULL) {
-		char dbfn[PATH_MAX], qdbfn[PATH_MAX],
-		     bkfn[PATH_MAX], qbkfn[PATH_MAX],
-		     tmpfn[PATH_MAX], qtmpfn[PATH_MAX],
-		     cmd[LINE_MAX], *estr;
-		const char *tdir;
-		struct stat stb;
-
-		xmkfn(dbfn, "%s/%s", SL_PATH_DEV_SHM, SL_FN_UPSCHDB);
-		rc = sqlite3_open(dbfn, &dbh->dbh);
-		if (rc == SQLITE_OK && !check) {
-			rc = sqlite3_exec(dbh->dbh,
-			    "PRAGMA integrity_check", NULL, NULL,
-			    &estr);
-			check = 1;
-		}
-
-		if (rc != SQLITE_OK) {
-			psc_assert(slm_opstate == SLM_OPSTATE_REPLAY);
-
-			psclog_errorx("upsch database not found or "
-			    "corrupted; rebuilding");
-
-			tdir = getenv("TMPDIR");
-			if (tdir == NULL)
-				tdir = _PATH_TMP;
-			snprintf(tmpfn, sizeof(tmpfn),
-			    "%s/upsch.tmp.XXXXXXXX", tdir);
-			mkstemp(tmpfn);
-
-			xmkfn(bkfn, "%s/%s", sl_datadir, SL_FN_UPSCHDB);
-
-			str_escmeta(dbfn, qdbfn);
-			str_escmeta(bkfn, qbkfn);
-			str_escmeta(tmpfn, qtmpfn);
-
-			unlink(tmpfn);
-
-			if (stat(dbfn, &stb) == 0) {
-				/* salvage anything from current db */
-				snprintf(cmd, sizeof(cmd),
-				    "echo .dump | sqlite3 '%s' > '%s'",
-				    qdbfn, qtmpfn);
-				(void)system(cmd);
-
-				unlink(dbfn);
-			}
-
-			/* rollback to backup */
-			snprintf(cmd, sizeof(cmd),
-			    "sqlite3 '%s' < '%s'", qdbfn, qbkfn);
-			(void)system(cmd);
-
-			rc = sqlite3_open(dbfn, &dbh->dbh);
-			if (rc)
-				psc_fatal("%s: %s", dbfn,
-				    sqlite3_errmsg(dbh->dbh));
-		}
-
-		psc_hashtbl_init(&dbh->dbh_sth_hashtbl, 0,
-		    struct slm_sth, sth_fmt, sth_hentry,
-		    pscthr_get()->pscthr_type == SLMTHRT_CTL ? 11 : 5,
-		    NULL, "sth-%s", pscthr_get()->pscthr_name);
-	}
-
-	key = (uint64_t)fmt;
-	sth = psc_hashtbl_search(&dbh->dbh_sth_hashtbl, &key);
-	if (sth == NULL) {
-		sth = PSCALLOC(sizeof(*sth));
-		psc_hashent_init(&dbh->dbh_sth_hashtbl, sth);
-		sth->sth_fmt = fmt;
-
-		do {
-			rc = sqlite3_prepare_v2(dbh->dbh, fmt, -1,
-			    &sth->sth_sth, NULL);
-			if (rc == SQLITE_BUSY)
-				pscthr_yield();
-		} while (rc == SQLITE_BUSY);
-		psc_assert(rc == SQLITE_OK);
-
-		psc_hashtbl_add_item(&dbh->dbh_sth_hashtbl, sth);
-	}
-
-	n = sqlite3_bind_parameter_count(sth->sth_sth);
-	va_start(ap, fmt);
-	log = psc_log_getlevel(pci->pci_subsys) >= PLL_DEBUG;
-	if (log) {
-		strlcpy(dbuf, fmt, sizeof(dbuf));
-		dbuf_off = strlen(fmt);
-		PFL_GETTIMEVAL(&tv0);
-	}
-	for (j = 0; j < n; j++) {
-		type = va_arg(ap, int);
-		switch (type) {
-		case SQLITE_INTEGER64: {
-			int64_t arg;
-
-			arg = va_arg(ap, int64_t);
-			rc = sqlite3_bind_int64(sth->sth_sth, j + 1,
-			    arg);
-			if (log)
-				dbuf_off += snprintf(dbuf + dbuf_off,
-				    sizeof(dbuf) - dbuf_off,
-				    "; arg %d: %"PRId64, j + 1, arg);
-			break;
-		    }
-		case SQLITE_INTEGER: {
-			int32_t arg;
-
-			arg = va_arg(ap, int32_t);
-			rc = sqlite3_bind_int(sth->sth_sth, j + 1, arg);
-			if (log)
-				dbuf_off += snprintf(dbuf + dbuf_off,
-				    sizeof(dbuf) - dbuf_off,
-				    "; arg %d: %d", j + 1, arg);
-			break;
-		    }
-		case SQLITE_TEXT:
-			p = va_arg(ap, char *);
-			rc = sqlite3_bind_text(sth->sth_sth, j + 1, p,
-			    strlen(p), SQLITE_STATIC);
-			if (log)
-				dbuf_off += snprintf(dbuf + dbuf_off,
-				    sizeof(dbuf) - dbuf_off,
-				    "; arg %d: %s", j + 1, p);
-			break;
-		case SQLITE_NULL:
-			(void)va_arg(ap, int);
-			rc = sqlite3_bind_null(sth->sth_sth, j + 1);
-			if (log)
-				dbuf_off += snprintf(dbuf + dbuf_off,
-				    sizeof(dbuf) - dbuf_off,
-				    "; arg %d: NULL", j + 1);
-			break;
-		default:
-			psc_fatalx("type");
-		}
-		psc_assert(rc == SQLITE_OK);
-	}
-	va_end(ap);
-
-	do {
-		rc = sqlite3_step(sth->sth_sth);
-		if (rc == SQLITE_ROW && cb)
-			cb(sth, cbarg);
-		if (rc != SQLITE_DONE)
-			pscthr_yield();
-		if (rc == SQLITE_LOCKED)
-			sqlite3_reset(sth->sth_sth);
-	} while (rc == SQLITE_ROW || rc == SQLITE_BUSY ||
-	    rc == SQLITE_LOCKED);
-
-	if (log) {
-		PFL_GETTIMEVAL(&tv);
-		timersub(&tv, &tv0, &tvd);
-		psclog_debug("ran SQL in %.2fs: %s", tvd.tv_sec +
-		    tvd.tv_usec / 1000000.0, dbuf);
-	}
-
-	if (rc != SQLITE_DONE)
-		psclog_errorx("SQL error: rc=%d query=%s; msg=%s", rc,
-		    fmt, sqlite3_errmsg(dbh->dbh));
-	sqlite3_reset(sth->sth_sth);
-}
-
 void
 slm_ptrunc_odt_startup_cb(void *data, __unusedx struct pfl_odt_receipt *odtr,
     __unusedx void *arg)
@@ -67,6 +67,14 @@
 #define R_ENTSZ			sizeof(struct srt_reclaim_entry)
 #define U_ENTSZ			sizeof(struct srt_update_entry)
 
+/* distill shards, one per secondary log */
+#define SLM_DISTILL_RECLAIM	0
+#define SLM_DISTILL_UPDATE	1
+#define SLM_DISTILL_NSHARDS	2
+
+/* bytes of log entries the distill thread buffers before writing */
+#define SLM_LOG_STAGE_SIZE	4096
+
 #define RP_ENTSZ		sizeof(struct reclaim_prog_entry)
 #define UP_ENTSZ		sizeof(struct update_prog_entry)
 
@@ -108,6 +116,9 @@ struct psc_journal		*slm_journal;
 
 static psc_spinlock_t		 mds_distill_lock = SPINLOCK_INIT;
 
+/* last xid found in each secondary log at startup, indexed by shard */
+static uint64_t			 mds_distill_lastxid[SLM_DISTILL_NSHARDS];
+
 static void			*mds_cursor_handle;
 struct psc_journal_cursor	 mds_cursor;
 
@@ -344,14 +355,57 @@ mds_open_logfile(uint64_t batchno, int update, int readonly,
 	return (rc);
 }
 
+/*
+ * Write out the log entries buffered by the distill thread.  Only then
+ * do they become visible to the threads sending them out.
+ */
+__static void
+mds_flush_logbuf(struct slm_progress *p, const char *name)
+{
+	size_t size;
+	int rc;
+
+	if (p->log_nstaged == 0)
+		return;
+
+	rc = mds_write_file(p->log_handle, p->log_stagebuf,
+	    p->log_nstaged, &size, p->log_offset - p->log_nstaged);
+	if (size != p->log_nstaged)
+		psc_fatal("Failed to write %s log file, "
+		    "batchno=%"PRId64" rc=%d", name, p->cur_batchno, rc);
+	OPSTAT_INCR("distill-flush");
+	p->log_nstaged = 0;
+
+	spinlock(&mds_distill_lock);
+	p->cur_xid = p->log_stagexid;
+	freelock(&mds_distill_lock);
+}
+
+/*
+ * Buffer a log entry to be written at the current log offset, writing
+ * out what has been buffered so far if there is no room.
+ */
+__static void
+mds_stage_logentry(struct slm_progress *p, const char *name,
+    const void *ent, size_t entsz, uint64_t xid)
+{
+	if (p->log_stagebuf == NULL)
+		p->log_stagebuf = PSCALLOC(SLM_LOG_STAGE_SIZE);
+	if (p->log_nstaged + entsz > SLM_LOG_STAGE_SIZE)
+		mds_flush_logbuf(p, name);
+	memcpy(PSC_AGP(p->log_stagebuf, p->log_nstaged), ent, entsz);
+	p->log_nstaged += entsz;
+	p->log_offset += entsz;
+	p->log_stagexid = xid;
+}
+
 void
 mds_write_logentry(uint64_t xid, uint64_t fid, uint64_t gen)
 {
-	struct srt_reclaim_entry re, *r;
+	struct srt_reclaim_entry re;
 	struct srt_stat sstb;
-	int rc, count, total;
-	void *reclaimbuf;
 	size_t size;
+	int rc;
 
 	if (!xid) {
 		PJ_LOCK(slm_journal);
@@ -373,51 +427,47 @@ mds_write_logentry(uint64_t xid, uint64_t fid, uint64_t gen)
 
 	psc_assert(rc == 0);
 
-	reclaim_prg.log_offset = 0;
 	/*
 	 * Even if there is no need to replay after a startup, we should
-	 * still skip existing entries.
+	 * still skip existing entries.  Entries are fixed size, so the
+	 * file size is all we need after checking the magic header.
 	 */
+	reclaim_prg.log_offset = sstb.sst_size;
 	if (sstb.sst_size) {
-		/* add to existing log; check magic at beginning */
-		reclaimbuf = PSCALLOC(sstb.sst_size);
-		rc = mds_read_file(reclaim_prg.log_handle, reclaimbuf,
-		    sstb.sst_size, &size, 0);
-		if (rc || size != sstb.sst_size)
+		rc = mds_read_file(reclaim_prg.log_handle, &re, R_ENTSZ,
+		    &size, 0);
+		if (rc || size != R_ENTSZ)
 			psc_fatalx("Failed to read reclaim log file, "
 			    "batchno=%"PRId64": %s",
 			    reclaim_prg.cur_batchno, slstrerror(rc));
 
-		r = reclaimbuf;
-		if (r->xid != RECLAIM_MAGIC_VER ||
-		    r->fg.fg_gen != RECLAIM_MAGIC_GEN ||
-		    r->fg.fg_fid != RECLAIM_MAGIC_FID)
+		if (re.xid != RECLAIM_MAGIC_VER ||
+		    re.fg.fg_gen != RECLAIM_MAGIC_GEN ||
+		    re.fg.fg_fid != RECLAIM_MAGIC_FID)
 			psc_fatalx("Reclaim log corrupted, "
 			    "batchno=%"PRId64, reclaim_prg.cur_batchno);
 
-		size -= R_ENTSZ;
-		r++;
-		reclaim_prg.log_offset += R_ENTSZ;
-
 		/* this should never happen, but we have seen bitten */
-		if (size > R_ENTSZ * SLM_RECLAIM_BATCH_NENTS ||
-		    size % R_ENTSZ) {
+		if (sstb.sst_size > R_ENTSZ * SLM_RECLAIM_BATCH_NENTS ||
+		    sstb.sst_size % R_ENTSZ) {
 			psclog_warnx("Reclaim log corrupted! "
-			    "batch=%"PRId64" size=%zd",
-			    reclaim_prg.cur_batchno, size);
-			size = R_ENTSZ * (SLM_RECLAIM_BATCH_NENTS - 1);
+			    "batch=%"PRId64" size=%"PRId64,
+			    reclaim_prg.cur_batchno, sstb.sst_size);
+			reclaim_prg.log_offset = MIN(sstb.sst_size -
+			    sstb.sst_size % R_ENTSZ,
+			    R_ENTSZ * (SLM_RECLAIM_BATCH_NENTS - 1));
 		}
-		total = size / R_ENTSZ;
-		for (count = 0; count < total; r++, count++) {
-			if (r->xid == xid)
+
+		/* entries are appended in xid order */
+		if (reclaim_prg.log_offset > (off_t)R_ENTSZ) {
+			rc = mds_read_file(reclaim_prg.log_handle, &re,
+			    R_ENTSZ, &size, reclaim_prg.log_offset -
+			    R_ENTSZ);
+			if (rc == 0 && size == R_ENTSZ && re.xid >= xid)
 				psclog_warnx("Reclaim xid %"PRId64" "
 				    "already in use! batch = %"PRId64,
 				    xid, reclaim_prg.cur_batchno);
-			reclaim_prg.log_offset += R_ENTSZ;
 		}
-		PSCFREE(reclaimbuf);
-		psc_assert(reclaim_prg.log_offset ==
-		    (off_t)sstb.sst_size);
 	} else {
 		/* starting new logfile: write a magic header */
 		re.xid = RECLAIM_MAGIC_VER;
@@ -438,19 +488,11 @@ mds_write_logentry(uint64_t xid, uint64_t fid, uint64_t gen)
 	re.fg.fg_fid = fid;
 	re.fg.fg_gen = gen;
 
-	rc = mds_write_file(reclaim_prg.log_handle, &re, R_ENTSZ,
-	    &size, reclaim_prg.log_offset);
-	if (size != R_ENTSZ)
-		psc_fatal("Failed to write reclaim log file, batchno=%"PRId64,
-		    reclaim_prg.cur_batchno);
-
-	spinlock(&mds_distill_lock);
-	reclaim_prg.cur_xid = xid;
-	freelock(&mds_distill_lock);
+	mds_stage_logentry(&reclaim_prg, "reclaim", &re, R_ENTSZ, xid);
 
-	reclaim_prg.log_offset += R_ENTSZ;
 	if (reclaim_prg.log_offset == SLM_RECLAIM_BATCH_NENTS *
 	    (off_t)R_ENTSZ) {
+		mds_flush_logbuf(&reclaim_prg, "reclaim");
 
 		mds_release_file(reclaim_prg.log_handle);
 		reclaim_prg.log_handle = NULL;
@@ -473,12 +515,13 @@ mds_write_logentry(uint64_t xid, uint64_t fid, uint64_t gen)
 	psc_assert(reclaim_prg.log_offset <= SLM_RECLAIM_BATCH_NENTS *
 	    (off_t)R_ENTSZ);
 
-	psclog_diag("reclaim_prg.cur_xid=%"PRIu64" batchno=%"PRIu64" "
+	psclog_diag("reclaim xid=%"PRIu64" batchno=%"PRIu64" "
 	    "fg="SLPRI_FG,
-	    reclaim_prg.cur_xid, reclaim_prg.cur_batchno,
-	    SLPRI_FG_ARGS(&re.fg));
+	    xid, reclaim_prg.cur_batchno, SLPRI_FG_ARGS(&re.fg));
 }
 
+#define MDS_DISTILL_RC(p)	((p)->log_nstaged ? PJ_DISTILL_STAGED : 0)
+
 /*
  * Distill information from the system journal and write into namespace
  * update or garbage reclaim logs.
@@ -493,10 +536,17 @@ mds_write_logentry(uint64_t xid, uint64_t fid, uint64_t gen)
  * We encode the cursor creation time and hostname into the log file
  * names to minimize collisions.  If undetected, these collisions can
  * lead to insidious bugs, especially when on-disk format changes.
+ *
+ * The reclaim and update logs are each appended by their own distill
+ * shard, so the two proceed in parallel while each stays in xid order.
+ *
+ * Entries are buffered and written out a page at a time.  The journal
+ * keeps distilled entries until we report them written, either from
+ * here or when called with a NULL @pje at the end of a distill pass.
  */
 int
 mds_distill_handler(struct psc_journal_enthdr *pje,
-    __unusedx uint64_t xid, int npeers, int action)
+    int shard, int npeers, int action)
 {
 	struct slmds_jent_namespace *sjnm = NULL;
 	struct slmds_jent_bmap_crc *sjbc = NULL;
@@ -505,33 +555,52 @@ mds_distill_handler(struct psc_journal_enthdr *pje,
 	uint16_t type;
 	size_t size;
 
+	if (pje == NULL) {
+		if (shard == SLM_DISTILL_RECLAIM)
+			mds_flush_logbuf(&reclaim_prg, "reclaim");
+		else
+			mds_flush_logbuf(&nsupd_prg, "update");
+		return (0);
+	}
+
 	psc_assert(pje->pje_magic == PJE_MAGIC);
 
 	/*
-	 * The following can only be executed by the singleton distill
-	 * thread.
+	 * Recovery resumes from the log that lags the most, so the
+	 * other log may already hold this entry.
+	 */
+	if (pje->pje_xid <= mds_distill_lastxid[shard])
+		return (MDS_DISTILL_RC(shard == SLM_DISTILL_RECLAIM ?
+		    &reclaim_prg : &nsupd_prg));
+
+	/*
+	 * The following can only be executed by the distill thread
+	 * owning the shard.
 	 */
 	type = pje->pje_type & ~(_PJE_FLSHFT - 1);
 	if (type == MDS_LOG_BMAP_CRC) {
+		if (shard == SLM_DISTILL_RECLAIM)
+			return (MDS_DISTILL_RC(&reclaim_prg));
 		sjbc = PJE_DATA(pje);
 		goto check_update;
 	}
 
 	if (type != MDS_LOG_NAMESPACE)
-		return (0);
+		return (MDS_DISTILL_RC(shard == SLM_DISTILL_RECLAIM ?
+		    &reclaim_prg : &nsupd_prg));
 
 	sjnm = PJE_DATA(pje);
 	psc_assert(sjnm->sjnm_magic == SJ_NAMESPACE_MAGIC);
 
+	if (shard == SLM_DISTILL_UPDATE)
+		goto check_update;
+
 	/*
-	 * Note that we distill reclaim before update.  This is the same
-	 * order we use in recovery.
-	 *
 	 * If the namespace operation needs to reclaim disk space on I/O
 	 * servers, write the information into the reclaim log.
 	 */
 	if (!(sjnm->sjnm_flag & SJ_NAMESPACE_RECLAIM))
-		goto check_update;
+		return (MDS_DISTILL_RC(&reclaim_prg));
 
 	psc_assert(
 	    sjnm->sjnm_op == NS_OP_RECLAIM ||
@@ -541,10 +610,11 @@ mds_distill_handler(struct psc_journal_enthdr *pje,
 
 	mds_write_logentry(pje->pje_xid, sjnm->sjnm_target_fid,
 	    sjnm->sjnm_target_gen);
+	return (MDS_DISTILL_RC(&reclaim_prg));
 
  check_update:
 	if (!npeers)
-		return (0);
+		return (MDS_DISTILL_RC(&nsupd_prg));
 
 	if (nsupd_prg.log_handle == NULL) {
 		nsupd_prg.log_offset = 0;
@@ -612,16 +682,12 @@ mds_distill_handler(struct psc_journal_enthdr *pje,
 	    sjnm->sjnm_namelen + sjnm->sjnm_namelen2);
 
  write_update:
-	rc = mds_write_file(nsupd_prg.log_handle, &ue, U_ENTSZ, &size,
-	    nsupd_prg.log_offset);
-	if (size != U_ENTSZ)
-		psc_fatal("failed to write update log file, "
-		    "batchno=%"PRId64" rc=%d",
-		    nsupd_prg.cur_batchno, rc);
+	mds_stage_logentry(&nsupd_prg, "update", &ue, U_ENTSZ,
+	    pje->pje_xid);
 
 	/* see if we need to close the current update log file */
-	nsupd_prg.log_offset += U_ENTSZ;
 	if (nsupd_prg.log_offset == SLM_UPDATE_BATCH_NENTS * U_ENTSZ) {
+		mds_flush_logbuf(&nsupd_prg, "update");
 		mds_release_file(nsupd_prg.log_handle);
 
 		nsupd_prg.log_handle = NULL;
@@ -636,11 +702,7 @@ mds_distill_handler(struct psc_journal_enthdr *pje,
 		freelock(&nsupd_prg.lock);
 	}
 
-	spinlock(&mds_distill_lock);
-	nsupd_prg.cur_xid = pje->pje_xid;
-	freelock(&mds_distill_lock);
-
-	return (0);
+	return (MDS_DISTILL_RC(&nsupd_prg));
 }
 
 const char *slm_ns_opnames[] = {
@@ -2111,6 +2173,7 @@ mds_journal_init(uint64_t fsuuid)
 	OPSTAT_INCR("reclaim-xid");
 
 	last_distill_xid = last_reclaim_xid;
+	mds_distill_lastxid[SLM_DISTILL_RECLAIM] = last_reclaim_xid;
 
 	mds_release_file(handle);
 
@@ -2208,7 +2271,16 @@ mds_journal_init(uint64_t fsuuid)
 	if (total == SLM_UPDATE_BATCH_NENTS)
 		nsupd_prg.cur_batchno++;
 
-	if (last_distill_xid < last_update_xid)
+	/*
+	 * We used to distill reclaim before update for each entry and
+	 * recover in the same order, so the update log was never ahead
+	 * and we could resume from the newer of the two.  The shards
+	 * now append and flush their logs independently, so either one
+	 * may lag after a crash.  Resume from the older one; anything
+	 * past it that a log already holds is skipped by its shard.
+	 */
+	mds_distill_lastxid[SLM_DISTILL_UPDATE] = last_update_xid;
+	if (last_distill_xid > last_update_xid)
 		last_distill_xid = last_update_xid;
 
 	/* search for newly-added metadata servers */
@@ -2243,7 +2315,8 @@ mds_journal_init(uint64_t fsuuid)
 	    slm_journal->pj_replay_xid);
 
 	pjournal_replay(slm_journal, SLMTHRT_JRNL, "slmjthr",
-	    mds_replay_handler, mds_distill_handler);
+	    mds_replay_handler, mds_distill_handler,
+	    SLM_DISTILL_NSHARDS);
 
 	psclog_info("Last used SLASH2 transaction ID is %"PRId64,
 	   slm_journal->pj_lastxid);
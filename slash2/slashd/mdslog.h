@@ -35,7 +35,11 @@ struct slm_progress {
 
 	void			*log_handle;
 	void			*log_buf;
-	off_t			 log_offset;
+	off_t			 log_offset;		/* includes staged entries */
+
+	void			*log_stagebuf;		/* entries not yet written */
+	size_t			 log_nstaged;		/* bytes in log_stagebuf */
+	uint64_t		 log_stagexid;		/* xid of last staged entry */
 };
 
 extern struct slm_progress	 nsupd_prg;
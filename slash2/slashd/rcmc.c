@@ -229,17 +229,6 @@ slmrcmthr_walk_bmaps(struct slm_replst_workreq *rsw,
 	return (rc);
 }
 
-int
-slmrcmthr_walk(struct slm_sth *sth, void *p)
-{
-	struct psc_dynarray *da = p;
-	slfid_t fid;
-
-	fid = sqlite3_column_int64(sth->sth_sth, 0);
-	psc_dynarray_add(da, (void *)fid);
-	return (0);
-}
-
 void
 slmrcmthr_main(struct psc_thread *thr)
 {
@@ -261,10 +250,7 @@ slmrcmthr_main(struct psc_thread *thr)
 		if (rsw->rsw_fg.fg_fid == FID_ANY) {
 			OPSTAT_INCR("replst-all");
 
-			UPSCH_LOCK();
-			dbdo(slmrcmthr_walk, &da,
-			    "SELECT DISTINCT fid FROM upsch");
-			UPSCH_ULOCK();
+			slm_upsch_idx_getfids(&da);
 
 			DYNARRAY_FOREACH(p, n, &da) {
 				fg.fg_fid = (slfid_t)p;
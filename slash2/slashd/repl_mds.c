@@ -624,33 +624,13 @@ slm_repl_upd_write(struct bmap *b, int rel)
 		slm_upsch_insert(b, add.iosv[n].bs_id, sprio, uprio);
 
 	for (n = 0; n < del.nios; n++)
-		dbdo(NULL, NULL,
-		    " DELETE FROM upsch"
-		    " WHERE	resid = ?"
-		    "   AND	fid = ?"
-		    "   AND	bno = ?",
-		    SQLITE_INTEGER, del.iosv[n].bs_id,
-		    SQLITE_INTEGER64, bmap_2_fid(b),
-		    SQLITE_INTEGER, b->bcm_bmapno);
+		slm_upsch_idx_remove(del.iosv[n].bs_id, bmap_2_fid(b),
+		    b->bcm_bmapno);
 
 	for (n = 0; n < chg.nios; n++)
-		dbdo(NULL, NULL,
-		    " UPDATE	upsch"
-		    " SET	status = IFNULL(?, status),"
-		    "		sys_prio = IFNULL(?, sys_prio),"
-		    "		usr_prio = IFNULL(?, usr_prio)"
-		    " WHERE	resid = ?"
-		    "	AND	fid = ?"
-		    "	AND	bno = ?",
-		    chg.stat[n] ? SQLITE_TEXT : SQLITE_NULL,
-		    chg.stat[n] ? chg.stat[n] : 0,
-		    sprio == -1 ? SQLITE_NULL : SQLITE_INTEGER,
-		    sprio == -1 ? 0 : sprio,
-		    uprio == -1 ? SQLITE_NULL : SQLITE_INTEGER,
-		    uprio == -1 ? 0 : uprio,
-		    SQLITE_INTEGER, chg.iosv[n].bs_id,
-		    SQLITE_INTEGER64, bmap_2_fid(b),
-		    SQLITE_INTEGER, b->bcm_bmapno);
+		slm_upsch_idx_update(chg.iosv[n].bs_id, bmap_2_fid(b),
+		    b->bcm_bmapno, chg.stat[n] ? chg.stat[n][0] : 0,
+		    sprio, uprio);
 
 	bmap_2_bmi(b)->bmi_sys_prio = -1;
 	bmap_2_bmi(b)->bmi_usr_prio = -1;
@@ -371,6 +371,72 @@ slm_rmc_handle_getbmap(struct pscrpc_request *rq)
 	return (rc ? rc : mp->rc);
 }
 
+/*
+ * Handle SRMT_GETBMAPS: lease a run of bmaps for a client streaming
+ * through a file.  The on-disk bmaps are gathered with one read before
+ * the leases are handed out individually.
+ */
+int
+slm_rmc_handle_getbmaps(struct pscrpc_request *rq)
+{
+	const struct srm_leasebmaps_req *mq;
+	struct srm_leasebmaps_rep *mp;
+	struct srt_bmaplease *bl = NULL;
+	struct fidc_membh *f = NULL;
+	int i, rc = 0, abort_bulk = 1;
+	struct iovec iov;
+
+	SL_RSX_ALLOCREP(rq, mq, mp);
+
+	if (mq->rw != SL_WRITE && mq->rw != SL_READ)
+		PFL_GOTOERR(out, mp->rc = -EINVAL);
+	if (mq->nbmaps < 1 || mq->nbmaps > SRM_LEASEBMAPS_MAX)
+		PFL_GOTOERR(out, mp->rc = -EINVAL);
+
+	mp->rc = -slm_fcmh_get(&mq->fg, &f);
+	if (mp->rc)
+		PFL_GOTOERR(out, mp->rc);
+	mp->flags = mq->flags;
+
+	bl = PSCALLOC(mq->nbmaps * sizeof(*bl));
+
+	/* On failure, each bmap simply reads itself from disk. */
+	mds_bmap_preread(f, mq->bmapno, mq->nbmaps);
+	for (i = 0; i < mq->nbmaps; i++) {
+		bl[i].rc = mds_bmap_load_cli(f, mq->bmapno + i,
+		    mq->flags, mq->rw, mq->prefios[0], &bl[i].sbd,
+		    rq->rq_export, bl[i].repls, 0);
+		if (bl[i].rc)
+			break;
+	}
+	mds_bmap_preread_done();
+
+	mp->nbmaps = i;
+	if (i == 0)
+		PFL_GOTOERR(out, mp->rc = bl[0].rc);
+	if (mq->rw == SL_WRITE)
+		OPSTAT_ADD("getbmaps-lease-write", i);
+	else
+		OPSTAT_ADD("getbmaps-lease-read", i);
+
+	if (mp->flags & SRM_LEASEBMAPF_GETINODE)
+		slm_pack_inode(f, &mp->ino);
+
+	iov.iov_base = bl;
+	iov.iov_len = mq->nbmaps * sizeof(*bl);
+	rc = slrpc_bulkserver(rq, BULK_PUT_SOURCE, SRMC_BULK_PORTAL,
+	    &iov, 1);
+	abort_bulk = 0;
+
+ out:
+	if (f)
+		fcmh_op_done(f);
+	PSCFREE(bl);
+	if (rc == 0 && abort_bulk)
+		pscrpc_msg_add_flags(rq->rq_repmsg, MSG_ABORT_BULK);
+	return (rc ? rc : mp->rc);
+}
+
 int
 slm_rmc_handle_link(struct pscrpc_request *rq)
 {
@@ -1725,6 +1791,9 @@ slm_rmc_handler(struct pscrpc_request *rq)
 	case SRMT_GETBMAP:
 		rc = slm_rmc_handle_getbmap(rq);
 		break;
+	case SRMT_GETBMAPS:
+		rc = slm_rmc_handle_getbmaps(rq);
+		break;
 	case SRMT_RELEASEBMAP:
 		rc = mds_handle_rls_bmap(rq, 0);
 		break;
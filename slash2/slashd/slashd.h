@@ -23,10 +23,10 @@
 #ifndef _SLASHD_H_
 #define _SLASHD_H_
 
-#include <sqlite3.h>
 
 #include "pfl/ctlsvr.h"
 #include "pfl/dynarray.h"
+#include "pfl/heap.h"
 #include "pfl/meter.h"
 #include "pfl/multiwait.h"
 #include "pfl/odtable.h"
@@ -42,16 +42,15 @@
 #include "sltypes.h"
 
 struct fidc_membh;
+struct slm_upsch_shard;
 struct srt_stat;
 
-struct slm_sth;
 struct bmap_mds_lease;
 
 /* MDS thread types. */
 enum {
 	SLMTHRT_BATCHRQ,	/* batch RPC reaper */
 	SLMTHRT_FREAP,		/* file reaper */
-	SLMTHRT_BKDB,		/* upsch database backup */
 	SLMTHRT_BMAPTIMEO,	/* bmap timeout thread */
 	SLMTHRT_CONN,		/* peer resource connection monitor */
 	SLMTHRT_CTL,		/* control processor */
@@ -69,30 +68,31 @@ enum {
 	SLMTHRT_RMM,		/* MDS <- MDS msg svc handler */
 	SLMTHRT_OPSTIMER,	/* opstats updater */
 	SLMTHRT_UPSCHED,	/* update scheduler for site resources */
+	SLMTHRT_UPSCHLOG,	/* update scheduler index log writer */
 	SLMTHRT_USKLNDPL,	/* userland socket lustre net dev poll thr */
 	SLMTHRT_WORKER,		/* miscellaneous work */
 	SLMTHRT_ZFS_KSTAT	/* ZFS stats */
 };
 
-struct slmthr_dbh {
-	sqlite3			 *dbh;
-	struct psc_hashtbl	  dbh_sth_hashtbl;
-};
-
 struct slmrmc_thread {
 	struct pscrpc_thread	  smrct_prt;
-	struct slmthr_dbh	  smrct_dbh;
+
+	/* on-disk bmap images pre-read for SRMT_GETBMAPS */
+	char			 *smrct_prebuf;
+	struct fidc_membh	 *smrct_pref;
+	uint64_t		  smrct_pregen;
+	sl_bmapno_t		  smrct_prebno;
+	int			  smrct_pren;
+	size_t			  smrct_prenb;
 };
 
 struct slmrcm_thread {
-	struct slmthr_dbh	  srcm_dbh;
 	char			 *srcm_page;
 	int			  srcm_page_bitpos;
 };
 
 struct slmrmi_thread {
 	struct pscrpc_thread	  smrit_prt;
-	struct slmthr_dbh	  smrit_dbh;
 };
 
 struct slmrmm_thread {
@@ -101,15 +101,10 @@ struct slmrmm_thread {
 
 struct slmdbwk_thread {
 	struct pfl_wk_thread	  smdw_wkthr;
-	struct slmthr_dbh	  smdw_dbh;
-};
-
-struct slmctl_thread {
-	struct slmthr_dbh	  smct_dbh;
 };
 
 struct slmupsch_thread {
-	struct slmthr_dbh	  sus_dbh;
+	struct slm_upsch_shard	 *sus_shard;
 };
 
 PSCTHR_MKCAST(slmctlthr, psc_ctlthr, SLMTHRT_CTL)
@@ -120,35 +115,6 @@ PSCTHR_MKCAST(slmrmithr, slmrmi_thread, SLMTHRT_RMI)
 PSCTHR_MKCAST(slmrmmthr, slmrmm_thread, SLMTHRT_RMM)
 PSCTHR_MKCAST(slmupschthr, slmupsch_thread, SLMTHRT_UPSCHED)
 
-static __inline struct slmctl_thread *
-slmctlthr_getpri(struct psc_thread *thr)
-{
-	return ((void *)(slmctlthr(thr) + 1));
-}
-
-static __inline struct slmthr_dbh *
-slmthr_getdbh(void)
-{
-	struct psc_thread *thr;
-
-	thr = pscthr_get();
-	switch (thr->pscthr_type) {
-	case SLMTHRT_CTL:
-		return (&slmctlthr_getpri(thr)->smct_dbh);
-	case SLMTHRT_RCM:
-		return (&slmrcmthr(thr)->srcm_dbh);
-	case SLMTHRT_RMC:
-		return (&slmrmcthr(thr)->smrct_dbh);
-	case SLMTHRT_RMI:
-		return (&slmrmithr(thr)->smrit_dbh);
-	case SLMTHRT_UPSCHED:
-		return (&slmupschthr(thr)->sus_dbh);
-	case SLMTHRT_DBWORKER:
-		return (&slmdbwkthr(thr)->smdw_dbh);
-	}
-	psc_fatalx("unknown thread type");
-}
-
 struct site_mds_info {
 };
 
@@ -232,6 +198,9 @@ struct rpmi_ios {
 	struct bw_dir		  si_bw_ingress;	/* incoming bandwidth */
 	struct bw_dir		  si_bw_egress;		/* outgoing bandwidth */
 	struct bw_dir		  si_bw_aggr;		/* aggregate (incoming + outgoing) */
+
+	struct slm_upsch_shard	 *si_upsch_shard;	/* scheduler thread serving us */
+	struct pfl_heap		  si_upsch_gheap;	/* queued updates by group */
 };
 #define sl_mds_iosinfo rpmi_ios
 
@@ -323,11 +292,6 @@ struct slm_wkdata_batchrq_cb {
 	int			 rc;
 };
 
-struct slm_wkdata_upschq {
-	struct sl_fidgen	 fg;
-	sl_bmapno_t		 bno;
-};
-
 struct slm_wkdata_rmdir_ino {
 	slfid_t			 fid;
 };
@@ -344,6 +308,7 @@ struct mio_rootnames {
 };
 
 #define SLM_NWORKER_THREADS	4
+#define SLM_NUPSCHED_THREADS	4
 
 enum {
 	SLM_OPSTATE_INIT = 0,
@@ -361,7 +326,6 @@ int		 mds_lease_reassign(struct fidc_membh *,
 
 int		 mds_sliod_alive(void *);
 
-void		 slmbkdbthr_main(struct psc_thread *);
 void		 slmbmaptimeothr_spawn(void);
 void		 slmctlthr_main(const char *);
 void		 slmrcmthr_main(struct psc_thread *);
@@ -381,11 +345,6 @@ void		 mdscoh_req(struct bmap_mds_lease *);
 void		 psc_scan_filesystems(void);
 void		 mds_note_update(int);
 
-#define dbdo(cb, arg, fmt, ...)	_dbdo(PFL_CALLERINFO(), (cb), (arg), (fmt), ## __VA_ARGS__)
-void		 _dbdo(const struct pfl_callerinfo *,
-			int (*)(struct slm_sth *, void *), void *,
-			const char *, ...);
-
 extern struct slash_creds	 rootcreds;
 extern struct pfl_odt		*slm_bia_odt;
 extern struct pfl_odt		*slm_ptrunc_odt;
@@ -0,0 +1,941 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Update scheduler index: the set of (resid, fid, bno) updates pending
+ * for I/O systems, e.g. replications waiting to be arranged.
+ *
+ * Queued items are kept in per-resource fair-share heaps two levels
+ * deep: a heap of group buckets, each holding a heap of user buckets,
+ * each holding a heap of items ordered by system then user priority.
+ * Every item paged in advances the virtual clock of its user and group
+ * bucket so the next page-in favors other users and groups at the same
+ * system priority.
+ *
+ * Mutations are appended to a log in the data directory, which is
+ * replayed at startup and compacted by slmupschlogthr once it grows
+ * well beyond the live item count.
+ */
+
+#define PSC_SUBSYS SLMSS_UPSCH
+#include "subsys_mds.h"
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/dynarray.h"
+#include "pfl/hashtbl.h"
+#include "pfl/heap.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/pool.h"
+#include "pfl/pthrutil.h"
+#include "pfl/thread.h"
+
+#include "mkfn.h"
+#include "pathnames.h"
+#include "slashd.h"
+#include "slconfig.h"
+#include "up_sched_res.h"
+
+#define SLM_UPSCH_NENTBKTS	(1 << 14)	/* item hash table size */
+#define SLM_UPSCH_NBKTBKTS	1024		/* user/group bucket table size */
+
+#define SLM_UPSCH_LOG_MAGIC	UINT32_C(0x75706c67)
+#define SLM_UPSCH_LOG_FLUSH	2		/* seconds between log writes */
+#define SLM_UPSCH_LOG_MINCOMPACT (1024 * 1024)	/* leave small logs alone */
+
+/* log record opcodes */
+#define UPSCH_LOGOP_PUT		1		/* item inserted or modified */
+#define UPSCH_LOGOP_DEL		2		/* resid/bno may be wildcards */
+
+struct slm_upsch_logrec {
+	uint32_t		 ulr_magic;
+	uint8_t			 ulr_op;
+	char			 ulr_status;
+	uint16_t		 ulr__pad;
+	sl_ios_id_t		 ulr_resid;
+	sl_bmapno_t		 ulr_bno;
+	uint64_t		 ulr_fid;
+	uint32_t		 ulr_uid;
+	uint32_t		 ulr_gid;
+	int32_t			 ulr_sys_prio;
+	int32_t			 ulr_usr_prio;
+	uint32_t		 ulr_nonce;
+	uint32_t		 ulr__pad2;
+} __packed;
+
+/*
+ * Fair-share bucket.  Group buckets hang off the resource and have no
+ * parent; user buckets hang off a group bucket.
+ */
+struct slm_upsch_bkt {
+	struct pfl_hashentry	 ub_hentry;
+	uint64_t		 ub_key;
+	struct sl_resource	*ub_res;
+	struct slm_upsch_bkt	*ub_parent;
+	uint32_t		 ub_id;		/* gid or uid */
+	int			 ub_nrefs;	/* items or child buckets */
+	int			 ub_queued;	/* in parent heap */
+	uint64_t		 ub_served;	/* virtual clock */
+	struct pfl_heap		 ub_heap;	/* queued children */
+	struct pfl_heap_entry	 ub_hpentry;
+};
+
+struct slm_upsch_ent {
+	struct pfl_hashentry	 ue_hentry;
+	slfid_t			 ue_fid;	/* hash key */
+	sl_bmapno_t		 ue_bno;
+	struct sl_resource	*ue_res;
+	struct slm_upsch_bkt	*ue_bkt;	/* user bucket */
+	uint32_t		 ue_uid;
+	uint32_t		 ue_gid;
+	int			 ue_sys_prio;
+	int			 ue_usr_prio;
+	uint32_t		 ue_nonce;
+	int			 ue_status;	/* UPSCH_ST_* */
+	uint64_t		 ue_seq;	/* FIFO among equal priority */
+	struct pfl_heap_entry	 ue_hpentry;
+	struct psc_listentry	 ue_lentry;
+};
+
+#define UPSCH_IDX_LOCK()	psc_mutex_lock(&slm_upsch_idx_mutex)
+#define UPSCH_IDX_ULOCK()	psc_mutex_unlock(&slm_upsch_idx_mutex)
+
+struct psc_poolmaster	 slm_upsch_ent_poolmaster;
+struct psc_poolmgr	*slm_upsch_ent_pool;
+
+struct psc_hashtbl	 slm_upsch_enttbl;
+struct psc_hashtbl	 slm_upsch_bkttbl;
+
+struct pfl_mutex	 slm_upsch_idx_mutex = PSC_MUTEX_INIT;
+uint64_t		 slm_upsch_idx_seq;
+int			 slm_upsch_idx_nents;
+
+/* log records not yet written out by slmupschlogthr */
+struct slm_upsch_logrec	*slm_upsch_logbuf;
+int			 slm_upsch_logbuf_len;
+int			 slm_upsch_logbuf_nalloc;
+
+int			 slm_upsch_log_fd = -1;
+off_t			 slm_upsch_log_size;
+int			 slm_upsch_log_replaying;
+
+int
+slm_upsch_ent_cmp(const void *a, const void *b)
+{
+	const struct slm_upsch_ent *x = a, *y = b;
+
+	if (x->ue_sys_prio != y->ue_sys_prio)
+		return (CMP(y->ue_sys_prio, x->ue_sys_prio));
+	if (x->ue_usr_prio != y->ue_usr_prio)
+		return (CMP(y->ue_usr_prio, x->ue_usr_prio));
+	return (CMP(x->ue_seq, y->ue_seq));
+}
+
+/*
+ * Retrieve the system priority of the best item queued beneath a
+ * bucket.
+ */
+int
+slm_upsch_bkt_prio(const struct slm_upsch_bkt *ub)
+{
+	struct slm_upsch_ent *ue;
+
+	if (ub->ub_parent == NULL)
+		ub = pfl_heap_peek((struct pfl_heap *)&ub->ub_heap);
+	ue = pfl_heap_peek((struct pfl_heap *)&ub->ub_heap);
+	return (ue->ue_sys_prio);
+}
+
+int
+slm_upsch_bkt_cmp(const void *a, const void *b)
+{
+	const struct slm_upsch_bkt *x = a, *y = b;
+	int px, py;
+
+	px = slm_upsch_bkt_prio(x);
+	py = slm_upsch_bkt_prio(y);
+	if (px != py)
+		return (CMP(py, px));
+	if (x->ub_served != y->ub_served)
+		return (CMP(x->ub_served, y->ub_served));
+	return (CMP(x->ub_id, y->ub_id));
+}
+
+int
+slm_upsch_ent_hcmp(const void *a, const void *b)
+{
+	const struct slm_upsch_ent *x = a, *y = b;
+
+	return (x->ue_res == y->ue_res && x->ue_bno == y->ue_bno);
+}
+
+int
+slm_upsch_bkt_hcmp(const void *a, const void *b)
+{
+	const struct slm_upsch_bkt *x = a, *y = b;
+
+	return (x->ub_res == y->ub_res &&
+	    x->ub_parent == y->ub_parent && x->ub_id == y->ub_id);
+}
+
+/*
+ * Grab the next free slot in the pending log buffer.
+ */
+struct slm_upsch_logrec *
+upsch_log_getrec(int op)
+{
+	struct slm_upsch_logrec *ulr;
+	int n;
+
+	if (slm_upsch_logbuf_len == slm_upsch_logbuf_nalloc) {
+		n = MAX(64, slm_upsch_logbuf_nalloc * 2);
+		slm_upsch_logbuf = psc_realloc(slm_upsch_logbuf,
+		    n * sizeof(*ulr), 0);
+		slm_upsch_logbuf_nalloc = n;
+	}
+	ulr = &slm_upsch_logbuf[slm_upsch_logbuf_len++];
+	memset(ulr, 0, sizeof(*ulr));
+	ulr->ulr_magic = SLM_UPSCH_LOG_MAGIC;
+	ulr->ulr_op = op;
+	return (ulr);
+}
+
+void
+upsch_ent_fillrec(struct slm_upsch_logrec *ulr,
+    const struct slm_upsch_ent *ue)
+{
+	ulr->ulr_status = ue->ue_status;
+	ulr->ulr_resid = ue->ue_res->res_id;
+	ulr->ulr_bno = ue->ue_bno;
+	ulr->ulr_fid = ue->ue_fid;
+	ulr->ulr_uid = ue->ue_uid;
+	ulr->ulr_gid = ue->ue_gid;
+	ulr->ulr_sys_prio = ue->ue_sys_prio;
+	ulr->ulr_usr_prio = ue->ue_usr_prio;
+	ulr->ulr_nonce = ue->ue_nonce;
+}
+
+void
+upsch_log_put(const struct slm_upsch_ent *ue)
+{
+	if (slm_upsch_log_replaying)
+		return;
+	upsch_ent_fillrec(upsch_log_getrec(UPSCH_LOGOP_PUT), ue);
+}
+
+void
+upsch_log_del(sl_ios_id_t resid, slfid_t fid, sl_bmapno_t bno)
+{
+	struct slm_upsch_logrec *ulr;
+
+	if (slm_upsch_log_replaying)
+		return;
+	ulr = upsch_log_getrec(UPSCH_LOGOP_DEL);
+	ulr->ulr_resid = resid;
+	ulr->ulr_fid = fid;
+	ulr->ulr_bno = bno;
+}
+
+/*
+ * Bring a bucket's position in its parent heap (and, recursively, its
+ * parent's position) in line with what is queued beneath it.
+ */
+void
+upsch_bkt_adjust(struct slm_upsch_bkt *ub)
+{
+	struct slm_upsch_bkt *top;
+	struct pfl_heap *ph;
+
+	for (; ub; ub = ub->ub_parent) {
+		ph = ub->ub_parent ? &ub->ub_parent->ub_heap :
+		    &res2iosinfo(ub->ub_res)->si_upsch_gheap;
+		if (pfl_heap_nitems(&ub->ub_heap) == 0) {
+			if (ub->ub_queued) {
+				pfl_heap_remove(ph, ub);
+				ub->ub_queued = 0;
+			}
+		} else if (ub->ub_queued) {
+			pfl_heap_reseat(ph, ub);
+		} else {
+			/*
+			 * Do not let a bucket bank credit while it had
+			 * nothing queued: restart it no further behind
+			 * than whoever is currently being served.
+			 */
+			top = pfl_heap_peek(ph);
+			if (top && top->ub_served > ub->ub_served)
+				ub->ub_served = top->ub_served;
+			pfl_heap_add(ph, ub);
+			ub->ub_queued = 1;
+		}
+	}
+}
+
+struct slm_upsch_bkt *
+upsch_bkt_lookup(struct sl_resource *r, struct slm_upsch_bkt *parent,
+    uint32_t id)
+{
+	struct slm_upsch_bkt q, *ub;
+
+	q.ub_res = r;
+	q.ub_parent = parent;
+	q.ub_id = id;
+	q.ub_key = (uint64_t)r->res_id << 32 ^ id ^
+	    (uint64_t)(uintptr_t)parent;
+	ub = psc_hashtbl_search_cmp(&slm_upsch_bkttbl, &q, &q.ub_key);
+	if (ub)
+		return (ub);
+
+	ub = PSCALLOC(sizeof(*ub));
+	psc_hashent_init(&slm_upsch_bkttbl, ub);
+	ub->ub_key = q.ub_key;
+	ub->ub_res = r;
+	ub->ub_parent = parent;
+	ub->ub_id = id;
+	if (parent) {
+		parent->ub_nrefs++;
+		pfl_heap_init(&ub->ub_heap, struct slm_upsch_ent,
+		    ue_hpentry, slm_upsch_ent_cmp);
+	} else
+		pfl_heap_init(&ub->ub_heap, struct slm_upsch_bkt,
+		    ub_hpentry, slm_upsch_bkt_cmp);
+	psc_hashtbl_add_item(&slm_upsch_bkttbl, ub);
+	return (ub);
+}
+
+void
+upsch_bkt_put(struct slm_upsch_bkt *ub)
+{
+	struct slm_upsch_bkt *parent;
+
+	for (; ub; ub = parent) {
+		parent = ub->ub_parent;
+		if (--ub->ub_nrefs)
+			break;
+		psc_assert(!ub->ub_queued);
+		psc_hashent_remove(&slm_upsch_bkttbl, ub);
+		pfl_heap_destroy(&ub->ub_heap);
+		PSCFREE(ub);
+	}
+}
+
+void
+upsch_ent_queue(struct slm_upsch_ent *ue)
+{
+	pfl_heap_add(&ue->ue_bkt->ub_heap, ue);
+	upsch_bkt_adjust(ue->ue_bkt);
+}
+
+void
+upsch_ent_dequeue(struct slm_upsch_ent *ue)
+{
+	pfl_heap_remove(&ue->ue_bkt->ub_heap, ue);
+	upsch_bkt_adjust(ue->ue_bkt);
+}
+
+void
+upsch_ent_setstatus(struct slm_upsch_ent *ue, int status)
+{
+	if (ue->ue_status == status)
+		return;
+	if (ue->ue_status == UPSCH_ST_QUEUED)
+		upsch_ent_dequeue(ue);
+	ue->ue_status = status;
+	if (ue->ue_status == UPSCH_ST_QUEUED)
+		upsch_ent_queue(ue);
+}
+
+void
+upsch_ent_setprio(struct slm_upsch_ent *ue, int sys_prio, int usr_prio)
+{
+	int queued;
+
+	queued = ue->ue_status == UPSCH_ST_QUEUED;
+	if (queued)
+		upsch_ent_dequeue(ue);
+	if (sys_prio != -1)
+		ue->ue_sys_prio = sys_prio;
+	if (usr_prio != -1)
+		ue->ue_usr_prio = usr_prio;
+	if (queued)
+		upsch_ent_queue(ue);
+}
+
+struct slm_upsch_ent *
+upsch_ent_lookup(struct sl_resource *r, slfid_t fid, sl_bmapno_t bno)
+{
+	struct slm_upsch_ent q;
+
+	q.ue_res = r;
+	q.ue_bno = bno;
+	return (psc_hashtbl_search_cmp(&slm_upsch_enttbl, &q, &fid));
+}
+
+struct slm_upsch_ent *
+upsch_ent_create(struct sl_resource *r, slfid_t fid, sl_bmapno_t bno,
+    uint32_t uid, uint32_t gid)
+{
+	struct slm_upsch_bkt *gb;
+	struct slm_upsch_ent *ue;
+
+	ue = psc_pool_get(slm_upsch_ent_pool);
+	memset(ue, 0, sizeof(*ue));
+	psc_hashent_init(&slm_upsch_enttbl, ue);
+	INIT_PSC_LISTENTRY(&ue->ue_lentry);
+	ue->ue_fid = fid;
+	ue->ue_bno = bno;
+	ue->ue_res = r;
+	ue->ue_uid = uid;
+	ue->ue_gid = gid;
+	ue->ue_seq = slm_upsch_idx_seq++;
+
+	gb = upsch_bkt_lookup(r, NULL, gid);
+	ue->ue_bkt = upsch_bkt_lookup(r, gb, uid);
+	ue->ue_bkt->ub_nrefs++;
+
+	psc_hashtbl_add_item(&slm_upsch_enttbl, ue);
+	slm_upsch_idx_nents++;
+	return (ue);
+}
+
+/*
+ * Remove an item.  The hash bucket holding it must be held.
+ */
+void
+upsch_ent_destroy(struct psc_hashbkt *hb, struct slm_upsch_ent *ue)
+{
+	if (ue->ue_status == UPSCH_ST_QUEUED)
+		upsch_ent_dequeue(ue);
+	psc_hashbkt_del_item(&slm_upsch_enttbl, hb, ue);
+	upsch_bkt_put(ue->ue_bkt);
+	slm_upsch_idx_nents--;
+	psc_pool_return(slm_upsch_ent_pool, ue);
+}
+
+/*
+ * Insert or overwrite an item.  Returns the item.
+ */
+struct slm_upsch_ent *
+upsch_ent_put(struct sl_resource *r, slfid_t fid, sl_bmapno_t bno,
+    uint32_t uid, uint32_t gid, int status, int sys_prio, int usr_prio,
+    uint32_t nonce)
+{
+	struct slm_upsch_ent *ue;
+
+	ue = upsch_ent_lookup(r, fid, bno);
+	if (ue == NULL) {
+		ue = upsch_ent_create(r, fid, bno, uid, gid);
+		ue->ue_status = status;
+		ue->ue_sys_prio = sys_prio;
+		ue->ue_usr_prio = usr_prio;
+		if (status == UPSCH_ST_QUEUED)
+			upsch_ent_queue(ue);
+	} else {
+		upsch_ent_setstatus(ue, status);
+		upsch_ent_setprio(ue, sys_prio, usr_prio);
+	}
+	ue->ue_nonce = nonce;
+	return (ue);
+}
+
+void
+upsch_ent_remove(sl_ios_id_t resid, slfid_t fid, sl_bmapno_t bno)
+{
+	struct slm_upsch_ent *ue, *ue_next;
+	struct psc_hashbkt *hb;
+
+	hb = psc_hashbkt_get(&slm_upsch_enttbl, &fid);
+	PSC_HASHBKT_FOREACH_ENTRY_SAFE(&slm_upsch_enttbl, ue, ue_next,
+	    hb) {
+		if (ue->ue_fid != fid)
+			continue;
+		if (bno != BMAPNO_ANY && ue->ue_bno != bno)
+			continue;
+		if (resid != IOS_ID_ANY && ue->ue_res->res_id != resid)
+			continue;
+		upsch_ent_destroy(hb, ue);
+	}
+	psc_hashbkt_put(&slm_upsch_enttbl, hb);
+}
+
+/*
+ * Add a pending update.  An existing update for the same (resid, fid,
+ * bno) is left untouched.
+ * Returns zero on success or errno on failure.
+ */
+int
+slm_upsch_idx_add(sl_ios_id_t resid, slfid_t fid, sl_bmapno_t bno,
+    uint32_t uid, uint32_t gid, int sys_prio, int usr_prio,
+    uint32_t nonce)
+{
+	struct slm_upsch_ent *ue;
+	struct sl_resource *r;
+
+	r = libsl_id2res(resid);
+	if (r == NULL || !RES_ISFS(r))
+		return (ENOENT);
+
+	UPSCH_IDX_LOCK();
+	if (upsch_ent_lookup(r, fid, bno)) {
+		UPSCH_IDX_ULOCK();
+		return (EEXIST);
+	}
+	ue = upsch_ent_put(r, fid, bno, uid, gid, UPSCH_ST_QUEUED,
+	    sys_prio, usr_prio, nonce);
+	upsch_log_put(ue);
+	UPSCH_IDX_ULOCK();
+	return (0);
+}
+
+/*
+ * Modify a pending update.
+ * @status: new UPSCH_ST_* status or zero to leave alone.
+ * @sys_prio: new system priority or -1 to leave alone.
+ * @usr_prio: new user priority or -1 to leave alone.
+ */
+void
+slm_upsch_idx_update(sl_ios_id_t resid, slfid_t fid, sl_bmapno_t bno,
+    int status, int sys_prio, int usr_prio)
+{
+	struct slm_upsch_ent *ue;
+	struct sl_resource *r;
+
+	r = libsl_id2res(resid);
+	if (r == NULL)
+		return;
+
+	UPSCH_IDX_LOCK();
+	ue = upsch_ent_lookup(r, fid, bno);
+	if (ue) {
+		if (status)
+			upsch_ent_setstatus(ue, status);
+		if (sys_prio != -1 || usr_prio != -1)
+			upsch_ent_setprio(ue, sys_prio, usr_prio);
+		upsch_log_put(ue);
+	}
+	UPSCH_IDX_ULOCK();
+}
+
+/*
+ * Remove pending updates.  @resid may be IOS_ID_ANY and @bno may be
+ * BMAPNO_ANY to match all.
+ */
+void
+slm_upsch_idx_remove(sl_ios_id_t resid, slfid_t fid, sl_bmapno_t bno)
+{
+	UPSCH_IDX_LOCK();
+	upsch_ent_remove(resid, fid, bno);
+	upsch_log_del(resid, fid, bno);
+	UPSCH_IDX_ULOCK();
+}
+
+/*
+ * Select the next batch of queued updates destined for a resource.
+ * Items are not removed; they stay queued until the caller changes
+ * their status.
+ * Returns the number of items filled in.
+ */
+int
+slm_upsch_idx_pagein(struct sl_resource *r, struct slm_upsch_item *v,
+    int max)
+{
+	struct slm_upsch_ent *ue, *uev[max];
+	struct slm_upsch_bkt *gb, *ub;
+	struct sl_mds_iosinfo *si;
+	int i, n;
+
+	si = res2iosinfo(r);
+
+	UPSCH_IDX_LOCK();
+	for (n = 0; n < max; n++) {
+		gb = pfl_heap_peek(&si->si_upsch_gheap);
+		if (gb == NULL)
+			break;
+		ub = pfl_heap_peek(&gb->ub_heap);
+		ue = pfl_heap_peek(&ub->ub_heap);
+
+		v[n].usi_fid = ue->ue_fid;
+		v[n].usi_bno = ue->ue_bno;
+		v[n].usi_resid = r->res_id;
+		v[n].usi_nonce = ue->ue_nonce;
+
+		/*
+		 * Take the item out for the rest of this pass so the
+		 * next pick sees the advanced clocks.
+		 */
+		uev[n] = ue;
+		ub->ub_served++;
+		gb->ub_served++;
+		upsch_ent_dequeue(ue);
+	}
+	for (i = 0; i < n; i++)
+		upsch_ent_queue(uev[i]);
+	UPSCH_IDX_ULOCK();
+
+	if (n)
+		OPSTAT_ADD("upsch-pagein", n);
+	return (n);
+}
+
+/*
+ * Gather the distinct files that have pending updates.
+ */
+void
+slm_upsch_idx_getfids(struct psc_dynarray *da)
+{
+	struct slm_upsch_ent *ue;
+	struct psc_hashbkt *hb;
+	int j, n;
+
+	UPSCH_IDX_LOCK();
+	PSC_HASHTBL_FOREACH_BUCKET(hb, &slm_upsch_enttbl) {
+		psc_hashbkt_lock(hb);
+		/* all items for a file live in the same hash bucket */
+		n = psc_dynarray_len(da);
+		PSC_HASHBKT_FOREACH_ENTRY(&slm_upsch_enttbl, ue, hb) {
+			for (j = n; j < psc_dynarray_len(da); j++)
+				if ((slfid_t)psc_dynarray_getpos(da, j) ==
+				    ue->ue_fid)
+					break;
+			if (j == psc_dynarray_len(da))
+				psc_dynarray_add(da, (void *)ue->ue_fid);
+		}
+		psc_hashbkt_unlock(hb);
+	}
+	UPSCH_IDX_ULOCK();
+}
+
+/*
+ * Retrieve the pending updates for a bmap.
+ * Returns the number of items filled in.
+ */
+int
+slm_upsch_idx_getbmap(slfid_t fid, sl_bmapno_t bno,
+    struct slm_upsch_item *v, int max)
+{
+	struct slm_upsch_ent *ue;
+	struct psc_hashbkt *hb;
+	int n = 0;
+
+	UPSCH_IDX_LOCK();
+	hb = psc_hashbkt_get(&slm_upsch_enttbl, &fid);
+	PSC_HASHBKT_FOREACH_ENTRY(&slm_upsch_enttbl, ue, hb) {
+		if (ue->ue_fid != fid || ue->ue_bno != bno)
+			continue;
+		if (n == max)
+			break;
+		v[n].usi_fid = fid;
+		v[n].usi_bno = bno;
+		v[n].usi_resid = ue->ue_res->res_id;
+		v[n].usi_nonce = ue->ue_nonce;
+		n++;
+	}
+	psc_hashbkt_put(&slm_upsch_enttbl, hb);
+	UPSCH_IDX_ULOCK();
+	return (n);
+}
+
+void
+slm_upsch_idx_setnonce(slfid_t fid, sl_bmapno_t bno, uint32_t nonce)
+{
+	struct slm_upsch_ent *ue;
+	struct psc_hashbkt *hb;
+
+	UPSCH_IDX_LOCK();
+	hb = psc_hashbkt_get(&slm_upsch_enttbl, &fid);
+	PSC_HASHBKT_FOREACH_ENTRY(&slm_upsch_enttbl, ue, hb) {
+		if (ue->ue_fid != fid || ue->ue_bno != bno ||
+		    ue->ue_nonce == nonce)
+			continue;
+		ue->ue_nonce = nonce;
+		upsch_log_put(ue);
+	}
+	psc_hashbkt_put(&slm_upsch_enttbl, hb);
+	UPSCH_IDX_ULOCK();
+}
+
+/*
+ * Requeue every update that was handed to an IOS before we went down
+ * and let @cbf undo the bmap side of the arrangement.
+ */
+void
+slm_upsch_idx_revert(int (*cbf)(slfid_t, sl_bmapno_t))
+{
+	struct slm_upsch_ent *ue;
+	struct psc_hashbkt *hb;
+	struct psc_dynarray da = DYNARRAY_INIT;
+	struct slm_upsch_item *it;
+	int n;
+
+	UPSCH_IDX_LOCK();
+	PSC_HASHTBL_FOREACH_BUCKET(hb, &slm_upsch_enttbl) {
+		psc_hashbkt_lock(hb);
+		PSC_HASHBKT_FOREACH_ENTRY(&slm_upsch_enttbl, ue, hb) {
+			if (ue->ue_status != UPSCH_ST_SCHED)
+				continue;
+			it = PSCALLOC(sizeof(*it));
+			it->usi_fid = ue->ue_fid;
+			it->usi_bno = ue->ue_bno;
+			psc_dynarray_add(&da, it);
+
+			upsch_ent_setstatus(ue, UPSCH_ST_QUEUED);
+			upsch_log_put(ue);
+		}
+		psc_hashbkt_unlock(hb);
+	}
+	UPSCH_IDX_ULOCK();
+
+	DYNARRAY_FOREACH(it, n, &da) {
+		cbf(it->usi_fid, it->usi_bno);
+		PSCFREE(it);
+	}
+	psc_dynarray_free(&da);
+}
+
+void
+upsch_log_open(const char *fn, int flags)
+{
+	slm_upsch_log_fd = open(fn, O_WRONLY | O_APPEND | flags, 0600);
+	if (slm_upsch_log_fd == -1)
+		psc_fatal("open %s", fn);
+}
+
+/*
+ * Write out log records accumulated since the last flush.
+ */
+void
+upsch_log_flush(void)
+{
+	struct slm_upsch_logrec *buf;
+	ssize_t rc;
+	size_t len;
+
+	UPSCH_IDX_LOCK();
+	buf = slm_upsch_logbuf;
+	len = slm_upsch_logbuf_len * sizeof(*buf);
+	slm_upsch_logbuf = NULL;
+	slm_upsch_logbuf_len = 0;
+	slm_upsch_logbuf_nalloc = 0;
+	UPSCH_IDX_ULOCK();
+
+	if (len) {
+		rc = write(slm_upsch_log_fd, buf, len);
+		if (rc != (ssize_t)len)
+			psclog_error("upsch log write; rc=%zd", rc);
+		else if (fsync(slm_upsch_log_fd) == -1)
+			psclog_error("upsch log fsync");
+		else
+			slm_upsch_log_size += len;
+	}
+	PSCFREE(buf);
+}
+
+/*
+ * Replace the log with a snapshot of the live items.  Only called
+ * before slmupschlogthr is started or from slmupschlogthr itself.
+ */
+void
+upsch_log_compact(void)
+{
+	char fn[PATH_MAX], tmpfn[PATH_MAX];
+	struct slm_upsch_logrec *buf, *ulr;
+	struct slm_upsch_ent *ue;
+	struct psc_hashbkt *hb;
+	int fd, n = 0;
+	ssize_t rc;
+	size_t len;
+
+	xmkfn(fn, "%s/%s", sl_datadir, SL_FN_UPSCHLOG);
+	xmkfn(tmpfn, "%s/%s.tmp", sl_datadir, SL_FN_UPSCHLOG);
+
+	UPSCH_IDX_LOCK();
+	buf = PSCALLOC(MAX(1, slm_upsch_idx_nents) * sizeof(*buf));
+	PSC_HASHTBL_FOREACH_BUCKET(hb, &slm_upsch_enttbl) {
+		psc_hashbkt_lock(hb);
+		PSC_HASHBKT_FOREACH_ENTRY(&slm_upsch_enttbl, ue, hb) {
+			ulr = &buf[n++];
+			ulr->ulr_magic = SLM_UPSCH_LOG_MAGIC;
+			ulr->ulr_op = UPSCH_LOGOP_PUT;
+			upsch_ent_fillrec(ulr, ue);
+		}
+		psc_hashbkt_unlock(hb);
+	}
+	psc_assert(n == slm_upsch_idx_nents);
+
+	/* anything pending is covered by the snapshot */
+	slm_upsch_logbuf_len = 0;
+	UPSCH_IDX_ULOCK();
+
+	len = n * sizeof(*buf);
+	fd = open(tmpfn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		psc_fatal("open %s", tmpfn);
+	rc = write(fd, buf, len);
+	if (rc != (ssize_t)len)
+		psc_fatal("write %s; rc=%zd", tmpfn, rc);
+	if (fsync(fd) == -1)
+		psc_fatal("fsync %s", tmpfn);
+	close(fd);
+	PSCFREE(buf);
+
+	if (rename(tmpfn, fn) == -1)
+		psc_fatal("rename %s", tmpfn);
+
+	/* make the rename itself durable */
+	fd = open(sl_datadir, O_RDONLY);
+	if (fd == -1)
+		psc_fatal("open %s", sl_datadir);
+	if (fsync(fd) == -1)
+		psc_fatal("fsync %s", sl_datadir);
+	close(fd);
+
+	if (slm_upsch_log_fd != -1)
+		close(slm_upsch_log_fd);
+	upsch_log_open(fn, 0);
+	slm_upsch_log_size = len;
+
+	OPSTAT_INCR("upsch-log-compact");
+	psclog_diag("compacted upsch log to %d items", n);
+}
+
+void
+upsch_log_apply(const struct slm_upsch_logrec *ulr)
+{
+	struct sl_resource *r;
+
+	switch (ulr->ulr_op) {
+	case UPSCH_LOGOP_PUT:
+		r = libsl_id2res(ulr->ulr_resid);
+		if (r == NULL || !RES_ISFS(r))
+			break;
+		upsch_ent_put(r, ulr->ulr_fid, ulr->ulr_bno,
+		    ulr->ulr_uid, ulr->ulr_gid, ulr->ulr_status,
+		    ulr->ulr_sys_prio, ulr->ulr_usr_prio,
+		    ulr->ulr_nonce);
+		break;
+	case UPSCH_LOGOP_DEL:
+		upsch_ent_remove(ulr->ulr_resid, ulr->ulr_fid,
+		    ulr->ulr_bno);
+		break;
+	}
+}
+
+/*
+ * Rebuild the index from the on-disk log.  A torn or corrupt tail is
+ * discarded; the log is then rewritten so it starts out compact.
+ */
+void
+slm_upsch_idx_load(void)
+{
+	struct slm_upsch_logrec buf[256];
+	char fn[PATH_MAX];
+	int fd, i, nrec = 0;
+	ssize_t rc;
+
+	xmkfn(fn, "%s/%s", sl_datadir, SL_FN_UPSCHLOG);
+	fd = open(fn, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			psc_fatal("open %s", fn);
+		psclog_info("%s: not found; starting empty", fn);
+		goto out;
+	}
+
+	UPSCH_IDX_LOCK();
+	slm_upsch_log_replaying = 1;
+	while ((rc = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < rc / (ssize_t)sizeof(buf[0]); i++,
+		    nrec++) {
+			if (buf[i].ulr_magic != SLM_UPSCH_LOG_MAGIC)
+				break;
+			upsch_log_apply(&buf[i]);
+		}
+		if (i != rc / (ssize_t)sizeof(buf[0]) ||
+		    rc % sizeof(buf[0])) {
+			psclog_warnx("%s: discarding log after record %d",
+			    fn, nrec);
+			break;
+		}
+	}
+	if (rc == -1)
+		psc_fatal("read %s", fn);
+	slm_upsch_log_replaying = 0;
+	UPSCH_IDX_ULOCK();
+	close(fd);
+
+	psclog_info("%s: replayed %d records, %d pending updates", fn,
+	    nrec, slm_upsch_idx_nents);
+
+ out:
+	upsch_log_compact();
+}
+
+void
+slmupschlogthr_main(struct psc_thread *thr)
+{
+	while (pscthr_run(thr)) {
+		sleep(SLM_UPSCH_LOG_FLUSH);
+		upsch_log_flush();
+		if (slm_upsch_log_size > SLM_UPSCH_LOG_MINCOMPACT &&
+		    slm_upsch_log_size > 4 * (off_t)sizeof(struct
+		    slm_upsch_logrec) * slm_upsch_idx_nents)
+			upsch_log_compact();
+	}
+}
+
+void
+slm_upsch_idx_init(void)
+{
+	struct sl_mds_iosinfo *si;
+	struct sl_resource *r;
+	struct sl_site *s;
+	int i;
+
+	psc_poolmaster_init(&slm_upsch_ent_poolmaster,
+	    struct slm_upsch_ent, ue_lentry, PPMF_AUTO, 1024, 1024, 0,
+	    NULL, NULL, NULL, "upschent");
+	slm_upsch_ent_pool = psc_poolmaster_getmgr(
+	    &slm_upsch_ent_poolmaster);
+
+	psc_hashtbl_init(&slm_upsch_enttbl, 0, struct slm_upsch_ent,
+	    ue_fid, ue_hentry, SLM_UPSCH_NENTBKTS, slm_upsch_ent_hcmp,
+	    "upsch");
+	psc_hashtbl_init(&slm_upsch_bkttbl, 0, struct slm_upsch_bkt,
+	    ub_key, ub_hentry, SLM_UPSCH_NBKTBKTS, slm_upsch_bkt_hcmp,
+	    "upschbkt");
+
+	CONF_FOREACH_RES(s, r, i)
+		if (RES_ISFS(r)) {
+			si = res2iosinfo(r);
+			pfl_heap_init(&si->si_upsch_gheap,
+			    struct slm_upsch_bkt, ub_hpentry,
+			    slm_upsch_bkt_cmp);
+		}
+}
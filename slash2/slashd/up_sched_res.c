@@ -34,8 +34,6 @@
 #include <dirent.h>
 #include <stdio.h>
 
-#include <sqlite3.h>
-
 #include "pfl/cdefs.h"
 #include "pfl/ctlsvr.h"
 #include "pfl/dynarray.h"
@@ -64,6 +62,9 @@
 
 #include "zfs-fuse/zfs_slashlib.h"
 
+/* maximum number of updates paged in for a resource at a time */
+#define UPSCH_MAX_ITEMS_RES	32
+
 /* RPC callback numeric arg indexes */
 #define IN_RC		0
 #define IN_OFF		1
@@ -75,13 +76,15 @@
 #define IP_SRCRESM	2
 #define IP_BMAP		3
 
-struct psc_mlist	 slm_upschq;
-struct psc_multiwait	 slm_upsch_mw;
+struct slm_upsch_shard	 slm_upsch_shards[SLM_NUPSCHED_THREADS];
 struct psc_poolmaster	 slm_upgen_poolmaster;
 struct psc_poolmgr	*slm_upgen_pool;
 
 void (*upd_proctab[])(struct slm_update_data *);
 
+/* multiwait of the scheduler thread we are running in */
+#define upsch_curmw()	(&slmupschthr(pscthr_get())->sus_shard->uss_mw)
+
 void
 upd_rpmi_add(struct resprof_mds_info *rpmi, struct slm_update_data *upd)
 {
@@ -170,15 +173,9 @@ slm_batch_repl_cb(struct batchrq *br, int ecode)
 			OPSTAT2_ADD("replcompl", bsr->bsr_amt);
 		} else {
 			if (bp == NULL || bp->rc == SLERR_ION_OFFLINE) {
-				dbdo(NULL, NULL,
-				    " UPDATE	upsch"
-				    " SET	status = 'Q'"
-				    " WHERE	resid = ?"
-				    "   AND	fid = ?"
-				    "   AND	bno = ?",
-				    SQLITE_INTEGER, br->br_res->res_id,
-				    SQLITE_INTEGER64, bmap_2_fid(b),
-				    SQLITE_INTEGER, b->bcm_bmapno);
+				slm_upsch_idx_update(br->br_res->res_id,
+				    bmap_2_fid(b), b->bcm_bmapno,
+				    UPSCH_ST_QUEUED, -1, -1);
 				tract[BREPLST_REPL_SCHED] =
 				    BREPLST_REPL_QUEUED;
 			} else {
@@ -223,7 +220,7 @@ slm_batch_repl_cb(struct batchrq *br, int ecode)
  * Try arranging a REPL_SCHEDWK for a bmap between a source and dst IOS
  * pair.  We estimate the data to reserve bandwidth then add the entry
  * to a batch RPC for the destination.  We mark the bmap residency table
- * and update the upsch database to avoid reprocessing until we receive
+ * and update the upsch index to avoid reprocessing until we receive
  * success or failure status from the destination IOS.
  */
 int
@@ -260,9 +257,9 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 		 * unbusy" and "dst to become unbusy" conditions to
 		 * multiwait.
 		 */
-		psc_multiwait_setcondwakeable(&slm_upsch_mw,
+		psc_multiwait_setcondwakeable(upsch_curmw(),
 		    &src_resm->resm_csvc->csvc_mwc, 1);
-		psc_multiwait_setcondwakeable(&slm_upsch_mw,
+		psc_multiwait_setcondwakeable(upsch_curmw(),
 		    &dst_resm->resm_csvc->csvc_mwc, 1);
 
 		/* XXX push batch out immediately */
@@ -274,7 +271,7 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 	bsr->bsr_amt = amt;
 
 	csvc = slm_geticsvc(dst_resm, NULL, CSVCF_NONBLOCK |
-	    CSVCF_NORECON, &slm_upsch_mw);
+	    CSVCF_NORECON, upsch_curmw());
 	if (csvc == NULL)
 		PFL_GOTOERR(fail, rc = resm_getcsvcerr(dst_resm));
 
@@ -319,30 +316,15 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 	if (rc != BREPLST_REPL_QUEUED)
 		PFL_GOTOERR(fail, rc = -ENODEV);
 
-	dbdo(NULL, NULL,
-	    " UPDATE	upsch"
-	    " SET	status = 'S'"
-	    " WHERE	resid = ?"
-	    "   AND	fid = ?"
-	    "   AND	bno = ?",
-	    SQLITE_INTEGER, dst_res->res_id,
-	    SQLITE_INTEGER64, bmap_2_fid(b),
-	    SQLITE_INTEGER, b->bcm_bmapno);
+	slm_upsch_idx_update(dst_res->res_id, bmap_2_fid(b),
+	    b->bcm_bmapno, UPSCH_ST_SCHED, -1, -1);
 
 	rc = batchrq_add(dst_res, csvc, SRMT_REPL_SCHEDWK,
 	    SRMI_BULK_PORTAL, SRIM_BULK_PORTAL, &pe, sizeof(pe), bsr,
 	    slm_batch_repl_cb, 5);
 	if (rc) {
-		dbdo(NULL, NULL,
-		    " UPDATE	upsch"
-		    " SET	status = 'Q'"
-		    " WHERE	resid = ?"
-		    "   AND	fid = ?"
-		    "   AND	bno = ?",
-		    SQLITE_INTEGER, dst_res->res_id,
-		    SQLITE_INTEGER64, bmap_2_fid(b),
-		    SQLITE_INTEGER, b->bcm_bmapno);
-
+		slm_upsch_idx_update(dst_res->res_id, bmap_2_fid(b),
+		    b->bcm_bmapno, UPSCH_ST_QUEUED, -1, -1);
 		PFL_GOTOERR(fail, rc);
 	}
 
@@ -380,7 +362,7 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 
 	resmpair_bw_adj(src_resm, dst_resm, -bsr->bsr_amt, NULL);
 
-	UPSCH_WAKE();
+	upsch_wake();
 
 	PSCFREE(bsr);
 
@@ -415,7 +397,7 @@ slm_upsch_finish_ptrunc(struct slashrpc_cservice *csvc,
 		sl_csvc_decref(csvc);
 	if (b)
 		bmap_op_done_type(b, BMAP_OPCNT_UPSCH);
-	UPSCH_WAKE();
+	upsch_wake();
 }
 
 int
@@ -503,7 +485,7 @@ slm_upsch_tryptrunc(struct bmap *b, int off,
 		return (-1);
 
 	csvc = slm_geticsvc(dst_resm, NULL, CSVCF_NONBLOCK |
-	    CSVCF_NORECON, &slm_upsch_mw);
+	    CSVCF_NORECON, upsch_curmw());
 	if (csvc == NULL)
 		PFL_GOTOERR(fail, rc = resm_getcsvcerr(dst_resm));
 	av.pointer_arg[IP_CSVC] = csvc;
@@ -606,7 +588,7 @@ slm_upsch_trypreclaim(struct sl_resource *r, struct bmap *b, int off)
 
 	m = res_getmemb(r);
 	csvc = slm_geticsvc(m, NULL, CSVCF_NONBLOCK | CSVCF_NORECON,
-	    &slm_upsch_mw);
+	    upsch_curmw());
 	if (csvc == NULL)
 		PFL_GOTOERR(fail, rc = resm_getcsvcerr(m));
 
@@ -818,7 +800,7 @@ upd_proc_bmap(struct slm_update_data *upd)
 					csvc = slm_geticsvc(m, NULL,
 					    CSVCF_NONBLOCK |
 					    CSVCF_NORECON,
-					    &slm_upsch_mw);
+					    upsch_curmw());
 					if (csvc == NULL)
 						continue;
 					sl_csvc_decref(csvc);
@@ -928,34 +910,31 @@ upd_proc_pagein_unit(struct slm_update_data *upd)
 		fcmh_op_done(f);
 }
 
-int
-upd_pagein_wk(void *p)
+/*
+ * Page some work in for one resource.  The index hands out items in
+ * fair-share order: highest system priority first and, within that,
+ * round robin among groups then among users.
+ */
+void
+upd_pagein_res(struct sl_resource *r)
 {
-	struct slm_wkdata_upschq *wk = p;
+	struct slm_upsch_item v[UPSCH_MAX_ITEMS_RES];
 	struct slm_update_generic *upg;
-
-	upg = psc_pool_get(slm_upgen_pool);
-	memset(upg, 0, sizeof(*upg));
-	INIT_PSC_LISTENTRY(&upg->upg_lentry);
-	upd_init(&upg->upg_upd, UPDT_PAGEIN_UNIT);
-	upg->upg_fg.fg_fid = wk->fg.fg_fid;
-	upg->upg_fg.fg_gen = FGEN_ANY;
-	upg->upg_bno = wk->bno;
-	upsch_enqueue(&upg->upg_upd);
-	UPD_UNBUSY(&upg->upg_upd);
-	return (0);
-}
-
-int
-upd_proc_pagein_cb(struct slm_sth *sth, __unusedx void *p)
-{
-	struct slm_wkdata_upschq *wk;
-
-	wk = pfl_workq_getitem(upd_pagein_wk, struct slm_wkdata_upschq);
-	wk->fg.fg_fid = sqlite3_column_int64(sth->sth_sth, 0);
-	wk->bno = sqlite3_column_int(sth->sth_sth, 1);
-	pfl_workq_putitem(wk);
-	return (0);
+	int i, n;
+
+	n = slm_upsch_idx_pagein(r, v, nitems(v));
+	for (i = 0; i < n; i++) {
+		upg = psc_pool_get(slm_upgen_pool);
+		memset(upg, 0, sizeof(*upg));
+		INIT_PSC_LISTENTRY(&upg->upg_lentry);
+		upg->upg_resm = res_getmemb(r);
+		upg->upg_fg.fg_fid = v[i].usi_fid;
+		upg->upg_fg.fg_gen = FGEN_ANY;
+		upg->upg_bno = v[i].usi_bno;
+		upd_init(&upg->upg_upd, UPDT_PAGEIN_UNIT);
+		upsch_enqueue(&upg->upg_upd);
+		UPD_UNBUSY(&upg->upg_upd);
+	}
 }
 
 void
@@ -963,8 +942,11 @@ upd_proc_pagein(struct slm_update_data *upd)
 {
 	struct slm_update_generic *upg;
 	struct resprof_mds_info *rpmi;
+	struct slm_upsch_shard *uss;
 	struct sl_mds_iosinfo *si;
 	struct sl_resource *r;
+	struct sl_site *s;
+	int i;
 
 	upg = upd_getpriv(upd);
 	if (upg->upg_resm) {
@@ -975,69 +957,22 @@ upd_proc_pagein(struct slm_update_data *upd)
 		RPMI_LOCK(rpmi);
 		si->si_flags &= ~SIF_UPSCH_PAGING;
 		RPMI_ULOCK(rpmi);
+
+		upd_pagein_res(r);
+		return;
 	}
 
-	/*
-	 * Page some work in.  We make a heuristic here to avoid a large
-	 * number of operations inside the database callback.
-	 *
-	 * This algorithm suffers because each piece of work pulled in
-	 * is not technically fair.  But each invocation of this routine
-	 * selects a different user at random, so over time, no users
-	 * will starve.
-	 */
-	dbdo(upd_proc_pagein_cb, NULL,
-	    " SELECT	fid,"
-	    "		bno,"
-	    "		nonce"
-	    " FROM	upsch u,"
-	    "		gsort gs,"
-	    "		usort us"
-	    " WHERE	resid = IFNULL(?, resid)"
-	    "   AND	status = 'Q'"
-	    "	AND	gs.gid = u.gid"
-	    "	AND	us.uid = u.uid"
-	    " ORDER BY	sys_prio DESC,"
-	    "		gs.rnd,"
-	    "		us.rnd,"
-	    "		usr_prio DESC,"
-	    "		RANDOM()"
-	    " LIMIT	32",
-	    upg->upg_resm ? SQLITE_INTEGER : SQLITE_NULL,
-	    upg->upg_resm ? r->res_id : 0);
+	/* no resource given: page in for everyone this thread serves */
+	uss = slmupschthr(pscthr_get())->sus_shard;
+	CONF_FOREACH_RES(s, r, i)
+		if (RES_ISFS(r) && res2iosinfo(r)->si_upsch_shard == uss)
+			upd_pagein_res(r);
 }
 
-#if 0
-
-#define UPSCH_MAX_ITEMS_RES 32
-
-	dbdo(upd_proc_pagein_cb, NULL,
-	    " SELECT	fid,"
-	    "		bno,"
-	    "		nonce"
-	    " FROM	upsch,"
-	    " WHERE	resid = IFNULL(?, resid)"
-	    "   AND	status = 'Q'"
-	    "   AND	gid = (SELECT gid FROM gsort ORDER BY RANDOM())"
-	    " ORDER BY	sys_pri DESC,"
-	    "		usr_pri DESC,"
-	    "		RANDOM()"
-	    " LIMIT	?",
-	    upg->upg_resm ? SQLITE_INTEGER : SQLITE_NULL,
-	    upg->upg_resm ? r->res_id : 0,
-	    SQLITE_INTEGER, UPSCH_MAX_ITEMS_RES);
-
-#endif
-
 void
 upd_proc(struct slm_update_data *upd)
 {
 	struct slm_update_generic *upg;
-	int locked;
-
-	locked = UPSCH_HASLOCK();
-	if (locked)
-		UPSCH_ULOCK();
 
 	UPD_LOCK(upd);
 	UPD_WAIT(upd);
@@ -1048,9 +983,6 @@ upd_proc(struct slm_update_data *upd)
 	UPD_WAKE(upd);
 	UPD_ULOCK(upd);
 
-	if (locked)
-		UPSCH_LOCK();
-
 	switch (upd->upd_type) {
 	case UPDT_BMAP:
 		UPD_DECREF(upd);
@@ -1065,17 +997,15 @@ upd_proc(struct slm_update_data *upd)
 }
 
 int
-slm_upsch_revert_cb(struct slm_sth *sth, __unusedx void *p)
+slm_upsch_revert_cb(slfid_t fid, sl_bmapno_t bno)
 {
 	int rc, tract[NBREPLST], retifset[NBREPLST];
 	struct fidc_membh *f = NULL;
 	struct sl_fidgen fg;
 	struct bmap *b = NULL;
-	sl_bmapno_t bno;
 
-	fg.fg_fid = sqlite3_column_int64(sth->sth_sth, 0);
+	fg.fg_fid = fid;
 	fg.fg_gen = FGEN_ANY;
-	bno = sqlite3_column_int(sth->sth_sth, 1);
 
 	rc = slm_fcmh_get(&fg, &f);
 	if (rc)
@@ -1117,20 +1047,11 @@ slm_upsch_insert(struct bmap *b, sl_ios_id_t resid, int sys_prio,
 	r = libsl_id2res(resid);
 	if (r == NULL)
 		return;
-	dbdo(NULL, NULL,
-	    " INSERT INTO upsch ("
-	    "	resid, fid, bno, uid, gid, status, sys_prio, usr_prio, nonce "
-	    ") VALUES ("
-	    "	?,     ?,   ?,   ?,   ?,   'Q',    ?,        ?,        ?"
-	    ")",
-	    SQLITE_INTEGER, resid,
-	    SQLITE_INTEGER64, bmap_2_fid(b),
-	    SQLITE_INTEGER, b->bcm_bmapno,
-	    SQLITE_INTEGER, b->bcm_fcmh->fcmh_sstb.sst_uid,
-	    SQLITE_INTEGER, b->bcm_fcmh->fcmh_sstb.sst_gid,
-	    SQLITE_INTEGER, sys_prio,
-	    SQLITE_INTEGER, usr_prio,
-	    SQLITE_INTEGER, sl_sys_upnonce);
+	if (slm_upsch_idx_add(resid, bmap_2_fid(b), b->bcm_bmapno,
+	    b->bcm_fcmh->fcmh_sstb.sst_uid,
+	    b->bcm_fcmh->fcmh_sstb.sst_gid, sys_prio, usr_prio,
+	    sl_sys_upnonce))
+		return;
 	upschq_resm(res_getmemb(r), UPDT_PAGEIN);
 }
 
@@ -1138,27 +1059,29 @@ void
 slmupschthr_main(struct psc_thread *thr)
 {
 	struct slm_update_data *upd;
+	struct slm_upsch_shard *uss;
 	struct sl_resource *r;
 	struct sl_resm *m;
 	struct sl_site *s;
 	int i, j, rc;
 
+	uss = slmupschthr(thr)->sus_shard;
 	while (pscthr_run(thr)) {
 		CONF_FOREACH_RESM(s, r, i, m, j)
 			if (RES_ISFS(r))
-				psc_multiwait_setcondwakeable(&slm_upsch_mw,
+				psc_multiwait_setcondwakeable(
+				    &uss->uss_mw,
 				    &m->resm_csvc->csvc_mwc, 0);
 
-		UPSCH_LOCK();
-		psc_multiwait_entercritsect(&slm_upsch_mw);
-		upd = psc_mlist_tryget(&slm_upschq);
-		if (upd)
+		MLIST_LOCK(&uss->uss_q);
+		psc_multiwait_entercritsect(&uss->uss_mw);
+		upd = psc_mlist_tryget(&uss->uss_q);
+		MLIST_ULOCK(&uss->uss_q);
+		if (upd) {
 			upd_proc(upd);
-		UPSCH_ULOCK();
-		if (upd)
-			psc_multiwait_leavecritsect(&slm_upsch_mw);
-		else {
-			rc = psc_multiwait_secs(&slm_upsch_mw, &upd, 30);
+			psc_multiwait_leavecritsect(&uss->uss_mw);
+		} else {
+			rc = psc_multiwait_secs(&uss->uss_mw, &upd, 30);
 			if (rc == -ETIMEDOUT)
 				upschq_resm(NULL, UPDT_PAGEIN);
 		}
@@ -1168,37 +1091,63 @@ slmupschthr_main(struct psc_thread *thr)
 void
 slm_upsch_init(void)
 {
+	struct slm_upsch_shard *uss;
+	struct sl_resource *r;
+	struct sl_site *s;
+	int i, n = 0;
+
 	psc_poolmaster_init(&slm_upgen_poolmaster,
 	    struct slm_update_generic, upg_lentry, PPMF_AUTO, 64, 64, 0,
 	    NULL, NULL, NULL, "upgen");
 	slm_upgen_pool = psc_poolmaster_getmgr(&slm_upgen_poolmaster);
 
-	psc_mlist_reginit(&slm_upschq, NULL, struct slm_update_data,
-	    upd_lentry, "upschq");
+	for (i = 0; i < SLM_NUPSCHED_THREADS; i++) {
+		uss = &slm_upsch_shards[i];
+		psc_mlist_reginit(&uss->uss_q, NULL,
+		    struct slm_update_data, upd_lentry, "upschq%d", i);
+	}
+
+	/* spread the I/O systems evenly across scheduler threads */
+	CONF_FOREACH_RES(s, r, i)
+		if (RES_ISFS(r))
+			res2iosinfo(r)->si_upsch_shard =
+			    &slm_upsch_shards[n++ % SLM_NUPSCHED_THREADS];
+
+	slm_upsch_idx_init();
 }
 
 void
 slmupschthr_spawn(void)
 {
+	struct slm_upsch_shard *uss;
 	struct psc_thread *thr;
 	struct sl_resource *r;
 	struct sl_site *s;
 	struct sl_resm *m;
-	int i, j;
-
-	psc_multiwait_init(&slm_upsch_mw, "upsch");
-	if (psc_multiwait_addcond(&slm_upsch_mw,
-	    &slm_upschq.pml_mwcond_empty) == -1)
-		psc_fatal("psc_multiwait_addcond");
+	int i, j, k;
 
-	CONF_FOREACH_RESM(s, r, i, m, j)
-		if (RES_ISFS(r))
-			psc_multiwait_addcond(&slm_upsch_mw,
-			    &m->resm_csvc->csvc_mwc);
+	for (k = 0; k < SLM_NUPSCHED_THREADS; k++) {
+		uss = &slm_upsch_shards[k];
+		psc_multiwait_init(&uss->uss_mw, "upsch%d", k);
+		if (psc_multiwait_addcond(&uss->uss_mw,
+		    &uss->uss_q.pml_mwcond_empty) == -1)
+			psc_fatal("psc_multiwait_addcond");
 
-	thr = pscthr_init(SLMTHRT_UPSCHED, slmupschthr_main, NULL,
-	    sizeof(struct slmupsch_thread), "slmupschthr");
-	pscthr_setready(thr);
+		/*
+		 * Bmap updates may involve any I/O system, so every
+		 * thread watches every connection.
+		 */
+		CONF_FOREACH_RESM(s, r, i, m, j)
+			if (RES_ISFS(r))
+				psc_multiwait_addcond(&uss->uss_mw,
+				    &m->resm_csvc->csvc_mwc);
+
+		thr = pscthr_init(SLMTHRT_UPSCHED, slmupschthr_main,
+		    NULL, sizeof(struct slmupsch_thread),
+		    "slmupschthr%d", k);
+		slmupschthr(thr)->sus_shard = uss;
+		pscthr_setready(thr);
+	}
 
 	/* page in initial replrq workload */
 	CONF_FOREACH_RES(s, r, i)
@@ -1291,38 +1240,65 @@ slm_wk_upsch_purge(void *p)
 {
 	struct slm_wkdata_upsch_purge *wk = p;
 
-	if (wk->bno == BMAPNO_ANY)
-		dbdo(NULL, NULL,
-		    " DELETE FROM	upsch"
-		    " WHERE		fid = ?",
-		    SQLITE_INTEGER64, wk->fid);
-	else
-		dbdo(NULL, NULL,
-		    " DELETE FROM	upsch"
-		    " WHERE		fid = ?"
-		    "	AND		bno = ?",
-		    SQLITE_INTEGER64, wk->fid,
-		    SQLITE_INTEGER, wk->bno);
+	slm_upsch_idx_remove(IOS_ID_ANY, wk->fid, wk->bno);
 	return (0);
 }
 
+/*
+ * Pick the scheduler thread to process an update.  Work for a given
+ * I/O system goes to the thread serving it; bmap updates stay with the
+ * thread that paged them in, or are spread by file ID otherwise.
+ */
+struct slm_upsch_shard *
+upsch_pickshard(struct slm_update_data *upd)
+{
+	struct slm_update_generic *upg;
+	struct psc_thread *thr;
+
+	if (upd->upd_type != UPDT_BMAP) {
+		upg = upd_getpriv(upd);
+		if (upg->upg_resm)
+			return (res2iosinfo(upg->upg_resm->resm_res)->
+			    si_upsch_shard);
+	}
+	thr = pscthr_get();
+	if (thr->pscthr_type == SLMTHRT_UPSCHED)
+		return (slmupschthr(thr)->sus_shard);
+	if (upd->upd_type == UPDT_BMAP)
+		return (&slm_upsch_shards[upd_2_fcmh(upd)->fcmh_fg.fg_fid %
+		    SLM_NUPSCHED_THREADS]);
+	return (&slm_upsch_shards[0]);
+}
+
 void
 upsch_enqueue(struct slm_update_data *upd)
 {
+	struct slm_upsch_shard *uss;
 	int locked;
 
 	locked = UPD_RLOCK(upd);
-	if (!psc_mlist_conjoint(&slm_upschq, upd)) {
+	if (psclist_disjoint(&upd->upd_lentry)) {
+		uss = upsch_pickshard(upd);
 		if (upd->upd_type == UPDT_BMAP &&
 		    (upd_2_fcmh(upd)->fcmh_flags & FCMH_MDS_IN_PTRUNC) == 0)
-			psc_mlist_addtail(&slm_upschq, upd);
+			psc_mlist_addtail(&uss->uss_q, upd);
 		else
-			psc_mlist_addhead(&slm_upschq, upd);
+			psc_mlist_addhead(&uss->uss_q, upd);
 		UPD_INCREF(upd);
 	}
 	UPD_URLOCK(upd, locked);
 }
 
+void
+upsch_wake(void)
+{
+	int i;
+
+	for (i = 0; i < SLM_NUPSCHED_THREADS; i++)
+		psc_multiwaitcond_wakeup(
+		    &slm_upsch_shards[i].uss_q.pml_mwcond_empty);
+}
+
 void *
 upd_getpriv(struct slm_update_data *upd)
 {
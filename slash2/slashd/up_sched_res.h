@@ -22,17 +22,21 @@
 
 /*
  * Update scheduler: this component manages updates to I/O systems such
- * as file chunks to replicate and garbage reclamation.  One thread is
- * spawned per site to watch over activity destined for any I/O system
- * contained therein.
+ * as file chunks to replicate and garbage reclamation.  Work is split
+ * among SLM_NUPSCHED_THREADS threads, each owning a share of the I/O
+ * systems, to watch over activity destined for them.
  */
 
 #ifndef _UP_SCHED_RES_H_
 #define _UP_SCHED_RES_H_
 
+#include "pfl/mlist.h"
+#include "pfl/multiwait.h"
+
 #include "subsys_mds.h"
 
-#include <sqlite3.h>
+struct psc_dynarray;
+struct psc_thread;
 
 struct slm_update_data {
 	int				 upd_type:4;
@@ -150,8 +154,27 @@ struct slm_update_generic {
 
 #define upd_init(upd, type)	upd_initf((upd), (type), 0)
 
+/* upsch index item status */
+#define UPSCH_ST_QUEUED			'Q'		/* waiting to be arranged */
+#define UPSCH_ST_SCHED			'S'		/* handed to the IOS */
+
+/* pending update as reported by the upsch index */
+struct slm_upsch_item {
+	slfid_t				 usi_fid;
+	sl_bmapno_t			 usi_bno;
+	sl_ios_id_t			 usi_resid;
+	uint32_t			 usi_nonce;
+};
+
+/* a scheduler thread and the update queue it services */
+struct slm_upsch_shard {
+	struct psc_mlist		 uss_q;
+	struct psc_multiwait		 uss_mw;
+};
+
 void	 upsch_enqueue(struct slm_update_data *);
 void	 upsch_purge(slfid_t);
+void	 upsch_wake(void);
 void	 upschq_resm(struct sl_resm *, int);
 
 int	 slm_wk_upsch_purge(void *);
@@ -160,32 +183,29 @@ void	 slm_upsch_init(void);
 void	 slmupschthr_spawn(void);
 
 void	 slm_upsch_insert(struct bmap *, sl_ios_id_t, int, int);
-int	 slm_upsch_revert_cb(struct slm_sth *, void *);
+int	 slm_upsch_revert_cb(slfid_t, sl_bmapno_t);
 
 void	 upd_initf(struct slm_update_data *, int, int);
 void	 upd_destroy(struct slm_update_data *);
 void	*upd_getpriv(struct slm_update_data *);
 void	 upd_rpmi_remove(struct resprof_mds_info *, struct slm_update_data *);
 
-#define UPSCH_LOCK()		MLIST_LOCK(&slm_upschq)
-#define UPSCH_ULOCK()		MLIST_ULOCK(&slm_upschq)
-#define UPSCH_HASLOCK()		MLIST_HASLOCK(&slm_upschq)
-#define UPSCH_RLOCK()		MLIST_REQLOCK(&slm_upschq)
-#define UPSCH_URLOCK(lk)	MLIST_URLOCK(&slm_upschq, (lk))
-#define UPSCH_LOCK_ENSURE()	MLIST_LOCK_ENSURE(&slm_upschq)
-#define UPSCH_WAKE()		psc_multiwaitcond_wakeup(&slm_upschq.pml_mwcond_empty)
-
-extern struct psc_mlist		 slm_upschq;
-
-struct slm_sth {
-	struct pfl_hashentry	 sth_hentry;
-	const char		*sth_fmt;
-	sqlite3_stmt		*sth_sth;
-	struct pfl_mutex	 sth_mutex;
-};
-
-#ifndef SQLITE_INTEGER64
-#define SQLITE_INTEGER64 (SQLITE_INTEGER + 1000)
-#endif
+int	 slm_upsch_idx_add(sl_ios_id_t, slfid_t, sl_bmapno_t, uint32_t,
+	    uint32_t, int, int, uint32_t);
+int	 slm_upsch_idx_getbmap(slfid_t, sl_bmapno_t,
+	    struct slm_upsch_item *, int);
+void	 slm_upsch_idx_getfids(struct psc_dynarray *);
+void	 slm_upsch_idx_init(void);
+void	 slm_upsch_idx_load(void);
+int	 slm_upsch_idx_pagein(struct sl_resource *,
+	    struct slm_upsch_item *, int);
+void	 slm_upsch_idx_remove(sl_ios_id_t, slfid_t, sl_bmapno_t);
+void	 slm_upsch_idx_revert(int (*)(slfid_t, sl_bmapno_t));
+void	 slm_upsch_idx_setnonce(slfid_t, sl_bmapno_t, uint32_t);
+void	 slm_upsch_idx_update(sl_ios_id_t, slfid_t, sl_bmapno_t, int,
+	    int, int);
+void	 slmupschlogthr_main(struct psc_thread *);
+
+extern struct slm_upsch_shard	 slm_upsch_shards[];
 
 #endif /* _UP_SCHED_RES_H_ */
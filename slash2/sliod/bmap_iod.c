@@ -40,6 +40,8 @@ struct bmap_iod_minseq	 bimSeq;
 static struct timespec	 bim_timeo = { BIM_MINAGE, 0 };
 
 struct psc_listcache	 sli_bmap_releaseq;
+struct psc_waitq	 sli_bmap_rls_waitq = PSC_WAITQ_INIT;
+psc_atomic32_t		 sli_bmap_rls_npending;	/* queued in bii_rls */
 
 struct psc_poolmaster    bmap_rls_poolmaster;
 struct psc_poolmgr	*bmap_rls_pool;
@@ -177,24 +179,82 @@ bim_getcurseq(void)
 	return (seqno);
 }
 
+/*
+ * Make a bcr eligible for transmission by placing it on the age-ordered
+ * heap consumed by slicrudthr_main().  Only the oldest unacknowledged
+ * bcr of a bmap is ever scheduled.
+ */
+void
+bcr_ready_sched(struct bcrcupd *bcr)
+{
+	BII_LOCK_ENSURE(bcr->bcr_bii);
+
+	spinlock(&sli_bcr_lock);
+	psc_assert((bcr->bcr_flags & BCRF_QUEUED) == 0);
+	bcr->bcr_flags |= BCRF_QUEUED;
+	pfl_heap_add(&sli_bcr_heap, bcr);
+	psc_waitq_wakeone(&sli_bcr_waitq);
+	freelock(&sli_bcr_lock);
+}
+
 void
 bcr_ready_add(struct bcrcupd *bcr)
 {
+	struct bmap_iod_info *bii = bcr->bcr_bii;
+	int first;
+
 	DEBUG_BCR(PLL_DIAG, bcr, "bcr add");
 
-	BII_LOCK_ENSURE(bcr->bcr_bii);
-	lc_addtail(&bcr_ready, bcr);
+	BII_LOCK_ENSURE(bii);
 	bmap_op_start_type(bcr_2_bmap(bcr), BMAP_OPCNT_BCRSCHED);
+
+	first = psc_listhd_empty(&bii->bii_bcrq);
+	psclist_add_tail(&bcr->bcr_lentry, &bii->bii_bcrq);
+	if (first)
+		bcr_ready_sched(bcr);
+}
+
+/*
+ * A bcr has filled up; there is no point in letting it age any longer.
+ */
+void
+bcr_ready_expedite(struct bcrcupd *bcr)
+{
+	BII_LOCK_ENSURE(bcr->bcr_bii);
+
+	spinlock(&sli_bcr_lock);
+	bcr->bcr_flags |= BCRF_EXPEDITE;
+	if (bcr->bcr_flags & BCRF_QUEUED) {
+		pfl_heap_reseat(&sli_bcr_heap, bcr);
+		psc_waitq_wakeone(&sli_bcr_waitq);
+	}
+	freelock(&sli_bcr_lock);
 }
 
+/*
+ * Discard an acknowledged (or obsolete) bcr and schedule the next one
+ * of its bmap, if any.  The bmap must be locked and is unlocked upon
+ * return.
+ */
 void
 bcr_ready_remove(struct bcrcupd *bcr)
 {
+	struct bmap_iod_info *bii = bcr->bcr_bii;
+	struct bcrcupd *next;
+
 	DEBUG_BCR(PLL_DIAG, bcr, "bcr remove");
 
-	lc_remove(&bcr_ready, bcr);
+	BII_LOCK_ENSURE(bii);
+	psc_assert((bcr->bcr_flags & BCRF_QUEUED) == 0);
+	psc_assert(psc_listhd_first(&bii->bii_bcrq) == &bcr->bcr_lentry);
+
+	psclist_del(&bcr->bcr_lentry, &bii->bii_bcrq);
+	next = psc_listhd_first_obj(&bii->bii_bcrq, struct bcrcupd,
+	    bcr_lentry);
+	if (next)
+		bcr_ready_sched(next);
 
-	bmap_op_done_type(bcr_2_bmap(bcr), BMAP_OPCNT_BCRSCHED);
+	bmap_op_done_type(bii_2_bmap(bii), BMAP_OPCNT_BCRSCHED);
 	psc_pool_return(bmap_crcupd_pool, bcr);
 }
 
@@ -236,6 +296,7 @@ slibmaprlsthr_main(struct psc_thread *thr)
 				    &brls->bir_sbd, sizeof(struct
 				    srt_bmapdesc));
 				psc_pool_return(bmap_rls_pool, brls);
+				psc_atomic32_dec(&sli_bmap_rls_npending);
 				if (nrls >= MAX_BMAP_RELEASE)
 					break;
 			}
@@ -258,7 +319,17 @@ slibmaprlsthr_main(struct psc_thread *thr)
 		psc_dynarray_reset(&a);
 
 		if (!nrls) {
-			sleep(SLIOD_BMAP_RLS_WAIT_SECS);
+			/*
+			 * With no bmaps cached there is nothing to do
+			 * until one is instantiated.  Otherwise give
+			 * clients time to return more leases, unless a
+			 * full batch shows up first.
+			 */
+			if (lc_nitems(&sli_bmap_releaseq))
+				psc_waitq_waitrel_s(&sli_bmap_rls_waitq,
+				    NULL, SLIOD_BMAP_RLS_WAIT_SECS);
+			else
+				lc_peekheadwait(&sli_bmap_releaseq);
 			continue;
 		}
 
@@ -315,6 +386,7 @@ iod_bmap_init(struct bmap *b)
 
 	memset(bii, 0, sizeof(*bii));
 	INIT_PSC_LISTENTRY(&bii->bii_lentry);
+	INIT_PSCLIST_HEAD(&bii->bii_bcrq);
 	SPLAY_INIT(&bii->bii_slvrs);
 
 	pll_init(&bii->bii_rls, struct bmap_iod_rls, bir_lentry, NULL);
@@ -335,6 +407,7 @@ iod_bmap_finalcleanup(struct bmap *b)
 	bii = bmap_2_bii(b);
 
 	psc_assert(pll_empty(&bii->bii_rls));
+	psc_assert(psc_listhd_empty(&bii->bii_bcrq));
 	psc_assert(SPLAY_EMPTY(&bii->bii_slvrs));
 	psc_assert(psclist_disjoint(&bii->bii_lentry));
 }
@@ -25,7 +25,9 @@
 
 #include <sys/time.h>
 
+#include "pfl/atomic.h"
 #include "pfl/bitflag.h"
+#include "pfl/heap.h"
 #include "pfl/list.h"
 #include "pfl/listcache.h"
 #include "pfl/lock.h"
@@ -41,10 +43,15 @@ struct slvr;
 struct bcrcupd {
 	struct timespec		 bcr_age;
 	struct bmap_iod_info	*bcr_bii;
-	struct psc_listentry	 bcr_lentry;
+	struct psc_listentry	 bcr_lentry;	/* bii_bcrq */
+	struct pfl_heap_entry	 bcr_hpentry;	/* sli_bcr_heap */
+	int			 bcr_flags;	/* under sli_bcr_lock */
 	struct srt_bmap_crcup	 bcr_crcup;
 };
 
+#define BCRF_QUEUED		(1 << 0)	/* on sli_bcr_heap */
+#define BCRF_EXPEDITE		(1 << 1)	/* full, send without aging */
+
 #define bcr_2_bmap(bcr)		bii_2_bmap((bcr)->bcr_bii)
 
 struct bmap_iod_minseq {
@@ -95,9 +102,24 @@ struct bmap_iod_info {
 	 */
 	struct bcrcupd		*bii_bcr;
 
+	/*
+	 * All bcrcupd structures of this bmap not yet acknowledged by
+	 * the MDS, oldest first.  Only the head is eligible to be sent
+	 * so updates for a bmap arrive in order.
+	 */
+	struct psclist_head	 bii_bcrq;
+
 	struct biod_slvrtree	 bii_slvrs;
 	struct psc_listentry	 bii_lentry;
 	struct psc_lockedlist	 bii_rls;	/* leases */
+
+	/* sequential read detection, see slvr_readahead() */
+	uint32_t		 bii_ra_last;	/* last sliver read */
+	uint32_t		 bii_ra_issued;	/* prefetched up to here */
+	int32_t			 bii_ra_win;	/* window in slivers */
+
+	/* slivers with a cache bypass in flight, see sli_dio_begin() */
+	uint8_t			 bii_dioslvrs[SLASH_SLVRS_PER_BMAP / NBBY];
 };
 
 /* sliod-specific bcm_flags */
@@ -124,13 +146,16 @@ struct bmap_iod_info {
 
 #define CRC_QUEUE_AGE		2	/* time wait on CRC queue in seconds */
 #define BCR_BATCH_AGE		12	/* time wait for BCR batching in seconds */
+#define BCR_MAX_INFL		128	/* CRC update RPCs inflight per MDS */
 
 uint64_t	bim_getcurseq(void);
 void		bim_init(void);
 int		bim_updateseq(uint64_t);
 
 void		bcr_ready_add(struct bcrcupd *);
+void		bcr_ready_expedite(struct bcrcupd *);
 void		bcr_ready_remove(struct bcrcupd *);
+void		bcr_ready_sched(struct bcrcupd *);
 
 void		slibmaprlsthr_spawn(void);
 
@@ -142,7 +167,11 @@ extern struct psc_poolmgr	*bmap_rls_pool;
 extern struct psc_poolmaster	 bmap_crcupd_poolmaster;
 extern struct psc_poolmgr	*bmap_crcupd_pool;
 
-extern struct psc_listcache	 bcr_ready;
+extern psc_spinlock_t		 sli_bcr_lock;
+extern struct pfl_heap		 sli_bcr_heap;
+extern struct psc_waitq		 sli_bcr_waitq;
+extern struct psc_waitq		 sli_bmap_rls_waitq;
+extern psc_atomic32_t		 sli_bmap_rls_npending;
 
 static __inline struct bmap *
 bii_2_bmap(struct bmap_iod_info *bii)
@@ -492,32 +492,41 @@ slictlrep_getreplwkst(int fd, struct psc_ctlmsghdr *mh, void *m)
 	return (rc);
 }
 
+struct slictl_slvrarg {
+	int			 fd;
+	struct psc_ctlmsghdr	*mh;
+	struct slictlmsg_slvr	*ss;
+};
+
+__static int
+slictl_sendslvr(struct slvr_2q_ent *e, void *arg)
+{
+	struct slictl_slvrarg *sa = arg;
+	struct slictlmsg_slvr *ss = sa->ss;
+	struct slvr *s = slvr_from_2qent(e);
+
+	memset(ss, 0, sizeof(*ss));
+	ss->ss_fid = fcmh_2_fid(slvr_2_fcmh(s));
+	ss->ss_bno = slvr_2_bmap(s)->bcm_bmapno;
+	ss->ss_slvrno = s->slvr_num;
+	ss->ss_flags = s->slvr_flags;
+	ss->ss_refcnt = s->slvr_refcnt;
+	ss->ss_err = s->slvr_err;
+	ss->ss_ts.tv_sec = s->slvr_ts.tv_sec;
+	ss->ss_ts.tv_nsec = s->slvr_ts.tv_nsec;
+
+	return (!psc_ctlmsg_sendv(sa->fd, sa->mh, ss));
+}
+
 int
 slictlrep_getslvr(int fd, struct psc_ctlmsghdr *mh, void *m)
 {
-	struct slictlmsg_slvr *ss = m;
-	struct slvr *s;
-	int rc;
+	struct slictl_slvrarg sa;
 
-	rc = 1;
-	LIST_CACHE_LOCK(&sli_lruslvrs);
-	LIST_CACHE_FOREACH(s, &sli_lruslvrs) {
-		memset(ss, 0, sizeof(*ss));
-		ss->ss_fid = fcmh_2_fid(slvr_2_fcmh(s));
-		ss->ss_bno = slvr_2_bmap(s)->bcm_bmapno;
-		ss->ss_slvrno = s->slvr_num;
-		ss->ss_flags = s->slvr_flags;
-		ss->ss_refcnt = s->slvr_refcnt;
-		ss->ss_err = s->slvr_err;
-		ss->ss_ts.tv_sec = s->slvr_ts.tv_sec;
-		ss->ss_ts.tv_nsec = s->slvr_ts.tv_nsec;
-
-		rc = psc_ctlmsg_sendv(fd, mh, ss);
-		if (!rc)
-			break;
-	}
-	LIST_CACHE_ULOCK(&sli_lruslvrs);
-	return (rc);
+	sa.fd = fd;
+	sa.mh = mh;
+	sa.ss = m;
+	return (!slvr_2q_walk(&sli_slvrcache, slictl_sendslvr, &sa));
 }
 
 int
@@ -592,6 +601,33 @@ slictlcmd_stop(__unusedx int fd, __unusedx struct psc_ctlmsghdr *mh,
 	exit(0);
 }
 
+const char *sli_slvr_policy_names[] = {
+	"2q",
+	"lru"
+};
+
+void
+slictlparam_slvr_policy_get(char *val)
+{
+	strlcpy(val, sli_slvr_policy_names[sli_slvrcache.sq_policy],
+	    PCP_VALUE_MAX);
+}
+
+int
+slictlparam_slvr_policy_set(const char *val)
+{
+	int i;
+
+	for (i = 0; i < SLVR_2QP_MAX; i++)
+		if (strcmp(val, sli_slvr_policy_names[i]) == 0) {
+			SLVR_2Q_LOCK(&sli_slvrcache);
+			sli_slvrcache.sq_policy = i;
+			SLVR_2Q_ULOCK(&sli_slvrcache);
+			return (0);
+		}
+	return (-1);
+}
+
 void
 sliriithr_get(struct psc_thread *thr, struct psc_ctlmsg_thread *pcst)
 {
@@ -662,12 +698,16 @@ slictlthr_main(const char *fn)
 
 	psc_ctlparam_register_var("sys.bminseqno", PFLCTL_PARAMT_UINT64,
 	    0, &bimSeq.bim_minseq);
+	psc_ctlparam_register_var("sys.readahead_max",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_readahead_max);
 	psc_ctlparam_register_var("sys.reclaim_batchno",
 	    PFLCTL_PARAMT_UINT64, 0, &current_reclaim_batchno);
 	psc_ctlparam_register_var("sys.reclaim_xid",
 	    PFLCTL_PARAMT_UINT64, 0, &current_reclaim_xid);
 	psc_ctlparam_register_var("sys.selftestrc", PFLCTL_PARAMT_INT,
 	    0, &sli_selftest_rc);
+	psc_ctlparam_register_simple("sys.slvr_policy",
+	    slictlparam_slvr_policy_get, slictlparam_slvr_policy_set);
 
 	psc_ctlthr_main(fn, slictlops, nitems(slictlops), SLITHRT_CTLAC);
 }
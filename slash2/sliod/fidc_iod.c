@@ -114,9 +114,46 @@ sli_open_backing_file(struct fidc_membh *f)
 		OPSTAT_INCR("open-succeed");
 	psclog(lvl, "opened backing file path=%s fd=%d rc=%d",
 	    strstr(fidfn, SL_RPATH_FIDNS_DIR), fcmh_2_fd(f), rc);
+
+	/*
+	 * Large aligned transfers may bypass the sliver cache, see
+	 * sli_ric_handle_dio().  Not every backing file system
+	 * supports O_DIRECT, in which case everything goes through
+	 * the cache.
+	 */
+	fcmh_2_fii(f)->fii_dio_fd = -1;
+	if (rc == 0 && slcfg_local->cfg_direct_io_min) {
+		incr = psc_rlim_adj(RLIMIT_NOFILE, 1);
+		fcmh_2_fii(f)->fii_dio_fd = open(fidfn,
+		    O_RDWR | O_DIRECT);
+		if (fcmh_2_fii(f)->fii_dio_fd == -1) {
+			if (incr)
+				psc_rlim_adj(RLIMIT_NOFILE, -1);
+			OPSTAT_INCR("open-dio-fail");
+		}
+	}
 	return (rc);
 }
 
+void
+sli_close_backing_file(struct fidc_membh *f)
+{
+	if (close(fcmh_2_fd(f)) == -1) {
+		OPSTAT_INCR("close-fail");
+		DEBUG_FCMH(PLL_ERROR, f, "close errno=%d", errno);
+	} else
+		OPSTAT_INCR("close-succeed");
+	fcmh_2_fd(f) = -1;
+	psc_rlim_adj(RLIMIT_NOFILE, -1);
+
+	if (fcmh_2_fii(f)->fii_dio_fd != -1) {
+		close(fcmh_2_fii(f)->fii_dio_fd);
+		fcmh_2_fii(f)->fii_dio_fd = -1;
+		psc_rlim_adj(RLIMIT_NOFILE, -1);
+	}
+	f->fcmh_flags &= ~FCMH_IOD_BACKFILE;
+}
+
 int
 sli_fcmh_getattr(struct fidc_membh *f)
 {
@@ -204,18 +241,8 @@ sli_fcmh_reopen(struct fidc_membh *f, slfgen_t fgen)
 		 * Need to reopen the backing file and possibly remove
 		 * the old one.
 		 */
-		if (f->fcmh_flags & FCMH_IOD_BACKFILE) {
-			if (close(fcmh_2_fd(f)) == -1) {
-				OPSTAT_INCR("close-fail");
-				DEBUG_FCMH(PLL_ERROR, f,
-				    "reopen/close errno=%d", errno);
-			} else {
-				OPSTAT_INCR("close-succeed");
-			}
-			fcmh_2_fd(f) = -1;
-			psc_rlim_adj(RLIMIT_NOFILE, -1);
-			f->fcmh_flags &= ~FCMH_IOD_BACKFILE;
-		}
+		if (f->fcmh_flags & FCMH_IOD_BACKFILE)
+			sli_close_backing_file(f);
 
 		oldfg.fg_fid = fcmh_2_fid(f);
 		oldfg.fg_gen = fcmh_2_gen(f);
@@ -281,16 +308,8 @@ sli_fcmh_ctor(struct fidc_membh *f, __unusedx int flags)
 void
 sli_fcmh_dtor(__unusedx struct fidc_membh *f)
 {
-	if (f->fcmh_flags & FCMH_IOD_BACKFILE) {
-		if (close(fcmh_2_fd(f)) == -1) {
-			OPSTAT_INCR("close-fail");
-			DEBUG_FCMH(PLL_ERROR, f,
-			    "dtor/close errno=%d", errno);
-		} else
-			OPSTAT_INCR("close-succeed");
-		psc_rlim_adj(RLIMIT_NOFILE, -1);
-		f->fcmh_flags &= ~FCMH_IOD_BACKFILE;
-	}
+	if (f->fcmh_flags & FCMH_IOD_BACKFILE)
+		sli_close_backing_file(f);
 }
 
 struct sl_fcmh_ops sl_fcmh_ops = {
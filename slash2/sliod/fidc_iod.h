@@ -33,6 +33,7 @@ struct fidc_membh;
 
 struct fcmh_iod_info {
 	int			fii_fd;		/* open file descriptor */
+	int			fii_dio_fd;	/* O_DIRECT descriptor or -1 */
 };
 
 /* sliod-specific fcmh_flags */
@@ -59,6 +60,7 @@ fii_2_fcmh(struct fcmh_iod_info *fii)
 #define sli_fcmh_get(fgp, fp)	sl_fcmh_get_fg((fgp), (fp))
 #define sli_fcmh_peek(fgp, fp)  sl_fcmh_peek_fg((fgp), (fp))
 
+void	sli_close_backing_file(struct fidc_membh *);
 void	sli_fg_makepath(const struct sl_fidgen *, char *);
 int	sli_fcmh_getattr(struct fidc_membh *);
 
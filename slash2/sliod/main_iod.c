@@ -268,7 +268,7 @@ main(int argc, char *argv[])
 	slcfg_local->cfg_fidcachesz = 4096;
 	slcfg_parse(cfn);
 	authbuf_checkkeyfile();
-	authbuf_readkeyfile();
+	authbuf_readkeyfile(slcfg_local->cfg_bulk_auth);
 
 	libsl_init((SLI_RIM_NBUFS + SLI_RIC_NBUFS + SLI_RII_NBUFS) * 2);
 
@@ -86,6 +86,86 @@ sli_ric_write_sliver(uint32_t off, uint32_t size, struct slvr **slvrs,
 	return (rc);
 }
 
+/*
+ * Serve a whole-sliver transfer straight from or to the backing file,
+ * bypassing the sliver cache.  The sliver has been fenced off from the
+ * cache by sli_dio_begin().
+ * @b: bmap, locked on entry and return.
+ */
+__static int
+sli_ric_handle_dio(struct pscrpc_request *rq, struct srm_io_req *mq,
+    struct bmap *b, enum rw rw)
+{
+	struct bmap_iod_info *bii = bmap_2_bii(b);
+	struct sli_diobuf *db;
+	uint32_t slvrno;
+	struct iovec iov;
+	uint8_t crcbits;
+	uint64_t crc;
+	ssize_t rv;
+	off_t foff;
+	int fd, rc;
+
+	slvrno = mq->offset / SLASH_SLVR_SIZE;
+	fd = fcmh_2_fii(b->bcm_fcmh)->fii_dio_fd;
+	foff = (off_t)b->bcm_bmapno * SLASH_BMAP_SIZE + mq->offset;
+	BMAP_ULOCK(b);
+
+	db = sli_diobuf_get();
+	iov.iov_base = db->db_base;
+	iov.iov_len = mq->size;
+
+	if (rw == SL_READ) {
+		OPSTAT_INCR("dio-read");
+		rv = sli_dio_read(fd, db, foff, &crc);
+		if (rv < 0)
+			PFL_GOTOERR(out, rc = rv);
+		pfl_opstat_add(sli_backingstore_iostats.rd, rv);
+
+		BMAP_LOCK(b);
+		crcbits = bii->bii_crcstates[slvrno];
+		if (!(crcbits & BMAP_SLVR_CRCABSENT) &&
+		    (crcbits & BMAP_SLVR_DATA) &&
+		    (crcbits & BMAP_SLVR_CRC) &&
+		    crc != bii->bii_crcs[slvrno]) {
+			OPSTAT_INCR("dio-read-crc-bad");
+			DEBUG_BMAP(PLL_ERROR, b, "bad crc slvr=%u", slvrno);
+		}
+		BMAP_ULOCK(b);
+
+		rc = slrpc_bulkserver(rq, BULK_PUT_SOURCE,
+		    SRIC_BULK_PORTAL, &iov, 1);
+	} else {
+		OPSTAT_INCR("dio-write");
+		rc = slrpc_bulkserver(rq, BULK_GET_SINK,
+		    SRIC_BULK_PORTAL, &iov, 1);
+		if (rc)
+			PFL_GOTOERR(out, rc);
+		rc = sli_dio_write(fd, db, foff, &crc);
+		if (rc)
+			PFL_GOTOERR(out, rc);
+		pfl_opstat_add(sli_backingstore_iostats.wr,
+		    SLASH_SLVR_SIZE);
+
+		/* The CRC was taken inline; no need to queue the slvr. */
+		BMAP_LOCK(b);
+		bii->bii_crcs[slvrno] = crc;
+		bii->bii_crcstates[slvrno] |= BMAP_SLVR_DATA |
+		    BMAP_SLVR_CRC;
+		slvr_bcr_addcrc(bii, slvrno, crc);
+		BMAP_ULOCK(b);
+	}
+
+ out:
+	if (rc)
+		psclog_warnx("direct %s error, rc=%d",
+		    rw == SL_WRITE ? "write" : "read", rc);
+	sli_diobuf_put(db);
+	BMAP_LOCK(b);
+	sli_dio_end(bii, slvrno);
+	return (rc);
+}
+
 __static int
 sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 {
@@ -205,6 +285,16 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 	    "sbd_seq=%"PRId64, bmap->bcm_bmapno, mq->size, mq->offset,
 	    rw == SL_WRITE ? "wr" : "rd", mq->sbd.sbd_seq);
 
+	if (f->fcmh_flags & FCMH_IOD_BACKFILE &&
+	    fcmh_2_fii(f)->fii_dio_fd != -1 &&
+	    sli_dio_eligible(mq->offset, mq->size, rw,
+	    slcfg_local->cfg_direct_io_min) &&
+	    sli_dio_begin(bmap_2_bii(bmap),
+	    mq->offset / SLASH_SLVR_SIZE, rw)) {
+		rc = mp->rc = sli_ric_handle_dio(rq, mq, bmap, rw);
+		goto aio_out;
+	}
+
 	/*
 	 * Currently we have LNET_MTU = SLASH_SLVR_SIZE = 1MiB,
 	 * therefore we would never exceed two slivers.
@@ -269,6 +359,8 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 		 */
 		psc_assert(iovs[i].iov_len > 0);
 	}
+	if (rw == SL_READ)
+		slvr_readahead(bmap_2_bii(bmap), slvr, nslvrs);
 	bmap_op_done(bmap);
 	bmap = NULL;
 
@@ -460,6 +552,13 @@ sli_ric_handle_rlsbmap(struct pscrpc_request *rq)
 				    newsbd, sbd->sbd_seq, sbd->sbd_key);
 
 				pll_add(&bii->bii_rls, newsbd);
+
+				/* A full batch need not wait. */
+				if (psc_atomic32_inc_getnew(
+				    &sli_bmap_rls_npending) >=
+				    MAX_BMAP_RELEASE)
+					psc_waitq_wakeone(
+					    &sli_bmap_rls_waitq);
 			}
 		}
 
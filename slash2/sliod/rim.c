@@ -181,9 +181,7 @@ sli_rim_handle_reclaim(struct pscrpc_request *rq)
 			FCMH_LOCK(f);
 			if (entryp->fg.fg_gen == fcmh_2_gen(f)) {
 				if (f->fcmh_flags & FCMH_IOD_BACKFILE) {
-					close(fcmh_2_fd(f));
-					fcmh_2_fd(f) = -1;
-					f->fcmh_flags &= ~FCMH_IOD_BACKFILE;
+					sli_close_backing_file(f);
 					OPSTAT_INCR("reclaim-close");
 				}
 				OPSTAT_INCR("slvr-remove-reclaim");
@@ -20,9 +20,17 @@
  * %END_LICENSE%
  */
 
+#include <sys/mman.h>
+
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
 
 #include "pfl/alloc.h"
 #include "pfl/cdefs.h"
@@ -31,6 +39,7 @@
 #include "pfl/listcache.h"
 #include "pfl/lock.h"
 #include "pfl/log.h"
+#include "pfl/memnode.h"
 #include "pfl/pool.h"
 #include "pfl/rpc.h"
 #include "pfl/vbitmap.h"
@@ -41,17 +50,69 @@
 #include "sliod.h"
 #include "slvr.h"
 
+#define SL_ARENA_HUGEPGSZ	(2 * 1024 * 1024)
+
+/*
+ * A contiguous region of sliver buffers bound to one memory node.
+ * Buffers are carved off in order as the node's pool is populated and
+ * are never handed back, so the region stays resident and any
+ * registration of its pages stays valid for the life of the process.
+ */
+struct sl_arena {
+	char			*sla_base;
+	size_t			 sla_len;
+	int			 sla_nbufs;
+	int			 sla_next;		/* next unassigned buffer */
+	psc_spinlock_t		 sla_lock;
+};
+
 struct psc_poolmaster	 sl_bufs_poolmaster;
-struct psc_poolmgr	*sl_bufs_pool;
+struct psc_poolmgr	**sl_bufs_pools;		/* one per memory node */
+struct sl_arena		*sl_arenas;			/* NULL if no arena */
+int			 sl_bufs_max = SL_BUFS_MAX;
+int			 sl_bufs_nmemnodes = 1;
 
+/*
+ * Map the memory node a sliver buffer pool manager serves.
+ */
 int
-sl_buffer_init(__unusedx struct psc_poolmgr *m, void *pri)
+sl_buffer_memnid(struct psc_poolmgr *m)
+{
+	int i;
+
+	for (i = 0; i < sl_bufs_nmemnodes; i++)
+		if (sl_bufs_pools[i] == m)
+			return (i);
+	psc_fatalx("pool manager %p is not a sliver buffer pool", m);
+}
+
+int
+sl_buffer_init(struct psc_poolmgr *m, void *pri)
 {
 	struct sl_buffer *slb = pri;
+	struct sl_arena *sla;
+	int idx = -1;
 
-	slb->slb_base = PSCALLOC(SLASH_SLVR_SIZE);
+	slb->slb_memnid = sl_buffer_memnid(m);
+	slb->slb_uring_idx = -1;
 	INIT_LISTENTRY(&slb->slb_mgmt_lentry);
 
+	if (sl_arenas) {
+		sla = &sl_arenas[slb->slb_memnid];
+		spinlock(&sla->sla_lock);
+		if (sla->sla_next < sla->sla_nbufs)
+			idx = sla->sla_next++;
+		freelock(&sla->sla_lock);
+		if (idx == -1)
+			return (-1);
+		slb->slb_base = sla->sla_base + (size_t)idx *
+		    SLASH_SLVR_SIZE;
+	} else
+		slb->slb_base = PSCALLOC(SLASH_SLVR_SIZE);
+
+	if (slcfg_local->cfg_async_io == SLCFG_ASYNCIO_URING)
+		sli_uring_addbuf(slb);
+
 	return (0);
 }
 
@@ -60,28 +121,192 @@ sl_buffer_destroy(void *pri)
 {
 	struct sl_buffer *slb = pri;
 
+	/* Arena pools are never shrunk. */
+	psc_assert(sl_arenas == NULL);
+
+	if (slb->slb_uring_idx != -1)
+		sli_uring_delbuf(slb);
 	PSCFREE(slb->slb_base);
 }
 
+/*
+ * Obtain a sliver buffer, preferring memory local to the CPU the
+ * caller is running on.  When the local node has nothing free, take
+ * from another node before blocking to reclaim locally.
+ */
+struct sl_buffer *
+sl_buffer_get(void)
+{
+	struct sl_buffer *slb;
+	int i, memnid = 0;
+
+	if (sl_bufs_nmemnodes > 1) {
+		memnid = psc_memnode_curid() % sl_bufs_nmemnodes;
+		slb = psc_pool_tryget(sl_bufs_pools[memnid]);
+		if (slb)
+			return (slb);
+		for (i = 1; i < sl_bufs_nmemnodes; i++) {
+			slb = psc_pool_tryget(sl_bufs_pools[
+			    (memnid + i) % sl_bufs_nmemnodes]);
+			if (slb) {
+				OPSTAT_INCR("slab-remote");
+				return (slb);
+			}
+		}
+	}
+	return (psc_pool_get(sl_bufs_pools[memnid]));
+}
+
+void
+sl_buffer_put(struct sl_buffer *slb)
+{
+	psc_pool_return(sl_bufs_pools[slb->slb_memnid], slb);
+}
+
+/*
+ * Keep a reserve of buffers available on each memory node so RPC
+ * threads rarely have to reclaim inline.  Which slivers are evicted to
+ * restore it is up to the sliver replacement policy.
+ */
 void
 slibreapthr_main(struct psc_thread *thr)
 {
+	struct psc_poolmgr *m;
+	int i, avail, want;
+
 	while (pscthr_run(thr)) {
-		psc_pool_reap(sl_bufs_pool, 0);
-		sleep(10);
+		for (i = 0; i < sl_bufs_nmemnodes; i++) {
+			m = sl_bufs_pools[i];
+			avail = psc_pool_nfree(m) + m->ppm_max -
+			    psc_pool_gettotal(m);
+			want = m->ppm_max * SL_BUFS_RESERVE / 100 - avail;
+			if (want > 0)
+				OPSTAT_ADD("slab-reserve-reap",
+				    slvr_reap(i, want));
+		}
+		sleep(1);
 	}
 }
 
+/*
+ * Reserve and fault in the memory for one node's arena.  Explicit 2MB
+ * huge pages are tried first; if none are reserved, fall back to
+ * regular pages with transparent huge pages requested.
+ */
+__static int
+sl_arena_map(struct sl_arena *sla, int memnid)
+{
+	size_t off, pgsz;
+	void *p;
+
+	sla->sla_len = PSC_ALIGN((size_t)sla->sla_nbufs *
+	    SLASH_SLVR_SIZE, SL_ARENA_HUGEPGSZ);
+	pgsz = SL_ARENA_HUGEPGSZ;
+#ifdef MAP_HUGETLB
+	p = mmap(NULL, sla->sla_len, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED)
+#endif
+	{
+		pgsz = sysconf(_SC_PAGESIZE);
+		p = mmap(NULL, sla->sla_len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return (-errno);
+#ifdef MADV_HUGEPAGE
+		madvise(p, sla->sla_len, MADV_HUGEPAGE);
+#endif
+	}
+
+#ifdef HAVE_NUMA
+	if (sl_bufs_nmemnodes > 1)
+		numa_tonode_memory(p, sla->sla_len, memnid);
+#else
+	(void)memnid;
+#endif
+
+	/* Pre-fault so no page faults are taken in the I/O path. */
+	for (off = 0; off < sla->sla_len; off += pgsz)
+		((volatile char *)p)[off] = 0;
+
+	psclog_info("sliver arena node %d: %d buffers, %zu bytes, "
+	    "%s pages", memnid, sla->sla_nbufs, sla->sla_len,
+	    pgsz == SL_ARENA_HUGEPGSZ ? "huge" : "transparent huge");
+
+	sla->sla_base = p;
+	return (0);
+}
+
+/*
+ * Size the sliver buffer cache.  This must run before io_uring setup so
+ * the fixed buffer table is sized for every buffer the arena will hold.
+ */
+void
+sl_buffer_arena_init(void)
+{
+	struct sl_arena *sla;
+	int i, n, nbufs, rc;
+
+	if (slcfg_local->cfg_slab_cache_size == 0)
+		return;
+
+	nbufs = slcfg_local->cfg_slab_cache_size / SLASH_SLVR_SIZE;
+	n = psc_memnode_count();
+	if (nbufs < n)
+		n = 1;
+	if (nbufs < 1)
+		psc_fatalx("slab_cache_size %zu is smaller than a sliver",
+		    slcfg_local->cfg_slab_cache_size);
+
+	sl_bufs_nmemnodes = n;
+	sl_arenas = PSCALLOC(n * sizeof(*sl_arenas));
+	for (i = 0, sla = sl_arenas; i < n; i++, sla++) {
+		INIT_SPINLOCK(&sla->sla_lock);
+		sla->sla_nbufs = nbufs / n;
+		rc = sl_arena_map(sla, i);
+		if (rc)
+			psc_fatalx("unable to map %zu bytes for sliver "
+			    "arena: %s", sla->sla_len, strerror(-rc));
+	}
+	sl_bufs_max = n * (nbufs / n);
+}
+
 void
 sl_buffer_cache_init(void)
 {
+	int i, flags = PPMF_AUTO, total = 64, min = 64, max;
+
 	psc_assert(SLASH_SLVR_SIZE <= LNET_MTU);
 
+	/*
+	 * An arena is fully committed up front so its pools are fixed
+	 * size: populated entirely at startup and never reaped.
+	 */
+	max = sl_bufs_max / sl_bufs_nmemnodes;
+	if (sl_arenas) {
+		flags = PPMF_NONE;
+		total = min = max;
+	}
+
+	/*
+	 * The pools are populated by hand: sl_buffer_init() needs to
+	 * find each pool in sl_bufs_pools[] to learn its memory node,
+	 * and that is only possible once _psc_poolmaster_getmgr() has
+	 * returned.
+	 */
 	psc_poolmaster_init(&sl_bufs_poolmaster, struct sl_buffer,
-	    slb_mgmt_lentry, PPMF_AUTO, 64, 64, 1024,
-	    sl_buffer_init, sl_buffer_destroy, slvr_buffer_reap, "slab",
-	    NULL);
-	sl_bufs_pool = psc_poolmaster_getmgr(&sl_bufs_poolmaster);
+	    slb_mgmt_lentry, flags, 0, min, max, sl_buffer_init,
+	    sl_buffer_destroy, slvr_buffer_reap, "slab", NULL);
+
+	sl_bufs_pools = PSCALLOC(sl_bufs_nmemnodes *
+	    sizeof(*sl_bufs_pools));
+	for (i = 0; i < sl_bufs_nmemnodes; i++) {
+		sl_bufs_pools[i] = _psc_poolmaster_getmgr(
+		    &sl_bufs_poolmaster, i);
+		psc_pool_grow(sl_bufs_pools[i], total);
+	}
+
+	slvr_2q_setsize(&sli_slvrcache, max * sl_bufs_nmemnodes);
 
 	pscthr_init(SLITHRT_BREAP, slibreapthr_main, NULL, 0,
 	    "slibreapthr");
@@ -38,11 +38,23 @@
  */
 struct sl_buffer {
 	void			*slb_base;		/* point to the data buffer */
+	int			 slb_uring_idx;		/* io_uring fixed buffer index or -1 */
+	int			 slb_memnid;		/* memory node of slb_base */
 	struct psclist_head	 slb_mgmt_lentry;	/* chain lru or outgoing q  */
 };
 
-void sl_buffer_cache_init(void);
+#define SL_BUFS_MAX		1024			/* default max # of sliver buffers */
+#define SL_BUFS_RESERVE		5			/* % of buffers kept available */
 
-extern struct psc_poolmgr	*sl_bufs_pool;
+struct sl_buffer *
+	sl_buffer_get(void);
+int	sl_buffer_memnid(struct psc_poolmgr *);
+void	sl_buffer_put(struct sl_buffer *);
+
+void	sl_buffer_arena_init(void);
+void	sl_buffer_cache_init(void);
+
+extern int			 sl_bufs_max;
+extern int			 sl_bufs_nmemnodes;
 
 #endif /* _SL_BUFFER_H_ */
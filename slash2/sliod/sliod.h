@@ -35,6 +35,7 @@
 
 struct bmapc_memb;
 struct fidc_membh;
+struct sli_uring;
 
 /* sliod thread types */
 enum {
@@ -50,17 +51,22 @@ enum {
 	SLITHRT_LNETAC,		/* Lustre net accept thr */
 	SLITHRT_NBRQ,		/* non blocking RPC request processor */
 	SLITHRT_OPSTIMER,	/* iostats updater */
+	SLITHRT_READAHEAD,	/* sequential sliver prefetchers */
 	SLITHRT_REPLPND,	/* process enqueued replication work */
 	SLITHRT_RIC,		/* service RPC requests from CLI */
 	SLITHRT_RII,		/* service RPC requests from ION */
 	SLITHRT_RIM,		/* service RPC requests from MDS */
 	SLITHRT_SLVR_CRC,	/* sliver CRC updaters */
 	SLITHRT_STATFS,		/* statvfs(2) updater */
+	SLITHRT_URING,		/* io_uring completion handlers */
 	SLITHRT_USKLNDPL,	/* userland socket Lustre net dev poll thr */
 	SLITHRT_WORKER		/* generic worker thread */
 };
 
 #define NSLVRCRC_THRS		4	/* perhaps default to ncores + configurable? */
+#define NSLI_READAHEAD_THRS	4	/* sliver prefetch workers */
+#define NSLI_URING_THRS		4	/* each owns one submission/completion ring */
+#define SLI_URING_MAXBUFS	16384	/* kernel limit on registered fixed buffers */
 
 enum {
 	SLI_FAULT_AIO_FAIL,
@@ -81,11 +87,17 @@ struct slirii_thread {
 	int			 sirit_st_nread;
 };
 
+struct sliuring_thread {
+	struct sli_uring	*siut_ring;
+};
+
 PSCTHR_MKCAST(sliricthr, sliric_thread, SLITHRT_RIC)
 PSCTHR_MKCAST(slirimthr, slirim_thread, SLITHRT_RIM)
 PSCTHR_MKCAST(sliriithr, slirii_thread, SLITHRT_RII)
+PSCTHR_MKCAST(sliuringthr, sliuring_thread, SLITHRT_URING)
 
 struct resm_iod_info {
+	int			 rmii_ninfl_crcup;	/* under sli_bcr_lock */
 };
 
 static __inline struct resm_iod_info *
@@ -107,6 +119,7 @@ extern struct srt_statfs	 sli_ssfb;
 extern psc_spinlock_t		 sli_ssfb_lock;
 extern struct timespec		 sli_ssfb_send;
 extern struct psc_thread	*sliconnthr;
+extern struct sl_resm		*rmi_resm;
 
 extern uint64_t			 current_reclaim_xid;
 extern uint64_t			 current_reclaim_batchno;
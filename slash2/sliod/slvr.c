@@ -37,6 +37,7 @@
 #include "pfl/rpc.h"
 #include "pfl/rsx.h"
 #include "pfl/treeutil.h"
+#include "pfl/uring.h"
 #include "pfl/vbitmap.h"
 
 #include "bmap_iod.h"
@@ -60,12 +61,33 @@ struct psc_poolmgr	*sli_readaheadrq_pool;
 struct psc_listcache	 sli_readaheadq;
 struct psc_listcache	 sli_iocb_pndg;
 
+int			 sli_readahead_max = SLI_READAHEAD_MAX / 2;
+
 psc_atomic64_t		 sli_aio_id = PSC_ATOMIC64_INIT(0);
 
-struct psc_listcache	 sli_lruslvrs;		/* LRU list of clean slivers which may be reaped */
+struct slvr_2q		 sli_slvrcache;		/* replacement order of cached slivers */
 struct psc_listcache	 sli_crcqslvrs;		/* Slivers ready to be CRC'd and have their
 						 * CRCs shipped to the MDS. */
 
+#ifdef HAVE_IO_URING
+/*
+ * Each io_uring completion thread owns one ring.  RPC threads are bound
+ * round-robin to a ring on their first read and submit into it.
+ */
+struct sli_uring {
+	struct pfl_uring	 su_ring;
+	struct pfl_mutex	 su_mutex;	/* serializes submission */
+};
+
+struct sli_uring	 sli_urings[NSLI_URING_THRS];
+psc_atomic32_t		 sli_uring_next = PSC_ATOMIC32_INIT(0);
+__threadx struct sli_uring *sli_uring_mine;
+
+/* fixed buffer table slots for sl_bufs_pool */
+struct psc_vbitmap	*sli_uring_bufidx;
+psc_spinlock_t		 sli_uring_bufidx_lock = SPINLOCK_INIT;
+#endif
+
 SPLAY_GENERATE(biod_slvrtree, slvr, slvr_tentry, slvr_cmp)
 
 /*
@@ -298,6 +320,7 @@ slvr_iocb_release(struct sli_iocb *iocb)
 __static void
 slvr_fsaio_done(struct sli_iocb *iocb)
 {
+	struct timespec ts1, tsd;
 	struct sli_aiocb_reply *a;
 	struct slvr *s;
 	int rc;
@@ -305,6 +328,11 @@ slvr_fsaio_done(struct sli_iocb *iocb)
 	s = iocb->iocb_slvr;
 	rc = iocb->iocb_rc;
 
+	PFL_GETTIMESPEC(&ts1);
+	timespecsub(&ts1, &iocb->iocb_ts, &tsd);
+	OPSTAT_HIST_ADD("read-wait-usecs",
+	    tsd.tv_sec * 1000000 + tsd.tv_nsec / 1000);
+
 	SLVR_LOCK(s);
 	psc_assert(iocb == s->slvr_iocb);
 	psc_assert(s->slvr_flags & SLVRF_FAULTING);
@@ -356,6 +384,7 @@ sli_aio_iocb_new(struct slvr *s)
 	 */
 	iocb->iocb_slvr = s;
 	iocb->iocb_cbf = slvr_fsaio_done;
+	PFL_GETTIMESPEC(&iocb->iocb_ts);
 
 	return (iocb);
 }
@@ -481,6 +510,229 @@ sli_aio_register(struct slvr *s)
 	return (-error);
 }
 
+#ifdef HAVE_IO_URING
+/*
+ * Install a sliver buffer into every ring's fixed buffer table so reads
+ * into it avoid per-I/O page pinning.  On any failure the buffer is
+ * simply used unregistered.
+ */
+void
+sli_uring_addbuf(struct sl_buffer *slb)
+{
+	size_t idx;
+	int i, rc = 0;
+
+	if (!(sli_urings[0].su_ring.pur_flags & PURF_FIXEDBUFS))
+		return;
+
+	spinlock(&sli_uring_bufidx_lock);
+	if (!psc_vbitmap_next(sli_uring_bufidx, &idx)) {
+		freelock(&sli_uring_bufidx_lock);
+		return;
+	}
+	freelock(&sli_uring_bufidx_lock);
+
+	for (i = 0; i < NSLI_URING_THRS; i++) {
+		rc = pfl_uring_update_buffer(&sli_urings[i].su_ring, idx,
+		    slb->slb_base, SLASH_SLVR_SIZE);
+		if (rc)
+			break;
+	}
+	if (rc) {
+		psclog_diag("io_uring buffer registration failed: %s",
+		    strerror(-rc));
+		OPSTAT_INCR("uring-regbuf-fail");
+		while (i-- > 0)
+			pfl_uring_update_buffer(&sli_urings[i].su_ring,
+			    idx, NULL, 0);
+		spinlock(&sli_uring_bufidx_lock);
+		psc_vbitmap_unset(sli_uring_bufidx, idx);
+		freelock(&sli_uring_bufidx_lock);
+		return;
+	}
+	slb->slb_uring_idx = idx;
+}
+
+void
+sli_uring_delbuf(struct sl_buffer *slb)
+{
+	int i;
+
+	for (i = 0; i < NSLI_URING_THRS; i++)
+		pfl_uring_update_buffer(&sli_urings[i].su_ring,
+		    slb->slb_uring_idx, NULL, 0);
+	spinlock(&sli_uring_bufidx_lock);
+	psc_vbitmap_unset(sli_uring_bufidx, slb->slb_uring_idx);
+	freelock(&sli_uring_bufidx_lock);
+	slb->slb_uring_idx = -1;
+}
+
+/*
+ * Queue a full sliver read on this thread's ring.  Completion is
+ * delivered to slvr_fsaio_done() by the ring's sliuringthr.
+ */
+int
+sli_uring_register(struct slvr *s)
+{
+	struct io_uring_sqe *sqe;
+	struct sli_iocb *iocb;
+	struct sli_uring *su;
+	int rc, urc;
+
+	su = sli_uring_mine;
+	if (su == NULL)
+		su = sli_uring_mine = &sli_urings[
+		    psc_atomic32_inc_getnew(&sli_uring_next) %
+		    NSLI_URING_THRS];
+
+	iocb = sli_aio_iocb_new(s);
+
+	SLVR_LOCK(s);
+	s->slvr_flags |= SLVRF_FAULTING;
+	s->slvr_iocb = iocb;
+	SLVR_WAKEUP(s);
+	SLVR_ULOCK(s);
+
+	psc_mutex_lock(&su->su_mutex);
+	sqe = pfl_uring_get_sqe(&su->su_ring);
+	if (sqe == NULL) {
+		OPSTAT_INCR("uring-sq-full");
+		rc = pfl_uring_submit(&su->su_ring);
+		sqe = pfl_uring_get_sqe(&su->su_ring);
+	}
+	if (sqe) {
+		pfl_uring_prep_read(sqe, slvr_2_fd(s), slvr_2_buf(s, 0),
+		    SLASH_SLVR_SIZE, slvr_2_fileoff(s, 0),
+		    s->slvr_slab->slb_uring_idx, (uintptr_t)iocb);
+		rc = pfl_uring_submit(&su->su_ring);
+		if (rc <= 0) {
+			/*
+			 * The SQE is still published in the ring; take
+			 * it back so the kernel never sees an iocb we
+			 * are about to free.  If the kernel already
+			 * consumed it, the CQE handler owns the iocb.
+			 */
+			urc = pfl_uring_unget_sqe(&su->su_ring);
+			if (urc == -EBUSY) {
+				OPSTAT_INCR("uring-submit-late");
+				rc = 1;
+			}
+		}
+	} else if (rc >= 0)
+		rc = -EAGAIN;
+	psc_mutex_unlock(&su->su_mutex);
+
+	if (rc > 0) {
+		OPSTAT_INCR("uring-submit");
+		if (s->slvr_slab->slb_uring_idx != -1)
+			OPSTAT_INCR("uring-fixedbuf");
+		psclog_diag("io_uring read: fd=%d iocb=%p sliver=%p",
+		    slvr_2_fd(s), iocb, s);
+		return (-SLERR_AIOWAIT);
+	}
+
+	psclog_warnx("io_uring read: fd=%d iocb=%p sliver=%p rc=%d",
+	    slvr_2_fd(s), iocb, s, rc);
+	OPSTAT_INCR("uring-submit-err");
+	SLVR_LOCK(s);
+	s->slvr_iocb = NULL;
+	s->slvr_flags &= ~SLVRF_FAULTING;
+	SLVR_WAKEUP(s);
+	SLVR_ULOCK(s);
+	slvr_iocb_release(iocb);
+	return (rc ? rc : -EIO);
+}
+
+void
+sliuringthr_main(struct psc_thread *thr)
+{
+	struct io_uring_cqe *cqe;
+	struct sli_iocb *iocb;
+	struct sli_uring *su;
+	int rc, res;
+
+	su = sliuringthr(thr)->siut_ring;
+	while (pscthr_run(thr)) {
+		rc = pfl_uring_wait_cqe(&su->su_ring, &cqe);
+		if (rc)
+			psc_fatalx("io_uring wait: %s", strerror(-rc));
+
+		iocb = (void *)(uintptr_t)cqe->user_data;
+		res = cqe->res;
+		pfl_uring_cqe_seen(&su->su_ring);
+
+		if (res < 0)
+			iocb->iocb_rc = -res;
+		else {
+			iocb->iocb_rc = 0;
+			pfl_opstat_add(sli_backingstore_iostats.rd, res);
+		}
+		(void)psc_fault_here_rc(SLI_FAULT_AIO_FAIL,
+		    &iocb->iocb_rc, EIO);
+
+		psclog_diag("io_uring done: iocb=%p res=%d", iocb, res);
+		iocb->iocb_cbf(iocb);	/* slvr_fsaio_done() */
+	}
+}
+
+__static void
+sli_uring_init(void)
+{
+	struct psc_thread *thr;
+	struct sli_uring *su;
+	int i, rc, nbufs, fixed = 1;
+
+	nbufs = MIN(sl_bufs_max, SLI_URING_MAXBUFS);
+	sli_uring_bufidx = psc_vbitmap_new(nbufs);
+
+	for (i = 0, su = sli_urings; i < NSLI_URING_THRS; i++, su++) {
+		/*
+		 * Size the completion queue so every sliver buffer can
+		 * have a read outstanding on a single ring.
+		 */
+		rc = pfl_uring_init(&su->su_ring, 256, 2 * nbufs);
+		if (rc)
+			psc_fatalx("io_uring setup: %s", strerror(-rc));
+		psc_mutex_init(&su->su_mutex);
+
+		if (fixed && pfl_uring_register_sparse(&su->su_ring,
+		    nbufs)) {
+			psclog_notice("io_uring fixed buffers unavailable");
+			fixed = 0;
+		}
+
+		thr = pscthr_init(SLITHRT_URING, sliuringthr_main, NULL,
+		    sizeof(struct sliuring_thread), "sliuringthr%d", i);
+		sliuringthr(thr)->siut_ring = su;
+		pscthr_setready(thr);
+	}
+
+	/* all or nothing */
+	if (!fixed)
+		for (i = 0; i < NSLI_URING_THRS; i++)
+			sli_urings[i].su_ring.pur_flags &= ~PURF_FIXEDBUFS;
+}
+
+#else
+
+int
+sli_uring_register(__unusedx struct slvr *s)
+{
+	return (-ENOTSUP);
+}
+
+void
+sli_uring_addbuf(__unusedx struct sl_buffer *slb)
+{
+}
+
+void
+sli_uring_delbuf(__unusedx struct sl_buffer *slb)
+{
+}
+
+#endif
+
 __static ssize_t
 slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 {
@@ -503,6 +755,8 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 	if (rw == SL_READ) {
 		OPSTAT_INCR("fsio-read");
 
+		if (slcfg_local->cfg_async_io == SLCFG_ASYNCIO_URING)
+			return (sli_uring_register(s));
 		if (slcfg_local->cfg_async_io)
 			return (sli_aio_register(s));
 
@@ -539,7 +793,12 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 			 * protocol.
 			 */
 			SLVR_LOCK(s);
-			crc_rc = slvr_do_crc(s, NULL);
+			/*
+			 * A dirty sliver no longer matches the CRC in
+			 * the bmap; the CRC worker will replace it.
+			 */
+			crc_rc = s->slvr_flags & SLVRF_CRCDIRTY ? -1 :
+			    slvr_do_crc(s, NULL);
 			SLVR_ULOCK(s);
 
 			if (crc_rc == PFLERR_BADCRC) {
@@ -554,7 +813,7 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 
 		PFL_GETTIMESPEC(&ts1);
 		timespecsub(&ts1, &ts0, &tsd);
-		OPSTAT_ADD("read-wait-usecs",
+		OPSTAT_HIST_ADD("read-wait-usecs",
 		    tsd.tv_sec * 1000000 + tsd.tv_nsec / 1000);
 	} else {
 		OPSTAT_INCR("fsio-write");
@@ -629,8 +888,46 @@ slvr_fsbytes_wio(struct slvr *s, uint32_t sblk, uint32_t size)
 }
 
 /*
- * Prepare a sliver for an incoming I/O.  This may entail faulting 32k
- * aligned regions in from the underlying fs.
+ * Synchronously fault in the blocks of a sliver given by @need and mark
+ * them valid.  The caller must hold SLVRF_FAULTING.
+ */
+ssize_t
+slvr_fsbytes_fill(struct slvr *s, uint32_t need)
+{
+	struct fidc_membh *f;
+	ssize_t rc;
+
+	if (!need)
+		return (0);
+
+	f = slvr_2_fcmh(s);
+	if (!(f->fcmh_flags & FCMH_IOD_BACKFILE)) {
+		OPSTAT_INCR("no-backfile");
+		return (-EBADF);
+	}
+
+	OPSTAT_INCR("fsio-fill");
+	rc = slvr_blks_read(slvr_2_fd(s), slvr_2_buf(s, 0),
+	    slvr_2_fileoff(s, 0), need);
+	if (rc < 0) {
+		OPSTAT_INCR("fsio-fill-fail");
+		DEBUG_SLVR(PLL_ERROR, s, "fill blks=%#x rc=%zd", need,
+		    rc);
+		return (rc);
+	}
+	pfl_opstat_add(sli_backingstore_iostats.rd, rc);
+
+	SLVR_LOCK(s);
+	s->slvr_validblks |= need;
+	DEBUG_SLVR(PLL_DIAG, s, "filled blks=%#x", need);
+	SLVR_ULOCK(s);
+	return (0);
+}
+
+/*
+ * Prepare a sliver for an incoming I/O.  A read faults in whatever
+ * part of the sliver is not already cached.  A write only faults in the
+ * 32k blocks at either end of its range that it partially covers.
  *
  * @s: the sliver
  * @off: offset into the slvr (not bmap or file object)
@@ -643,6 +940,7 @@ slvr_io_prep(struct slvr *s, uint32_t off, uint32_t len, enum rw rw,
     __unusedx int flags)
 {
 	struct bmap *b = slvr_2_bmap(s);
+	uint32_t need;
 	ssize_t rc = 0;
 
 	BMAP_ULOCK(b);
@@ -672,22 +970,38 @@ slvr_io_prep(struct slvr *s, uint32_t off, uint32_t len, enum rw rw,
 	if (s->slvr_flags & SLVRF_DATARDY)
 		goto out1;
 
-	if (rw == SL_WRITE && !off && len == SLASH_SLVR_SIZE) {
+	if (slvr_blks_prep(off, len, rw, s->slvr_validblks, &need) ==
+	    SLVR_BLKS_FULLREAD) {
+		s->slvr_validblks = SLVR_BLKS_ALL;
+		SLVR_ULOCK(s);
+
 		/*
-		 * Full sliver write, no need to read blocks from disk.
-		 * All blocks will be dirtied by the incoming network
-		 * IO.
+		 * Execute read to fault in needed blocks after dropping
+		 * the lock.  All should be protected by the FAULTING
+		 * bit.
 		 */
-		goto out1;
+		rc = slvr_fsbytes_rio(s, off, len);
+		goto out2;
 	}
-
 	SLVR_ULOCK(s);
 
 	/*
-	 * Execute read to fault in needed blocks after dropping the
-	 * lock.  All should be protected by the FAULTING bit.
+	 * For a write, blocks wholly covered by it will be overwritten
+	 * by the incoming network I/O.  The rest of the sliver is
+	 * faulted in lazily, see slislvrthr_proc().  If the transfer
+	 * fails, the sliver is marked DATAERR and thrown away.
 	 */
-	rc = slvr_fsbytes_rio(s, off, len);
+	if (need && rw == SL_WRITE)
+		OPSTAT_INCR("slvr-write-rmw");
+	else if (need)
+		OPSTAT_INCR("slvr-read-fill");
+	rc = slvr_fsbytes_fill(s, need);
+	if (!rc) {
+		SLVR_LOCK(s);
+		s->slvr_validblks = slvr_blks_done(off, len, rw,
+		    s->slvr_validblks);
+		SLVR_ULOCK(s);
+	}
 	goto out2;
 
  out1:
@@ -705,7 +1019,6 @@ slvr_schedule_crc_locked(struct slvr *s)
 	PFL_GETTIMESPEC(&s->slvr_ts);
 	DEBUG_SLVR(PLL_DIAG, s, "sched crc");
 
-	lc_remove(&sli_lruslvrs, s);
 	lc_addqueue(&sli_crcqslvrs, s);
 }
 
@@ -717,19 +1030,23 @@ slvr_remove(struct slvr *s)
 	DEBUG_SLVR(PLL_DEBUG, s, "freeing slvr");
 
 	psc_assert(s->slvr_refcnt == 0);
-	if (s->slvr_flags & SLVRF_LRU)
-		lc_remove(&sli_lruslvrs, s);
-	else
+	if ((s->slvr_flags & SLVRF_LRU) == 0)
 		lc_remove(&sli_crcqslvrs, s);
+	slvr_2q_remove(&sli_slvrcache, &s->slvr_2qent);
 
 	bii = slvr_2_bii(s);
 
 	BII_LOCK(bii);
+	if (s->slvr_flags & SLVRF_READAHEAD) {
+		/* Prefetched but never read: back off. */
+		OPSTAT_INCR("readahead-waste");
+		bii->bii_ra_win /= 2;
+	}
 	PSC_SPLAY_XREMOVE(biod_slvrtree, &bii->bii_slvrs, s);
 	bmap_op_done_type(bii_2_bmap(bii), BMAP_OPCNT_SLVR);
 
 	if (s->slvr_slab)
-		psc_pool_return(sl_bufs_pool, s->slvr_slab);
+		sl_buffer_put(s->slvr_slab);
 	psc_pool_return(slvr_pool, s);
 }
 
@@ -829,15 +1146,6 @@ slvr_lru_tryunpin_locked(struct slvr *s)
 
 	psc_assert(s->slvr_flags & SLVRF_LRU);
 	psc_assert(s->slvr_flags & SLVRF_DATARDY);
-
-	/*
-	 * Locking convention: it is legal to request for a list lock
-	 * while holding the sliver lock.  On the other hand, when you
-	 * already hold the list lock, you should drop the list lock
-	 * first before asking for the sliver lock or you should use
-	 * trylock().
-	 */
-	lc_move2tail(&sli_lruslvrs, s);
 	SLVR_ULOCK(s);
 }
 
@@ -850,10 +1158,9 @@ slvr_io_done(struct slvr *s, int rc)
 		s->slvr_err = rc;
 		s->slvr_flags |= SLVRF_DATAERR;
 		DEBUG_SLVR(PLL_DIAG, s, "FAULTING --> DATAERR");
-	} else {
+	} else if (s->slvr_validblks == SLVR_BLKS_ALL) {
 		s->slvr_flags |= SLVRF_DATARDY;
 		DEBUG_SLVR(PLL_DIAG, s, "FAULTING --> DATARDY");
-
 	}
 	SLVR_WAKEUP(s);
 	SLVR_ULOCK(s);
@@ -894,6 +1201,62 @@ slvr_wio_done(struct slvr *s, int repl)
 	}
 }
 
+/*
+ * Fence a sliver off from the cache for a direct I/O if sli_dio_fence()
+ * allows it, dropping a clean cached copy, until sli_dio_end().
+ * @bii: bmap, locked.
+ * @slvrno: sliver number in the bmap.
+ * @rw: read or write.
+ * Returns nonzero if the caller should proceed with direct I/O.
+ */
+int
+sli_dio_begin(struct bmap_iod_info *bii, uint32_t slvrno, enum rw rw)
+{
+	struct slvr *s, ts;
+	int busy = 0;
+
+	BII_LOCK_ENSURE(bii);
+
+	ts.slvr_num = slvrno;
+	s = SPLAY_FIND(biod_slvrtree, &bii->bii_slvrs, &ts);
+	if (s) {
+		SLVR_LOCK(s);
+		busy = s->slvr_refcnt || !(s->slvr_flags & SLVRF_LRU) ||
+		    s->slvr_flags & SLVRF_FAULTING;
+	}
+
+	switch (sli_dio_fence(bii->bii_dioslvrs, slvrno, rw, s != NULL,
+	    busy)) {
+	case SLI_DIO_CACHED:
+		if (s)
+			SLVR_ULOCK(s);
+		if (busy && rw == SL_WRITE)
+			OPSTAT_INCR("dio-skip-cached");
+		return (0);
+	case SLI_DIO_INVALIDATE:
+		if (s->slvr_flags & SLVRF_FREEING) {
+			/* already on its way out, e.g. reaped */
+			SLVR_ULOCK(s);
+			break;
+		}
+		s->slvr_flags |= SLVRF_FREEING;
+		SLVR_ULOCK(s);
+		OPSTAT_INCR("dio-invalidate");
+		BII_ULOCK(bii);
+		slvr_remove(s);
+		BII_LOCK(bii);
+		break;
+	}
+	return (1);
+}
+
+void
+sli_dio_end(struct bmap_iod_info *bii, uint32_t slvrno)
+{
+	BII_LOCK_ENSURE(bii);
+	sli_dio_unfence(bii->bii_dioslvrs, slvrno);
+	psc_waitq_wakeall(&bii_2_bmap(bii)->bcm_fcmh->fcmh_waitq);
+}
 /*
  * Lookup or create a sliver reference, ignoring one that is being
  * freed.
@@ -933,12 +1296,25 @@ _slvr_lookup(const struct pfl_callerinfo *pci, uint32_t num,
 		s->slvr_refcnt++;
 
 		SLVR_ULOCK(s);
+
+		slvr_2q_access(&sli_slvrcache, &s->slvr_2qent);
 	} else {
+		if (sli_dio_fenced(bii->bii_dioslvrs, num)) {
+			/*
+			 * A cache bypass of this sliver is in flight;
+			 * faulting it in now could cache stale data.
+			 */
+			OPSTAT_INCR("slvr-dio-wait");
+			psc_waitq_wait(&bii_2_bmap(bii)->bcm_fcmh->
+			    fcmh_waitq, &bii_2_bmap(bii)->bcm_lock);
+			BII_LOCK(bii);
+			goto retry;
+		}
 		if (!alloc) {
 			alloc = 1;
 			BII_ULOCK(bii);
 			tmp1 = psc_pool_get(slvr_pool);
-			tmp2 = psc_pool_get(sl_bufs_pool);
+			tmp2 = sl_buffer_get();
 			BII_LOCK(bii);
 			goto retry;
 		}
@@ -964,19 +1340,94 @@ _slvr_lookup(const struct pfl_callerinfo *pci, uint32_t num,
 		/*
 		 * Until the slab is added to the sliver, the sliver is
 		 * private to the bmap's biod_slvrtree.
+		 *
+		 * Locking convention: it is legal to take the policy
+		 * lock while holding the sliver lock.  On the other
+		 * hand, with the policy lock held, slivers may only be
+		 * trylock()'d.
 		 */
 		s->slvr_flags |= SLVRF_LRU;
-		/* note: lc_addtail() will grab the list lock itself */
-		lc_addtail(&sli_lruslvrs, s);
+		s->slvr_2qent.sqe_key.sqk_fid =
+		    fcmh_2_fid(bii_2_bmap(bii)->bcm_fcmh);
+		s->slvr_2qent.sqe_key.sqk_bno =
+		    bii_2_bmap(bii)->bcm_bmapno;
+		s->slvr_2qent.sqe_key.sqk_slvrno = num;
+		slvr_2q_insert(&sli_slvrcache, &s->slvr_2qent);
 
 	}
 	if (alloc) {
 		psc_pool_return(slvr_pool, tmp1);
-		psc_pool_return(sl_bufs_pool, tmp2);
+		sl_buffer_put(tmp2);
 	}
 	return (s);
 }
 
+struct slvr_reaparg {
+	struct psc_dynarray	a;
+	int			memnid;
+};
+
+/*
+ * Claim a sliver chosen by the replacement policy for eviction.  Called
+ * with the policy locked so slivers may only be trylock()'d.
+ */
+__static int
+slvr_reap_claim(struct slvr_2q_ent *e, void *arg)
+{
+	struct slvr *s = slvr_from_2qent(e);
+	struct slvr_reaparg *ra = arg;
+
+	DEBUG_SLVR(PLL_DIAG, s, "considering for reap");
+
+	/*
+	 * Freeing a sliver returns its buffer to the pool of the node
+	 * it came from, which would not help the waiters on this one.
+	 */
+	if (s->slvr_slab->slb_memnid != ra->memnid)
+		return (0);
+
+	if (!SLVR_TRYLOCK(s))
+		return (0);
+
+	/*
+	 * Dirty slivers stay in the policy queues while they wait on
+	 * the CRC queue, so skip those along with busy ones.
+	 */
+	if (s->slvr_refcnt || (s->slvr_flags & SLVRF_FREEING) ||
+	    (s->slvr_flags & SLVRF_LRU) == 0) {
+		SLVR_ULOCK(s);
+		return (0);
+	}
+
+	psc_dynarray_add(&ra->a, s);
+	s->slvr_flags |= SLVRF_FREEING;
+	SLVR_ULOCK(s);
+	return (1);
+}
+
+/*
+ * Evict up to @n clean slivers whose buffers come from memory node
+ * @memnid, in the order chosen by the replacement policy.
+ * Returns the number evicted.
+ */
+int
+slvr_reap(int memnid, int n)
+{
+	struct slvr_reaparg ra;
+	struct slvr *s;
+	int i;
+
+	psc_dynarray_init(&ra.a);
+	ra.memnid = memnid;
+	slvr_2q_reclaim(&sli_slvrcache, n, slvr_reap_claim, &ra);
+
+	n = psc_dynarray_len(&ra.a);
+	DYNARRAY_FOREACH(s, i, &ra.a)
+		slvr_remove(s);
+	psc_dynarray_free(&ra.a);
+	return (n);
+}
+
 /*
  * The reclaim function for sl_bufs_pool.  Note that our caller
  * psc_pool_get() ensures that we are called exclusively.
@@ -984,56 +1435,192 @@ _slvr_lookup(const struct pfl_callerinfo *pci, uint32_t num,
 int
 slvr_buffer_reap(struct psc_poolmgr *m)
 {
-	static struct psc_dynarray a;
-	struct slvr *s, *dummy;
-	int i, n;
+	int n, nwaiters;
 
-	psc_dynarray_init(&a);
+	nwaiters = psc_atomic32_read(&m->ppm_nwaiters);
+	n = slvr_reap(sl_buffer_memnid(m), MAX(nwaiters, 1));
+	if (!n || n < nwaiters)
+		psc_waitq_wakeone(&sli_slvr_waitq);
+	return (n);
+}
 
-	LIST_CACHE_LOCK(&sli_lruslvrs);
-	LIST_CACHE_FOREACH_SAFE(s, dummy, &sli_lruslvrs) {
-		DEBUG_SLVR(PLL_DIAG, s,
-		    "considering for reap, nwaiters=%d",
-		    psc_atomic32_read(&m->ppm_nwaiters));
+/*
+ * Account for a client read of the given slivers and, if the reader is
+ * walking the bmap sequentially, queue a prefetch of the slivers ahead
+ * of it.
+ * @bii: bmap, locked by the caller.
+ * @slvrs: slivers covered by the read, in order.
+ * @nslvrs: number of slivers.
+ */
+void
+slvr_readahead(struct bmap_iod_info *bii, struct slvr **slvrs,
+    int nslvrs)
+{
+	struct sli_readaheadrq *rarq;
+	uint32_t first, start, end;
+	struct fidc_membh *f;
+	struct bmap *b;
+	struct slvr *s;
+	int i, max;
 
-		/*
-		 * We are reaping so it is fine to back off on some
-		 * slivers.  We have to use a reqlock here because
-		 * slivers do not have private spinlocks; instead they
-		 * use the lock of the bii.  So if this thread tries to
-		 * free a slvr from the same bii trylock will abort.
-		 */
-		if (!SLVR_TRYLOCK(s))
-			continue;
+	BII_LOCK_ENSURE(bii);
 
-		/*
-		 * We do not check SLVRF_FAULTING here because we
-		 * are not looking at the CRC list (sli_crcqslvrs).
-		 */
-		if (s->slvr_refcnt || (s->slvr_flags & SLVRF_FREEING)) {
+	max = MIN(sli_readahead_max, SLI_READAHEAD_MAX);
+
+	for (i = 0; i < nslvrs; i++) {
+		s = slvrs[i];
+		SLVR_LOCK(s);
+		if (s->slvr_flags & SLVRF_READAHEAD) {
+			s->slvr_flags &= ~SLVRF_READAHEAD;
+			OPSTAT_INCR("readahead-hit");
+			bii->bii_ra_win = MIN(bii->bii_ra_win * 2, max);
+		}
+		s->slvr_flags |= SLVRF_ACCESSED;
+		SLVR_ULOCK(s);
+	}
+
+	if (max <= 0)
+		return;
+
+	/*
+	 * Reads smaller than a sliver land on the same sliver several
+	 * times in a row, so that counts as sequential too.  A fresh
+	 * bmap starts out with bii_ra_last at zero, which lets a reader
+	 * streaming across bmap boundaries keep its momentum.
+	 */
+	first = slvrs[0]->slvr_num;
+	end = slvrs[nslvrs - 1]->slvr_num + 1;
+	if (first != bii->bii_ra_last && first != bii->bii_ra_last + 1) {
+		bii->bii_ra_win = 0;
+		bii->bii_ra_issued = 0;
+		bii->bii_ra_last = end - 1;
+		return;
+	}
+	bii->bii_ra_last = end - 1;
+	if (bii->bii_ra_win < SLI_READAHEAD_MIN)
+		bii->bii_ra_win = SLI_READAHEAD_MIN;
+
+	start = MAX(end, bii->bii_ra_issued);
+	end = MIN(end + bii->bii_ra_win, SLASH_SLVRS_PER_BMAP);
+
+	/*
+	 * Batch prefetches: wait until at least half a window has been
+	 * consumed before topping it up.
+	 */
+	if (start >= end || (end - start < (uint32_t)bii->bii_ra_win / 2 &&
+	    end < SLASH_SLVRS_PER_BMAP))
+		return;
+
+	b = bii_2_bmap(bii);
+	f = b->bcm_fcmh;
+
+	rarq = psc_pool_tryget(sli_readaheadrq_pool);
+	if (rarq == NULL) {
+		OPSTAT_INCR("readahead-nomem");
+		return;
+	}
+	INIT_PSC_LISTENTRY(&rarq->rarq_lentry);
+	rarq->rarq_fg = f->fcmh_fg;
+	rarq->rarq_bno = b->bcm_bmapno;
+	rarq->rarq_off = start * SLASH_SLVR_SIZE;
+	rarq->rarq_size = (end - start) * SLASH_SLVR_SIZE;
+	bii->bii_ra_issued = end;
+
+	OPSTAT_INCR("readahead-queue");
+	lc_add(&sli_readaheadq, rarq);
+}
+
+/*
+ * Fault in the slivers named by a readahead request.  All reads are
+ * issued before any is waited on so that, with async I/O configured,
+ * the whole window is in flight at once.  The slivers are left on the
+ * LRU marked SLVRF_READAHEAD for slvr_readahead() to claim.
+ */
+__static void
+slvr_readahead_fault(struct sli_readaheadrq *rarq)
+{
+	struct slvr *s, *slvrs[SLI_READAHEAD_MAX];
+	ssize_t rc[SLI_READAHEAD_MAX];
+	struct bmap_iod_info *bii;
+	struct fidc_membh *f;
+	uint32_t num, end;
+	off_t base, fsize;
+	struct bmap *b;
+	int i, n = 0;
+
+	if (sli_fcmh_peek(&rarq->rarq_fg, &f))
+		return;
+
+	/*
+	 * The cached size is only refreshed when the fcmh is loaded, so
+	 * stat the backing file to avoid prefetching past its end.
+	 */
+	if (sli_fcmh_getattr(f))
+		goto out;
+	base = (off_t)rarq->rarq_bno * SLASH_BMAP_SIZE;
+	fsize = f->fcmh_sstb.sst_size;
+	if (base + rarq->rarq_off >= fsize) {
+		OPSTAT_INCR("readahead-eof");
+		goto out;
+	}
+	end = MIN((uint32_t)(rarq->rarq_off + rarq->rarq_size),
+	    fsize - base);
+	end = (end + SLASH_SLVR_SIZE - 1) / SLASH_SLVR_SIZE;
+
+	/* Only prefetch into bmaps still in use by a reader. */
+	if (bmap_lookup(f, rarq->rarq_bno, &b))
+		goto out;
+
+	bii = bmap_2_bii(b);
+	for (num = rarq->rarq_off / SLASH_SLVR_SIZE;
+	    num < end && n < SLI_READAHEAD_MAX; num++) {
+		s = slvr_lookup(num, bii);
+
+		SLVR_LOCK(s);
+		if (s->slvr_flags & (SLVRF_FAULTING | SLVRF_DATARDY |
+		    SLVRF_DATAERR)) {
+			/* Already cached or being read by someone. */
 			SLVR_ULOCK(s);
+			slvr_rio_done(s);
 			continue;
 		}
-
-		psc_dynarray_add(&a, s);
-		s->slvr_flags |= SLVRF_FREEING;
+		s->slvr_flags |= SLVRF_READAHEAD;
 		SLVR_ULOCK(s);
 
-		if (psc_dynarray_len(&a) >=
-		    psc_atomic32_read(&m->ppm_nwaiters))
-			break;
+		slvrs[n] = s;
+		rc[n] = slvr_io_prep(s, 0, SLASH_SLVR_SIZE, SL_READ, 0);
+		n++;
 	}
-	LIST_CACHE_ULOCK(&sli_lruslvrs);
+	bmap_op_done(b);
 
-	n = psc_dynarray_len(&a);
-	DYNARRAY_FOREACH(s, i, &a)
-		slvr_remove(s);
-	psc_dynarray_free(&a);
+	OPSTAT_ADD("readahead-slvrs", n);
 
-	if (!n || n < psc_atomic32_read(&m->ppm_nwaiters))
-		psc_waitq_wakeone(&sli_slvr_waitq);
+	for (i = 0; i < n; i++) {
+		s = slvrs[i];
+		if (rc[i] == -SLERR_AIOWAIT) {
+			/* slvr_fsaio_done() sets the final state. */
+			SLVR_LOCK(s);
+			SLVR_WAIT(s, s->slvr_flags & SLVRF_FAULTING);
+			SLVR_ULOCK(s);
+		} else
+			slvr_io_done(s, rc[i]);
+		slvr_rio_done(s);
+	}
 
-	return (n);
+ out:
+	fcmh_op_done(f);
+}
+
+void
+slireadaheadthr_main(struct psc_thread *thr)
+{
+	struct sli_readaheadrq *rarq;
+
+	while (pscthr_run(thr)) {
+		rarq = lc_getwait(&sli_readaheadq);
+		slvr_readahead_fault(rarq);
+		psc_pool_return(sli_readaheadrq_pool, rarq);
+	}
 }
 
 void
@@ -1075,6 +1662,10 @@ sliaiothr_main(__unusedx struct psc_thread *thr)
 void
 slvr_cache_init(void)
 {
+	int i;
+
+	sl_buffer_arena_init();
+
 	psc_poolmaster_init(&slvr_poolmaster,
 	    struct slvr, slvr_lentry, PPMF_AUTO, 64, 64, 0,
 	    NULL, NULL, NULL, "slvr");
@@ -1089,7 +1680,11 @@ slvr_cache_init(void)
 	lc_reginit(&sli_readaheadq, struct sli_readaheadrq, rarq_lentry,
 	    "readaheadq");
 
-	lc_reginit(&sli_lruslvrs, struct slvr, slvr_lentry, "lruslvrs");
+	if (slcfg_local->cfg_direct_io_min)
+		sli_dio_init();
+
+	/* sized by sl_buffer_cache_init() */
+	slvr_2q_init(&sli_slvrcache, SLVR_2QP_2Q, 0, "slvr");
 	lc_reginit(&sli_crcqslvrs, struct slvr, slvr_lentry, "crcqslvrs");
 
 	if (slcfg_local->cfg_async_io) {
@@ -1103,15 +1698,26 @@ slvr_cache_init(void)
 		    64, 1024, NULL, NULL, NULL, "aiocbr");
 		sli_aiocbr_pool = psc_poolmaster_getmgr(&sli_aiocbr_poolmaster);
 
-		lc_reginit(&sli_iocb_pndg, struct sli_iocb, iocb_lentry,
-		    "iocbpndg");
+#ifdef HAVE_IO_URING
+		if (slcfg_local->cfg_async_io == SLCFG_ASYNCIO_URING)
+			sli_uring_init();
+		else
+#endif
+		{
+			lc_reginit(&sli_iocb_pndg, struct sli_iocb,
+			    iocb_lentry, "iocbpndg");
 
-		pscthr_init(SLITHRT_AIO, sliaiothr_main, NULL, 0,
-		    "sliaiothr");
+			pscthr_init(SLITHRT_AIO, sliaiothr_main, NULL, 0,
+			    "sliaiothr");
+		}
 	}
 
 	sl_buffer_cache_init();
 	slvr_worker_init();
+
+	for (i = 0; i < NSLI_READAHEAD_THRS; i++)
+		pscthr_init(SLITHRT_READAHEAD, slireadaheadthr_main, NULL,
+		    0, "slirathr%d", i);
 }
 
 #if PFL_DEBUG > 0
@@ -1133,6 +1739,7 @@ dump_sliver_flags(int fl)
 	PFL_PRFLAG(SLVRF_CRCDIRTY, &fl, &seq);
 	PFL_PRFLAG(SLVRF_FREEING, &fl, &seq);
 	PFL_PRFLAG(SLVRF_ACCESSED, &fl, &seq);
+	PFL_PRFLAG(SLVRF_READAHEAD, &fl, &seq);
 	if (fl)
 		printf(" unknown: %x", fl);
 	printf("\n");
@@ -35,6 +35,9 @@
 #include "bmap_iod.h"
 #include "slab.h"
 #include "slashrpc.h"
+#include "slvr_2q.h"
+#include "slvr_blk.h"
+#include "slvr_dio.h"
 #include "subsys_iod.h"
 
 struct bmap_iod_info;
@@ -48,6 +51,7 @@ struct bmap_iod_info;
 struct slvr {
 	uint16_t		 slvr_num;	/* bmap slvr offset */
 	uint16_t		 slvr_flags;	/* see SLVR_* flags */
+	uint32_t		 slvr_validblks;/* blocks in sync with disk */
 	uint32_t		 slvr_refcnt;
 	/*
 	 * KISS: A sliver marked with an error must be freed.
@@ -62,14 +66,15 @@ struct slvr {
 	struct sl_buffer	*slvr_slab;
 	struct sli_aiocb_reply  *slvr_aioreply;
 	struct psclist_head	 slvr_lentry;	/* dirty queue */
+	struct slvr_2q_ent	 slvr_2qent;	/* replacement policy */
 	SPLAY_ENTRY(slvr)	 slvr_tentry;	/* bmap tree entry */
 };
 
 /* slvr_flags */
 #define SLVRF_FAULTING		(1 <<  0)	/* contents loading from disk or net */
-#define SLVRF_DATARDY		(1 <<  1)	/* ready for read / write activity */
+#define SLVRF_DATARDY		(1 <<  1)	/* all blocks valid */
 #define SLVRF_DATAERR		(1 <<  2)	/* a sliver can't be reused if marked error */
-#define SLVRF_LRU		(1 <<  3)	/* cached but not dirty */
+#define SLVRF_LRU		(1 <<  3)	/* cached, not on the CRC queue */
 /*
  * This flag acts like an extra reference count to the sliver.  I would
  * like to get rid of this special case.  However, maybe someday, we
@@ -78,6 +83,7 @@ struct slvr {
 #define SLVRF_CRCDIRTY		(1 <<  4)	/* CRC does not match cached buffer */
 #define SLVRF_FREEING		(1 <<  5)	/* sliver is being reaped */
 #define SLVRF_ACCESSED		(1 <<  6)	/* actually used by a client */
+#define SLVRF_READAHEAD		(1 <<  7)	/* prefetched, not yet read by a client */
 
 #define SLVR_LOCK(s)		spinlock(&(s)->slvr_lock)
 #define SLVR_ULOCK(s)		freelock(&(s)->slvr_lock)
@@ -105,6 +111,8 @@ struct slvr {
 	} while (0)
 
 #define slvr_2_bii(s)		((s)->slvr_bii)
+#define slvr_from_2qent(e)						\
+	((struct slvr *)((char *)(e) - offsetof(struct slvr, slvr_2qent)))
 #define slvr_2_bmap(s)		bii_2_bmap(slvr_2_bii(s))
 #define slvr_2_fcmh(s)		slvr_2_bmap(s)->bcm_fcmh
 #define slvr_2_fii(s)		fcmh_2_fii(slvr_2_fcmh(s))
@@ -126,10 +134,10 @@ struct slvr {
 
 #define DEBUG_SLVR(level, s, fmt, ...)					\
 	psclogs((level), SLISS_SLVR, "slvr@%p num=%hu ref=%u "		\
-	    "ts="PSCPRI_TIMESPEC" "					\
+	    "valid=%#x ts="PSCPRI_TIMESPEC" "				\
 	    "bii=%p slab=%p bmap=%p fid="SLPRI_FID" iocb=%p flgs="	\
-	    "%s%s%s%s%s%s%s :: " fmt,					\
-	    (s), (s)->slvr_num, (s)->slvr_refcnt,			\
+	    "%s%s%s%s%s%s%s%s :: " fmt,					\
+	    (s), (s)->slvr_num, (s)->slvr_refcnt, (s)->slvr_validblks,	\
 	    PSCPRI_TIMESPEC_ARGS(&(s)->slvr_ts),			\
 	    (s)->slvr_bii, (s)->slvr_slab,				\
 	    (s)->slvr_bii ? slvr_2_bmap(s) : NULL,			\
@@ -143,6 +151,7 @@ struct slvr {
 	    (s)->slvr_flags & SLVRF_CRCDIRTY	? "D" : "-",		\
 	    (s)->slvr_flags & SLVRF_FREEING	? "F" : "-",		\
 	    (s)->slvr_flags & SLVRF_ACCESSED	? "a" : "-",		\
+	    (s)->slvr_flags & SLVRF_READAHEAD	? "r" : "-",		\
 	    ##__VA_ARGS__)
 
 #define RIC_MAX_SLVRS_PER_IO	2
@@ -170,6 +179,7 @@ struct sli_iocb {
 	struct psc_listentry	  iocb_lentry;
 	struct slvr		 *iocb_slvr;
 	struct aiocb		  iocb_aiocb;
+	struct timespec		  iocb_ts;	/* submission time */
 	void			(*iocb_cbf)(struct sli_iocb *);
 	int			  iocb_rc;
 };
@@ -180,8 +190,10 @@ struct sli_iocb {
 struct slvr *
 	_slvr_lookup(const struct pfl_callerinfo *pci, uint32_t,
 	    struct bmap_iod_info *);
+void	slvr_bcr_addcrc(struct bmap_iod_info *, uint16_t, uint64_t);
 void	slvr_cache_init(void);
 int	slvr_do_crc(struct slvr *, uint64_t *);
+ssize_t	slvr_fsbytes_fill(struct slvr *, uint32_t);
 ssize_t	slvr_fsbytes_wio(struct slvr *, uint32_t, uint32_t);
 ssize_t	slvr_io_prep(struct slvr *, uint32_t, uint32_t, enum rw, int);
 
@@ -205,8 +217,27 @@ struct sli_aiocb_reply *
 
 void	sli_aio_aiocbr_release(struct sli_aiocb_reply *);
 
+void	sli_uring_addbuf(struct sl_buffer *);
+void	sli_uring_delbuf(struct sl_buffer *);
+
 int	slvr_buffer_reap(struct psc_poolmgr *);
+int	slvr_reap(int, int);
+
+void	slvr_readahead(struct bmap_iod_info *, struct slvr **, int);
 
+/*
+ * Bounds on the per-bmap readahead window, in slivers.  The window
+ * starts at the minimum once sequential access is seen, doubles each
+ * time a prefetched sliver is read, and halves each time one is
+ * reclaimed unread.
+ */
+#define SLI_READAHEAD_MIN	2
+#define SLI_READAHEAD_MAX	32
+
+/*
+ * Prefetch request: rarq_off and rarq_size are byte offsets relative to
+ * the bmap, sliver aligned.
+ */
 struct sli_readaheadrq {
 	struct sl_fidgen	rarq_fg;
 	sl_bmapno_t		rarq_bno;
@@ -216,9 +247,10 @@ struct sli_readaheadrq {
 };
 
 extern struct psc_poolmgr	*sli_readaheadrq_pool;
-extern struct psc_listcache	 sli_lruslvrs;
+extern struct slvr_2q		 sli_slvrcache;
 extern struct psc_listcache	 sli_crcqslvrs;
 extern struct psc_listcache	 sli_readaheadq;
+extern int			 sli_readahead_max;
 extern struct psc_waitq		 sli_slvr_waitq;
 
 static __inline int
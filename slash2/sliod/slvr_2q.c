@@ -0,0 +1,324 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * 2Q replacement policy for the sliver cache, see slvr_2q.h.
+ */
+
+#include <string.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/hashtbl.h"
+#include "pfl/list.h"
+#include "pfl/lock.h"
+#include "pfl/opstats.h"
+#include "pfl/pool.h"
+
+#include "slvr_2q.h"
+
+__static uint64_t
+slvr_2q_hashkey(const struct slvr_2q_key *k)
+{
+	uint64_t h;
+
+	h = k->sqk_fid * UINT64_C(0x9e3779b97f4a7c15);
+	h ^= ((uint64_t)k->sqk_bno << 20) | k->sqk_slvrno;
+	return (h ^ (h >> 29));
+}
+
+__static int
+slvr_2q_ghostcmp(const void *a, const void *b)
+{
+	const struct slvr_2q_ghost *g = b;
+	const struct slvr_2q_key *k = a;
+
+	return (k->sqk_fid == g->sqg_key.sqk_fid &&
+	    k->sqk_bno == g->sqg_key.sqk_bno &&
+	    k->sqk_slvrno == g->sqg_key.sqk_slvrno);
+}
+
+__static void
+slvr_2q_ghost_drop(struct slvr_2q *q, struct slvr_2q_ghost *g)
+{
+	psclist_del(&g->sqg_lentry, &q->sq_a1out);
+	psc_hashent_remove(&q->sq_ghosts, g);
+	q->sq_na1out--;
+	psc_pool_return(q->sq_ghost_pool, g);
+}
+
+/*
+ * Remember the key of an object evicted from A1in, forgetting the
+ * oldest keys beyond the A1out bound.
+ */
+__static void
+slvr_2q_ghost_add(struct slvr_2q *q, const struct slvr_2q_key *k)
+{
+	struct slvr_2q_ghost *g;
+
+	while (q->sq_na1out && q->sq_na1out >= q->sq_kout)
+		slvr_2q_ghost_drop(q, psc_listhd_first_obj(
+		    &q->sq_a1out, struct slvr_2q_ghost, sqg_lentry));
+	if (q->sq_kout == 0)
+		return;
+
+	g = psc_pool_get(q->sq_ghost_pool);
+	memset(g, 0, sizeof(*g));
+	INIT_PSC_LISTENTRY(&g->sqg_lentry);
+	psc_hashent_init(&q->sq_ghosts, g);
+	g->sqg_key = *k;
+	g->sqg_hkey = slvr_2q_hashkey(k);
+	psc_hashtbl_add_item(&q->sq_ghosts, g);
+	psclist_add_tail(&g->sqg_lentry, &q->sq_a1out);
+	q->sq_na1out++;
+}
+
+/*
+ * Initialize a sliver cache policy.
+ * @q: policy state.
+ * @policy: SLVR_2QP_*.
+ * @size: number of objects the cache holds.
+ * @name: prefix for the pool, table and opstats names.
+ */
+void
+slvr_2q_init(struct slvr_2q *q, int policy, int size, const char *name)
+{
+	memset(q, 0, sizeof(*q));
+	INIT_SPINLOCK(&q->sq_lock);
+	INIT_PSCLIST_HEAD(&q->sq_a1in);
+	INIT_PSCLIST_HEAD(&q->sq_am);
+	INIT_PSCLIST_HEAD(&q->sq_a1out);
+	q->sq_policy = policy;
+
+	psc_hashtbl_init(&q->sq_ghosts, 0, struct slvr_2q_ghost,
+	    sqg_hkey, sqg_hentry, 1023, slvr_2q_ghostcmp, "%s-ghost",
+	    name);
+	psc_poolmaster_init(&q->sq_ghost_poolmaster,
+	    struct slvr_2q_ghost, sqg_lentry, PPMF_AUTO, 64, 64, 0,
+	    NULL, NULL, NULL, "%s-ghost", name);
+	q->sq_ghost_pool = psc_poolmaster_getmgr(
+	    &q->sq_ghost_poolmaster);
+
+	q->sq_opst_hits = pfl_opstat_initf(OPSTF_BASE10, "%s-hit",
+	    name);
+	q->sq_opst_misses = pfl_opstat_initf(OPSTF_BASE10, "%s-miss",
+	    name);
+	q->sq_opst_ghosthits = pfl_opstat_initf(OPSTF_BASE10,
+	    "%s-ghost-hit", name);
+	q->sq_opst_evict_a1in = pfl_opstat_initf(OPSTF_BASE10,
+	    "%s-evict-a1in", name);
+	q->sq_opst_evict_am = pfl_opstat_initf(OPSTF_BASE10,
+	    "%s-evict-am", name);
+
+	slvr_2q_setsize(q, size);
+}
+
+/*
+ * Set the number of objects the cache holds, which scales the A1in
+ * target and the A1out bound.
+ */
+void
+slvr_2q_setsize(struct slvr_2q *q, int size)
+{
+	SLVR_2Q_LOCK(q);
+	q->sq_size = size;
+	q->sq_kin = MAX(1, size * SLVR_2Q_KIN / 100);
+	q->sq_kout = size * SLVR_2Q_KOUT / 100;
+	while (q->sq_na1out > q->sq_kout)
+		slvr_2q_ghost_drop(q, psc_listhd_first_obj(
+		    &q->sq_a1out, struct slvr_2q_ghost, sqg_lentry));
+	SLVR_2Q_ULOCK(q);
+}
+
+/*
+ * Account for a miss: an object with the key in @e has just been
+ * faulted into the cache.
+ */
+void
+slvr_2q_insert(struct slvr_2q *q, struct slvr_2q_ent *e)
+{
+	struct slvr_2q_ghost *g = NULL;
+	uint64_t hkey;
+
+	psc_assert(e->sqe_queue == SLVR_2Q_NONE);
+	INIT_PSC_LISTENTRY(&e->sqe_lentry);
+	pfl_opstat_incr(q->sq_opst_misses);
+
+	SLVR_2Q_LOCK(q);
+	if (q->sq_na1out) {
+		hkey = slvr_2q_hashkey(&e->sqe_key);
+		g = psc_hashtbl_search_cmp(&q->sq_ghosts, &e->sqe_key,
+		    &hkey);
+	}
+	if (g) {
+		pfl_opstat_incr(q->sq_opst_ghosthits);
+		slvr_2q_ghost_drop(q, g);
+	}
+	if (g || q->sq_policy == SLVR_2QP_LRU) {
+		e->sqe_queue = SLVR_2Q_AM;
+		psclist_add_tail(&e->sqe_lentry, &q->sq_am);
+		q->sq_nam++;
+	} else {
+		e->sqe_queue = SLVR_2Q_A1IN;
+		psclist_add_tail(&e->sqe_lentry, &q->sq_a1in);
+		q->sq_na1in++;
+	}
+	SLVR_2Q_ULOCK(q);
+}
+
+/*
+ * Account for a hit on a cached object.  References while on A1in are
+ * correlated with the one that faulted it in and leave it in place.
+ */
+void
+slvr_2q_access(struct slvr_2q *q, struct slvr_2q_ent *e)
+{
+	pfl_opstat_incr(q->sq_opst_hits);
+
+	SLVR_2Q_LOCK(q);
+	switch (e->sqe_queue) {
+	case SLVR_2Q_AM:
+		psclist_del(&e->sqe_lentry, &q->sq_am);
+		psclist_add_tail(&e->sqe_lentry, &q->sq_am);
+		break;
+	case SLVR_2Q_A1IN:
+		/* left over from a policy switch */
+		if (q->sq_policy == SLVR_2QP_LRU) {
+			psclist_del(&e->sqe_lentry, &q->sq_a1in);
+			q->sq_na1in--;
+			psclist_add_tail(&e->sqe_lentry, &q->sq_am);
+			q->sq_nam++;
+			e->sqe_queue = SLVR_2Q_AM;
+		}
+		break;
+	}
+	SLVR_2Q_ULOCK(q);
+}
+
+__static void
+slvr_2q_unlink(struct slvr_2q *q, struct slvr_2q_ent *e)
+{
+	switch (e->sqe_queue) {
+	case SLVR_2Q_A1IN:
+		psclist_del(&e->sqe_lentry, &q->sq_a1in);
+		q->sq_na1in--;
+		break;
+	case SLVR_2Q_AM:
+		psclist_del(&e->sqe_lentry, &q->sq_am);
+		q->sq_nam--;
+		break;
+	}
+	e->sqe_queue = SLVR_2Q_NONE;
+}
+
+/*
+ * Drop an object that is going away for reasons other than replacement
+ * (invalidation, I/O error, or after slvr_2q_reclaim() chose it).
+ */
+void
+slvr_2q_remove(struct slvr_2q *q, struct slvr_2q_ent *e)
+{
+	SLVR_2Q_LOCK(q);
+	slvr_2q_unlink(q, e);
+	SLVR_2Q_ULOCK(q);
+}
+
+__static void
+slvr_2q_evict(struct slvr_2q *q, struct slvr_2q_ent *e)
+{
+	if (e->sqe_queue == SLVR_2Q_A1IN) {
+		pfl_opstat_incr(q->sq_opst_evict_a1in);
+		if (q->sq_policy == SLVR_2QP_2Q)
+			slvr_2q_ghost_add(q, &e->sqe_key);
+	} else
+		pfl_opstat_incr(q->sq_opst_evict_am);
+	slvr_2q_unlink(q, e);
+}
+
+/*
+ * Pick up to @n objects to evict in policy order: the overflow of A1in
+ * beyond its target first, then the LRU end of Am, then whatever is
+ * left on A1in.  @cbf is called with the policy locked on each
+ * candidate and returns nonzero if it claims it; claimed objects are
+ * unlinked before return, so the slvr_2q_remove() done when they are
+ * freed finds them on no queue and does nothing.
+ * Returns the number claimed.
+ */
+int
+slvr_2q_reclaim(struct slvr_2q *q, int n,
+    int (*cbf)(struct slvr_2q_ent *, void *), void *arg)
+{
+	struct slvr_2q_ent *e, *next;
+	int nclaimed = 0;
+
+	SLVR_2Q_LOCK(q);
+	psclist_for_each_entry_safe(e, next, &q->sq_a1in, sqe_lentry) {
+		if (nclaimed >= n || (q->sq_policy == SLVR_2QP_2Q &&
+		    q->sq_na1in <= q->sq_kin))
+			break;
+		if (cbf(e, arg)) {
+			slvr_2q_evict(q, e);
+			nclaimed++;
+		}
+	}
+	psclist_for_each_entry_safe(e, next, &q->sq_am, sqe_lentry) {
+		if (nclaimed >= n)
+			break;
+		if (cbf(e, arg)) {
+			slvr_2q_evict(q, e);
+			nclaimed++;
+		}
+	}
+	psclist_for_each_entry_safe(e, next, &q->sq_a1in, sqe_lentry) {
+		if (nclaimed >= n)
+			break;
+		if (cbf(e, arg)) {
+			slvr_2q_evict(q, e);
+			nclaimed++;
+		}
+	}
+	SLVR_2Q_ULOCK(q);
+	return (nclaimed);
+}
+
+/*
+ * Visit every cached object, A1in first, with the policy locked.  The
+ * walk stops when @cbf returns nonzero, which is then returned.
+ */
+int
+slvr_2q_walk(struct slvr_2q *q, int (*cbf)(struct slvr_2q_ent *,
+    void *), void *arg)
+{
+	struct slvr_2q_ent *e;
+	int rc = 0;
+
+	SLVR_2Q_LOCK(q);
+	psclist_for_each_entry(e, &q->sq_a1in, sqe_lentry)
+		if ((rc = cbf(e, arg)))
+			goto out;
+	psclist_for_each_entry(e, &q->sq_am, sqe_lentry)
+		if ((rc = cbf(e, arg)))
+			goto out;
+ out:
+	SLVR_2Q_ULOCK(q);
+	return (rc);
+}
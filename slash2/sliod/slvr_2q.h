@@ -0,0 +1,122 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Replacement policy for the sliver cache.
+ *
+ * The default is 2Q (Johnson & Shasha, VLDB '94).  A sliver faulted in
+ * for the first time goes on the A1in FIFO, and further references
+ * while it sits there are treated as correlated (e.g. the several RPCs
+ * that make up one large read) and do not promote it.  When A1in
+ * overflows its share of the cache, its oldest slivers are evicted and
+ * their keys remembered on the A1out ghost FIFO.  A sliver faulted in
+ * again while its key is still on A1out has proven itself and goes on
+ * the Am LRU, which a sequential scan can only reach by rereading.
+ *
+ * The policy core knows nothing about slivers beyond their key so the
+ * simulator in tests/slvrcache can drive it directly.
+ */
+
+#ifndef _SLVR_2Q_H_
+#define _SLVR_2Q_H_
+
+#include "pfl/hashtbl.h"
+#include "pfl/list.h"
+#include "pfl/lock.h"
+#include "pfl/pool.h"
+
+#include "sltypes.h"
+
+struct pfl_opstat;
+
+/* policies */
+#define SLVR_2QP_2Q		0
+#define SLVR_2QP_LRU		1		/* plain LRU, for comparison */
+#define SLVR_2QP_MAX		2
+
+/* queues */
+#define SLVR_2Q_NONE		0		/* not cached */
+#define SLVR_2Q_A1IN		1		/* referenced once, FIFO */
+#define SLVR_2Q_AM		2		/* re-referenced, LRU */
+
+/* share of the cache held by A1in and remembered by A1out, in percent */
+#define SLVR_2Q_KIN		25
+#define SLVR_2Q_KOUT		50
+
+struct slvr_2q_key {
+	slfid_t			 sqk_fid;
+	sl_bmapno_t		 sqk_bno;
+	uint32_t		 sqk_slvrno;
+};
+
+/* embedded in each cached object */
+struct slvr_2q_ent {
+	struct psclist_head	 sqe_lentry;
+	struct slvr_2q_key	 sqe_key;
+	int			 sqe_queue;
+};
+
+/* key of an object recently evicted from A1in */
+struct slvr_2q_ghost {
+	struct pfl_hashentry	 sqg_hentry;
+	struct psclist_head	 sqg_lentry;
+	struct slvr_2q_key	 sqg_key;
+	uint64_t		 sqg_hkey;
+};
+
+struct slvr_2q {
+	psc_spinlock_t		 sq_lock;
+	int			 sq_policy;	/* SLVR_2QP_* */
+	int			 sq_size;	/* #objects the cache holds */
+	int			 sq_kin;	/* A1in target length */
+	int			 sq_kout;	/* A1out bound */
+	int			 sq_na1in;
+	int			 sq_nam;
+	int			 sq_na1out;
+	struct psclist_head	 sq_a1in;
+	struct psclist_head	 sq_am;
+	struct psclist_head	 sq_a1out;
+	struct psc_hashtbl	 sq_ghosts;	/* A1out lookup */
+	struct psc_poolmaster	 sq_ghost_poolmaster;
+	struct psc_poolmgr	*sq_ghost_pool;
+
+	struct pfl_opstat	*sq_opst_hits;
+	struct pfl_opstat	*sq_opst_misses;
+	struct pfl_opstat	*sq_opst_ghosthits;
+	struct pfl_opstat	*sq_opst_evict_a1in;
+	struct pfl_opstat	*sq_opst_evict_am;
+};
+
+#define SLVR_2Q_LOCK(q)		spinlock(&(q)->sq_lock)
+#define SLVR_2Q_ULOCK(q)	freelock(&(q)->sq_lock)
+
+void	slvr_2q_init(struct slvr_2q *, int, int, const char *);
+void	slvr_2q_setsize(struct slvr_2q *, int);
+void	slvr_2q_insert(struct slvr_2q *, struct slvr_2q_ent *);
+void	slvr_2q_access(struct slvr_2q *, struct slvr_2q_ent *);
+void	slvr_2q_remove(struct slvr_2q *, struct slvr_2q_ent *);
+int	slvr_2q_reclaim(struct slvr_2q *, int,
+	    int (*)(struct slvr_2q_ent *, void *), void *);
+int	slvr_2q_walk(struct slvr_2q *,
+	    int (*)(struct slvr_2q_ent *, void *), void *);
+
+#endif /* _SLVR_2Q_H_ */
@@ -0,0 +1,128 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Sliver block validity helpers, see slvr_blk.h.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+
+#include "slvr_blk.h"
+
+/*
+ * Determine which blocks must be faulted in before a write of @len
+ * bytes at sliver offset @off can be applied: the first and last
+ * blocks of the range if the write only partially covers them and
+ * they are not already in @valid.
+ */
+uint32_t
+slvr_blks_edges(uint32_t off, uint32_t len, uint32_t valid)
+{
+	uint32_t need = 0;
+
+	psc_assert(len && off + len <= SLASH_SLVR_SIZE);
+
+	if (off & SLASH_SLVR_BLKMASK)
+		need |= SLVR_BLKS(off / SLASH_SLVR_BLKSZ,
+		    off / SLASH_SLVR_BLKSZ);
+	if ((off + len) & SLASH_SLVR_BLKMASK)
+		need |= SLVR_BLKS((off + len) / SLASH_SLVR_BLKSZ,
+		    (off + len) / SLASH_SLVR_BLKSZ);
+	return (need & ~valid);
+}
+
+/*
+ * Decide what must be faulted in before an I/O of @len bytes at sliver
+ * offset @off, given the blocks already @valid.  The blocks to read
+ * are returned in @need.
+ *
+ * A write only needs its partially covered edge blocks.  A read needs
+ * every block that is not valid.  A sliver that has nothing valid is
+ * read as a whole, which lets the read go asynchronous and have its
+ * stored CRC verified.  Otherwise only the missing blocks are filled
+ * in: valid blocks may have been written since the CRC was taken.
+ */
+int
+slvr_blks_prep(uint32_t off, uint32_t len, enum rw rw, uint32_t valid,
+    uint32_t *need)
+{
+	if (rw == SL_WRITE) {
+		*need = slvr_blks_edges(off, len, valid);
+		return (SLVR_BLKS_FILL);
+	}
+	*need = ~valid & SLVR_BLKS_ALL;
+	if (*need == SLVR_BLKS_ALL)
+		return (SLVR_BLKS_FULLREAD);
+	return (SLVR_BLKS_FILL);
+}
+
+/*
+ * Return the blocks valid once an I/O prepared by slvr_blks_prep() has
+ * completed, given the blocks @valid after faulting in.
+ */
+uint32_t
+slvr_blks_done(uint32_t off, uint32_t len, enum rw rw, uint32_t valid)
+{
+	if (rw == SL_WRITE)
+		return (valid | SLVR_BLKS_RANGE(off, len));
+	return (SLVR_BLKS_ALL);
+}
+
+/*
+ * Read the blocks in the @need mask of the sliver whose buffer is @base
+ * and which starts at @foff in the backing file @fd.  Adjacent blocks
+ * are read together.  Anything past EOF is zeroed.
+ * Returns the number of bytes read or -errno.
+ */
+ssize_t
+slvr_blks_read(int fd, void *base, off_t foff, uint32_t need)
+{
+	ssize_t rc, tot = 0;
+	size_t len;
+	char *p;
+	int i, n;
+
+	for (i = 0; i < SLASH_BLKS_PER_SLVR; i += n) {
+		if ((need & (1U << i)) == 0) {
+			n = 1;
+			continue;
+		}
+		for (n = 1; i + n < SLASH_BLKS_PER_SLVR &&
+		    need & (1U << (i + n)); n++)
+			;
+
+		p = (char *)base + i * SLASH_SLVR_BLKSZ;
+		len = n * SLASH_SLVR_BLKSZ;
+		rc = pread(fd, p, len, foff + i * SLASH_SLVR_BLKSZ);
+		if (rc == -1)
+			return (-errno);
+		if ((size_t)rc < len)
+			memset(p + rc, 0, len - rc);
+		tot += rc;
+	}
+	return (tot);
+}
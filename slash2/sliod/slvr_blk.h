@@ -0,0 +1,66 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Block validity tracking for slivers.
+ *
+ * Each sliver records which of its SLASH_SLVR_BLKSZ blocks hold the
+ * same data as the backing file in a bitmap.  A write that does not
+ * cover the whole sliver only needs its partially covered edge blocks
+ * faulted in; the remaining blocks are read lazily, when a read needs
+ * the whole sliver or the CRC worker checksums it.  A sliver with all
+ * its blocks valid is SLVRF_DATARDY.
+ */
+
+#ifndef _SLVR_BLK_H_
+#define _SLVR_BLK_H_
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+#include "cache_params.h"
+#include "sltypes.h"
+
+#define SLVR_BLKS_ALL							\
+	((uint32_t)((UINT64_C(1) << SLASH_BLKS_PER_SLVR) - 1))
+
+/* mask of blocks sblk through eblk inclusive */
+#define SLVR_BLKS(sblk, eblk)						\
+	((SLVR_BLKS_ALL >> (SLASH_BLKS_PER_SLVR - 1 - (eblk))) &	\
+	 (SLVR_BLKS_ALL << (sblk)))
+
+/* mask of blocks overlapping the sliver range [off, off + len) */
+#define SLVR_BLKS_RANGE(off, len)					\
+	SLVR_BLKS((off) / SLASH_SLVR_BLKSZ,				\
+	    ((off) + (len) - 1) / SLASH_SLVR_BLKSZ)
+
+/* slvr_blks_prep() return values */
+#define SLVR_BLKS_FILL		0	/* fill in the needed blocks */
+#define SLVR_BLKS_FULLREAD	1	/* read the sliver as a whole */
+
+uint32_t slvr_blks_done(uint32_t, uint32_t, enum rw, uint32_t);
+uint32_t slvr_blks_edges(uint32_t, uint32_t, uint32_t);
+int	 slvr_blks_prep(uint32_t, uint32_t, enum rw, uint32_t, uint32_t *);
+ssize_t	 slvr_blks_read(int, void *, off_t, uint32_t);
+
+#endif /* _SLVR_BLK_H_ */
@@ -0,0 +1,151 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Backing store side of the direct I/O path, see slvr_dio.h.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/crc.h"
+#include "pfl/log.h"
+#include "pfl/pool.h"
+
+#include "slvr_dio.h"
+
+/* bounce buffers kept around for direct I/O */
+#define SLI_DIOBUF_MIN		8
+#define SLI_DIOBUF_MAX		64
+
+struct psc_poolmaster	 sli_diobuf_poolmaster;
+struct psc_poolmgr	*sli_diobuf_pool;
+
+/*
+ * Determine whether a transfer of @len bytes at bmap offset @off may
+ * bypass the sliver cache.  Reads must start on a sliver boundary and
+ * may end short of the next one, e.g. at EOF; writes must cover whole
+ * slivers since O_DIRECT cannot write a partial block.
+ */
+int
+sli_dio_eligible(uint32_t off, uint32_t len, enum rw rw, size_t min)
+{
+	if (min == 0 || len < min)
+		return (0);
+	if (off % SLASH_SLVR_SIZE)
+		return (0);
+	if (rw == SL_WRITE)
+		return (len == SLASH_SLVR_SIZE);
+	return (len <= SLASH_SLVR_SIZE);
+}
+
+/*
+ * Decide whether an I/O on sliver @slvrno may bypass the cache and, if
+ * so, fence the sliver off in the bmap's @map until sli_dio_unfence().
+ * A cached copy (@cached) is always used for reads.  For writes, a
+ * clean idle copy is to be dropped since it would become stale, and a
+ * dirty or busy one (@busy) is written through the cache as usual.
+ * Only one bypass of a sliver may be in flight at a time.
+ */
+int
+sli_dio_fence(uint8_t *map, uint32_t slvrno, enum rw rw, int cached,
+    int busy)
+{
+	if (sli_dio_fenced(map, slvrno))
+		return (SLI_DIO_CACHED);
+	if (cached && (rw == SL_READ || busy))
+		return (SLI_DIO_CACHED);
+	map[slvrno / NBBY] |= 1 << (slvrno % NBBY);
+	return (cached ? SLI_DIO_INVALIDATE : SLI_DIO_BYPASS);
+}
+
+/*
+ * Lift the fence set by sli_dio_fence().  The caller must wake any
+ * lookup waiting on it.
+ */
+void
+sli_dio_unfence(uint8_t *map, uint32_t slvrno)
+{
+	psc_assert(sli_dio_fenced(map, slvrno));
+	map[slvrno / NBBY] &= ~(1 << (slvrno % NBBY));
+}
+
+/*
+ * Read the sliver at file offset @foff into @db, zeroing anything past
+ * EOF, and compute its CRC the same way slvr_do_crc() does.
+ * Returns the number of bytes read or -errno.
+ */
+ssize_t
+sli_dio_read(int fd, struct sli_diobuf *db, off_t foff, uint64_t *crcp)
+{
+	ssize_t rc;
+
+	rc = pread(fd, db->db_base, SLASH_SLVR_SIZE, foff);
+	if (rc == -1)
+		return (-errno);
+	if (rc < SLASH_SLVR_SIZE)
+		memset(db->db_base + rc, 0, SLASH_SLVR_SIZE - rc);
+	psc_crc64_calc(crcp, db->db_base, SLASH_SLVR_SIZE);
+	return (rc);
+}
+
+/*
+ * Write the sliver in @db at file offset @foff and compute its CRC.
+ * Returns 0 or -errno.
+ */
+ssize_t
+sli_dio_write(int fd, struct sli_diobuf *db, off_t foff, uint64_t *crcp)
+{
+	ssize_t rc;
+
+	psc_crc64_calc(crcp, db->db_base, SLASH_SLVR_SIZE);
+	rc = pwrite(fd, db->db_base, SLASH_SLVR_SIZE, foff);
+	if (rc == -1)
+		return (-errno);
+	if (rc != SLASH_SLVR_SIZE)
+		return (-EIO);
+	return (0);
+}
+
+struct sli_diobuf *
+sli_diobuf_get(void)
+{
+	return (psc_pool_get(sli_diobuf_pool));
+}
+
+void
+sli_diobuf_put(struct sli_diobuf *db)
+{
+	psc_pool_return(sli_diobuf_pool, db);
+}
+
+void
+sli_dio_init(void)
+{
+	psc_poolmaster_init(&sli_diobuf_poolmaster, struct sli_diobuf,
+	    db_lentry, PPMF_AUTO | PPMF_ALIGN, SLI_DIOBUF_MIN,
+	    SLI_DIOBUF_MIN, SLI_DIOBUF_MAX, NULL, NULL, NULL,
+	    "diobuf");
+	sli_diobuf_pool = psc_poolmaster_getmgr(&sli_diobuf_poolmaster);
+}
@@ -0,0 +1,75 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright 2008-2015, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Direct I/O path for large aligned client transfers.  When enabled by
+ * the direct_io_min setting, whole-sliver transfers skip the sliver
+ * cache: the bulk lands in an aligned bounce buffer that is read or
+ * written with O_DIRECT, and the sliver CRC is computed on that buffer.
+ * Coherency with the cache is kept by sli_dio_begin(), see slvr.c,
+ * which fences slivers off from the cache as sli_dio_fence() decides.
+ */
+
+#ifndef _SLVR_DIO_H_
+#define _SLVR_DIO_H_
+
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include <stdint.h>
+
+#include "pfl/list.h"
+
+#include "cache_params.h"
+#include "sltypes.h"
+
+struct bmap_iod_info;
+
+struct sli_diobuf {
+	char			 db_base[SLASH_SLVR_SIZE];	/* page aligned */
+	struct psc_listentry	 db_lentry;
+};
+
+/* sli_dio_fence() return values */
+#define SLI_DIO_CACHED		0	/* go through the sliver cache */
+#define SLI_DIO_BYPASS		1	/* bypass, nothing cached */
+#define SLI_DIO_INVALIDATE	2	/* bypass, drop the cached copy */
+
+#define sli_dio_fenced(map, n)	((map)[(n) / NBBY] & (1 << ((n) % NBBY)))
+
+int	 sli_dio_eligible(uint32_t, uint32_t, enum rw, size_t);
+int	 sli_dio_fence(uint8_t *, uint32_t, enum rw, int, int);
+void	 sli_dio_unfence(uint8_t *, uint32_t);
+ssize_t	 sli_dio_read(int, struct sli_diobuf *, off_t, uint64_t *);
+ssize_t	 sli_dio_write(int, struct sli_diobuf *, off_t, uint64_t *);
+
+struct sli_diobuf *
+	 sli_diobuf_get(void);
+void	 sli_diobuf_put(struct sli_diobuf *);
+void	 sli_dio_init(void);
+
+int	 sli_dio_begin(struct bmap_iod_info *, uint32_t, enum rw);
+void	 sli_dio_end(struct bmap_iod_info *, uint32_t);
+
+extern struct psc_poolmgr	*sli_diobuf_pool;
+
+#endif /* _SLVR_DIO_H_ */
@@ -46,17 +46,43 @@
 
 struct psc_poolmaster		 bmap_crcupd_poolmaster;
 struct psc_poolmgr		*bmap_crcupd_pool;
-psc_atomic32_t			 sli_ninfl_bcrcupd;
 
-struct psc_listcache		 bcr_ready;
+int	bcr_cmp(const void *, const void *);
+
+/*
+ * bcrs ready for transmission, ordered by age with full ones first.
+ * sli_bcr_waitq is signalled whenever the head may have changed or an
+ * inflight slot has been freed up.
+ */
+psc_spinlock_t			 sli_bcr_lock = SPINLOCK_INIT;
+struct pfl_heap			 sli_bcr_heap = HEAP_INIT(struct bcrcupd,
+				    bcr_hpentry, bcr_cmp);
+struct psc_waitq		 sli_bcr_waitq = PSC_WAITQ_INIT;
+
 struct timespec			 sli_bcr_pause = { 0, 200000L };
 struct psc_waitq		 sli_slvr_waitq = PSC_WAITQ_INIT;
 
+int
+bcr_cmp(const void *a, const void *b)
+{
+	const struct bcrcupd *x = a, *y = b;
+	int ex, ey;
+
+	ex = x->bcr_flags & BCRF_EXPEDITE;
+	ey = y->bcr_flags & BCRF_EXPEDITE;
+	if (ex != ey)
+		return (CMP(ey, ex));
+	if (x->bcr_age.tv_sec != y->bcr_age.tv_sec)
+		return (CMP(x->bcr_age.tv_sec, y->bcr_age.tv_sec));
+	return (CMP(x->bcr_age.tv_nsec, y->bcr_age.tv_nsec));
+}
+
 int
 sli_rmi_bcrcupd_cb(struct pscrpc_request *rq,
     struct pscrpc_async_args *args)
 {
 	struct slashrpc_cservice *csvc = args->pointer_arg[1];
+	struct resm_iod_info *rmii = args->pointer_arg[2];
 	struct psc_dynarray *a = args->pointer_arg[0];
 	struct srm_bmap_crcwrt_rep *mp;
 	struct srm_bmap_crcwrt_req *mq;
@@ -82,9 +108,10 @@ sli_rmi_bcrcupd_cb(struct pscrpc_request *rq,
 		bii_2_bmap(bii)->bcm_flags &= ~BMAPF_CRUD_INFLIGHT;
 
 		if (rc) {
-			BII_ULOCK(bii);
 			DEBUG_BCR(PLL_ERROR, bcr, "rescheduling");
 			OPSTAT_INCR("crc-update-cb-failure");
+			bcr_ready_sched(bcr);
+			BII_ULOCK(bii);
 			continue;
 		}
 		bcr_ready_remove(bcr);
@@ -104,7 +131,10 @@ sli_rmi_bcrcupd_cb(struct pscrpc_request *rq,
 
 	sl_csvc_decref(csvc);
 
-	psc_atomic32_dec(&sli_ninfl_bcrcupd);
+	spinlock(&sli_bcr_lock);
+	rmii->rmii_ninfl_crcup--;
+	psc_waitq_wakeone(&sli_bcr_waitq);
+	freelock(&sli_bcr_lock);
 
 	return (1);
 }
@@ -112,12 +142,13 @@ sli_rmi_bcrcupd_cb(struct pscrpc_request *rq,
 /*
  * Send an RPC containing CRC updates for slivers to the MDS.  To avoid
  * potential woes caused by out-of-order deliveries, we allow at most
- * only one inflight CRC update RPC at any time.  Note that this does
+ * one inflight CRC update per bmap at any time.  Note that this does
  * not prevent us from having multiple threads to do the CRC
  * calculation.
  */
 __static int
-slvr_worker_crcup_genrq(const struct psc_dynarray *bcrs)
+slvr_worker_crcup_genrq(const struct psc_dynarray *bcrs,
+    struct resm_iod_info *rmii)
 {
 	struct pscrpc_request *rq = NULL;
 	struct slashrpc_cservice *csvc;
@@ -143,6 +174,7 @@ slvr_worker_crcup_genrq(const struct psc_dynarray *bcrs)
 	rq->rq_interpret_reply = sli_rmi_bcrcupd_cb;
 	rq->rq_async_args.pointer_arg[0] = (void *)bcrs;
 	rq->rq_async_args.pointer_arg[1] = csvc;
+	rq->rq_async_args.pointer_arg[2] = rmii;
 
 	len = mq->ncrc_updates * sizeof(struct srt_bmap_crcup);
 	iovs = PSCALLOC(sizeof(*iovs) * mq->ncrc_updates);
@@ -171,11 +203,18 @@ slvr_worker_crcup_genrq(const struct psc_dynarray *bcrs)
 	if (rc)
 		PFL_GOTOERR(out, rc);
 
+	/* Account before the callback can possibly run. */
+	spinlock(&sli_bcr_lock);
+	rmii->rmii_ninfl_crcup++;
+	freelock(&sli_bcr_lock);
+
 	rc = SL_NBRQSET_ADD(csvc, rq);
-	if (rc)
+	if (rc) {
+		spinlock(&sli_bcr_lock);
+		rmii->rmii_ninfl_crcup--;
+		freelock(&sli_bcr_lock);
 		PFL_GOTOERR(out, rc);
-
-	psc_atomic32_inc(&sli_ninfl_bcrcupd);
+	}
 
   out:
 	PSCFREE(iovs);
@@ -188,103 +227,196 @@ slvr_worker_crcup_genrq(const struct psc_dynarray *bcrs)
 	return (rc);
 }
 
+/*
+ * Collect the bcrs which are due from the head of the ready heap.
+ * Returns with sli_bcr_lock released; if nothing is due, sleeps until
+ * something may be.
+ */
+__static void
+slicrudthr_getbcrs(struct psc_dynarray *bcrs,
+    struct resm_iod_info **rmiip)
+{
+	struct resm_iod_info *rmii;
+	struct timespec now, due;
+	struct bcrcupd *bcr;
+
+	spinlock(&sli_bcr_lock);
+	PFL_GETTIMESPEC(&now);
+	while ((bcr = pfl_heap_peek(&sli_bcr_heap))) {
+		if ((bcr->bcr_flags & BCRF_EXPEDITE) == 0) {
+			due = bcr->bcr_age;
+			due.tv_sec += BCR_BATCH_AGE;
+			if (timespeccmp(&now, &due, <))
+				break;
+		}
+		if (psc_dynarray_len(bcrs) == 0) {
+			rmii = *rmiip = resm2rmii(rmi_resm);
+			if (rmii->rmii_ninfl_crcup >= BCR_MAX_INFL) {
+				/* Woken by sli_rmi_bcrcupd_cb(). */
+				OPSTAT_INCR("crc-update-throttle");
+				psc_waitq_wait(&sli_bcr_waitq,
+				    &sli_bcr_lock);
+				return;
+			}
+		}
+		pfl_heap_shift(&sli_bcr_heap);
+		bcr->bcr_flags &= ~BCRF_QUEUED;
+		psc_dynarray_add(bcrs, bcr);
+		if (psc_dynarray_len(bcrs) == MAX_BMAP_NCRC_UPDATES)
+			break;
+	}
+
+	if (psc_dynarray_len(bcrs)) {
+		freelock(&sli_bcr_lock);
+		return;
+	}
+
+	/* Nothing due: sleep until the oldest bcr is or a new one arrives. */
+	if (bcr)
+		psc_waitq_waitabs(&sli_bcr_waitq, &sli_bcr_lock, &due);
+	else
+		psc_waitq_wait(&sli_bcr_waitq, &sli_bcr_lock);
+}
+
 void
 slicrudthr_main(struct psc_thread *thr)
 {
+	struct resm_iod_info *rmii;
 	struct psc_dynarray *bcrs;
-	struct timespec now, diff;
+	struct bmap_iod_info *bii;
 	struct bcrcupd *bcr;
 	int i, rc;
 
 	bcrs = PSCALLOC(sizeof(*bcrs));
-
 	while (pscthr_run(thr)) {
-#define MAX_INFL_BCRCUPD 128
-		/* XXX per-MDS */
-		while (psc_atomic32_read(&sli_ninfl_bcrcupd) >
-		    MAX_INFL_BCRCUPD)
-			usleep(3000);
-
-		LIST_CACHE_LOCK(&bcr_ready);
-		PFL_GETTIMESPEC(&now);
-		LIST_CACHE_FOREACH(bcr, &bcr_ready) {
-			psc_assert(bcr->bcr_crcup.nups > 0);
-
-			if (!BII_TRYLOCK(bcr->bcr_bii))
-				continue;
-
-			/*
-			 * Leave scheduled bcr's on the list so that in
-			 * case of a failure, ordering will be
-			 * maintained.
-			 */
-			if (bcr_2_bmap(bcr)->bcm_flags &
-			    BMAPF_CRUD_INFLIGHT) {
-				BII_ULOCK(bcr->bcr_bii);
-				continue;
-			}
-
-			timespecsub(&now, &bcr->bcr_age, &diff);
-			if (bcr->bcr_crcup.nups == MAX_BMAP_INODE_PAIRS ||
-			    diff.tv_sec >= BCR_BATCH_AGE) {
-				psc_dynarray_add(bcrs, bcr);
-				bcr->bcr_bii->bii_bcr = NULL;
-				bcr_2_bmap(bcr)->bcm_flags |=
-				    BMAPF_CRUD_INFLIGHT;
-			}
-
-			BII_ULOCK(bcr->bcr_bii);
-
-			DEBUG_BCR(PLL_DIAG, bcr,
-			    "scheduled nbcrs=%d total_bcrs=%d",
-			    psc_dynarray_len(bcrs),
-			    lc_nitems(&bcr_ready));
+		slicrudthr_getbcrs(bcrs, &rmii);
+		if (!psc_dynarray_len(bcrs))
+			continue;
 
-			if (psc_dynarray_len(bcrs) ==
-			    MAX_BMAP_NCRC_UPDATES)
-				break;
-		}
-		LIST_CACHE_ULOCK(&bcr_ready);
+		/*
+		 * Stop further CRCs from being added to the bcrs being
+		 * sent; they will start a new bcr queued behind these.
+		 */
+		DYNARRAY_FOREACH(bcr, i, bcrs) {
+			bii = bcr->bcr_bii;
+			BII_LOCK(bii);
+			psc_assert((bii_2_bmap(bii)->bcm_flags &
+			    BMAPF_CRUD_INFLIGHT) == 0);
+			bii_2_bmap(bii)->bcm_flags |= BMAPF_CRUD_INFLIGHT;
+			if (bii->bii_bcr == bcr)
+				bii->bii_bcr = NULL;
+			BII_ULOCK(bii);
 
-		if (!psc_dynarray_len(bcrs)) {
-			usleep(3000);
-			continue;
+			DEBUG_BCR(PLL_DIAG, bcr, "scheduled nbcrs=%d",
+			    psc_dynarray_len(bcrs));
 		}
 
 		OPSTAT_INCR("crc-update-push");
 
 		/*
-		 * If we fail to send an RPC, we must leave the
-		 * reference in the tree for future attempt(s).
-		 * Otherwise, the callback function (i.e.
-		 * sli_rmi_bcrcupd_cb) should remove them from the tree.
+		 * If we fail to send an RPC, we must put the bcrs back
+		 * on the heap for future attempt(s).  Otherwise, the
+		 * callback function (i.e. sli_rmi_bcrcupd_cb) should
+		 * dispose of them.
 		 */
-		rc = slvr_worker_crcup_genrq(bcrs);
+		rc = slvr_worker_crcup_genrq(bcrs, rmii);
 		if (rc) {
 			DYNARRAY_FOREACH(bcr, i, bcrs) {
-				BII_LOCK(bcr->bcr_bii);
-				bcr_2_bmap(bcr)->bcm_flags &=
+				bii = bcr->bcr_bii;
+				BII_LOCK(bii);
+				bii_2_bmap(bii)->bcm_flags &=
 				    ~BMAPF_CRUD_INFLIGHT;
-				//bcr->bcr_bii->bii_bcr = NULL;
-				BII_ULOCK(bcr->bcr_bii);
 
 				/*
 				 * There is a newer FID generation in
 				 * existence than our packaged update is
 				 * for, so this can be safely discarded.
 				 */
-				if (rc == ESTALE ||
-				    rc == EBADF) {
+				if (rc == ESTALE || rc == EBADF)
 					bcr_ready_remove(bcr);
+				else {
+					bcr_ready_sched(bcr);
+					BII_ULOCK(bii);
 				}
 			}
 			psc_dynarray_reset(bcrs);
+
+			/* Do not spin against a failing MDS. */
+			if (rc != ESTALE && rc != EBADF)
+				usleep(3000);
 		} else {
 			bcrs = PSCALLOC(sizeof(*bcrs));
 		}
 	}
 }
 
+/*
+ * Queue a CRC update of a sliver to the MDS, merging it into the bmap's
+ * pending CRC update RPC if there is one.
+ * @bii: bmap, locked.
+ * @slot: sliver number.
+ * @crc: new CRC of the sliver.
+ */
+void
+slvr_bcr_addcrc(struct bmap_iod_info *bii, uint16_t slot, uint64_t crc)
+{
+	struct bmap *b = bii_2_bmap(bii);
+	struct bcrcupd *bcr;
+
+	BII_LOCK_ENSURE(bii);
+	bcr = bii->bii_bcr;
+
+	if (bcr) {
+		uint32_t i;
+		int found;
+
+		psc_assert(bcr->bcr_crcup.bno == b->bcm_bmapno);
+		psc_assert(bcr->bcr_crcup.fg.fg_fid ==
+		    b->bcm_fcmh->fcmh_fg.fg_fid);
+		psc_assert(bcr->bcr_crcup.nups < MAX_BMAP_INODE_PAIRS);
+
+		/*
+		 * If we already have a slot for our slvr_num then reuse
+		 * it.
+		 */
+		for (i = 0, found = 0; i < bcr->bcr_crcup.nups; i++) {
+			if (bcr->bcr_crcup.crcs[i].slot == slot) {
+				found = 1;
+				break;
+			}
+		}
+
+		bcr->bcr_crcup.crcs[i].crc = crc;
+		if (!found) {
+			bcr->bcr_crcup.nups++;
+			bcr->bcr_crcup.crcs[i].slot = slot;
+		}
+
+		DEBUG_BCR(PLL_DIAG, bcr, "add to existing bcr slot=%d "
+		    "nups=%d", i, bcr->bcr_crcup.nups);
+
+		if (bcr->bcr_crcup.nups == MAX_BMAP_INODE_PAIRS) {
+			bcr->bcr_bii->bii_bcr = NULL;
+			bcr_ready_expedite(bcr);
+		}
+	} else {
+		bii->bii_bcr = bcr = psc_pool_get(bmap_crcupd_pool);
+		memset(bcr, 0, bmap_crcupd_pool->ppm_entsize);
+
+		INIT_PSC_LISTENTRY(&bcr->bcr_lentry);
+		COPYFG(&bcr->bcr_crcup.fg, &b->bcm_fcmh->fcmh_fg);
+
+		bcr->bcr_bii = bii;
+		bcr->bcr_crcup.bno = b->bcm_bmapno;
+		bcr->bcr_crcup.crcs[0].crc = crc;
+		bcr->bcr_crcup.crcs[0].slot = slot;
+		bcr->bcr_crcup.nups = 1;
+
+		PFL_GETTIMESPEC(&bcr->bcr_age);
+		bcr_ready_add(bcr);
+	}
+}
+
 /*
  * Attempt to setup a bmap CRC update RPC for dirty part(s) of a sliver.
  */
@@ -292,9 +424,9 @@ __static void
 slislvrthr_proc(struct slvr *s)
 {
 	struct bmap_iod_info *bii;
-	struct bcrcupd *bcr;
 	struct bmap *b;
 	uint64_t crc;
+	ssize_t rc;
 
 	/*
 	 * Take a reference now because we might free the sliver later.
@@ -303,12 +435,25 @@ slislvrthr_proc(struct slvr *s)
 	b = bii_2_bmap(bii);
 	bmap_op_start_type(b, BMAP_OPCNT_BCRSCHED);
 
+	/*
+	 * Partial writes only fault in their edge blocks, so fetch the
+	 * rest of the sliver before checksumming it.  We hold FAULTING
+	 * so no I/O can race with us.
+	 */
+	rc = slvr_fsbytes_fill(s, ~s->slvr_validblks & SLVR_BLKS_ALL);
+
 	SLVR_LOCK(s);
 	DEBUG_SLVR(PLL_DEBUG, s, "got sliver");
 
 	psc_assert(!(s->slvr_flags & SLVRF_LRU));
 	psc_assert(s->slvr_flags & SLVRF_CRCDIRTY);
-	psc_assert(s->slvr_flags & SLVRF_DATARDY);
+
+	if (rc) {
+		OPSTAT_INCR("slvr-crc-fill-fail");
+		s->slvr_err = rc;
+		s->slvr_flags |= SLVRF_DATAERR;
+	} else
+		s->slvr_flags |= SLVRF_DATARDY;
 
 	/*
 	 * OK, we've got a sliver to work on.  From this point until we
@@ -316,12 +461,13 @@ slislvrthr_proc(struct slvr *s)
 	 */
 
 	psc_assert(psclist_disjoint(&s->slvr_lentry));
-	psc_assert(slvr_do_crc(s, &crc));
+	if (!rc)
+		psc_assert(slvr_do_crc(s, &crc));
 
 	/* Be paranoid, ensure the sliver is not queued anywhere. */
 	psc_assert(psclist_disjoint(&s->slvr_lentry));
 
-	/* Put the slvr back to the LRU so it may have its slab reaped. */
+	/* Mark the slvr clean again so it may have its slab reaped. */
 
 	if ((s->slvr_flags & SLVRF_DATAERR) && !s->slvr_refcnt) {
 		OPSTAT_INCR("slvr-crc-remove2");
@@ -338,61 +484,17 @@ slislvrthr_proc(struct slvr *s)
 	s->slvr_flags |= SLVRF_LRU;
 	s->slvr_flags &= ~(SLVRF_CRCDIRTY | SLVRF_FAULTING);
 	OPSTAT_INCR("slvr-crc-requeue");
-	lc_addtail(&sli_lruslvrs, s);
 	SLVR_WAKEUP(s);
 	SLVR_ULOCK(s);
 
-	BII_LOCK(bii);
-	bcr = bii->bii_bcr;
-
-	if (bcr) {
-		uint32_t i;
-		int found;
-
-		psc_assert(bcr->bcr_crcup.bno == b->bcm_bmapno);
-		psc_assert(bcr->bcr_crcup.fg.fg_fid ==
-		    b->bcm_fcmh->fcmh_fg.fg_fid);
-		psc_assert(bcr->bcr_crcup.nups < MAX_BMAP_INODE_PAIRS);
-
-		/*
-		 * If we already have a slot for our slvr_num then reuse
-		 * it.
-		 */
-		for (i = 0, found = 0; i < bcr->bcr_crcup.nups; i++) {
-			if (bcr->bcr_crcup.crcs[i].slot == s->slvr_num) {
-				found = 1;
-				break;
-			}
-		}
-
-		bcr->bcr_crcup.crcs[i].crc = crc;
-		if (!found) {
-			bcr->bcr_crcup.nups++;
-			bcr->bcr_crcup.crcs[i].slot = s->slvr_num;
-		}
-
-		DEBUG_BCR(PLL_DIAG, bcr, "add to existing bcr slot=%d "
-		    "nups=%d", i, bcr->bcr_crcup.nups);
-
-		if (bcr->bcr_crcup.nups == MAX_BMAP_INODE_PAIRS)
-			bcr->bcr_bii->bii_bcr = NULL;
-	} else {
-		bii->bii_bcr = bcr = psc_pool_get(bmap_crcupd_pool);
-		memset(bcr, 0, bmap_crcupd_pool->ppm_entsize);
-
-		INIT_PSC_LISTENTRY(&bcr->bcr_lentry);
-		COPYFG(&bcr->bcr_crcup.fg, &b->bcm_fcmh->fcmh_fg);
-
-		bcr->bcr_bii = bii;
-		bcr->bcr_crcup.bno = b->bcm_bmapno;
-		bcr->bcr_crcup.crcs[0].crc = crc;
-		bcr->bcr_crcup.crcs[0].slot = s->slvr_num;
-		bcr->bcr_crcup.nups = 1;
-
-		bcr_ready_add(bcr);
-		PFL_GETTIMESPEC(&bcr->bcr_age);
+	if (rc) {
+		/* The last reference will free the sliver. */
+		bmap_op_done_type(b, BMAP_OPCNT_BCRSCHED);
+		return;
 	}
 
+	BII_LOCK(bii);
+	slvr_bcr_addcrc(bii, s->slvr_num, crc);
 	bmap_op_done_type(b, BMAP_OPCNT_BCRSCHED);
 }
 
@@ -476,8 +578,6 @@ slvr_worker_init(void)
 {
 	int i;
 
-	lc_reginit(&bcr_ready, struct bcrcupd, bcr_lentry, "bcr_ready");
-
 	_psc_poolmaster_init(&bmap_crcupd_poolmaster,
 	    sizeof(struct bcrcupd) +
 	    sizeof(struct srt_bmap_crcwire) * MAX_BMAP_INODE_PAIRS,
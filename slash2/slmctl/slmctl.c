@@ -204,19 +204,6 @@ slmctlcmd_stop(int ac, __unusedx char *av[])
 	psc_ctlmsg_push(SLMCMT_STOP, 0);
 }
 
-void
-slmctlcmd_upsch_query(int ac, char *av[])
-{
-	struct slmctlmsg_upsch_query *scuq;
-	size_t len;
-
-	if (ac != 1)
-		errx(1, "upsch_query: no query specified");
-	len = strlen(av[0]) + 1;
-	scuq = psc_ctlmsg_push(SLMCMT_UPSCH_QUERY, sizeof(*scuq) + len);
-	strlcpy(scuq->scuq_query, av[0], len);
-}
-
 void
 slm_bml_prhdr(__unusedx struct psc_ctlmsghdr *mh,
     __unusedx const void *m)
@@ -313,8 +300,7 @@ psc_ctl_prthr_t psc_ctl_prthrs[] = {
 };
 
 struct psc_ctlcmd_req psc_ctlcmd_reqs[] = {
-	{ "stop",		slmctlcmd_stop },
-	{ "upsch-query",	slmctlcmd_upsch_query }
+	{ "stop",		slmctlcmd_stop }
 };
 
 PFLCTL_CLI_DEFS;
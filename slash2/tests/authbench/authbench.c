@@ -0,0 +1,122 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Bulk authenticator throughput benchmark.  Each algorithm selectable
+ * with the slcfg bulk_auth setting is keyed the same way the daemons
+ * key it and then run over bulk-sized buffers, one handle copy per
+ * buffer as slrpc_bulk_sign() does, e.g.
+ *
+ *	authbench -b 1m -s 4g
+ */
+
+#include <sys/time.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/fmt.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+#include "authbuf.h"
+#include "pathnames.h"
+
+const char	*sl_datadir = SL_PATH_DATA_DIR;
+const char	*progname;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-b bufsize] [-s total]\n", progname);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned char key[AUTHBUF_KEYSIZE], out[AUTHBUF_ALGLEN];
+	ssize_t bufsz = 1024 * 1024, total = (ssize_t)1 << 30, done;
+	struct timeval t0, t1, td;
+	gcry_md_hd_t base, hd;
+	gcry_error_t gerr;
+	char ebuf[BUFSIZ];
+	double secs;
+	void *buf;
+	int c, alg;
+
+	pfl_init();
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "b:s:")) != -1)
+		switch (c) {
+		case 'b':
+			bufsz = pfl_humantonum(optarg);
+			break;
+		case 's':
+			total = pfl_humantonum(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || bufsz <= 0 || total < bufsz)
+		usage();
+
+	gcry_randomize(key, sizeof(key), GCRY_WEAK_RANDOM);
+	buf = PSCALLOC(bufsz);
+	gcry_randomize(buf, bufsz, GCRY_WEAK_RANDOM);
+
+	printf("%-8s %12s %10s\n", "alg", "bytes", "MB/s");
+	for (alg = 0; alg < AUTHBUF_BULKALG_MAX; alg++) {
+		gerr = authbuf_bulkalg_open(alg, &base, key,
+		    sizeof(key));
+		if (gerr) {
+			gpg_strerror_r(gerr, ebuf, sizeof(ebuf));
+			printf("%-8s unavailable: %s\n",
+			    authbuf_bulkalg_names[alg], ebuf);
+			continue;
+		}
+
+		gettimeofday(&t0, NULL);
+		for (done = 0; done + bufsz <= total; done += bufsz) {
+			gerr = gcry_md_copy(&hd, base);
+			if (gerr)
+				errx(1, "gcry_md_copy: %d", gerr);
+			gcry_md_write(hd, buf, bufsz);
+			memcpy(out, gcry_md_read(hd, 0), sizeof(out));
+			gcry_md_close(hd);
+		}
+		gettimeofday(&t1, NULL);
+		gcry_md_close(base);
+
+		timersub(&t1, &t0, &td);
+		secs = td.tv_sec + td.tv_usec * 1e-6;
+		printf("%-8s %12zd %10.1f\n", authbuf_bulkalg_names[alg],
+		    done, secs > 0 ? done / secs / (1024 * 1024) : 0.);
+	}
+	PSCFREE(buf);
+	exit(0);
+}
@@ -0,0 +1,477 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2006-2013, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Simulator for the client bmap flusher write coalescing policy.
+ * Synthetic streams of writes (or a trace file of "usecs offset len"
+ * lines) are turned into biorqs, which are carved into RPCs by
+ * bwc_nextrun() as the flusher does: on biorq arrival, on RPC
+ * completion, and when held runs age out.  The distribution of the
+ * resulting RPC sizes is reported for each stream.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/dynarray.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+#include "cache_params.h"
+#include "coalesce.h"
+
+#define RPCSZ_MAX	(1 << 20)	/* LNET_MTU */
+#define MAXAGE		10000		/* usecs, msl_bflush_maxage */
+#define MAXHOLD		50000		/* usecs, msl_bflush_maxhold */
+#define NBMAPS		8		/* bmaps in the simulated file */
+#define NBUCKETS	9		/* 4k, 8k, ..., 1m */
+#define NOTIME		INT64_MAX
+
+struct sim_write {
+	int64_t			 t;		/* arrival, usecs */
+	uint64_t		 off;		/* file offset */
+	uint32_t		 len;
+};
+
+struct sim_biorq {
+	uint32_t		 off;		/* bmap-relative */
+	uint32_t		 len;
+	int64_t			 queued;	/* arrival, usecs */
+};
+
+struct sim_rpc {
+	int			 bno;
+	int64_t			 done;
+};
+
+struct sim_bmap {
+	struct psc_dynarray	 pending;	/* sorted by offset */
+	int			 infl;
+};
+
+struct sim {
+	struct sim_bmap		 bmaps[NBMAPS];
+	struct psc_dynarray	 rpcs;		/* in flight */
+	int			 depth;		/* slc_bflush_maxinfl */
+	int64_t			 now;
+	int64_t			 nbiorqs;
+	int64_t			 nsent;		/* biorqs sent */
+	int64_t			 nrpcs;
+	int64_t			 nfull;
+	int64_t			 bytes;
+	int64_t			 hist[NBUCKETS];
+};
+
+const char		*progname;
+struct psc_dynarray	 trace = DYNARRAY_INIT;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: %s [-d depth] [-s seed] [-t trace]\n", progname);
+	exit(1);
+}
+
+/* RPC turnaround: fixed overhead plus 1 GB/s of bulk transfer */
+int64_t
+rpc_latency(uint32_t sz)
+{
+	return (200 + sz / 1000);
+}
+
+void
+sim_rpc_send(struct sim *s, int bno, uint32_t sz)
+{
+	struct sim_rpc *rpc;
+	int b;
+
+	psc_assert(sz && sz <= RPCSZ_MAX);
+
+	rpc = PSCALLOC(sizeof(*rpc));
+	rpc->bno = bno;
+	rpc->done = s->now + rpc_latency(sz);
+	psc_dynarray_add(&s->rpcs, rpc);
+	s->bmaps[bno].infl++;
+	psc_assert(s->depth == 0 || s->bmaps[bno].infl <= s->depth);
+
+	s->nrpcs++;
+	s->bytes += sz;
+	if (sz == RPCSZ_MAX)
+		s->nfull++;
+	for (b = 0; b < NBUCKETS - 1 && sz > (4096U << b); b++)
+		;
+	s->hist[b]++;
+}
+
+/*
+ * Run the flusher over one bmap, as bmap_flush_bmap() does.  If
+ * @force is set, everything pending has been forcibly expired, as on
+ * fsync(2) or close(2).
+ */
+void
+sim_flush(struct sim *s, int bno, int force)
+{
+	struct sim_bmap *sb = &s->bmaps[bno];
+	struct sim_biorq *r;
+	struct bwc_ext *ext;
+	uint32_t soff, sz;
+	int i, j, n, nrun, rc;
+
+	n = psc_dynarray_len(&sb->pending);
+	if (n == 0)
+		return;
+
+	ext = PSCALLOC(n * sizeof(*ext));
+	DYNARRAY_FOREACH(r, i, &sb->pending) {
+		ext[i].be_off = r->off;
+		ext[i].be_len = r->len;
+		ext[i].be_expired = r->queued + MAXAGE <= s->now;
+		ext[i].be_forced = force ||
+		    r->queued + MAXHOLD <= s->now;
+	}
+
+	for (i = 0; (rc = bwc_nextrun(ext, n, i, RPCSZ_MAX,
+	    SLASH_BMAP_SIZE, &nrun, &soff, &sz)) != BWC_RUN_NONE;
+	    i += nrun) {
+		if (rc == BWC_RUN_HOLD)
+			continue;
+		if (s->depth && sb->infl >= s->depth)
+			break;
+		sim_rpc_send(s, bno, sz);
+
+		/* mark the members sent */
+		for (j = i; j < i + nrun; j++) {
+			r = psc_dynarray_getpos(&sb->pending, j);
+			r->len = 0;
+		}
+		s->nsent += nrun;
+	}
+	PSCFREE(ext);
+
+	for (i = 0; i < psc_dynarray_len(&sb->pending); i++) {
+		r = psc_dynarray_getpos(&sb->pending, i);
+		if (r->len == 0) {
+			psc_dynarray_splice(&sb->pending, i--, 1, NULL,
+			    0);
+			PSCFREE(r);
+		}
+	}
+}
+
+/*
+ * Queue a write as biorqs, split at bmap boundaries as the client
+ * does, and flush the bmaps written to.
+ */
+void
+sim_write(struct sim *s, const struct sim_write *w)
+{
+	struct sim_biorq *r, *t;
+	uint64_t off = w->off;
+	uint32_t len = w->len, n;
+	int bno, i;
+
+	while (len) {
+		bno = off / SLASH_BMAP_SIZE;
+		psc_assert(bno < NBMAPS);
+
+		n = MIN(len, SLASH_BMAP_SIZE - off % SLASH_BMAP_SIZE);
+		r = PSCALLOC(sizeof(*r));
+		r->off = off % SLASH_BMAP_SIZE;
+		r->len = n;
+		r->queued = s->now;
+
+		/* insertion sort; writes mostly append */
+		for (i = psc_dynarray_len(&s->bmaps[bno].pending);
+		    i > 0; i--) {
+			t = psc_dynarray_getpos(&s->bmaps[bno].pending,
+			    i - 1);
+			if (t->off <= r->off)
+				break;
+		}
+		psc_dynarray_splice(&s->bmaps[bno].pending, i, 0,
+		    (void *)&r, 1);
+		s->nbiorqs++;
+
+		sim_flush(s, bno, 0);
+		off += n;
+		len -= n;
+	}
+}
+
+/*
+ * Determine when the next held back biorq ages out or has been held
+ * too long, i.e. when the next flushq sweep is due.
+ */
+int64_t
+sim_next_expire(struct sim *s, int *pendingp)
+{
+	struct sim_biorq *r;
+	int64_t t = NOTIME;
+	int bno, i;
+
+	*pendingp = 0;
+	for (bno = 0; bno < NBMAPS; bno++)
+		DYNARRAY_FOREACH(r, i, &s->bmaps[bno].pending) {
+			*pendingp = 1;
+			if (r->queued + MAXAGE > s->now)
+				t = MIN(t, r->queued + MAXAGE);
+			else if (r->queued + MAXHOLD > s->now)
+				t = MIN(t, r->queued + MAXHOLD);
+		}
+	return (t);
+}
+
+/*
+ * Replay the trace with up to @depth RPCs in flight per bmap and
+ * report the RPC sizes.  Returns the mean RPC size as a fraction of
+ * the bulk limit.
+ */
+double
+replay(struct sim *sp, const char *name, int depth)
+{
+	struct sim_rpc *rpc, *first;
+	struct sim_write *w;
+	struct sim s;
+	int64_t tw, tc, te;
+	int bno, i, nw = 0, pending;
+
+	memset(&s, 0, sizeof(s));
+	s.depth = depth;
+	for (bno = 0; bno < NBMAPS; bno++)
+		psc_dynarray_init(&s.bmaps[bno].pending);
+	psc_dynarray_init(&s.rpcs);
+
+	for (;;) {
+		tw = nw < psc_dynarray_len(&trace) ?
+		    ((struct sim_write *)psc_dynarray_getpos(&trace,
+		    nw))->t : NOTIME;
+
+		first = NULL;
+		DYNARRAY_FOREACH(rpc, i, &s.rpcs)
+			if (first == NULL || rpc->done < first->done)
+				first = rpc;
+		tc = first ? first->done : NOTIME;
+
+		te = sim_next_expire(&s, &pending);
+
+		if (tw == NOTIME && tc == NOTIME) {
+			if (!pending)
+				break;
+			/* the writer is done; flush as close(2) does */
+			for (bno = 0; bno < NBMAPS; bno++)
+				sim_flush(&s, bno, 1);
+			continue;
+		}
+
+		if (tw <= tc && tw <= te) {
+			w = psc_dynarray_getpos(&trace, nw++);
+			s.now = MAX(s.now, w->t);
+			sim_write(&s, w);
+		} else if (tc <= te) {
+			s.now = tc;
+			psc_dynarray_remove(&s.rpcs, first);
+			s.bmaps[first->bno].infl--;
+			sim_flush(&s, first->bno, 0);
+			PSCFREE(first);
+		} else {
+			/* flushq sweep */
+			s.now = te;
+			for (bno = 0; bno < NBMAPS; bno++)
+				sim_flush(&s, bno, 0);
+		}
+	}
+
+	psc_assert(s.nsent == s.nbiorqs);
+	for (bno = 0; bno < NBMAPS; bno++) {
+		psc_assert(s.bmaps[bno].infl == 0);
+		psc_dynarray_free(&s.bmaps[bno].pending);
+	}
+	psc_dynarray_free(&s.rpcs);
+
+	printf("%-16s %6"PRId64" biorqs %5"PRId64" rpcs, "
+	    "mean %7.1fk, %5.1f%% full\n ", name, s.nbiorqs, s.nrpcs,
+	    s.bytes / 1024. / s.nrpcs, 100. * s.nfull / s.nrpcs);
+	for (i = 0; i < NBUCKETS; i++)
+		if (s.hist[i])
+			printf(" <=%dk:%"PRId64, 4 << i, s.hist[i]);
+	printf("\n");
+
+	if (sp)
+		*sp = s;
+	return ((double)s.bytes / s.nrpcs / RPCSZ_MAX);
+}
+
+void
+trace_reset(void)
+{
+	struct sim_write *w;
+	int i;
+
+	DYNARRAY_FOREACH(w, i, &trace)
+		PSCFREE(w);
+	psc_dynarray_reset(&trace);
+}
+
+void
+trace_add(int64_t t, uint64_t off, uint32_t len)
+{
+	struct sim_write *w;
+
+	w = PSCALLOC(sizeof(*w));
+	w->t = t;
+	w->off = off;
+	w->len = len;
+	psc_dynarray_add(&trace, w);
+}
+
+/*
+ * Build a trace of @nstreams sequential writers issuing @wsz byte
+ * writes at @rate bytes per usec each, @stride bytes apart (a stride
+ * larger than @wsz leaves holes), for @total bytes overall.
+ */
+void
+trace_seq(int nstreams, uint32_t wsz, uint64_t stride, int rate,
+    uint64_t total)
+{
+	uint64_t n, nwrites, base;
+	int i;
+
+	trace_reset();
+	nwrites = total / wsz / nstreams;
+	for (n = 0; n < nwrites; n++)
+		for (i = 0; i < nstreams; i++) {
+			base = (uint64_t)i * NBMAPS / nstreams *
+			    SLASH_BMAP_SIZE;
+			trace_add(n * wsz / rate, base + n * stride,
+			    wsz);
+		}
+}
+
+/* Build a trace of @n @wsz byte writes at random aligned offsets. */
+void
+trace_random(int n, uint32_t wsz, int rate)
+{
+	uint64_t nslots;
+	int i;
+
+	trace_reset();
+	nslots = (uint64_t)NBMAPS * SLASH_BMAP_SIZE / wsz;
+	for (i = 0; i < n; i++)
+		trace_add((int64_t)i * wsz / rate,
+		    random() % nslots * wsz, wsz);
+}
+
+void
+trace_load(const char *fn)
+{
+	char buf[BUFSIZ];
+	int64_t t, last = 0;
+	uint64_t off;
+	uint32_t len;
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (fp == NULL)
+		psc_fatal("%s", fn);
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "%"SCNd64" %"SCNu64" %"SCNu32, &t, &off,
+		    &len) != 3)
+			psc_fatalx("%s: malformed line: %s", fn, buf);
+		if (t < last || len == 0 ||
+		    off + len > (uint64_t)NBMAPS * SLASH_BMAP_SIZE)
+			psc_fatalx("%s: bad write: %s", fn, buf);
+		trace_add(t, off, len);
+		last = t;
+	}
+	fclose(fp);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *tracefn = NULL;
+	int c, depth = 8;
+	struct sim s;
+
+	progname = argv[0];
+	pfl_init();
+	srandom(1);
+	while ((c = getopt(argc, argv, "d:s:t:")) != -1)
+		switch (c) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			srandom(atoi(optarg));
+			break;
+		case 't':
+			tracefn = optarg;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || depth < 0)
+		usage();
+
+	if (tracefn) {
+		trace_load(tracefn);
+		replay(NULL, tracefn, depth);
+		exit(0);
+	}
+
+	/*
+	 * Streaming writers, faster and slower than the network:
+	 * nearly every RPC should be a full bulk.
+	 */
+	trace_seq(1, 4096, 4096, 2000, 64 << 20);
+	psc_assert(replay(&s, "seq-4k-fast", depth) > .95);
+	psc_assert(s.bytes == 64 << 20);
+
+	trace_seq(1, 32768, 32768, 100, 32 << 20);
+	psc_assert(replay(&s, "seq-32k-slow", depth) > .95);
+	psc_assert(s.bytes == 32 << 20);
+
+	trace_seq(1, 100000, 100000, 2000, 64 << 20);
+	psc_assert(replay(&s, "seq-100000", depth) > .9);
+
+	trace_seq(4, 65536, 65536, 500, 64 << 20);
+	psc_assert(replay(&s, "seq-4-streams", depth) > .9);
+
+	/* holes keep runs from growing: RPCs are one write each */
+	trace_seq(1, 65536, 131072, 2000, 16 << 20);
+	replay(&s, "strided-64k", depth);
+	psc_assert(s.nrpcs == 256 && s.nfull == 0);
+
+	/* random small writes: most cannot be coalesced */
+	trace_random(4096, 4096, 2000);
+	replay(&s, "random-4k", depth);
+	psc_assert(s.bytes <= 4096 * 4096);
+
+	exit(0);
+}
@@ -0,0 +1,200 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * bmap lookup contention benchmark.  N threads call bmap_get() on a
+ * small set of bmaps of a single fcmh, holding each bmap locked for a
+ * moment as I/O paths do, to mimic many threads of a shared-file
+ * checkpoint landing on the same bmaps.  With -c the cached bmaps are
+ * not held by the main thread so they are also freed and recreated.
+ */
+
+#include <sys/time.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+#include "pfl/pthrutil.h"
+#include "pfl/random.h"
+#include "pfl/waitq.h"
+
+#include "bmap.h"
+#include "fidcache.h"
+#include "slsubsys.h"
+
+struct thr {
+	pthread_t		 t_pthread;
+	uint64_t		 t_nops;
+};
+
+struct fidc_membh		 fcmh;
+int				 nbmaps = 4;
+int				 nthreads = 32;
+int				 nsecs = 5;
+int				 holdspins = 100;
+int				 churn;
+volatile int			 done;
+
+const char			*progname;
+
+void
+_fcmh_op_start_type(__unusedx const struct pfl_callerinfo *pci,
+    __unusedx struct fidc_membh *f, __unusedx int type)
+{
+}
+
+void
+_fcmh_op_done_type(__unusedx const struct pfl_callerinfo *pci,
+    __unusedx struct fidc_membh *f, __unusedx int type,
+    __unusedx int rele)
+{
+}
+
+void
+bmapget_init_private(__unusedx struct bmap *b)
+{
+}
+
+int
+bmapget_retrieve(__unusedx struct bmap *b, __unusedx int flags)
+{
+	return (0);
+}
+
+struct bmap_ops sl_bmap_ops = {
+	NULL,				/* bmo_reapf */
+	bmapget_init_private,		/* bmo_init_privatef */
+	bmapget_retrieve,		/* bmo_retrievef */
+	NULL,				/* bmo_mode_chngf */
+	NULL				/* bmo_final_cleanupf */
+};
+
+void *
+thr_main(void *arg)
+{
+	struct thr *t = arg;
+	struct bmap *b;
+	volatile int i;
+
+	while (!done) {
+		if (bmap_get(&fcmh, psc_random32u(nbmaps), SL_READ,
+		    &b))
+			psc_fatalx("bmap_get");
+		for (i = 0; i < holdspins; i++)
+			;
+		bmap_op_done(b);
+		t->t_nops++;
+	}
+	return (NULL);
+}
+
+__dead void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: %s [-c] [-b nbmaps] [-h holdspins] [-s secs] "
+	    "[-t threads]\n", progname);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timeval t0, t1;
+	struct bmap **held;
+	struct thr *thrs;
+	uint64_t nops = 0;
+	double elapsed;
+	int c, i;
+
+	pfl_init();
+	sl_subsys_register();
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "b:ch:s:t:")) != -1)
+		switch (c) {
+		case 'b':
+			nbmaps = atoi(optarg);
+			break;
+		case 'c':
+			churn = 1;
+			break;
+		case 'h':
+			holdspins = atoi(optarg);
+			break;
+		case 's':
+			nsecs = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || nbmaps < 1 || nsecs < 1 || nthreads < 1)
+		usage();
+
+	bmap_cache_init(0);
+	psc_waitq_init(&fcmh.fcmh_waitq);
+	pfl_rwlock_init(&fcmh.fcmh_rwlock);
+	RB_INIT(&fcmh.fcmh_bmaptree);
+
+	held = PSCALLOC(nbmaps * sizeof(*held));
+	if (!churn)
+		for (i = 0; i < nbmaps; i++) {
+			if (bmap_get(&fcmh, i, SL_READ, &held[i]))
+				psc_fatalx("bmap_get");
+			BMAP_ULOCK(held[i]);
+		}
+
+	thrs = PSCALLOC(nthreads * sizeof(*thrs));
+	gettimeofday(&t0, NULL);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&thrs[i].t_pthread, NULL, thr_main,
+		    &thrs[i]))
+			errx(1, "pthread_create");
+	sleep(nsecs);
+	done = 1;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(thrs[i].t_pthread, NULL);
+		nops += thrs[i].t_nops;
+	}
+	gettimeofday(&t1, NULL);
+
+	elapsed = t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) * 1e-6;
+	printf("%d threads, %d bmaps%s: %.0f bmap_get/s\n", nthreads,
+	    nbmaps, churn ? " (churn)" : "", nops / elapsed);
+
+	if (!churn)
+		for (i = 0; i < nbmaps; i++)
+			bmap_op_done(held[i]);
+	PSCFREE(held);
+	PSCFREE(thrs);
+	exit(0);
+}
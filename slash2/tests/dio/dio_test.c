@@ -0,0 +1,437 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2006-2013, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Drive the cache coherency decisions of the sliod direct I/O path,
+ * sli_dio_fence() and sli_dio_unfence(), against a small model of the
+ * sliver cache of one bmap.  Lookups wait while a sliver is fenced, as
+ * slvr_lookup() does, and a direct write drops a clean cached copy, as
+ * sli_dio_begin() does through slvr_remove().  The data seen through
+ * either path must always match the file.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/crc.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+#include "slvr_dio.h"
+
+#define NSLVRS		8
+#define FILESIZE	(NSLVRS * SLASH_SLVR_SIZE - 4321)
+
+/* a cached sliver */
+struct cslvr {
+	char			*cs_buf;	/* NULL if not cached */
+	int			 cs_refcnt;
+	int			 cs_dirty;	/* CRC not yet taken */
+};
+
+const char		*progname;
+int			 fd, dfd;
+char			*model;
+
+/* the bmap: its lock, sliver cache, fence map and fcmh wait queue */
+pthread_mutex_t		 bii_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t		 bii_waitq = PTHREAD_COND_INITIALIZER;
+struct cslvr		 cache[NSLVRS];
+uint8_t			 dioslvrs[NSLVRS / NBBY + 1];
+int			 nwaiting;
+
+int			 ndio, ncached, ninval;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-n nops]\n", progname);
+	exit(1);
+}
+
+void
+fill(char *p, size_t len)
+{
+	uint32_t x = random() | 1;
+
+	while (len--) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*p++ = x;
+	}
+}
+
+/*
+ * Find or fault in sliver @n, waiting out a bypass in flight the way
+ * slvr_lookup() does.
+ */
+struct cslvr *
+slvr_lookup(int n)
+{
+	struct cslvr *s = &cache[n];
+	ssize_t rc;
+
+	pthread_mutex_lock(&bii_lock);
+	while (s->cs_buf == NULL && sli_dio_fenced(dioslvrs, n)) {
+		nwaiting++;
+		pthread_cond_wait(&bii_waitq, &bii_lock);
+		nwaiting--;
+	}
+	if (s->cs_buf == NULL) {
+		s->cs_buf = PSCALLOC(SLASH_SLVR_SIZE);
+		rc = pread(fd, s->cs_buf, SLASH_SLVR_SIZE,
+		    n * SLASH_SLVR_SIZE);
+		psc_assert(rc >= 0);
+	}
+	s->cs_refcnt++;
+	pthread_mutex_unlock(&bii_lock);
+	return (s);
+}
+
+void
+slvr_release(struct cslvr *s)
+{
+	pthread_mutex_lock(&bii_lock);
+	s->cs_refcnt--;
+	pthread_mutex_unlock(&bii_lock);
+}
+
+/* the CRC worker followed by the reaper */
+void
+slvr_flush(int n, int reap)
+{
+	struct cslvr *s = &cache[n];
+	uint64_t crc, mcrc;
+
+	pthread_mutex_lock(&bii_lock);
+	if (s->cs_buf && s->cs_refcnt == 0) {
+		psc_crc64_calc(&crc, s->cs_buf, SLASH_SLVR_SIZE);
+		psc_crc64_calc(&mcrc, model + n * SLASH_SLVR_SIZE,
+		    SLASH_SLVR_SIZE);
+		psc_assert(crc == mcrc);
+		s->cs_dirty = 0;
+		if (reap) {
+			PSCFREE(s->cs_buf);
+			s->cs_buf = NULL;
+		}
+	}
+	pthread_mutex_unlock(&bii_lock);
+}
+
+void
+cached_read(int n, uint32_t off, uint32_t len)
+{
+	struct cslvr *s;
+
+	s = slvr_lookup(n);
+	psc_assert(memcmp(s->cs_buf + off, model + n * SLASH_SLVR_SIZE +
+	    off, len) == 0);
+	slvr_release(s);
+	ncached++;
+}
+
+void
+cached_write(int n, uint32_t off, uint32_t len)
+{
+	struct cslvr *s;
+	ssize_t rc;
+
+	s = slvr_lookup(n);
+	fill(s->cs_buf + off, len);
+	rc = pwrite(fd, s->cs_buf + off, len, n * SLASH_SLVR_SIZE + off);
+	psc_assert(rc == (ssize_t)len);
+	memcpy(model + n * SLASH_SLVR_SIZE + off, s->cs_buf + off, len);
+	s->cs_dirty = 1;
+	slvr_release(s);
+	ncached++;
+}
+
+/*
+ * Start a direct I/O on sliver @n, as sli_dio_begin() does.  Returns
+ * zero if it must go through the cache instead.
+ */
+int
+dio_begin(int n, enum rw rw)
+{
+	struct cslvr *s = &cache[n];
+	int rc;
+
+	pthread_mutex_lock(&bii_lock);
+	rc = sli_dio_fence(dioslvrs, n, rw, s->cs_buf != NULL,
+	    s->cs_refcnt || s->cs_dirty);
+	switch (rc) {
+	case SLI_DIO_CACHED:
+		break;
+	case SLI_DIO_BYPASS:
+		psc_assert(s->cs_buf == NULL);
+		break;
+	case SLI_DIO_INVALIDATE:
+		psc_assert(rw == SL_WRITE);
+		psc_assert(s->cs_refcnt == 0 && !s->cs_dirty);
+		PSCFREE(s->cs_buf);
+		s->cs_buf = NULL;
+		ninval++;
+		break;
+	}
+	if (rc != SLI_DIO_CACHED)
+		psc_assert(sli_dio_fenced(dioslvrs, n));
+	pthread_mutex_unlock(&bii_lock);
+	return (rc != SLI_DIO_CACHED);
+}
+
+void
+dio_end(int n)
+{
+	pthread_mutex_lock(&bii_lock);
+	sli_dio_unfence(dioslvrs, n);
+	psc_assert(!sli_dio_fenced(dioslvrs, n));
+	pthread_cond_broadcast(&bii_waitq);
+	pthread_mutex_unlock(&bii_lock);
+}
+
+void
+dio_read(int n, uint32_t len)
+{
+	struct sli_diobuf *db;
+	uint64_t crc, mcrc;
+	ssize_t rc;
+
+	if (!dio_begin(n, SL_READ)) {
+		cached_read(n, 0, len);
+		return;
+	}
+	db = sli_diobuf_get();
+	rc = sli_dio_read(dfd, db, n * SLASH_SLVR_SIZE, &crc);
+	psc_assert(rc >= 0);
+	psc_assert(memcmp(db->db_base, model + n * SLASH_SLVR_SIZE,
+	    len) == 0);
+	psc_crc64_calc(&mcrc, model + n * SLASH_SLVR_SIZE,
+	    SLASH_SLVR_SIZE);
+	psc_assert(crc == mcrc);
+	sli_diobuf_put(db);
+	dio_end(n);
+	ndio++;
+}
+
+/* the transfer itself, once dio_begin() has let it through */
+void
+dio_write_data(int n)
+{
+	struct sli_diobuf *db;
+	uint64_t crc, mcrc;
+
+	db = sli_diobuf_get();
+	fill(db->db_base, SLASH_SLVR_SIZE);
+	psc_assert(sli_dio_write(dfd, db, n * SLASH_SLVR_SIZE,
+	    &crc) == 0);
+	memcpy(model + n * SLASH_SLVR_SIZE, db->db_base,
+	    SLASH_SLVR_SIZE);
+	psc_crc64_calc(&mcrc, model + n * SLASH_SLVR_SIZE,
+	    SLASH_SLVR_SIZE);
+	psc_assert(crc == mcrc);
+	sli_diobuf_put(db);
+}
+
+void
+dio_write(int n)
+{
+	if (!dio_begin(n, SL_WRITE)) {
+		cached_write(n, 0, SLASH_SLVR_SIZE);
+		return;
+	}
+	dio_write_data(n);
+	dio_end(n);
+	ndio++;
+}
+
+void *
+reader_main(void *arg)
+{
+	int n = (int)(intptr_t)arg;
+
+	cached_read(n, 0, SLASH_SLVR_SIZE);
+	return (NULL);
+}
+
+/*
+ * A cached lookup that arrives while a direct write is in flight must
+ * wait for it and then fault in the new data, never the old.
+ */
+void
+test_race(int n)
+{
+	pthread_t thr;
+
+	cached_read(n, 0, SLASH_SLVR_SIZE);
+	slvr_flush(n, 0);
+
+	psc_assert(dio_begin(n, SL_WRITE));
+	psc_assert(cache[n].cs_buf == NULL);
+	psc_assert(ninval == 1);
+
+	if (pthread_create(&thr, NULL, reader_main, (void *)(intptr_t)n))
+		psc_fatalx("pthread_create");
+	for (;;) {
+		pthread_mutex_lock(&bii_lock);
+		if (nwaiting) {
+			pthread_mutex_unlock(&bii_lock);
+			break;
+		}
+		psc_assert(cache[n].cs_buf == NULL);
+		pthread_mutex_unlock(&bii_lock);
+		usleep(1000);
+	}
+
+	dio_write_data(n);
+	dio_end(n);
+	pthread_join(thr, NULL);
+	psc_assert(cache[n].cs_buf);
+	slvr_flush(n, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char fn[PATH_MAX], *fbuf;
+	int c, i, n, nops = 2000;
+	uint32_t off, len;
+	ssize_t rc;
+
+	progname = argv[0];
+	pfl_init();
+	while ((c = getopt(argc, argv, "n:")) != -1)
+		switch (c) {
+		case 'n':
+			nops = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc)
+		usage();
+
+	psc_assert(!sli_dio_eligible(0, SLASH_SLVR_SIZE, SL_READ, 0));
+	psc_assert(sli_dio_eligible(0, SLASH_SLVR_SIZE, SL_WRITE,
+	    SLASH_SLVR_SIZE));
+	psc_assert(sli_dio_eligible(SLASH_SLVR_SIZE, 600000, SL_READ,
+	    512 * 1024));
+	psc_assert(!sli_dio_eligible(SLASH_SLVR_SIZE, 600000, SL_WRITE,
+	    512 * 1024));
+	psc_assert(!sli_dio_eligible(4096, SLASH_SLVR_SIZE - 4096,
+	    SL_READ, 512 * 1024));
+
+	/* fencing decisions */
+	psc_assert(sli_dio_fence(dioslvrs, 1, SL_READ, 1, 0) ==
+	    SLI_DIO_CACHED && !sli_dio_fenced(dioslvrs, 1));
+	psc_assert(sli_dio_fence(dioslvrs, 1, SL_WRITE, 1, 1) ==
+	    SLI_DIO_CACHED && !sli_dio_fenced(dioslvrs, 1));
+	psc_assert(sli_dio_fence(dioslvrs, 1, SL_READ, 0, 0) ==
+	    SLI_DIO_BYPASS && sli_dio_fenced(dioslvrs, 1));
+	psc_assert(sli_dio_fence(dioslvrs, 1, SL_READ, 0, 0) ==
+	    SLI_DIO_CACHED);
+	psc_assert(!sli_dio_fenced(dioslvrs, 0) &&
+	    !sli_dio_fenced(dioslvrs, 2));
+	sli_dio_unfence(dioslvrs, 1);
+	psc_assert(sli_dio_fence(dioslvrs, 7, SL_WRITE, 1, 0) ==
+	    SLI_DIO_INVALIDATE && sli_dio_fenced(dioslvrs, 7));
+	sli_dio_unfence(dioslvrs, 7);
+	for (i = 0; i < (int)sizeof(dioslvrs); i++)
+		psc_assert(dioslvrs[i] == 0);
+
+	/* O_DIRECT is not supported by tmpfs on older kernels */
+	snprintf(fn, sizeof(fn), "%s/dio.XXXXXX",
+	    getenv("TMPDIR") ? getenv("TMPDIR") : "/var/tmp");
+	fd = mkstemp(fn);
+	if (fd == -1)
+		psc_fatal("mkstemp %s", fn);
+	dfd = open(fn, O_RDWR | O_DIRECT);
+	unlink(fn);
+	if (dfd == -1)
+		psc_fatal("open %s O_DIRECT", fn);
+
+	sli_dio_init();
+
+	srandom(1);
+	model = PSCALLOC(NSLVRS * SLASH_SLVR_SIZE);
+	fill(model, FILESIZE);
+	rc = pwrite(fd, model, FILESIZE, 0);
+	psc_assert(rc == FILESIZE);
+
+	test_race(3);
+
+	/* a dirty cached copy keeps a direct write in the cache */
+	cached_write(4, 10, 100);
+	dio_write(4);
+	psc_assert(ndio == 0 && !sli_dio_fenced(dioslvrs, 4));
+	slvr_flush(4, 1);
+
+	/* mixed cached and direct I/O */
+	for (i = 0; i < nops; i++) {
+		n = random() % NSLVRS;
+		switch (random() % 6) {
+		case 0:
+			len = 1 + random() % SLASH_SLVR_SIZE;
+			off = random() % (SLASH_SLVR_SIZE - len + 1);
+			cached_read(n, off, len);
+			break;
+		case 1:
+			len = 1 + random() % (2 * SLASH_SLVR_BLKSZ);
+			off = random() % (SLASH_SLVR_SIZE - len + 1);
+			cached_write(n, off, len);
+			break;
+		case 2:
+		case 3:
+			dio_read(n, SLASH_SLVR_SIZE - random() % 2 * 1000);
+			break;
+		case 4:
+			dio_write(n);
+			break;
+		case 5:
+			slvr_flush(n, random() % 2);
+			break;
+		}
+	}
+	psc_assert(ndio && ncached && ninval > 1);
+	for (i = 0; i < (int)sizeof(dioslvrs); i++)
+		psc_assert(dioslvrs[i] == 0);
+
+	fbuf = PSCALLOC(NSLVRS * SLASH_SLVR_SIZE);
+	rc = pread(fd, fbuf, NSLVRS * SLASH_SLVR_SIZE, 0);
+	psc_assert(rc >= FILESIZE);
+	psc_assert(memcmp(fbuf, model, rc) == 0);
+	PSCFREE(fbuf);
+
+	close(dfd);
+	close(fd);
+	exit(0);
+}
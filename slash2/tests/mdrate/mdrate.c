@@ -0,0 +1,205 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Small-file metadata rate benchmark.  Each thread creates, stats, and
+ * unlinks its own set of empty files in a private subdirectory so the
+ * client is driven with many concurrent, independent metadata
+ * requests.  Used to compare mount_slash FUSE dispatch modes, e.g.
+ *
+ *	mount_slash /s2
+ *	mdrate -t 64 /s2/bench
+ *	mount_slash -o fuse_clonefd /s2
+ *	mdrate -t 64 /s2/bench
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+	PHASE_CREATE,
+	PHASE_STAT,
+	PHASE_UNLINK,
+	NPHASES
+};
+
+const char		*phase_names[] = {
+	"create",
+	"stat",
+	"unlink"
+};
+
+struct thr {
+	pthread_t	 t_pthread;
+	int		 t_id;
+};
+
+pthread_barrier_t	 barrier;
+const char		*basedir;
+int			 nfiles = 1000;
+int			 nthreads = 16;
+int			 keep;
+int			 nphases = NPHASES;
+double			 phase_start[NPHASES];
+
+const char		*progname;
+
+double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+void *
+thr_main(void *arg)
+{
+	char dir[PATH_MAX], fn[PATH_MAX];
+	struct thr *t = arg;
+	struct stat stb;
+	int fd, i, p;
+
+	snprintf(dir, sizeof(dir), "%s/t%d", basedir, t->t_id);
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		err(1, "mkdir %s", dir);
+
+	for (p = 0; p < nphases; p++) {
+		/* wait for everyone to finish the previous phase */
+		pthread_barrier_wait(&barrier);
+		/* main records the start time in between */
+		pthread_barrier_wait(&barrier);
+
+		for (i = 0; i < nfiles; i++) {
+			snprintf(fn, sizeof(fn), "%s/f%d", dir, i);
+			switch (p) {
+			case PHASE_CREATE:
+				fd = open(fn, O_CREAT | O_WRONLY, 0644);
+				if (fd == -1)
+					err(1, "create %s", fn);
+				close(fd);
+				break;
+			case PHASE_STAT:
+				if (stat(fn, &stb) == -1)
+					err(1, "stat %s", fn);
+				break;
+			case PHASE_UNLINK:
+				if (unlink(fn) == -1)
+					err(1, "unlink %s", fn);
+				break;
+			}
+		}
+	}
+	if (!keep)
+		rmdir(dir);
+	pthread_barrier_wait(&barrier);
+	return (NULL);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: %s [-k] [-n files] [-t threads] dir\n",
+	    progname);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	double elapsed, end;
+	struct thr *thrs;
+	int c, i, p;
+
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "kn:t:")) != -1)
+		switch (c) {
+		case 'k':
+			keep = 1;
+			nphases = PHASE_UNLINK;
+			break;
+		case 'n':
+			nfiles = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1 || nfiles < 1 || nthreads < 1)
+		usage();
+	basedir = argv[0];
+
+	if (mkdir(basedir, 0755) == -1 && errno != EEXIST)
+		err(1, "mkdir %s", basedir);
+
+	/*
+	 * Main takes part in every barrier so it can timestamp each
+	 * phase once all workers have finished the previous one.
+	 */
+	pthread_barrier_init(&barrier, NULL, nthreads + 1);
+	thrs = calloc(nthreads, sizeof(*thrs));
+	if (thrs == NULL)
+		err(1, "calloc");
+	for (i = 0; i < nthreads; i++) {
+		thrs[i].t_id = i;
+		if (pthread_create(&thrs[i].t_pthread, NULL, thr_main,
+		    &thrs[i]))
+			errx(1, "pthread_create");
+	}
+
+	for (p = 0; p < nphases; p++) {
+		pthread_barrier_wait(&barrier);
+		phase_start[p] = now();
+		pthread_barrier_wait(&barrier);
+	}
+	pthread_barrier_wait(&barrier);
+	end = now();
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(thrs[i].t_pthread, NULL);
+
+	printf("%d threads, %d files each\n", nthreads, nfiles);
+	for (p = 0; p < nphases; p++) {
+		elapsed = (p + 1 < nphases ? phase_start[p + 1] : end) -
+		    phase_start[p];
+		printf("%-8s %10.0f ops/s  (%.3fs)\n", phase_names[p],
+		    (double)nthreads * nfiles / elapsed, elapsed);
+	}
+	free(thrs);
+	exit(0);
+}
@@ -0,0 +1,153 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Multithreaded small random read benchmark.  All threads pread(2)
+ * random aligned blocks of one existing file for a fixed time, which
+ * after a warm-up pass mostly exercises client page cache lookups
+ * (compare the bmpce-hit opstat before and after), e.g.
+ *
+ *	dd if=/dev/zero of=/s2/f bs=1M count=256
+ *	randread -t 32 -s 30 /s2/f
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct thr {
+	pthread_t	 t_pthread;
+	unsigned int	 t_seed;
+	uint64_t	 t_nops;
+};
+
+int			 fd;
+off_t			 nblks;
+size_t			 blksz = 4096;
+int			 nthreads = 16;
+int			 nsecs = 10;
+volatile int		 done;
+
+const char		*progname;
+
+void *
+thr_main(void *arg)
+{
+	struct thr *t = arg;
+	off_t blk;
+	char *buf;
+
+	buf = malloc(blksz);
+	if (buf == NULL)
+		err(1, "malloc");
+	while (!done) {
+		blk = ((off_t)rand_r(&t->t_seed) << 16 ^
+		    rand_r(&t->t_seed)) % nblks;
+		if (pread(fd, buf, blksz, blk * blksz) == -1)
+			err(1, "pread");
+		t->t_nops++;
+	}
+	free(buf);
+	return (NULL);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: %s [-b blksz] [-s secs] [-t threads] file\n",
+	    progname);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timeval t0, t1;
+	struct thr *thrs;
+	uint64_t nops = 0;
+	struct stat stb;
+	double elapsed;
+	int c, i;
+
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "b:s:t:")) != -1)
+		switch (c) {
+		case 'b':
+			blksz = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			nsecs = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1 || blksz == 0 || nsecs < 1 || nthreads < 1)
+		usage();
+
+	fd = open(argv[0], O_RDONLY);
+	if (fd == -1)
+		err(1, "open %s", argv[0]);
+	if (fstat(fd, &stb) == -1)
+		err(1, "stat %s", argv[0]);
+	nblks = stb.st_size / blksz;
+	if (nblks == 0)
+		errx(1, "%s: smaller than one block", argv[0]);
+
+	thrs = calloc(nthreads, sizeof(*thrs));
+	if (thrs == NULL)
+		err(1, "calloc");
+	gettimeofday(&t0, NULL);
+	for (i = 0; i < nthreads; i++) {
+		thrs[i].t_seed = t0.tv_usec + i;
+		if (pthread_create(&thrs[i].t_pthread, NULL, thr_main,
+		    &thrs[i]))
+			errx(1, "pthread_create");
+	}
+	sleep(nsecs);
+	done = 1;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(thrs[i].t_pthread, NULL);
+		nops += thrs[i].t_nops;
+	}
+	gettimeofday(&t1, NULL);
+
+	elapsed = t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) * 1e-6;
+	printf("%d threads, %zu byte reads: %.0f ops/s, %.1f MB/s\n",
+	    nthreads, blksz, nops / elapsed,
+	    nops * blksz / elapsed / (1024 * 1024));
+	free(thrs);
+	close(fd);
+	exit(0);
+}
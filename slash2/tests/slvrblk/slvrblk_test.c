@@ -0,0 +1,379 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2006-2013, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+
+/*
+ * Exercise the sliod partial sliver I/O path.  Each I/O goes through
+ * the steps of slvr_io_prep(), deciding what to fault in with the same
+ * slvr_blks_prep() and slvr_blks_done() calls.  Writes are written
+ * through to the backing file the way sli_ric_write_sliver() does it.
+ * Slivers go through the CRC worker's fill.  Contents, blocks faulted
+ * in, and CRCs are checked against the file.
+ */
+
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/crc.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+#include "slvr_blk.h"
+
+#define NSLVRS		3
+#define FILESIZE	(NSLVRS * SLASH_SLVR_SIZE - 12345)
+
+/* the subset of slvr_flags this test models */
+#define DATARDY		(1 << 0)
+#define CRCDIRTY	(1 << 1)
+
+struct sim_slvr {
+	char			*buf;
+	uint32_t		 valid;
+	int			 flags;
+	uint64_t		 crc;		/* as stored in the bmap */
+};
+
+const char		*progname;
+int			 fd;
+char			*model;			/* expected file contents */
+struct sim_slvr		 slvrs[NSLVRS];
+ssize_t			 nread;
+int			 nfullreads;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-n nwrites] [-s seed]\n", progname);
+	exit(1);
+}
+
+/* check that every valid block holds the file contents */
+void
+slvr_check_valid(int n)
+{
+	struct sim_slvr *s = &slvrs[n];
+	off_t foff = n * SLASH_SLVR_SIZE;
+	int i;
+
+	for (i = 0; i < SLASH_BLKS_PER_SLVR; i++)
+		if (s->valid & (1U << i))
+			psc_assert(memcmp(s->buf + i * SLASH_SLVR_BLKSZ,
+			    model + foff + i * SLASH_SLVR_BLKSZ,
+			    SLASH_SLVR_BLKSZ) == 0);
+}
+
+/*
+ * Prepare sliver @n for an I/O as slvr_io_prep() and slvr_io_done()
+ * do.  Returns the blocks read from the backing file.
+ */
+uint32_t
+slvr_prep(int n, uint32_t off, uint32_t len, enum rw rw)
+{
+	struct sim_slvr *s = &slvrs[n];
+	uint32_t need;
+	uint64_t crc;
+	ssize_t rc;
+
+	if (s->flags & DATARDY)
+		return (0);
+
+	if (slvr_blks_prep(off, len, rw, s->valid, &need) ==
+	    SLVR_BLKS_FULLREAD) {
+		psc_assert(rw == SL_READ && s->valid == 0);
+		psc_assert(need == SLVR_BLKS_ALL);
+		nfullreads++;
+	} else if (rw == SL_READ)
+		psc_assert(need == (~s->valid & SLVR_BLKS_ALL));
+	else
+		psc_assert((need & SLVR_BLKS_RANGE(off, len)) == need);
+
+	/* never refetch a block that may hold newer data */
+	psc_assert((need & s->valid) == 0);
+
+	rc = slvr_blks_read(fd, s->buf, n * SLASH_SLVR_SIZE, need);
+	psc_assert(rc >= 0);
+	nread += rc;
+	s->valid |= need;
+	slvr_check_valid(n);
+
+	/* slvr_fsio() verifies a full read against a clean CRC */
+	if (need == SLVR_BLKS_ALL && !(s->flags & CRCDIRTY)) {
+		psc_crc64_calc(&crc, s->buf, SLASH_SLVR_SIZE);
+		psc_assert(crc == s->crc);
+	}
+
+	s->valid = slvr_blks_done(off, len, rw, s->valid);
+	if (s->valid == SLVR_BLKS_ALL)
+		s->flags |= DATARDY;
+	return (need);
+}
+
+/*
+ * Apply a write that lies within one sliver, as slvr_io_prep() followed
+ * by sli_ric_write_sliver() and slvr_wio_done().
+ */
+uint32_t
+slvr_write(int n, uint32_t off, uint32_t len)
+{
+	struct sim_slvr *s = &slvrs[n];
+	uint32_t need, sblk, i;
+	off_t foff;
+	ssize_t rc;
+
+	foff = n * SLASH_SLVR_SIZE;
+	need = slvr_prep(n, off, len, SL_WRITE);
+	psc_assert(__builtin_popcount(need) <= 2);
+
+	/* the bulk transfer from the client */
+	for (i = 0; i < len; i++)
+		s->buf[off + i] = random();
+	psc_assert((s->valid & SLVR_BLKS_RANGE(off, len)) ==
+	    SLVR_BLKS_RANGE(off, len));
+
+	/* write back starting from the first block touched */
+	sblk = off / SLASH_SLVR_BLKSZ;
+	rc = pwrite(fd, s->buf + sblk * SLASH_SLVR_BLKSZ,
+	    off + len - sblk * SLASH_SLVR_BLKSZ,
+	    foff + sblk * SLASH_SLVR_BLKSZ);
+	psc_assert(rc == (ssize_t)(off + len - sblk * SLASH_SLVR_BLKSZ));
+	memcpy(model + foff + off, s->buf + off, len);
+
+	s->flags |= CRCDIRTY;
+	return (need);
+}
+
+/* read sliver @n and check what the client would get */
+uint32_t
+slvr_read(int n)
+{
+	struct sim_slvr *s = &slvrs[n];
+	uint32_t need;
+
+	need = slvr_prep(n, 0, SLASH_SLVR_SIZE, SL_READ);
+	psc_assert(s->flags & DATARDY);
+	psc_assert(memcmp(s->buf, model + n * SLASH_SLVR_SIZE,
+	    SLASH_SLVR_SIZE) == 0);
+	return (need);
+}
+
+/*
+ * Fault in what is missing, as the CRC worker does, and check the
+ * sliver CRC against the backing file.
+ */
+uint32_t
+slvr_crc_update(int n)
+{
+	struct sim_slvr *s = &slvrs[n];
+	uint32_t need;
+	uint64_t fcrc;
+	char *fbuf;
+	ssize_t rc;
+
+	psc_assert(s->flags & CRCDIRTY);
+	need = ~s->valid & SLVR_BLKS_ALL;
+	rc = slvr_blks_read(fd, s->buf, n * SLASH_SLVR_SIZE, need);
+	psc_assert(rc >= 0);
+	s->valid = SLVR_BLKS_ALL;
+	s->flags = DATARDY;
+
+	fbuf = PSCALLOC(SLASH_SLVR_SIZE);
+	rc = pread(fd, fbuf, SLASH_SLVR_SIZE, n * SLASH_SLVR_SIZE);
+	psc_assert(rc >= 0);
+	if (rc < SLASH_SLVR_SIZE)
+		memset(fbuf + rc, 0, SLASH_SLVR_SIZE - rc);
+
+	psc_crc64_calc(&s->crc, s->buf, SLASH_SLVR_SIZE);
+	psc_crc64_calc(&fcrc, fbuf, SLASH_SLVR_SIZE);
+	psc_assert(s->crc == fcrc);
+	psc_crc64_calc(&fcrc, model + n * SLASH_SLVR_SIZE,
+	    SLASH_SLVR_SIZE);
+	psc_assert(s->crc == fcrc);
+	PSCFREE(fbuf);
+	return (need);
+}
+
+/* drop sliver @n from the cache */
+void
+slvr_reap(int n)
+{
+	struct sim_slvr *s = &slvrs[n];
+
+	psc_assert(!(s->flags & CRCDIRTY));
+	memset(s->buf, 0, SLASH_SLVR_SIZE);
+	s->valid = 0;
+	s->flags = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char fn[] = "/tmp/slvrblk.XXXXXX", *fbuf;
+	int c, i, n, nwrites = 1000;
+	uint32_t off, len, need;
+	ssize_t rc;
+
+	progname = argv[0];
+	pfl_init();
+	srandom(1);
+	while ((c = getopt(argc, argv, "n:s:")) != -1)
+		switch (c) {
+		case 'n':
+			nwrites = atoi(optarg);
+			break;
+		case 's':
+			srandom(atoi(optarg));
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc)
+		usage();
+
+	/* mask arithmetic */
+	psc_assert(SLVR_BLKS(0, SLASH_BLKS_PER_SLVR - 1) == SLVR_BLKS_ALL);
+	psc_assert(SLVR_BLKS(3, 3) == 1U << 3);
+	psc_assert(SLVR_BLKS_RANGE(1, SLASH_SLVR_BLKSZ) == 3);
+	psc_assert(slvr_blks_edges(0, SLASH_SLVR_SIZE, 0) == 0);
+	psc_assert(slvr_blks_edges(SLASH_SLVR_BLKSZ, SLASH_SLVR_BLKSZ,
+	    0) == 0);
+	psc_assert(slvr_blks_edges(10, 20, 0) == 1);
+	psc_assert(slvr_blks_edges(10, 20, 1) == 0);
+	psc_assert(slvr_blks_edges(SLASH_SLVR_BLKSZ - 1, 2, 0) == 3);
+	psc_assert(slvr_blks_edges(SLASH_SLVR_SIZE - 1, 1, 0) ==
+	    1U << (SLASH_BLKS_PER_SLVR - 1));
+
+	/* prep verdicts */
+	psc_assert(slvr_blks_prep(0, 1, SL_READ, 0, &need) ==
+	    SLVR_BLKS_FULLREAD && need == SLVR_BLKS_ALL);
+	psc_assert(slvr_blks_prep(0, 1, SL_READ, 1, &need) ==
+	    SLVR_BLKS_FILL && need == (SLVR_BLKS_ALL & ~1U));
+	psc_assert(slvr_blks_prep(10, 20, SL_WRITE, 0, &need) ==
+	    SLVR_BLKS_FILL && need == 1);
+	psc_assert(slvr_blks_done(10, 20, SL_WRITE, 1) == 1);
+	psc_assert(slvr_blks_done(SLASH_SLVR_BLKSZ, 1, SL_WRITE, 0) ==
+	    2);
+	psc_assert(slvr_blks_done(0, 1, SL_READ, 1) == SLVR_BLKS_ALL);
+
+	fd = mkstemp(fn);
+	if (fd == -1)
+		psc_fatal("mkstemp");
+	unlink(fn);
+
+	model = PSCALLOC(NSLVRS * SLASH_SLVR_SIZE);
+	for (i = 0; i < FILESIZE; i++)
+		model[i] = random();
+	rc = pwrite(fd, model, FILESIZE, 0);
+	psc_assert(rc == FILESIZE);
+
+	for (n = 0; n < NSLVRS; n++) {
+		slvrs[n].buf = PSCALLOC(SLASH_SLVR_SIZE);
+		psc_crc64_calc(&slvrs[n].crc, model + n *
+		    SLASH_SLVR_SIZE, SLASH_SLVR_SIZE);
+	}
+
+	/*
+	 * A read soon after a partial write only fills in the blocks
+	 * the write did not bring in, and leaves the CRC alone.
+	 */
+	need = slvr_write(0, 100, 3 * SLASH_SLVR_BLKSZ);
+	psc_assert(need == SLVR_BLKS(0, 0) + SLVR_BLKS(3, 3));
+	psc_assert(slvrs[0].valid == SLVR_BLKS(0, 3));
+	need = slvr_read(0);
+	psc_assert(need == (SLVR_BLKS_ALL & ~SLVR_BLKS(0, 3)));
+	psc_assert(slvrs[0].flags & CRCDIRTY);
+	psc_assert(slvr_crc_update(0) == 0);
+	psc_assert(slvr_read(0) == 0);
+
+	/* a partial write, then the CRC fill, then a read */
+	slvr_reap(1);
+	slvr_write(1, SLASH_SLVR_SIZE - 10, 10);
+	need = slvr_crc_update(1);
+	psc_assert(need == (SLVR_BLKS_ALL &
+	    ~SLVR_BLKS(SLASH_BLKS_PER_SLVR - 1, SLASH_BLKS_PER_SLVR - 1)));
+	psc_assert(slvr_read(1) == 0);
+
+	/* a cold read goes through the full read */
+	slvr_reap(1);
+	psc_assert(slvr_read(1) == SLVR_BLKS_ALL);
+	psc_assert(nfullreads == 1);
+
+	for (n = 0; n < NSLVRS; n++) {
+		if (slvrs[n].flags & CRCDIRTY)
+			slvr_crc_update(n);
+		slvr_reap(n);
+	}
+	nread = 0;
+	nfullreads = 0;
+
+	/*
+	 * Small misaligned writes, some straddling block boundaries,
+	 * with reads, CRC updates and reaps mixed in.
+	 */
+	for (i = 0; i < nwrites; i++) {
+		n = random() % NSLVRS;
+		len = 1 + random() % (2 * SLASH_SLVR_BLKSZ);
+		off = random() % (SLASH_SLVR_SIZE - len + 1);
+		slvr_write(n, off, len);
+
+		switch (random() % 64) {
+		case 0:
+			slvr_read(n);
+			break;
+		case 1:
+			slvr_crc_update(n);
+			break;
+		case 2:
+			slvr_crc_update(n);
+			slvr_reap(n);
+			break;
+		}
+	}
+
+	/* edge-only faulting reads far less than whole slivers */
+	psc_assert(nread < nwrites * SLASH_SLVR_SIZE / 8);
+	psc_assert(nfullreads == 0);
+
+	for (n = 0; n < NSLVRS; n++) {
+		slvr_read(n);
+		if (slvrs[n].flags & CRCDIRTY)
+			slvr_crc_update(n);
+	}
+
+	/* the on-disk data must match every write made */
+	fbuf = PSCALLOC(NSLVRS * SLASH_SLVR_SIZE);
+	rc = pread(fd, fbuf, NSLVRS * SLASH_SLVR_SIZE, 0);
+	psc_assert(rc >= FILESIZE);
+	psc_assert(memcmp(fbuf, model, rc) == 0);
+	PSCFREE(fbuf);
+
+	close(fd);
+	exit(0);
+}
@@ -0,0 +1,321 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2006-2013, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Trace-driven simulator for the sliod sliver cache replacement
+ * policies.  Synthetic traces mix a hot set of slivers read at random,
+ * as small-file readers do, with long sequential streams in which each
+ * sliver is read by several consecutive RPCs, as a large read or a
+ * replication does.  Each trace is replayed against 2Q and plain LRU.
+ * A trace file of "fid bmapno slvrno" lines may be replayed instead.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/dynarray.h"
+#include "pfl/hashtbl.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/pfl.h"
+
+#include "slvr_2q.h"
+
+#define CACHESIZE	1024		/* slivers */
+#define NHOT		(CACHESIZE / 2)
+#define NACCESS		(64 * CACHESIZE)
+#define NSTREAMRPC	4		/* RPCs per streamed sliver */
+
+struct simobj {
+	struct slvr_2q_ent	 ent;
+	struct pfl_hashentry	 hentry;
+	uint64_t		 hkey;
+};
+
+struct sim {
+	struct slvr_2q		 q;
+	struct psc_hashtbl	 resident;
+	int			 nresident;
+	int			 size;
+	int64_t			 hits;
+	int64_t			 hothits;
+	int64_t			 hotrefs;
+};
+
+const char		*progname;
+struct psc_dynarray	 trace = DYNARRAY_INIT;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-c cachesize] [-s seed] [-t trace]\n",
+	    progname);
+	exit(1);
+}
+
+uint64_t
+hashkey(const struct slvr_2q_key *k)
+{
+	return (k->sqk_fid * UINT64_C(0x9e3779b97f4a7c15) ^
+	    ((uint64_t)k->sqk_bno << 20 | k->sqk_slvrno));
+}
+
+int
+simobj_cmp(const void *a, const void *b)
+{
+	const struct simobj *o = b;
+
+	return (memcmp(a, &o->ent.sqe_key, sizeof(struct slvr_2q_key)) ==
+	    0);
+}
+
+int
+sim_claim(struct slvr_2q_ent *e, void *arg)
+{
+	struct slvr_2q_ent **ep = arg;
+
+	*ep = e;
+	return (1);
+}
+
+void
+sim_init(struct sim *s, int policy, int size, const char *name)
+{
+	memset(s, 0, sizeof(*s));
+	s->size = size;
+	slvr_2q_init(&s->q, policy, size, name);
+	psc_hashtbl_init(&s->resident, 0, struct simobj, hkey, hentry,
+	    1023, simobj_cmp, "%s-resident", name);
+}
+
+void
+sim_access(struct sim *s, const struct slvr_2q_key *k, int hot)
+{
+	struct slvr_2q_ent *e;
+	struct simobj *o;
+	uint64_t hkey;
+
+	hkey = hashkey(k);
+	o = psc_hashtbl_search_cmp(&s->resident, k, &hkey);
+	if (o) {
+		slvr_2q_access(&s->q, &o->ent);
+		s->hits++;
+		s->hothits += hot;
+		s->hotrefs += hot;
+		return;
+	}
+	s->hotrefs += hot;
+
+	if (s->nresident == s->size) {
+		psc_assert(slvr_2q_reclaim(&s->q, 1, sim_claim, &e) == 1);
+		o = (void *)((char *)e - offsetof(struct simobj, ent));
+		psc_hashent_remove(&s->resident, o);
+		PSCFREE(o);
+		s->nresident--;
+	}
+
+	o = PSCALLOC(sizeof(*o));
+	psc_hashent_init(&s->resident, o);
+	o->ent.sqe_key = *k;
+	o->hkey = hkey;
+	slvr_2q_insert(&s->q, &o->ent);
+	psc_hashtbl_add_item(&s->resident, o);
+	s->nresident++;
+}
+
+/*
+ * Build a trace in which a fraction @hotpct of the references go to
+ * a hot set of @nhot slivers chosen at random and the rest walk
+ * sequential streams of @streamlen slivers each.  Hot references are
+ * tagged by a set low bit in the trace entry.
+ */
+void
+trace_build(int naccess, int nhot, int hotpct, int streamlen)
+{
+	uintptr_t id, next = 0;
+	int i, rpc = 0;
+
+	psc_dynarray_reset(&trace);
+	for (i = 0; i < naccess; i++) {
+		if ((int)(random() % 100) < hotpct)
+			id = (random() % nhot) << 1 | 1;
+		else {
+			id = (nhot + next) << 1;
+			if (++rpc == NSTREAMRPC) {
+				rpc = 0;
+				if (++next % streamlen == 0)
+					/* start a new file */
+					next += 1024;
+			}
+		}
+		psc_dynarray_add(&trace, (void *)id);
+	}
+}
+
+void
+trace_key(uintptr_t id, struct slvr_2q_key *k)
+{
+	id >>= 1;
+	k->sqk_fid = 1 + id / 1024;
+	k->sqk_bno = id / 16 % 64;
+	k->sqk_slvrno = id % 16;
+}
+
+void
+trace_load(const char *fn)
+{
+	struct slvr_2q_key *k;
+	char buf[BUFSIZ];
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (fp == NULL)
+		psc_fatal("%s", fn);
+	while (fgets(buf, sizeof(buf), fp)) {
+		k = PSCALLOC(sizeof(*k));
+		if (sscanf(buf, "%"SCNx64" %u %u", &k->sqk_fid,
+		    &k->sqk_bno, &k->sqk_slvrno) != 3)
+			psc_fatalx("%s: malformed line: %s", fn, buf);
+		psc_dynarray_add(&trace, k);
+	}
+	fclose(fp);
+}
+
+/*
+ * Replay the trace against one policy.  Returns the hit ratio of the
+ * hot set, or of all references for a trace file.
+ */
+double
+replay(int policy, int size, int loaded, const char *name)
+{
+	struct slvr_2q_key k;
+	struct sim s;
+	void *p;
+	int i;
+
+	sim_init(&s, policy, size, name);
+	DYNARRAY_FOREACH(p, i, &trace) {
+		if (loaded) {
+			sim_access(&s, p, 1);
+			continue;
+		}
+		trace_key((uintptr_t)p, &k);
+		sim_access(&s, &k, (uintptr_t)p & 1);
+	}
+	psc_assert(s.nresident <= size);
+	psc_assert(s.q.sq_na1in + s.q.sq_nam == s.nresident);
+	psc_assert(s.q.sq_na1out <= s.q.sq_kout);
+	psc_assert(psc_atomic64_read(&s.q.sq_opst_hits->opst_lifetime) ==
+	    s.hits);
+	psc_assert(psc_atomic64_read(&s.q.sq_opst_hits->opst_lifetime) +
+	    psc_atomic64_read(&s.q.sq_opst_misses->opst_lifetime) ==
+	    psc_dynarray_len(&trace));
+
+	printf("  %-4s hit %5.1f%%, ghost hits %"PRId64"\n",
+	    policy == SLVR_2QP_2Q ? "2q" : "lru",
+	    100. * s.hothits / s.hotrefs,
+	    psc_atomic64_read(&s.q.sq_opst_ghosthits->opst_lifetime));
+	return ((double)s.hothits / s.hotrefs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *tracefn = NULL;
+	struct slvr_2q_key k;
+	struct sim s;
+	int c, i, size = CACHESIZE;
+	double r2q, rlru;
+	char name[32];
+
+	progname = argv[0];
+	pfl_init();
+	srandom(1);
+	while ((c = getopt(argc, argv, "c:s:t:")) != -1)
+		switch (c) {
+		case 'c':
+			size = atoi(optarg);
+			break;
+		case 's':
+			srandom(atoi(optarg));
+			break;
+		case 't':
+			tracefn = optarg;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || size < 8)
+		usage();
+
+	if (tracefn) {
+		trace_load(tracefn);
+		printf("%s: %d references\n", tracefn,
+		    psc_dynarray_len(&trace));
+		replay(SLVR_2QP_2Q, size, 1, "trace-2q");
+		replay(SLVR_2QP_LRU, size, 1, "trace-lru");
+		exit(0);
+	}
+
+	/* a key evicted from A1in comes back onto Am */
+	sim_init(&s, SLVR_2QP_2Q, 8, "ghost");
+	memset(&k, 0, sizeof(k));
+	for (i = 0; i < 8 + s.q.sq_kin; i++) {
+		k.sqk_slvrno = i;
+		sim_access(&s, &k, 0);
+	}
+	psc_assert(s.q.sq_na1out == s.q.sq_kin);
+	k.sqk_slvrno = 0;
+	sim_access(&s, &k, 0);
+	psc_assert(psc_atomic64_read(
+	    &s.q.sq_opst_ghosthits->opst_lifetime) == 1);
+	psc_assert(s.q.sq_nam == 1);
+
+	/* hot set only: both policies keep it */
+	printf("hot set of %d slivers, cache of %d\n", NHOT * size /
+	    CACHESIZE, size);
+	trace_build(NACCESS, NHOT * size / CACHESIZE, 100, 1);
+	r2q = replay(SLVR_2QP_2Q, size, 0, "hot-2q");
+	rlru = replay(SLVR_2QP_LRU, size, 0, "hot-lru");
+	psc_assert(r2q > .95 && rlru > .95);
+
+	/* hot set mixed with streaming reads */
+	for (i = 10; i <= 30; i += 10) {
+		printf("%d%% hot references, %d%% streaming\n", i,
+		    100 - i);
+		trace_build(NACCESS, NHOT * size / CACHESIZE, i,
+		    4 * size);
+		snprintf(name, sizeof(name), "mix%d-2q", i);
+		r2q = replay(SLVR_2QP_2Q, size, 0, name);
+		snprintf(name, sizeof(name), "mix%d-lru", i);
+		rlru = replay(SLVR_2QP_LRU, size, 0, name);
+		psc_assert(r2q > rlru);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,277 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015, Google, Inc.
+ * Copyright (c) 2015, Pittsburgh Supercomputing Center (PSC).
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Exercise the MDS update scheduler index: fair-share page-in across
+ * users and groups, status changes, wildcard removal, and rebuilding
+ * the index from its on-disk log, including one with a torn tail.
+ */
+
+#include <sys/param.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/dynarray.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+#include "mkfn.h"
+#include "pathnames.h"
+#include "slashd.h"
+#include "slconfig.h"
+#include "subsys_mds.h"
+#include "up_sched_res.h"
+
+#define NRES		2
+#define NBULK		64		/* items queued by the busy user */
+
+#define FID_BULK	100		/* uid 1, gid 1 */
+#define FID_USER	200		/* uid 2, gid 1 */
+#define FID_GROUP	300		/* uid 3, gid 2 */
+#define FID_PRIO	400		/* uid 1, gid 1, high sys prio */
+
+struct test_res {
+	struct sl_resource	 r;
+	struct resprof_mds_info	 rpmi;
+	struct rpmi_ios		 si;
+};
+
+void	upsch_log_flush(void);
+
+extern int		 slm_upsch_idx_nents;
+extern int		 slm_upsch_log_replaying;
+
+struct sl_config	 globalConfig;
+const char		*sl_datadir;
+
+const char		*progname;
+struct test_res		 resources[NRES];
+struct sl_site		 site;
+int			 nreverted;
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s\n", progname);
+	exit(1);
+}
+
+struct sl_resource *
+libsl_id2res(sl_ios_id_t id)
+{
+	int i;
+
+	for (i = 0; i < NRES; i++)
+		if (resources[i].r.res_id == id)
+			return (&resources[i].r);
+	return (NULL);
+}
+
+int
+revert_cb(__unusedx slfid_t fid, __unusedx sl_bmapno_t bno)
+{
+	nreverted++;
+	return (0);
+}
+
+/*
+ * Page in everything queued for a resource and check whether @fid
+ * is among the first @n items.
+ */
+int
+pagein_has(struct sl_resource *r, int n, slfid_t fid)
+{
+	struct slm_upsch_item v[NBULK + 8];
+	int i;
+
+	n = slm_upsch_idx_pagein(r, v, n);
+	for (i = 0; i < n; i++)
+		if (v[i].usi_fid == fid)
+			return (1);
+	return (0);
+}
+
+int
+nfids(void)
+{
+	struct psc_dynarray da = DYNARRAY_INIT;
+	int n;
+
+	slm_upsch_idx_getfids(&da);
+	n = psc_dynarray_len(&da);
+	psc_dynarray_free(&da);
+	return (n);
+}
+
+/*
+ * Drop every item from memory without logging it, as if the MDS had
+ * restarted, then rebuild the index from the log.
+ */
+void
+reload(void)
+{
+	struct psc_dynarray da = DYNARRAY_INIT;
+	void *p;
+	int i;
+
+	upsch_log_flush();
+	slm_upsch_idx_getfids(&da);
+	slm_upsch_log_replaying = 1;
+	DYNARRAY_FOREACH(p, i, &da)
+		slm_upsch_idx_remove(IOS_ID_ANY, (slfid_t)p, BMAPNO_ANY);
+	slm_upsch_log_replaying = 0;
+	psc_dynarray_free(&da);
+	psc_assert(slm_upsch_idx_nents == 0);
+
+	slm_upsch_idx_load();
+}
+
+int
+main(int argc, char *argv[])
+{
+	char dir[PATH_MAX], fn[PATH_MAX];
+	struct slm_upsch_item v[2];
+	struct sl_resource *r;
+	int c, fd, i;
+
+	progname = argv[0];
+	pfl_init();
+	sl_subsys_register();
+	psc_subsys_register(SLMSS_ZFS, "zfs");
+	psc_subsys_register(SLMSS_JOURNAL, "log");
+	psc_subsys_register(SLMSS_UPSCH, "upsch");
+	while ((c = getopt(argc, argv, "")) != -1)
+		switch (c) {
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc)
+		usage();
+
+	snprintf(dir, sizeof(dir), "%s/upschidx.XXXXXX",
+	    getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+	if (mkdtemp(dir) == NULL)
+		psc_fatal("mkdtemp %s", dir);
+	sl_datadir = dir;
+
+	INIT_GCONF(&globalConfig);
+	psc_dynarray_init(&site.site_resources);
+	INIT_PSC_LISTENTRY(&site.site_lentry);
+	for (i = 0; i < NRES; i++) {
+		r = &resources[i].r;
+		r->res_id = i + 1;
+		r->res_type = SLREST_STANDALONE_FS;
+		r->res_site = &site;
+		resources[i].rpmi.rpmi_info = &resources[i].si;
+		psc_assert(res2iosinfo(r) == &resources[i].si);
+		psc_dynarray_add(&site.site_resources, r);
+	}
+	pll_add(&globalConfig.gconf_sites, &site);
+
+	slm_upsch_idx_init();
+	slm_upsch_idx_load();
+	psc_assert(slm_upsch_idx_nents == 0);
+
+	r = &resources[0].r;
+	for (i = 0; i < NBULK; i++)
+		psc_assert(slm_upsch_idx_add(r->res_id, FID_BULK, i, 1, 1,
+		    0, 0, 0) == 0);
+	psc_assert(slm_upsch_idx_add(r->res_id, FID_BULK, 0, 1, 1, 0,
+	    0, 0) == EEXIST);
+	psc_assert(slm_upsch_idx_add(99, FID_BULK, 0, 1, 1, 0, 0, 0) ==
+	    ENOENT);
+	psc_assert(slm_upsch_idx_add(r->res_id, FID_USER, 0, 2, 1, 0, 0,
+	    0) == 0);
+	psc_assert(slm_upsch_idx_add(r->res_id, FID_GROUP, 0, 3, 2, 0, 0,
+	    0) == 0);
+	psc_assert(slm_upsch_idx_add(resources[1].r.res_id, FID_BULK, 0,
+	    1, 1, 0, 0, 0) == 0);
+
+	/* the lone users and groups are not starved by the busy one */
+	psc_assert(pagein_has(r, 4, FID_USER));
+	psc_assert(pagein_has(r, 4, FID_GROUP));
+
+	/* system priority trumps fair share */
+	psc_assert(slm_upsch_idx_add(r->res_id, FID_PRIO, 0, 1, 1, 10, 0,
+	    0) == 0);
+	psc_assert(slm_upsch_idx_pagein(r, v, 1) == 1);
+	psc_assert(v[0].usi_fid == FID_PRIO);
+
+	/* scheduled items are not paged in until reverted */
+	slm_upsch_idx_update(r->res_id, FID_PRIO, 0, UPSCH_ST_SCHED, -1,
+	    -1);
+	psc_assert(!pagein_has(r, NBULK + 8, FID_PRIO));
+	slm_upsch_idx_revert(revert_cb);
+	psc_assert(nreverted == 1);
+	psc_assert(pagein_has(r, 1, FID_PRIO));
+
+	slm_upsch_idx_setnonce(FID_USER, 0, 7);
+	psc_assert(slm_upsch_idx_getbmap(FID_USER, 0, v, 2) == 1);
+	psc_assert(v[0].usi_nonce == 7);
+
+	/* wildcard removal */
+	psc_assert(slm_upsch_idx_getbmap(FID_BULK, 0, v, 2) == 2);
+	slm_upsch_idx_remove(r->res_id, FID_BULK, BMAPNO_ANY);
+	psc_assert(slm_upsch_idx_getbmap(FID_BULK, 0, v, 2) == 1);
+	psc_assert(v[0].usi_resid == resources[1].r.res_id);
+	psc_assert(slm_upsch_idx_nents == 4);
+	psc_assert(nfids() == 4);
+
+	/* everything survives a restart */
+	slm_upsch_idx_update(r->res_id, FID_PRIO, 0, UPSCH_ST_SCHED, -1,
+	    -1);
+	reload();
+	psc_assert(slm_upsch_idx_nents == 4);
+	psc_assert(slm_upsch_idx_getbmap(FID_USER, 0, v, 2) == 1);
+	psc_assert(v[0].usi_nonce == 7);
+	psc_assert(!pagein_has(r, NBULK + 8, FID_PRIO));
+	nreverted = 0;
+	slm_upsch_idx_revert(revert_cb);
+	psc_assert(nreverted == 1);
+
+	/* a torn record at the end of the log is dropped */
+	slm_upsch_idx_remove(IOS_ID_ANY, FID_GROUP, BMAPNO_ANY);
+	upsch_log_flush();
+	xmkfn(fn, "%s/%s", sl_datadir, SL_FN_UPSCHLOG);
+	fd = open(fn, O_WRONLY | O_APPEND);
+	if (fd == -1)
+		psc_fatal("open %s", fn);
+	if (write(fd, "torn", 4) != 4)
+		psc_fatal("write %s", fn);
+	close(fd);
+	reload();
+	psc_assert(slm_upsch_idx_nents == 3);
+	psc_assert(slm_upsch_idx_getbmap(FID_GROUP, 0, v, 2) == 0);
+	psc_assert(pagein_has(r, 1, FID_PRIO));
+
+	unlink(fn);
+	rmdir(dir);
+	exit(0);
+}
@@ -252,21 +252,19 @@ main(int argc, char *argv[])
 	PRTYPE(struct slm_nsstats);
 	PRTYPE(struct slm_progress);
 	PRTYPE(struct slm_replst_workreq);
-	PRTYPE(struct slm_sth);
 	PRTYPE(struct slm_update_data);
 	PRTYPE(struct slm_update_generic);
+	PRTYPE(struct slm_upsch_item);
+	PRTYPE(struct slm_upsch_shard);
 	PRTYPE(struct slm_wkdata_batchrq_cb);
 	PRTYPE(struct slm_wkdata_ptrunc);
 	PRTYPE(struct slm_wkdata_rmdir_ino);
 	PRTYPE(struct slm_wkdata_upsch_cb);
 	PRTYPE(struct slm_wkdata_upsch_purge);
-	PRTYPE(struct slm_wkdata_upschq);
 	PRTYPE(struct slm_wkdata_wr_brepl);
-	PRTYPE(struct slmctl_thread);
 	PRTYPE(struct slmctlmsg_bml);
 	PRTYPE(struct slmctlmsg_replqueued);
 	PRTYPE(struct slmctlmsg_statfs);
-	PRTYPE(struct slmctlmsg_upsch_query);
 	PRTYPE(struct slmdbwk_thread);
 	PRTYPE(struct slmds_jent_assign_rep);
 	PRTYPE(struct slmds_jent_bmap_assign);
@@ -279,7 +277,6 @@ main(int argc, char *argv[])
 	PRTYPE(struct slmrmc_thread);
 	PRTYPE(struct slmrmi_thread);
 	PRTYPE(struct slmrmm_thread);
-	PRTYPE(struct slmthr_dbh);
 	PRTYPE(struct slmupsch_thread);
 	PRTYPE(struct slrpc_cservice);
 	PRTYPE(struct slrpc_ops);
@@ -295,6 +292,7 @@ main(int argc, char *argv[])
 	PRTYPE(struct srm_bmap_release_rep);
 	PRTYPE(struct srm_bmap_release_req);
 	PRTYPE(struct srm_bmap_wake_req);
+	PRTYPE(struct srm_connect_bulkauth_rep);
 	PRTYPE(struct srm_connect_rep);
 	PRTYPE(struct srm_connect_req);
 	PRTYPE(struct srm_create_rep);
@@ -832,6 +830,7 @@ main(int argc, char *argv[])
 	PRVAL(SLITHRT_RIM);
 	PRVAL(SLITHRT_SLVR_CRC);
 	PRVAL(SLITHRT_STATFS);
+	PRVAL(SLITHRT_URING);
 	PRVAL(SLITHRT_USKLNDPL);
 	PRVAL(SLITHRT_WORKER);
 	PRVAL(SLI_FAULT_AIO_FAIL);
@@ -840,7 +839,6 @@ main(int argc, char *argv[])
 	PRVAL(SLI_REPLWKOP_PTRUNC);
 	PRVAL(SLI_REPLWKOP_REPL);
 	PRVAL(SLMTHRT_BATCHRQ);
-	PRVAL(SLMTHRT_BKDB);
 	PRVAL(SLMTHRT_BMAPTIMEO);
 	PRVAL(SLMTHRT_CONN);
 	PRVAL(SLMTHRT_CTL);
@@ -859,6 +857,7 @@ main(int argc, char *argv[])
 	PRVAL(SLMTHRT_RMI);
 	PRVAL(SLMTHRT_RMM);
 	PRVAL(SLMTHRT_UPSCHED);
+	PRVAL(SLMTHRT_UPSCHLOG);
 	PRVAL(SLMTHRT_USKLNDPL);
 	PRVAL(SLMTHRT_WORKER);
 	PRVAL(SLMTHRT_ZFS_KSTAT);